@@ -15,6 +15,9 @@
 /* Define to 1 if you have the `nana' library (-lnana). */
 #cmakedefine HAVE_LIBNANA 1
 
+/* Define to 1 if you have the <linux/io_uring.h> header file. */
+#cmakedefine HAVE_LINUX_IO_URING_H 1
+
 /* Define to 1 if you have the <memory.h> header file. */
 #cmakedefine HAVE_MEMORY_H 1
 
@@ -27,6 +30,12 @@
 /* Define to 1 if you have the <openssl/sha.h> header file. */
 #cmakedefine HAVE_OPENSSL_SHA_H 1
 
+/* Define to 1 if you have the `ppoll' function. */
+#cmakedefine HAVE_PPOLL 1
+
+/* Define to 1 if you have the `sched_setaffinity' function. */
+#cmakedefine HAVE_SCHED_SETAFFINITY 1
+
 /* Define to 1 if you have the <stdint.h> header file. */
 #cmakedefine HAVE_STDINT_H 1
 
@@ -39,6 +48,9 @@
 /* Define to 1 if you have the <string.h> header file. */
 #cmakedefine HAVE_STRING_H 1
 
+/* Define to 1 if you have the <sys/epoll.h> header file. */
+#cmakedefine HAVE_SYS_EPOLL_H 1
+
 /* Define to 1 if you have the <sys/stat.h> header file. */
 #cmakedefine HAVE_SYS_STAT_H 1
 
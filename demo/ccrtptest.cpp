@@ -15,6 +15,7 @@
 // along with this program; if not, write to the Free Software
 // Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 #include <cstdlib>
+#include <vector>
 #include <ccrtp/rtp.h>
 
 #ifdef  CCXX_NAMESPACES
@@ -209,6 +210,683 @@ class MiscTest : public Test, public Thread, public TimerPort
     }
 };
 
+/**
+ * Data channel that loses and reorders the data packets of a payload
+ * type, following a pattern repeated every few packets, to test
+ * the recovery of lost packets over the loopback interface.
+ **/
+template<class BaseChannel>
+class ImpairedChannel : public BaseChannel
+{
+public:
+    ImpairedChannel(const InetAddress& ia, tpport_t port) :
+        BaseChannel(ia,port), payloadType(0), period(1), lossMask(0),
+        delayMask(0), count(0), held()
+    { }
+
+    /**
+     * @param pt payload type of the packets impaired.
+     * @param p number of packets in the pattern, up to 32.
+     * @param loss positions in the pattern of the packets lost.
+     * @param delay positions of the packets sent after the next one.
+     **/
+    void setPattern(PayloadType pt, uint32 p, uint32 loss, uint32 delay)
+    {
+        payloadType = pt;
+        period = p;
+        lossMask = loss;
+        delayMask = delay;
+        count = 0;
+    }
+
+    size_t send(const unsigned char* const buffer, size_t len)
+    {
+        if ( len < 2 || (buffer[1] & 0x7f) != payloadType )
+            return BaseChannel::send(buffer,len);
+        uint32 position = count++ % period;
+        if ( (lossMask >> position) & 1 )
+            return len;
+        if ( (delayMask >> position) & 1 ) {
+            held.assign(buffer,buffer + len);
+            return len;
+        }
+        size_t sent = BaseChannel::send(buffer,len);
+        if ( !held.empty() ) {
+            BaseChannel::send(&held[0],held.size());
+            held.clear();
+        }
+        return sent;
+    }
+
+private:
+    PayloadType payloadType;
+    uint32 period;
+    uint32 lossMask;
+    uint32 delayMask;
+    uint32 count;
+    std::vector<unsigned char> held;
+};
+
+typedef SingleThreadRTPSession<ImpairedChannel<DualRTPUDPIPv4Channel>,
+                   DualRTPUDPIPv4Channel> ImpairedRTPSession;
+
+/**
+ * Test of a sender and a receiver over the loopback interface,
+ * run in a thread of its own. The receiver is bound to getPort()
+ * and the sender to getPort() + 10, every test having its own
+ * ports.
+ **/
+class LoopbackTest : public Test, public Thread
+{
+public:
+    LoopbackTest(const char* n, const char* o) :
+        name(n), option(o), result(0), port(nextPort)
+    { nextPort += 4; }
+
+    void run()
+    {
+        result = doTest();
+    }
+
+    const char* getName() const
+        { return name; }
+
+    const char* getOption() const
+        { return option; }
+
+    int getResult() const
+        { return result; }
+
+protected:
+    static const uint32 packetsNumber = 96;
+    static const InetHostAddress localhost;
+
+    tpport_t getPort() const
+        { return port; }
+
+    /**
+     * Start a receiver once the test has set it up.
+     **/
+    template<class Session>
+    static void startReceiver(Session& rx, const PayloadFormat& pf)
+    {
+        rx.setPayloadFormat(pf);
+        rx.setExpireTimeout(10000000);
+        rx.startRunning();
+    }
+
+    /**
+     * Start a sender once the test has set it up, sending to the
+     * receiver.
+     *
+     * @return whether the receiver could be added as destination.
+     **/
+    template<class Session>
+    bool startSender(Session& tx, const PayloadFormat& pf)
+    {
+        tx.setPayloadFormat(pf);
+        tx.setSchedulingTimeout(10000);
+        if ( !tx.addDestination(localhost,port) )
+            return false;
+        tx.startRunning();
+        return true;
+    }
+
+    /**
+     * Put packets at a fixed rate, then wait for them to arrive.
+     *
+     * @param rate packets per second.
+     * @param wait time to wait after the last one, in milliseconds.
+     **/
+    template<class Session>
+    static void sendPackets(Session& tx, uint32 count, size_t size,
+                uint32 rate = 50, timeout_t wait = 500)
+    {
+        uint16 inc = tx.getCurrentRTPClockRate()/rate;
+        for ( uint32 i = 0; i < count; i++ ) {
+            tx.putData(i*inc, pattern.getPacketData(i),size);
+            Thread::sleep(1000/rate);
+        }
+        Thread::sleep(wait);
+    }
+
+    /**
+     * Take the data packets queued in a session.
+     *
+     * @return number of packets taken.
+     **/
+    template<class Session>
+    static uint32 drain(Session& rx)
+    {
+        uint32 n = 0;
+        const AppDataUnit* adu;
+        while ( (adu = rx.getData(rx.getFirstTimestamp())) ) {
+            n++;
+            delete adu;
+        }
+        return n;
+    }
+
+    int check(bool passed, const char* what)
+    {
+        if ( !passed )
+            cerr << name << ": " << what << endl;
+        return passed ? 0 : 1;
+    }
+
+private:
+    const char* name;
+    const char* option;
+    int result;
+    tpport_t port;
+    static tpport_t nextPort;
+};
+
+const InetHostAddress LoopbackTest::localhost =
+    InetHostAddress("localhost");
+
+tpport_t LoopbackTest::nextPort = 34570;
+
+class FECRecoveryTest : public LoopbackTest
+{
+public:
+    FECRecoveryTest() :
+        LoopbackTest("FEC recovery","--fec")
+    { }
+
+    int doTest()
+    {
+        const PayloadType fecType = 100;
+        RTPSession rx(localhost,getPort());
+        ImpairedRTPSession tx(localhost,getPort() + 10);
+
+        // blocks of 4 packets with one FEC packet each, and one
+        // packet lost in every block.
+        FECEncoder encoder;
+        encoder.setBlockSize(4);
+        encoder.addMask(0x0f);
+        FECDecoder decoder;
+        tx.getDSO()->setPattern(sptPCMU,8,0x24,0);
+
+        rx.setFECDecoder(&decoder,fecType);
+        startReceiver(rx,StaticPayloadFormat(sptPCMU));
+        if ( !tx.setFECEncoder(&encoder,tx.getLocalSSRC() + 1,fecType) ||
+             !startSender(tx,StaticPayloadFormat(sptPCMU)) )
+            return 1;
+        sendPackets(tx,packetsNumber,pattern.getPacketSize(0));
+
+        int failed = check(packetsNumber == drain(rx),
+                   "packets missing");
+        failed |= check(packetsNumber / 4 == decoder.getRecoveredCount(),
+                "packets not recovered");
+        return failed;
+    }
+};
+
+class REDRecoveryTest : public LoopbackTest
+{
+public:
+    REDRecoveryTest() :
+        LoopbackTest("RED recovery","--red")
+    { }
+
+    int doTest()
+    {
+        return testEncoder() | testDistance();
+    }
+
+private:
+    static const PayloadType redType = 101;
+
+    int testEncoder()
+    {
+        RTPSession rx(localhost,getPort());
+        ImpairedRTPSession tx(localhost,getPort() + 10);
+
+        // every packet carries the previous frame, and no two
+        // consecutive packets are lost.
+        REDEncoder encoder(1);
+        REDDecoder decoder;
+        tx.getDSO()->setPattern(redType,8,0x24,0);
+
+        rx.setREDDecoder(&decoder,redType);
+        startReceiver(rx,StaticPayloadFormat(sptPCMU));
+        tx.setREDEncoder(&encoder,redType);
+        if ( !startSender(tx,StaticPayloadFormat(sptPCMU)) )
+            return 1;
+        sendPackets(tx,packetsNumber,pattern.getPacketSize(0));
+
+        int failed = check(packetsNumber == drain(rx),
+                   "packets missing");
+        failed |= check(packetsNumber / 4 == decoder.getRecoveredCount(),
+                "packets not recovered");
+        return failed;
+    }
+
+    /**
+     * Packets carry the frame put two frames before, not the
+     * previous one, as some senders do. Every 8 packets the third
+     * one is lost, and the sixth one is sent after the seventh,
+     * whose redundant block is then the frame before the sixth.
+     **/
+    int testDistance()
+    {
+        const size_t size = 100;
+        const uint32 offset = 2 * 160;
+        RTPSession rx(localhost,getPort());
+        ImpairedRTPSession tx(localhost,getPort() + 10);
+        REDDecoder decoder;
+        tx.getDSO()->setPattern(redType,8,0x04,0x20);
+
+        rx.setREDDecoder(&decoder,redType);
+        startReceiver(rx,StaticPayloadFormat(sptPCMU));
+        if ( !startSender(tx,DynamicPayloadFormat(redType,8000)) )
+            return 1;
+
+        // the payloads are built here: a block header, the primary
+        // header and the data of both frames, every frame filled
+        // with its number plus one.
+        unsigned char payload[4 + 1 + 2 * size];
+        for ( uint32 i = 0; i < packetsNumber; i++ ) {
+            unsigned char* p = payload;
+            if ( i >= 2 ) {
+                *p++ = 0x80 | sptPCMU;
+                *p++ = static_cast<unsigned char>(offset >> 6);
+                *p++ = static_cast<unsigned char>((offset & 0x3f) << 2);
+                *p++ = static_cast<unsigned char>(size);
+            }
+            *p++ = sptPCMU;
+            if ( i >= 2 ) {
+                memset(p,i - 1,size);
+                p += size;
+            }
+            memset(p,i + 1,size);
+            p += size;
+            tx.putData(i*160,payload,p - payload);
+            Thread::sleep(20);
+        }
+        Thread::sleep(500);
+
+        // frames arrive once each, with their own data
+        uint32 received = 0;
+        bool intact = true;
+        const AppDataUnit* adu;
+        while ( (adu = rx.getData(rx.getFirstTimestamp())) ) {
+            received++;
+            if ( adu->getSize() != size ||
+                 adu->getData()[0] != received )
+                intact = false;
+            delete adu;
+        }
+        int failed = check(packetsNumber == received,
+                   "distance 2 packets missing");
+        failed |= check(intact,"distance 2 blocks misplaced");
+        failed |= check(packetsNumber / 8 == decoder.getRecoveredCount(),
+                "distance 2 packets not recovered");
+        return failed;
+    }
+};
+
+/**
+ * Delivery handler that checks the packets are delivered in order.
+ **/
+class OrderDeliveryHandler : public RTPDeliveryHandler
+{
+public:
+    OrderDeliveryHandler() :
+        delivered(0), ordered(true), last(0)
+    { }
+
+    bool onDelivery(const IncomingRTPPkt& packet, SyncSource&)
+    {
+        if ( delivered &&
+             static_cast<int16>(packet.getSeqNum() - last) <= 0 )
+            ordered = false;
+        last = packet.getSeqNum();
+        delivered++;
+        return true;
+    }
+
+    uint32 delivered;
+    bool ordered;
+    uint16 last;
+};
+
+class DeliveryOrderTest : public LoopbackTest
+{
+public:
+    DeliveryOrderTest() :
+        LoopbackTest("delivery order","--delivery")
+    { }
+
+    int doTest()
+    {
+        OrderDeliveryHandler handler;
+        {
+            RTPSession rx(localhost,getPort());
+            ImpairedRTPSession tx(localhost,getPort() + 10);
+
+            // every 8 packets, the second one is sent after the
+            // third one, and the sixth and seventh are lost. The
+            // last packet is held till the hold time expires, as
+            // no more packets follow.
+            tx.getDSO()->setPattern(sptPCMU,8,0x60,0x02);
+
+            rx.setDeliveryHandler(&handler);
+            rx.setDeliveryHoldTime(100000);
+            startReceiver(rx,StaticPayloadFormat(sptPCMU));
+            if ( !startSender(tx,StaticPayloadFormat(sptPCMU)) )
+                return 1;
+            sendPackets(tx,packetsNumber,pattern.getPacketSize(0));
+        }
+
+        int failed = check(packetsNumber / 4 * 3 == handler.delivered,
+                   "packets not delivered");
+        failed |= check(handler.ordered,"packets delivered out of order");
+        return failed;
+    }
+};
+
+class H264TransmissionTest : public LoopbackTest
+{
+public:
+    H264TransmissionTest() :
+        LoopbackTest("H.264 transmission","--h264")
+    { }
+
+    int doTest()
+    {
+        const PayloadType h264Type = 102;
+        const uint32 framesNumber = 10;
+        RTPSession rx(localhost,getPort());
+        RTPSession tx(localhost,getPort() + 10);
+
+        // two small NAL units, aggregated, and a large one,
+        // fragmented.
+        static const size_t sizes[] = { 20, 30, 5000 };
+        static const unsigned char headers[] = { 0x67, 0x68, 0x65 };
+        std::vector<unsigned char> frame;
+        for ( size_t i = 0; i < 3; i++ ) {
+            static const unsigned char startCode[] = { 0, 0, 0, 1 };
+            frame.insert(frame.end(),startCode,startCode + 4);
+            frame.push_back(headers[i]);
+            for ( size_t j = 1; j < sizes[i]; j++ )
+                frame.push_back(static_cast<unsigned char>(j % 200 + 2));
+        }
+
+        startReceiver(rx,DynamicPayloadFormat(h264Type,90000));
+        tx.setMaxSendSegmentSize(1200);
+        if ( !startSender(tx,DynamicPayloadFormat(h264Type,90000)) )
+            return 1;
+
+        H264Packetizer packetizer;
+        for ( uint32 i = 0; i < framesNumber; i++ ) {
+            tx.putPacketizedData(i * 3600,&frame[0],frame.size(),
+                         packetizer);
+            Thread::sleep(40);
+        }
+        Thread::sleep(500);
+
+        H264Depacketizer depacketizer;
+        uint32 received = 0;
+        bool intact = true;
+        RTPSession::SyncSourcesIterator it;
+        for ( it = rx.begin(); it != rx.end(); it++ ) {
+            if ( !it->isSender() )
+                continue;
+            while ( rx.getDepacketizedData(*it,depacketizer) ) {
+                received++;
+                if ( !depacketizer.isComplete() ||
+                     depacketizer.getSize() != frame.size() ||
+                     memcmp(depacketizer.getData(),&frame[0],
+                        frame.size()) )
+                    intact = false;
+            }
+        }
+
+        int failed = check(framesNumber == received,"frames missing");
+        failed |= check(intact,"frames not rebuilt");
+        return failed;
+    }
+};
+
+typedef SingleThreadRTPSession<DelayRTPChannel<SingleRTPChannel>,
+                   SingleRTPChannel, AVPFQueue> DelayedAVPFSession;
+
+class TransportFeedbackTest : public LoopbackTest
+{
+public:
+    TransportFeedbackTest() :
+        LoopbackTest("transport-cc feedback","--transport-cc")
+    { }
+
+    int doTest()
+    {
+        const uint32 start = 1000000;
+        AVPFSession rx(localhost,getPort());
+        DelayedAVPFSession tx(localhost,getPort() + 10);
+
+        // a stream of 800 kbps through a link of 250 kbps with a
+        // delay of 20 ms.
+        tx.getDSO()->setDelay(20000);
+        tx.getDSO()->setBottleneck(250000);
+
+        if ( !rx.setTransportCC(1) )
+            return 1;
+        startReceiver(rx,StaticPayloadFormat(sptPCMU));
+        tx.getBandwidthEstimator().setBitrates(start,30000,10000000);
+        if ( !tx.setTransportCC(1) ||
+             !startSender(tx,StaticPayloadFormat(sptPCMU)) )
+            return 1;
+        sendPackets(tx,400,1000,100);
+
+        SendSideEstimator& estimator = tx.getBandwidthEstimator();
+        int failed = check(estimator.getAckedBitrate() > 0,
+                   "no transport-cc feedback");
+        failed |= check(estimator.getTargetBitrate() < start,
+                "target bitrate not decreased");
+        return failed;
+    }
+};
+
+/**
+ * Session that keeps the last bitrate received in REMB messages.
+ **/
+class REMBSession : public DelayedAVPFSession
+{
+public:
+    REMBSession(const InetHostAddress& ia, tpport_t port) :
+        DelayedAVPFSession(ia,port), remb(0)
+    { }
+
+    uint32 getREMB() const
+        { return remb; }
+
+protected:
+    void onGotREMB(SyncSource&, uint32 bitrate)
+    {
+        remb = bitrate;
+    }
+
+private:
+    uint32 remb;
+};
+
+class REMBFeedbackTest : public LoopbackTest
+{
+public:
+    REMBFeedbackTest() :
+        LoopbackTest("REMB feedback","--remb")
+    { }
+
+    int doTest()
+    {
+        AVPFSession rx(localhost,getPort());
+        REMBSession tx(localhost,getPort() + 10);
+
+        tx.getDSO()->setDelay(20000);
+        tx.getDSO()->setBottleneck(250000);
+
+        rx.setRemoteBitrateEstimation(true);
+        startReceiver(rx,StaticPayloadFormat(sptPCMU));
+        if ( !startSender(tx,StaticPayloadFormat(sptPCMU)) )
+            return 1;
+        sendPackets(tx,400,1000,100,1000);
+
+        uint32 estimate = 0;
+        RTPSession::SyncSourcesIterator it;
+        for ( it = rx.begin(); it != rx.end(); it++ )
+            if ( it->isSender() )
+                estimate = rx.getRemoteBitrateEstimate(*it);
+
+        int failed = check(estimate > 0,"no bandwidth estimate");
+        failed |= check(tx.getREMB() > 0,"no REMB feedback");
+        return failed;
+    }
+};
+
+/**
+ * Data channel that keeps the header and the first payload octet
+ * of the data packets it sends, in the order they are sent.
+ **/
+template<class BaseChannel>
+class RecordingChannel : public BaseChannel
+{
+public:
+    struct Record
+    {
+        PayloadType payloadType;
+        uint16 seqNum;
+        uint32 timestamp;
+        unsigned char first;
+    };
+
+    RecordingChannel(const InetAddress& ia, tpport_t port) :
+        BaseChannel(ia,port), records()
+    { }
+
+    size_t send(const unsigned char* const buffer, size_t len)
+    {
+        if ( len > 12 ) {
+            Record r;
+            r.payloadType = buffer[1] & 0x7f;
+            r.seqNum = (buffer[2] << 8) | buffer[3];
+            r.timestamp = (buffer[4] << 24) | (buffer[5] << 16) |
+                (buffer[6] << 8) | buffer[7];
+            r.first = buffer[12];
+            records.push_back(r);
+        }
+        return BaseChannel::send(buffer,len);
+    }
+
+    const std::vector<Record>& getRecords() const
+        { return records; }
+
+private:
+    std::vector<Record> records;
+};
+
+typedef SingleThreadRTPSession<RecordingChannel<DualRTPUDPIPv4Channel>,
+                   DualRTPUDPIPv4Channel> RecordingRTPSession;
+
+class SendOrderTest : public LoopbackTest
+{
+public:
+    SendOrderTest() :
+        LoopbackTest("send order","--send-order")
+    { }
+
+    int doTest()
+    {
+        const PayloadType fecType = 100;
+        const uint32 framesNumber = 16;
+        // frame split in three segments, the second one patched
+        const uint32 split = 6;
+        const size_t segment = 100;
+        RTPSession rx(localhost,getPort());
+        RecordingRTPSession tx(localhost,getPort() + 10);
+
+        FECEncoder encoder;
+        encoder.setBlockSize(4);
+        encoder.addMask(0x0f);
+        FECDecoder decoder;
+        rx.setFECDecoder(&decoder,fecType);
+        startReceiver(rx,StaticPayloadFormat(sptPCMU));
+
+        tx.setPayloadFormat(StaticPayloadFormat(sptPCMU));
+        tx.setMaxSendSegmentSize(segment);
+        tx.setSendClassPriority(1,1);
+        if ( !tx.setFECEncoder(&encoder,tx.getLocalSSRC() + 1,fecType) )
+            return 1;
+
+        // every group of four frames is put out of order, 1 0 3 2,
+        // in a send class of its own, and all of them before
+        // sending starts, from 200 ms on.
+        static const uint32 order[] = { 1, 0, 3, 2 };
+        unsigned char data[3 * segment];
+        unsigned char patch[segment];
+        memset(patch,0xff,segment);
+        uint16 inc = tx.getCurrentRTPClockRate()/50;
+        for ( uint32 i = 0; i < framesNumber; i++ ) {
+            uint32 frame = i / 4 * 4 + order[i % 4];
+            size_t len = ( split == frame ) ? 3 * segment : segment;
+            memset(data,frame,len);
+            tx.setSendClass((frame / 4) % 2);
+            uint16 queued = tx.getQueueSequenceNumber();
+            tx.putData((10 + frame) * inc,data,len);
+            if ( split == frame &&
+                 segment != tx.setPartialBySeqNum(queued + 1,patch,0,
+                                  segment) )
+                return 1;
+        }
+        if ( !startSender(tx,StaticPayloadFormat(sptPCMU)) )
+            return 1;
+        Thread::sleep(20 * framesNumber + 700);
+
+        // media packets go with consecutive sequence numbers in
+        // timestamp order, and an FEC packet follows every four.
+        const std::vector<RecordingChannel<DualRTPUDPIPv4Channel>::Record>&
+            records = tx.getDSO()->getRecords();
+        uint32 media = 0, fec = 0, patched = 0;
+        bool consecutive = true, ordered = true, following = true;
+        uint16 seqNum = 0, fecSeqNum = 0;
+        uint32 timestamp = 0;
+        for ( size_t i = 0; i < records.size(); i++ ) {
+            if ( fecType == records[i].payloadType ) {
+                if ( fec && records[i].seqNum != uint16(fecSeqNum + 1) )
+                    consecutive = false;
+                fecSeqNum = records[i].seqNum;
+                fec++;
+                if ( media != 4 * fec )
+                    following = false;
+                continue;
+            }
+            if ( media ) {
+                if ( records[i].seqNum != uint16(seqNum + 1) )
+                    consecutive = false;
+                if ( static_cast<int32>(records[i].timestamp -
+                            timestamp) < 0 )
+                    ordered = false;
+            }
+            seqNum = records[i].seqNum;
+            timestamp = records[i].timestamp;
+            if ( 0xff == records[i].first )
+                patched = media;
+            media++;
+        }
+
+        int failed = check(framesNumber + 2 == media,"packets not sent");
+        failed |= check(consecutive,"sequence numbers not consecutive");
+        failed |= check(ordered,"timestamps not ordered");
+        failed |= check((framesNumber + 2) / 4 == fec && following,
+                "FEC packets not following their blocks");
+        failed |= check(split + 1 == patched,"segment not patched");
+        failed |= check(framesNumber + 2 == drain(rx),
+                "packets not received");
+        return failed;
+    }
+};
+
 // class TestPacketHeaders { }
 // header extension
 
@@ -225,8 +903,21 @@ int main(int argc, char *argv[])
     int result = 0;
     bool send = false;
     bool recv = false;
-
-    // accept as parameter if must run as --send or --recv
+    const char* only = NULL;
+
+    FECRecoveryTest fec;
+    REDRecoveryTest red;
+    DeliveryOrderTest delivery;
+    H264TransmissionTest h264;
+    TransportFeedbackTest transport;
+    REMBFeedbackTest remb;
+    SendOrderTest order;
+    LoopbackTest* tests[] = { &fec, &red, &delivery, &h264,
+                  &transport, &remb, &order };
+    const size_t testsNumber = sizeof(tests)/sizeof(tests[0]);
+
+    // accept as parameter if must run as --send or --recv, or only
+    // one of the loopback tests
     for (int i = 1; i < argc; ++i) {
         send |= !strcmp(argv[i], "-s") or !strcmp(argv[i], "--send");
         if ( send )
@@ -234,6 +925,17 @@ int main(int argc, char *argv[])
         recv |= !strcmp(argv[i], "-r") or !strcmp(argv[i], "--recv");
         if ( recv )
             break;
+        only = argv[i];
+        size_t t = 0;
+        while ( t < testsNumber && strcmp(only, tests[t]->getOption()) )
+            t++;
+        if ( t == testsNumber ) {
+            cerr << "usage: " << argv[0] << " [-s|--send|-r|--recv";
+            for ( t = 0; t < testsNumber; t++ )
+                cerr << "|" << tests[t]->getOption();
+            cerr << "]" << endl;
+            exit(2);
+        }
     }
 
     // run several tests in parallel threads
@@ -246,9 +948,21 @@ int main(int argc, char *argv[])
         rx.start();
         rx.join();
     } else {
-        MiscTest m;
-        m.start();
-        m.join();
+        if ( !only ) {
+            MiscTest m;
+            m.start();
+            m.join();
+        }
+        for ( size_t i = 0; i < testsNumber; i++ ) {
+            if ( only && strcmp(only, tests[i]->getOption()) )
+                continue;
+            tests[i]->start();
+            tests[i]->join();
+            cout << tests[i]->getName() << ": " <<
+                (tests[i]->getResult() ? "failed" : "ok") << endl;
+            if ( tests[i]->getResult() )
+                result = 1;
+        }
     }
     exit(result);
 }
@@ -0,0 +1,250 @@
+// benchmark of threaded session pools
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+// Receiving sessions are served by a ThreadedRTPSessionPool. A
+// sender thread sends them packets, through the loopback interface,
+// carrying the time they were sent. The number of sessions is
+// doubled at each step until the 99th percentile of the time from
+// sending to the reception service goes over the SLO. With "uring",
+// the data packets are received through io_uring rather than read
+// on readiness, to compare both. At the end, the memory used per
+// session is reported, and again once the sessions are parked.
+
+#include <cstdlib>
+#include <cstring>
+#include <ccrtp/rtp.h>
+#include <ccrtp/pool.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#ifdef  CCXX_NAMESPACES
+using namespace ost;
+using namespace std;
+#endif
+
+// base port of the receiving sessions
+const int RECEIVER_BASE = 40000;
+
+static inline uint64
+microseconds()
+{
+    timeval now;
+    SysTime::gettimeofday(&now,NULL);
+    return static_cast<uint64>(now.tv_sec) * 1000000 + now.tv_usec;
+}
+
+/**
+ * Latencies of the packets received in a step, shared by the pool
+ * threads.
+ **/
+class Latencies
+{
+public:
+    void add(uint32 l)
+    {
+        MutexLock lock(mutex);
+        values.push_back(l);
+    }
+
+    // returns the number of latencies, and the percentile p of them
+    size_t take(double p, uint32& percentile)
+    {
+        MutexLock lock(mutex);
+        size_t n = values.size();
+        percentile = 0;
+        if ( n ) {
+            size_t i = static_cast<size_t>(p * (n - 1));
+            nth_element(values.begin(),values.begin() + i,values.end());
+            percentile = values[i];
+        }
+        values.clear();
+        return n;
+    }
+
+private:
+    Mutex mutex;
+    vector<uint32> values;
+};
+
+Latencies latencies;
+
+/**
+ * Session that records the latency of the packets and drops them.
+ **/
+class BenchSession : public RTPSessionBase
+{
+public:
+    BenchSession(tpport_t port) :
+        RTPSessionBase(InetHostAddress("127.0.0.1"),port,port + 1,
+                       MembershipBookkeeping::defaultMembersHashSize,
+                       defaultApplication())
+    { setPayloadFormat(StaticPayloadFormat(sptPCMU)); }
+
+protected:
+    bool onRTPPacketRecv(IncomingRTPPkt& packet)
+    {
+        if ( packet.getPayloadSize() >= sizeof(uint64) ) {
+            uint64 sent;
+            memcpy(&sent,packet.getPayload(),sizeof(sent));
+            latencies.add(static_cast<uint32>(microseconds() - sent));
+        }
+        return false;
+    }
+};
+
+/**
+ * Sends packets to the sessions at a fixed rate.
+ **/
+class Sender : public Thread
+{
+public:
+    Sender(size_t n, uint32 pps, uint32 seconds) :
+        sessions(n), rate(pps), duration(seconds)
+    { }
+
+    void run()
+    {
+        int so = socket(AF_INET,SOCK_DGRAM,0);
+        sockaddr_in to;
+        memset(&to,0,sizeof(to));
+        to.sin_family = AF_INET;
+        to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        unsigned char packet[12 + 160];
+        memset(packet,0,sizeof(packet));
+        packet[0] = 0x80;
+        packet[1] = sptPCMU;
+
+        // one round of packets, to every session, per period
+        uint64 period = 1000000 / rate;
+        uint64 next = microseconds();
+        uint64 end = next + static_cast<uint64>(duration) * 1000000;
+        for ( uint16 seq = 0; next < end; seq++ ) {
+            uint32 stamp = htonl(static_cast<uint32>(seq) * 160);
+            uint16 s = htons(seq);
+            memcpy(packet + 2,&s,2);
+            memcpy(packet + 4,&stamp,4);
+            for ( size_t i = 0; i < sessions; i++ ) {
+                uint32 ssrc = htonl(static_cast<uint32>(i + 1));
+                memcpy(packet + 8,&ssrc,4);
+                uint64 now = microseconds();
+                memcpy(packet + 12,&now,sizeof(now));
+                to.sin_port = htons(static_cast<uint16>(RECEIVER_BASE + 2*i));
+                sendto(so,packet,sizeof(packet),0,
+                       reinterpret_cast<sockaddr*>(&to),sizeof(to));
+            }
+            next += period;
+            uint64 now = microseconds();
+            if ( next > now )
+                Thread::sleep(static_cast<timeout_t>((next - now) / 1000));
+        }
+        close(so);
+    }
+
+private:
+    size_t sessions;
+    uint32 rate;
+    uint32 duration;
+};
+
+int main(int argc, char *argv[])
+{
+    unsigned shards = (argc > 1) ? atoi(argv[1]) : 0;
+    size_t maxSessions = (argc > 2) ? atoi(argv[2]) : 4096;
+    uint32 pps = (argc > 3) ? atoi(argv[3]) : 50;
+    uint32 slo = (argc > 4) ? atoi(argv[4]) : 10000;
+    uint32 seconds = (argc > 5) ? atoi(argv[5]) : 5;
+    bool uring = (argc > 6) && !strcmp(argv[6],"uring");
+
+    if ( !pps || !seconds || ((argc > 6) && !uring) ) {
+        cerr << "usage: " << argv[0]
+             << " [shards [sessions [pps [slo_usec [seconds [uring]]]]]]"
+             << endl;
+        exit(1);
+    }
+
+    ThreadedRTPSessionPool pool(shards);
+    if ( uring && !pool.enableUring() ) {
+        cerr << "io_uring is not available" << endl;
+        exit(1);
+    }
+    pool.startRunning();
+    cout << pool.getShardsCount() << " shards, " << pps
+         << " packets per second and session, SLO of p99 <= "
+         << slo << " usec, " << (uring ? "io_uring" : "epoll") << endl;
+
+    vector<BenchSession*> sessions;
+    for ( size_t n = 1; n <= maxSessions; n *= 2 ) {
+        while ( sessions.size() < n ) {
+            BenchSession* s =
+                new BenchSession(RECEIVER_BASE + 2*sessions.size());
+            pool.addSession(*s);
+            sessions.push_back(s);
+        }
+
+        Sender sender(n,pps,seconds);
+        sender.start();
+        sender.join();
+        Thread::sleep(100);
+
+        uint32 p99;
+        size_t received = latencies.take(0.99,p99);
+        uint64 expected = static_cast<uint64>(n) * pps * seconds;
+        cout << n << " sessions: " << received << "/" << expected
+             << " packets, p99 " << p99 << " usec, shard loads";
+        for ( unsigned i = 0; i < pool.getShardsCount(); i++ ) {
+            RTPPoolLoad load;
+            pool.getShardLoad(i,load);
+            cout << " " << load.sessions << ":"
+                 << static_cast<int>(load.busy * 100) << "%";
+        }
+        cout << ", " << pool.getMigratedCount() << " migrated" << endl;
+
+        if ( p99 > slo || received < expected * 99 / 100 ) {
+            cout << "SLO broken at " << n << " sessions" << endl;
+            break;
+        }
+    }
+
+    // sessions no longer served can be parked, as held calls would
+    size_t served = 0, parked = 0;
+    for ( size_t i = 0; i < sessions.size(); i++ ) {
+        pool.removeSession(*sessions[i]);
+        served += sessions[i]->getMemoryUsage();
+        sessions[i]->park();
+        parked += sessions[i]->getMemoryUsage();
+    }
+    if ( !sessions.empty() )
+        cout << "memory per session: " << served / sessions.size()
+             << " bytes, " << parked / sessions.size()
+             << " parked" << endl;
+    for ( size_t i = 0; i < sessions.size(); i++ )
+        delete sessions[i];
+    return 0;
+}
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
@@ -0,0 +1,433 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+#include "private.h"
+#include <ccrtp/audio.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+NAMESPACE_COMMONCPP
+
+// G.711 (ITU-T G.711) conversions of one sample. The SIMD versions
+// below compute the same functions.
+
+static inline int16
+ulawSample(unsigned char u)
+{
+    u = ~u;
+    int t = ((u & 0x0f) << 3) + 0x84;
+    t <<= (u & 0x70) >> 4;
+    return static_cast<int16>(( u & 0x80 ) ? (0x84 - t) : (t - 0x84));
+}
+
+static inline int16
+alawSample(unsigned char a)
+{
+    a ^= 0x55;
+    int t = (a & 0x0f) << 4;
+    int seg = (a & 0x70) >> 4;
+    if ( 0 == seg )
+        t += 8;
+    else if ( 1 == seg )
+        t += 0x108;
+    else
+        t = (t + 0x108) << (seg - 1);
+    return static_cast<int16>(( a & 0x80 ) ? t : -t);
+}
+
+// segment of a magnitude: the number of significant bits above the
+// lowest ones (lowBits) of the segment 0.
+static inline int
+segment(int value, int lowBits)
+{
+    int seg = 0;
+    for ( value >>= lowBits; value && seg < 8; value >>= 1 )
+        seg++;
+    return seg;
+}
+
+static inline unsigned char
+ulawCode(int16 sample)
+{
+    int value = sample >> 2;
+    unsigned char mask = 0xff;
+    if ( value < 0 ) {
+        value = -value;
+        mask = 0x7f;
+    }
+    if ( value > 8159 )
+        value = 8159;
+    value += 0x21;
+    int seg = segment(value,6);
+    if ( seg >= 8 )
+        return 0x7f ^ mask;
+    unsigned char u = static_cast<unsigned char>
+        ((seg << 4) | ((value >> (seg + 1)) & 0x0f));
+    return u ^ mask;
+}
+
+static inline unsigned char
+alawCode(int16 sample)
+{
+    int value = sample >> 3;
+    unsigned char mask = 0xd5;
+    if ( value < 0 ) {
+        value = -value - 1;
+        mask = 0x55;
+    }
+    int seg = segment(value,5);
+    if ( seg >= 8 )
+        return 0x7f ^ mask;
+    unsigned char a = static_cast<unsigned char>(seg << 4);
+    if ( seg < 2 )
+        a |= (value >> 1) & 0x0f;
+    else
+        a |= (value >> seg) & 0x0f;
+    return a ^ mask;
+}
+
+#if defined(__SSE2__)
+// SSE2 has no per lane shifts: t << s, for s in 0..7 given by the
+// bits 4 to 6 of bits, is done in three selections.
+static inline __m128i
+shiftBySegment(__m128i t, __m128i bits)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i m = _mm_cmpeq_epi16(_mm_and_si128(bits,_mm_set1_epi16(0x10)),
+                    zero);
+    t = _mm_or_si128(_mm_and_si128(m,t),
+             _mm_andnot_si128(m,_mm_slli_epi16(t,1)));
+    m = _mm_cmpeq_epi16(_mm_and_si128(bits,_mm_set1_epi16(0x20)),zero);
+    t = _mm_or_si128(_mm_and_si128(m,t),
+             _mm_andnot_si128(m,_mm_slli_epi16(t,2)));
+    m = _mm_cmpeq_epi16(_mm_and_si128(bits,_mm_set1_epi16(0x40)),zero);
+    return _mm_or_si128(_mm_and_si128(m,t),
+                _mm_andnot_si128(m,_mm_slli_epi16(t,4)));
+}
+
+// (m ^ x) - m: -x where m is all ones, x where m is zero.
+static inline __m128i
+negateIf(__m128i x, __m128i m)
+{
+    return _mm_sub_epi16(_mm_xor_si128(x,m),m);
+}
+
+// 8 mu-law samples, zero extended to 16 bits.
+static inline __m128i
+ulawVector(__m128i u)
+{
+    __m128i v = _mm_xor_si128(u,_mm_set1_epi16(0xff));
+    __m128i t = _mm_add_epi16(
+        _mm_slli_epi16(_mm_and_si128(v,_mm_set1_epi16(0x0f)),3),
+        _mm_set1_epi16(0x84));
+    t = _mm_sub_epi16(shiftBySegment(t,v),_mm_set1_epi16(0x84));
+    __m128i sign = _mm_and_si128(v,_mm_set1_epi16(0x80));
+    return negateIf(t,_mm_cmpeq_epi16(sign,_mm_set1_epi16(0x80)));
+}
+
+// 8 A-law samples, zero extended to 16 bits.
+static inline __m128i
+alawVector(__m128i a)
+{
+    a = _mm_xor_si128(a,_mm_set1_epi16(0x55));
+    __m128i t = _mm_add_epi16(
+        _mm_slli_epi16(_mm_and_si128(a,_mm_set1_epi16(0x0f)),4),
+        _mm_set1_epi16(8));
+    // segments above 0 add 0x100 and shift by the segment minus 1
+    __m128i seg = _mm_and_si128(a,_mm_set1_epi16(0x70));
+    __m128i first = _mm_cmpeq_epi16(seg,_mm_setzero_si128());
+    t = _mm_add_epi16(t,_mm_andnot_si128(first,_mm_set1_epi16(0x100)));
+    t = shiftBySegment(t,_mm_subs_epu16(seg,_mm_set1_epi16(0x10)));
+    __m128i sign = _mm_and_si128(a,_mm_set1_epi16(0x80));
+    return negateIf(t,_mm_cmpeq_epi16(sign,_mm_setzero_si128()));
+}
+
+// Position of the most significant bit (exponent) and the 4 bits
+// after it (mantissa) of 8 positive values, packed as exponent << 4
+// | mantissa, as read from their conversions to float.
+static inline __m128i
+logVector(__m128i v)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_castps_si128(
+        _mm_cvtepi32_ps(_mm_unpacklo_epi16(v,zero)));
+    __m128i hi = _mm_castps_si128(
+        _mm_cvtepi32_ps(_mm_unpackhi_epi16(v,zero)));
+    // exponent and mantissa bits are contiguous: keep 4 mantissa
+    // bits, and remove the exponent bias.
+    lo = _mm_sub_epi32(_mm_srli_epi32(lo,19),_mm_set1_epi32(127 << 4));
+    hi = _mm_sub_epi32(_mm_srli_epi32(hi,19),_mm_set1_epi32(127 << 4));
+    return _mm_packs_epi32(lo,hi);
+}
+
+// 8 samples to mu-law, in the low bytes of 16 bits lanes.
+static inline __m128i
+ulawEncodeVector(__m128i x)
+{
+    __m128i negative = _mm_srai_epi16(x,15);
+    __m128i v = negateIf(_mm_srai_epi16(x,2),negative);
+    v = _mm_add_epi16(_mm_min_epi16(v,_mm_set1_epi16(8159)),
+              _mm_set1_epi16(0x21));
+    // v is at least 0x21: the segment is the exponent minus 5. The
+    // segment 8 (v = 0x2000) is clamped.
+    __m128i u = _mm_sub_epi16(logVector(v),_mm_set1_epi16(5 << 4));
+    u = _mm_min_epi16(u,_mm_set1_epi16(0x7f));
+    __m128i mask = _mm_xor_si128(_mm_set1_epi16(0xff),
+                     _mm_and_si128(negative,_mm_set1_epi16(0x80)));
+    return _mm_xor_si128(u,mask);
+}
+
+// 8 samples to A-law, in the low bytes of 16 bits lanes.
+static inline __m128i
+alawEncodeVector(__m128i x)
+{
+    __m128i negative = _mm_srai_epi16(x,15);
+    // -value - 1 for negative values
+    __m128i v = _mm_xor_si128(_mm_srai_epi16(x,3),negative);
+    // from 32 on, the segment is the exponent minus 4
+    __m128i a = _mm_sub_epi16(logVector(v),_mm_set1_epi16(4 << 4));
+    __m128i first = _mm_cmplt_epi16(v,_mm_set1_epi16(32));
+    a = _mm_or_si128(_mm_andnot_si128(first,a),
+             _mm_and_si128(first,_mm_srli_epi16(v,1)));
+    __m128i mask = _mm_xor_si128(_mm_set1_epi16(0xd5),
+                     _mm_and_si128(negative,_mm_set1_epi16(0x80)));
+    return _mm_xor_si128(a,mask);
+}
+#endif
+
+// Decoding doubles the size of the samples: going backwards, the
+// samples are read before the ones written over them, and in place
+// decoding works.
+
+void
+ulawToLinear(int16* dst, const unsigned char* src, size_t count)
+{
+    size_t i = count;
+#if defined(__SSE2__)
+    for ( ; i > (count & ~static_cast<size_t>(7)); i-- )
+        dst[i - 1] = ulawSample(src[i - 1]);
+    while ( i ) {
+        i -= 8;
+        __m128i u = _mm_unpacklo_epi8(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)),
+            _mm_setzero_si128());
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                 ulawVector(u));
+    }
+#endif
+    for ( ; i; i-- )
+        dst[i - 1] = ulawSample(src[i - 1]);
+}
+
+void
+alawToLinear(int16* dst, const unsigned char* src, size_t count)
+{
+    size_t i = count;
+#if defined(__SSE2__)
+    for ( ; i > (count & ~static_cast<size_t>(7)); i-- )
+        dst[i - 1] = alawSample(src[i - 1]);
+    while ( i ) {
+        i -= 8;
+        __m128i a = _mm_unpacklo_epi8(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)),
+            _mm_setzero_si128());
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                 alawVector(a));
+    }
+#endif
+    for ( ; i; i-- )
+        dst[i - 1] = alawSample(src[i - 1]);
+}
+
+void
+linearToUlaw(unsigned char* dst, const int16* src, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for ( ; i + 16 <= count; i += 16 ) {
+        __m128i a = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(src + i));
+        __m128i b = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(src + i + 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                 _mm_packus_epi16(ulawEncodeVector(a),
+                          ulawEncodeVector(b)));
+    }
+#endif
+    for ( ; i < count; i++ )
+        dst[i] = ulawCode(src[i]);
+}
+
+void
+linearToAlaw(unsigned char* dst, const int16* src, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for ( ; i + 16 <= count; i += 16 ) {
+        __m128i a = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(src + i));
+        __m128i b = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(src + i + 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                 _mm_packus_epi16(alawEncodeVector(a),
+                          alawEncodeVector(b)));
+    }
+#endif
+    for ( ; i < count; i++ )
+        dst[i] = alawCode(src[i]);
+}
+
+// SSE2 targets are little endian: the vector loops swap the bytes,
+// the scalar ones work with any byte order.
+
+void
+l16ToLinear(int16* dst, const unsigned char* src, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for ( ; i + 8 <= count; i += 8 ) {
+        __m128i x = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(src + 2 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                 _mm_or_si128(_mm_slli_epi16(x,8),
+                          _mm_srli_epi16(x,8)));
+    }
+#endif
+    for ( ; i < count; i++ )
+        dst[i] = static_cast<int16>((src[2 * i] << 8) | src[2 * i + 1]);
+}
+
+void
+linearToL16(unsigned char* dst, const int16* src, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for ( ; i + 8 <= count; i += 8 ) {
+        __m128i x = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i),
+                 _mm_or_si128(_mm_slli_epi16(x,8),
+                          _mm_srli_epi16(x,8)));
+    }
+#endif
+    for ( ; i < count; i++ ) {
+        uint16 s = static_cast<uint16>(src[i]);
+        dst[2 * i] = static_cast<unsigned char>(s >> 8);
+        dst[2 * i + 1] = static_cast<unsigned char>(s);
+    }
+}
+
+void
+interleaveChannels(int16* dst, const int16* const* channels,
+unsigned channelsCount, size_t count)
+{
+    size_t i = 0;
+    if ( 2 == channelsCount ) {
+        const int16* left = channels[0];
+        const int16* right = channels[1];
+#if defined(__SSE2__)
+        for ( ; i + 8 <= count; i += 8 ) {
+            __m128i l = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(left + i));
+            __m128i r = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(right + i));
+            __m128i* d = reinterpret_cast<__m128i*>(dst + 2 * i);
+            _mm_storeu_si128(d,_mm_unpacklo_epi16(l,r));
+            _mm_storeu_si128(d + 1,_mm_unpackhi_epi16(l,r));
+        }
+#endif
+        for ( ; i < count; i++ ) {
+            dst[2 * i] = left[i];
+            dst[2 * i + 1] = right[i];
+        }
+        return;
+    }
+    for ( unsigned c = 0; c < channelsCount; c++ ) {
+        const int16* channel = channels[c];
+        int16* d = dst + c;
+        for ( i = 0; i < count; i++, d += channelsCount )
+            *d = channel[i];
+    }
+}
+
+void
+deinterleaveChannels(int16* const* channels, const int16* src,
+unsigned channelsCount, size_t count)
+{
+    size_t i = 0;
+    if ( 2 == channelsCount ) {
+        int16* left = channels[0];
+        int16* right = channels[1];
+#if defined(__SSE2__)
+        for ( ; i + 8 <= count; i += 8 ) {
+            const __m128i* s =
+                reinterpret_cast<const __m128i*>(src + 2 * i);
+            __m128i a = _mm_loadu_si128(s);
+            __m128i b = _mm_loadu_si128(s + 1);
+            // sign extended left and right samples, 32 bits each
+            __m128i la = _mm_srai_epi32(_mm_slli_epi32(a,16),16);
+            __m128i lb = _mm_srai_epi32(_mm_slli_epi32(b,16),16);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(left + i),
+                     _mm_packs_epi32(la,lb));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(right + i),
+                     _mm_packs_epi32(_mm_srai_epi32(a,16),
+                             _mm_srai_epi32(b,16)));
+        }
+#endif
+        for ( ; i < count; i++ ) {
+            left[i] = src[2 * i];
+            right[i] = src[2 * i + 1];
+        }
+        return;
+    }
+    for ( unsigned c = 0; c < channelsCount; c++ ) {
+        int16* channel = channels[c];
+        const int16* s = src + c;
+        for ( i = 0; i < count; i++, s += channelsCount )
+            channel[i] = *s;
+    }
+}
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
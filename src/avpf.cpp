@@ -0,0 +1,580 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+#include "private.h"
+#include <ccrtp/cqueue.h>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+
+NAMESPACE_COMMONCPP
+
+const uint8 AVPFQueue::defaultNACKRetries = 2;
+/// Do not keep track of more than this many packets lost.
+const size_t AVPFQueue::maxLostPackets = 512;
+/// Check for incoming RTCP packets every 10 ms.
+const microtimeout_t AVPFQueue::defaultFeedbackCheckInterval = 10000;
+/// Send transport-cc feedback every 100 ms.
+const microtimeout_t AVPFQueue::defaultTransportFeedbackInterval = 100000;
+/// Pace at 2.5 times the target bitrate.
+const float AVPFQueue::defaultPacingFactor = 2.5f;
+
+AVPFQueue::AVPFQueue(uint32 size, RTPApplication& app) :
+AVPQueue(size,app), estimator(), transportSequence(&estimator)
+{
+    initAVPF();
+}
+
+AVPFQueue::AVPFQueue(uint32 ssrc, uint32 size, RTPApplication& app) :
+AVPQueue(ssrc,size,app), estimator(), transportSequence(&estimator)
+{
+    initAVPF();
+}
+
+AVPFQueue::~AVPFQueue()
+{ }
+
+void
+AVPFQueue::initAVPF()
+{
+    nackEnabled = true;
+    nackRetries = defaultNACKRetries;
+    rrInterval = 0;
+    allowEarly = true;
+    earlyScheduled = false;
+    sendingEarly = false;
+    timerclear(&earlyTime);
+    timerclear(&regularInterval);
+    earlyCount = 0;
+    transportCCId = 0;
+    transportFeedbackInterval = defaultTransportFeedbackInterval;
+    timerclear(&lastTransportFeedback);
+    sendingTransportFeedback = false;
+    pacingFactor = defaultPacingFactor;
+    // AVPF has no 5 seconds minimum interval
+    setMinRTCPInterval(rrInterval);
+    setRTCPCheckInterval(defaultFeedbackCheckInterval);
+}
+
+void
+AVPFQueue::setNACKEnabled(bool enable)
+{
+    feedbackLock.enter();
+    nackEnabled = enable;
+    if ( !enable )
+        lostPackets.clear();
+    feedbackLock.leave();
+}
+
+void
+AVPFQueue::setRRInterval(microtimeout_t interval)
+{
+    rrInterval = interval;
+    setMinRTCPInterval(interval);
+}
+
+void
+AVPFQueue::requestNACK(uint32 ssrc, uint16 seqNum)
+{
+    feedbackLock.enter();
+    std::list<LostPacket>::iterator i;
+    for ( i = lostPackets.begin(); lostPackets.end() != i; i++ ) {
+        if ( i->ssrc == ssrc && i->seqNum == seqNum )
+            break;
+    }
+    if ( lostPackets.end() == i ) {
+        if ( lostPackets.size() >= maxLostPackets )
+            lostPackets.pop_front();
+        LostPacket lost;
+        lost.ssrc = ssrc;
+        lost.seqNum = seqNum;
+        lost.nacks = 0;
+        lostPackets.push_back(lost);
+    }
+    scheduleFeedback();
+    feedbackLock.leave();
+}
+
+void
+AVPFQueue::requestPLI(uint32 ssrc)
+{
+    feedbackLock.enter();
+    if ( pliRequests.end() ==
+         std::find(pliRequests.begin(),pliRequests.end(),ssrc) )
+        pliRequests.push_back(ssrc);
+    scheduleFeedback();
+    feedbackLock.leave();
+}
+
+void
+AVPFQueue::requestFIR(uint32 ssrc)
+{
+    feedbackLock.enter();
+    if ( firRequests.end() ==
+         std::find(firRequests.begin(),firRequests.end(),ssrc) ) {
+        firRequests.push_back(ssrc);
+        // a new request, with a new sequence number. The map
+        // starts at 0 for new sources.
+        firSeqNums[ssrc]++;
+    }
+    scheduleFeedback();
+    feedbackLock.leave();
+}
+
+bool
+AVPFQueue::setTransportCC(uint8 id)
+{
+    if ( transportCCId )
+        removeHeaderExtension(transportCCId);
+    transportCCId = 0;
+    if ( id ) {
+        if ( !addHeaderExtension(id,transportSequence) )
+            return false;
+        transportCCId = id;
+    }
+    if ( id && pacingFactor > 0 )
+        setPacingRate(static_cast<uint32>(pacingFactor *
+                          estimator.getTargetBitrate()));
+    else
+        setPacingRate(0);
+    return true;
+}
+
+void
+AVPFQueue::onPacketsLost(SyncSource& source, uint16 firstSeqNum,
+uint16 count)
+{
+    if ( !nackEnabled )
+        return;
+    // only the most recent ones if the gap is too large.
+    if ( count > maxLostPackets ) {
+        firstSeqNum += count - maxLostPackets;
+        count = maxLostPackets;
+    }
+    feedbackLock.enter();
+    for ( uint16 i = 0; i < count; i++ ) {
+        if ( lostPackets.size() >= maxLostPackets )
+            lostPackets.pop_front();
+        LostPacket lost;
+        lost.ssrc = source.getID();
+        lost.seqNum = firstSeqNum + i;
+        lost.nacks = 0;
+        lostPackets.push_back(lost);
+    }
+    scheduleFeedback();
+    feedbackLock.leave();
+}
+
+void
+AVPFQueue::onLatePacket(SyncSource& source, uint16 seqNum)
+{
+    feedbackLock.enter();
+    for ( std::list<LostPacket>::iterator i = lostPackets.begin();
+          lostPackets.end() != i; i++ ) {
+        if ( i->ssrc == source.getID() && i->seqNum == seqNum ) {
+            lostPackets.erase(i);
+            break;
+        }
+    }
+    feedbackLock.leave();
+}
+
+void
+AVPFQueue::onRemoteBitrateDecrease(SyncSource&, uint32)
+{
+    feedbackLock.enter();
+    scheduleFeedback();
+    feedbackLock.leave();
+}
+
+void
+AVPFQueue::scheduleFeedback()
+{
+    // already scheduled, or waiting for the next regular packet
+    // because an early one has just been sent.
+    if ( earlyScheduled || !allowEarly )
+        return;
+
+    timeval now;
+    SysTime::gettimeofday(&now,NULL);
+    // T_dither_max: no dithering in point to point sessions
+    microtimeout_t dither = 0;
+    if ( getMembersCount() > 2 )
+        dither = timeval2microtimeout(regularInterval) / 2;
+    timeval tmp, latest;
+    tmp.tv_sec = dither / 1000000;
+    tmp.tv_usec = dither % 1000000;
+    timeradd(&now,&tmp,&latest);
+    // the regular packet would be sent before: use it
+    timeval next = getNextRTCPTime();
+    if ( timercmp(&latest,&next,>=) )
+        return;
+
+    microtimeout_t delay = static_cast<microtimeout_t>
+        (dither * (rand() / (RAND_MAX + 1.0)));
+    tmp.tv_sec = delay / 1000000;
+    tmp.tv_usec = delay % 1000000;
+    timeradd(&now,&tmp,&earlyTime);
+    earlyScheduled = true;
+}
+
+void
+AVPFQueue::controlTransmissionService()
+{
+    if ( isControlServiceActive() ) {
+        timeval now;
+        SysTime::gettimeofday(&now,NULL);
+        bool due = false;
+        feedbackLock.enter();
+        if ( earlyScheduled )
+            due = timercmp(&now,&earlyTime,>=);
+        feedbackLock.leave();
+        if ( due ) {
+            sendingEarly = true;
+            dispatchControlPacket();
+            sendingEarly = false;
+        }
+
+        TransportFeedbackRecorder* recorder = transportCCId ?
+            &transportSequence.getRecorder() : NULL;
+        if ( recorder && recorder->isPending() ) {
+            timeval elapsed;
+            timersub(&now,&lastTransportFeedback,&elapsed);
+            if ( timeval2microtimeout(elapsed) >=
+                 transportFeedbackInterval ) {
+                lastTransportFeedback = now;
+                sendingTransportFeedback = true;
+                dispatchControlPacket();
+                sendingTransportFeedback = false;
+            }
+        }
+    }
+    AVPQueue::controlTransmissionService();
+}
+
+timeval
+AVPFQueue::getNextControlTime()
+{
+    timeval next = AVPQueue::getNextControlTime();
+    feedbackLock.enter();
+    if ( earlyScheduled && timercmp(&earlyTime,&next,<) )
+        next = earlyTime;
+    feedbackLock.leave();
+
+    TransportFeedbackRecorder* recorder = transportCCId ?
+        &transportSequence.getRecorder() : NULL;
+    if ( recorder && recorder->isPending() ) {
+        timeval interval = microtimeout2Timeval(transportFeedbackInterval);
+        timeval feedback;
+        timeradd(&lastTransportFeedback,&interval,&feedback);
+        if ( timercmp(&feedback,&next,<) )
+            next = feedback;
+    }
+    return next;
+}
+
+timeval
+AVPFQueue::computeRTCPInterval()
+{
+    timeval interval = AVPQueue::computeRTCPInterval();
+    regularInterval = interval;
+    // after an early packet, the next regular one is sent one
+    // more regular interval later (RFC 4585, 3.5.2)
+    if ( !allowEarly )
+        timeradd(&interval,&regularInterval,&interval);
+    return interval;
+}
+
+uint16
+AVPFQueue::packRTCPExtension(unsigned char* buffer, uint16 available)
+{
+    // the transport-cc feedback goes in any packet
+    uint16 len = packTransportFeedback(buffer,available);
+    // a packet for transport-cc feedback only does not count as
+    // an early one.
+    if ( sendingTransportFeedback )
+        return len;
+
+    feedbackLock.enter();
+    if ( sendingEarly ) {
+        allowEarly = false;
+        earlyCount++;
+    } else {
+        allowEarly = true;
+    }
+    earlyScheduled = false;
+    // REMB messages, if any
+    len += AVPQueue::packRTCPExtension(buffer + len,available - len);
+    len += packNACKs(buffer + len,available - len);
+    len += packPLIs(buffer + len,available - len);
+    len += packFIRs(buffer + len,available - len);
+    feedbackLock.leave();
+    return len;
+}
+
+uint16
+AVPFQueue::packNACKs(unsigned char* buffer, uint16 available)
+{
+    const uint16 headerLen = sizeof(RTCPFixedHeader) + 2 * sizeof(uint32);
+    // media sources with packets lost, in order of loss.
+    std::list<uint32> sources;
+    std::list<LostPacket>::iterator i;
+    for ( i = lostPackets.begin(); lostPackets.end() != i; i++ ) {
+        if ( sources.end() ==
+             std::find(sources.begin(),sources.end(),i->ssrc) )
+            sources.push_back(i->ssrc);
+    }
+
+    // one packet per media source
+    uint16 len = 0;
+    for ( std::list<uint32>::iterator s = sources.begin();
+          sources.end() != s &&
+              len + headerLen + sizeof(GenericNACK) <= available; s++ ) {
+        RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(buffer + len);
+        GenericNACK* fci = reinterpret_cast<GenericNACK*>(pkt->info.FB.fci);
+        uint16 entries = 0;
+        uint16 maxEntries = (available - len - headerLen) / sizeof(GenericNACK);
+        for ( i = lostPackets.begin(); lostPackets.end() != i; i++ ) {
+            if ( i->ssrc != *s )
+                continue;
+            // in the bitmask of an entry already built?
+            uint16 e = 0;
+            for ( ; e < entries; e++ ) {
+                uint16 step = i->seqNum - ntohs(fci[e].pid);
+                if ( 0 == step )
+                    break;
+                if ( step <= 16 ) {
+                    fci[e].blp = htons(ntohs(fci[e].blp) |
+                               (1 << (step - 1)));
+                    break;
+                }
+            }
+            if ( e == entries ) {
+                if ( entries == maxEntries )
+                    continue;
+                fci[entries].pid = htons(i->seqNum);
+                fci[entries].blp = 0;
+                entries++;
+            }
+            i->nacks++;
+        }
+        pkt->fh.version = CCRTP_VERSION;
+        pkt->fh.padding = 0;
+        pkt->fh.block_count = RTCPPacket::fbGenericNACK;
+        pkt->fh.type = RTCPPacket::tRTPFB;
+        pkt->info.FB.ssrc = getLocalSSRCNetwork();
+        pkt->info.FB.mediaSSRC = htonl(*s);
+        uint16 plen = headerLen + entries * sizeof(GenericNACK);
+        pkt->fh.length = htons((plen >> 2) - 1);
+        len += plen;
+    }
+
+    // forget the packets NACKed enough times.
+    i = lostPackets.begin();
+    while ( lostPackets.end() != i ) {
+        if ( i->nacks >= nackRetries )
+            i = lostPackets.erase(i);
+        else
+            i++;
+    }
+    return len;
+}
+
+uint16
+AVPFQueue::packPLIs(unsigned char* buffer, uint16 available)
+{
+    const uint16 plen = sizeof(RTCPFixedHeader) + 2 * sizeof(uint32);
+    uint16 len = 0;
+    while ( !pliRequests.empty() && len + plen <= available ) {
+        RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(buffer + len);
+        pkt->fh.version = CCRTP_VERSION;
+        pkt->fh.padding = 0;
+        pkt->fh.block_count = RTCPPacket::fbPLI;
+        pkt->fh.type = RTCPPacket::tPSFB;
+        pkt->fh.length = htons((plen >> 2) - 1);
+        pkt->info.FB.ssrc = getLocalSSRCNetwork();
+        pkt->info.FB.mediaSSRC = htonl(pliRequests.front());
+        pliRequests.pop_front();
+        len += plen;
+    }
+    return len;
+}
+
+uint16
+AVPFQueue::packFIRs(unsigned char* buffer, uint16 available)
+{
+    const uint16 headerLen = sizeof(RTCPFixedHeader) + 2 * sizeof(uint32);
+    if ( firRequests.empty() || headerLen + sizeof(FIREntry) > available )
+        return 0;
+    // all the requests go in one packet
+    RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(buffer);
+    FIREntry* fci = reinterpret_cast<FIREntry*>(pkt->info.FB.fci);
+    uint16 entries = 0;
+    while ( !firRequests.empty() &&
+        headerLen + (entries + 1) * sizeof(FIREntry) <= available ) {
+        uint32 ssrc = firRequests.front();
+        firRequests.pop_front();
+        fci[entries].ssrc = htonl(ssrc);
+        fci[entries].seqNum = firSeqNums[ssrc];
+        fci[entries].reserved[0] = fci[entries].reserved[1] =
+            fci[entries].reserved[2] = 0;
+        entries++;
+    }
+    uint16 plen = headerLen + entries * sizeof(FIREntry);
+    pkt->fh.version = CCRTP_VERSION;
+    pkt->fh.padding = 0;
+    pkt->fh.block_count = RTCPPacket::fbFIR;
+    pkt->fh.type = RTCPPacket::tPSFB;
+    pkt->fh.length = htons((plen >> 2) - 1);
+    pkt->info.FB.ssrc = getLocalSSRCNetwork();
+    // not used in FIR messages
+    pkt->info.FB.mediaSSRC = 0;
+    return plen;
+}
+
+uint16
+AVPFQueue::packTransportFeedback(unsigned char* buffer, uint16 available)
+{
+    const uint16 headerLen = sizeof(RTCPFixedHeader) + 2 * sizeof(uint32);
+    TransportFeedbackRecorder* recorder = transportCCId ?
+        &transportSequence.getRecorder() : NULL;
+    if ( !recorder || available <= headerLen )
+        return 0;
+    RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(buffer);
+    uint32 mediaSSRC;
+    size_t fciLen = recorder->build(pkt->info.FB.fci,available - headerLen,
+                    mediaSSRC);
+    if ( 0 == fciLen )
+        return 0;
+    uint16 plen = static_cast<uint16>(headerLen + fciLen);
+    pkt->fh.version = CCRTP_VERSION;
+    pkt->fh.padding = 0;
+    pkt->fh.block_count = RTCPPacket::fbTransportCC;
+    pkt->fh.type = RTCPPacket::tRTPFB;
+    pkt->fh.length = htons((plen >> 2) - 1);
+    pkt->info.FB.ssrc = getLocalSSRCNetwork();
+    pkt->info.FB.mediaSSRC = htonl(mediaSSRC);
+    return plen;
+}
+
+void
+AVPFQueue::onGotNACK(SyncSource&, uint32 mediaSSRC, uint16 seqNum)
+{
+    retransmit(mediaSSRC,seqNum);
+}
+
+void
+AVPFQueue::onGotRRSRExtension(unsigned char* buffer, size_t len)
+{
+    const size_t headerLen = sizeof(RTCPFixedHeader) + 2 * sizeof(uint32);
+    size_t pointer = 0;
+    while ( pointer + headerLen <= len ) {
+        RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(buffer + pointer);
+        size_t plen = pkt->getLength();
+        if ( plen > len - pointer )
+            break;
+        pointer += plen;
+        if ( RTCPPacket::tRTPFB != pkt->fh.type &&
+             RTCPPacket::tPSFB != pkt->fh.type )
+            continue;
+        if ( plen < headerLen )
+            continue;
+
+        bool source_created;
+        SyncSourceLink* sourceLink =
+            getSourceBySSRC(pkt->getSSRC(),source_created);
+        SyncSource& source = *(sourceLink->getSource());
+        uint32 mediaSSRC = ntohl(pkt->info.FB.mediaSSRC);
+        size_t fciLen = plen - headerLen;
+        uint8 fmt = pkt->fh.block_count;
+
+        if ( RTCPPacket::tRTPFB == pkt->fh.type &&
+             RTCPPacket::fbGenericNACK == fmt ) {
+            GenericNACK* fci = reinterpret_cast<GenericNACK*>(pkt->info.FB.fci);
+            for ( size_t e = 0; e < fciLen / sizeof(GenericNACK); e++ ) {
+                uint16 pid = ntohs(fci[e].pid);
+                uint16 blp = ntohs(fci[e].blp);
+                onGotNACK(source,mediaSSRC,pid);
+                for ( uint8 b = 0; b < 16; b++ ) {
+                    if ( blp & (1 << b) )
+                        onGotNACK(source,mediaSSRC,pid + b + 1);
+                }
+            }
+        } else if ( RTCPPacket::tRTPFB == pkt->fh.type &&
+                RTCPPacket::fbTransportCC == fmt ) {
+            timeval now;
+            SysTime::gettimeofday(&now,NULL);
+            if ( estimator.onTransportFeedback(pkt->info.FB.fci,fciLen,
+                               now) ) {
+                uint32 target = estimator.getTargetBitrate();
+                if ( transportCCId && pacingFactor > 0 )
+                    setPacingRate(static_cast<uint32>(pacingFactor *
+                                      target));
+                onTargetBitrate(target);
+            }
+        } else if ( RTCPPacket::tPSFB == pkt->fh.type &&
+                RTCPPacket::fbAFB == fmt && fciLen >= 8 &&
+                0 == memcmp(pkt->info.FB.fci,"REMB",4) ) {
+            const unsigned char* fci = pkt->info.FB.fci;
+            uint8 exp = fci[5] >> 2;
+            uint32 mantissa = (fci[5] & 0x03) << 16 | fci[6] << 8 | fci[7];
+            // saturate what does not fit in 32 bits
+            uint32 bitrate = ( exp >= 32 ||
+                       (static_cast<uint64>(mantissa) << exp) >
+                       0xffffffff ) ? 0xffffffff : mantissa << exp;
+            onGotREMB(source,bitrate);
+        } else if ( RTCPPacket::tPSFB == pkt->fh.type &&
+                RTCPPacket::fbPLI == fmt ) {
+            onGotPLI(source,mediaSSRC);
+        } else if ( RTCPPacket::tPSFB == pkt->fh.type &&
+                RTCPPacket::fbFIR == fmt ) {
+            FIREntry* fci = reinterpret_cast<FIREntry*>(pkt->info.FB.fci);
+            for ( size_t e = 0; e < fciLen / sizeof(FIREntry); e++ )
+                onGotFIR(source,ntohl(fci[e].ssrc),fci[e].seqNum);
+        } else {
+            onGotFeedback(source,*pkt);
+        }
+    }
+}
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
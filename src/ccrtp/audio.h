@@ -0,0 +1,164 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file audio.h
+ *
+ * @short Conversions of G.711 and L16 audio payloads.
+ **/
+
+#ifndef CCXX_RTP_AUDIO_H_
+#define CCXX_RTP_AUDIO_H_
+
+#include <ccrtp/base.h>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @defgroup audio Audio payload conversions.
+ *
+ * Conversions between the sample formats of the PCMU, PCMA (ITU-T
+ * G.711) and L16 payload types and linear 16 bit samples in host
+ * order. They compute the G.711 laws without lookup tables, and use
+ * SSE2 instructions when the library is built for a target that
+ * supports them. Results are the same as those of the reference
+ * G.711 implementation.
+ *
+ * Conversions may be done in place, for instance on the payload of
+ * a packet received or on a payload being built: the destination
+ * may start at the same address as the source. When decoding G.711,
+ * there must be room there for the linear samples.
+ * @{
+ **/
+
+/**
+ * Decode mu-law (PCMU) samples.
+ *
+ * @param dst where to store the linear samples.
+ * @param src mu-law samples.
+ * @param count number of samples.
+ **/
+__EXPORT void
+ulawToLinear(int16* dst, const unsigned char* src, size_t count);
+
+/**
+ * Decode A-law (PCMA) samples.
+ *
+ * @param dst where to store the linear samples.
+ * @param src A-law samples.
+ * @param count number of samples.
+ **/
+__EXPORT void
+alawToLinear(int16* dst, const unsigned char* src, size_t count);
+
+/**
+ * Encode linear samples with the mu-law (PCMU).
+ *
+ * @param dst where to store the mu-law samples.
+ * @param src linear samples.
+ * @param count number of samples.
+ **/
+__EXPORT void
+linearToUlaw(unsigned char* dst, const int16* src, size_t count);
+
+/**
+ * Encode linear samples with the A-law (PCMA).
+ *
+ * @param dst where to store the A-law samples.
+ * @param src linear samples.
+ * @param count number of samples.
+ **/
+__EXPORT void
+linearToAlaw(unsigned char* dst, const int16* src, size_t count);
+
+/**
+ * Convert L16 samples, in network order, to host order.
+ *
+ * @param dst where to store the samples in host order.
+ * @param src L16 samples, need not be aligned.
+ * @param count number of samples.
+ **/
+__EXPORT void
+l16ToLinear(int16* dst, const unsigned char* src, size_t count);
+
+/**
+ * Convert samples in host order to L16 samples, in network order.
+ *
+ * @param dst where to store the L16 samples, need not be aligned.
+ * @param src samples in host order.
+ * @param count number of samples.
+ **/
+__EXPORT void
+linearToL16(unsigned char* dst, const int16* src, size_t count);
+
+/**
+ * Interleave the samples of several channels, as in multichannel
+ * L16 payloads. This can not be done in place.
+ *
+ * @param dst where to store count * channelsCount samples.
+ * @param channels samples of each channel.
+ * @param channelsCount number of channels.
+ * @param count number of samples per channel.
+ **/
+__EXPORT void
+interleaveChannels(int16* dst, const int16* const* channels,
+           unsigned channelsCount, size_t count);
+
+/**
+ * Split interleaved samples into one buffer per channel. This can
+ * not be done in place.
+ *
+ * @param channels where to store the samples of each channel.
+ * @param src count * channelsCount interleaved samples.
+ * @param channelsCount number of channels.
+ * @param count number of samples per channel.
+ **/
+__EXPORT void
+deinterleaveChannels(int16* const* channels, const int16* src,
+             unsigned channelsCount, size_t count);
+
+/** @}*/ // audio
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_AUDIO_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
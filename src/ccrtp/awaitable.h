@@ -0,0 +1,253 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file awaitable.h
+ *
+ * @short Coroutine interface of RTP sessions.
+ **/
+
+#ifndef CCXX_RTP_AWAITABLE_H_
+#define CCXX_RTP_AWAITABLE_H_
+
+#include <ccrtp/rtp.h>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#include <deque>
+#include <vector>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @defgroup awaitable Coroutine interface of RTP sessions.
+ * @{
+ **/
+
+/**
+ * @class AwaitableRTPSession
+ * @short RTP session served to C++20 coroutines.
+ *
+ * <code>co_await session.nextData(src)</code> resumes the coroutine
+ * when data from the source is queued, with the data. <code>co_await
+ * session.sendSlot()</code> resumes it when the sending queue has
+ * room for more data (see setSendCapacity()); when the session is
+ * paced, that is at the pacing rate. A coroutine per session can
+ * thus handle the session as straight-line code, with no thread of
+ * its own and without checking isWaiting() periodically.
+ *
+ * Coroutines are resumed by whatever serves the session, as packets
+ * are received and sent: its thread, a session pool, or the event
+ * loop of the application in reactor mode (see
+ * TRTPSessionBase::onReadable()). No locks of the session are held
+ * then. Coroutines must not be waiting when the session is deleted.
+ *
+ * This header needs C++20. The library itself does not.
+ **/
+template <class Session = TRTPSessionBase<> >
+class AwaitableRTPSession : public Session
+{
+public:
+    using Session::Session;
+
+    /**
+     * Awaited by nextData().
+     **/
+    class DataAwaiter
+    {
+    public:
+        DataAwaiter(AwaitableRTPSession& s, const SyncSource* src) :
+            session(s), source(src)
+        { }
+
+        bool
+        await_ready() const
+        { return session.isWaiting(source); }
+
+        bool
+        await_suspend(std::coroutine_handle<> h)
+        { handle = h; return session.waitData(*this); }
+
+        /**
+         * @return data unit, to be deleted, NULL if the data was
+         *         taken by somebody else meanwhile.
+         **/
+        const AppDataUnit*
+        await_resume()
+        { return session.getData(session.getFirstTimestamp(source),source); }
+
+    private:
+        friend class AwaitableRTPSession;
+
+        AwaitableRTPSession& session;
+        const SyncSource* source;
+        std::coroutine_handle<> handle;
+    };
+
+    /**
+     * Awaited by sendSlot().
+     **/
+    class SendAwaiter
+    {
+    public:
+        SendAwaiter(AwaitableRTPSession& s) :
+            session(s)
+        { }
+
+        bool
+        await_ready() const
+        { return session.getSendQueueLength() < session.sendCapacity; }
+
+        bool
+        await_suspend(std::coroutine_handle<> h)
+        { return session.waitSend(h); }
+
+        void
+        await_resume()
+        { }
+
+    private:
+        AwaitableRTPSession& session;
+    };
+
+    /**
+     * Wait for data.
+     *
+     * @param src source of the data, NULL for any source.
+     **/
+    inline DataAwaiter
+    nextData(const SyncSource* src = NULL)
+    { return DataAwaiter(*this,src); }
+
+    /**
+     * Wait till more data can be put.
+     **/
+    inline SendAwaiter
+    sendSlot()
+    { return SendAwaiter(*this); }
+
+    /**
+     * Set how many packets may be waiting in the sending queue for
+     * sendSlot() to resume. 4 by default.
+     **/
+    inline void
+    setSendCapacity(size_t packets)
+    { sendCapacity = packets ? packets : 1; }
+
+    inline size_t
+    getSendCapacity() const
+    { return sendCapacity; }
+
+protected:
+    void
+    onDataQueued(SyncSource& src)
+    {
+        std::vector<std::coroutine_handle<> > ready;
+        awaitLock.enter();
+        for ( size_t i = 0; i < dataWaiters.size(); ) {
+            DataAwaiter* w = dataWaiters[i];
+            if ( !w->source || w->source == &src ) {
+                ready.push_back(w->handle);
+                dataWaiters[i] = dataWaiters.back();
+                dataWaiters.pop_back();
+            } else {
+                i++;
+            }
+        }
+        awaitLock.leave();
+        for ( size_t i = 0; i < ready.size(); i++ )
+            ready[i].resume();
+        Session::onDataQueued(src);
+    }
+
+    void
+    onSendDequeued()
+    {
+        std::vector<std::coroutine_handle<> > ready;
+        awaitLock.enter();
+        size_t length = this->getSendQueueLength();
+        while ( !sendWaiters.empty() && length + ready.size() < sendCapacity ) {
+            ready.push_back(sendWaiters.front());
+            sendWaiters.pop_front();
+        }
+        awaitLock.leave();
+        for ( size_t i = 0; i < ready.size(); i++ )
+            ready[i].resume();
+        Session::onSendDequeued();
+    }
+
+private:
+    // checked again with the lock held, not to miss a notification
+    bool
+    waitData(DataAwaiter& w)
+    {
+        MutexLock lock(awaitLock);
+        if ( this->isWaiting(w.source) )
+            return false;
+        dataWaiters.push_back(&w);
+        return true;
+    }
+
+    bool
+    waitSend(std::coroutine_handle<> h)
+    {
+        MutexLock lock(awaitLock);
+        if ( this->getSendQueueLength() < sendCapacity )
+            return false;
+        sendWaiters.push_back(h);
+        return true;
+    }
+
+    Mutex awaitLock;
+    std::vector<DataAwaiter*> dataWaiters;
+    std::deque<std::coroutine_handle<> > sendWaiters;
+    size_t sendCapacity = 4;
+};
+
+/** @}*/ // awaitable
+
+END_NAMESPACE
+
+#endif  // __cpp_impl_coroutine
+
+#endif  //CCXX_RTP_AWAITABLE_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
@@ -38,7 +38,10 @@
 #define CCRTP_CHANNEL_H_
 
 #include <ccrtp/base.h>
+#include <ccrtp/uring.h>
 #include <commoncpp/socket.h>
+#include <deque>
+#include <vector>
 
 #ifndef _MSWINDOWS_
 #include <sys/ioctl.h>
@@ -89,6 +92,9 @@ NAMESPACE_COMMONCPP
  * should provide in order to specialize the ccRTP stack for different
  * underlying protocols.
  *
+ * The socket may be attached to an io_uring (see setUring()), which
+ * then receives and sends its datagrams.
+ *
  * @author Federico Montesino Pouzols <fedemp@altern.org>
  **/
 class RTPBaseUDPIPv4Socket : private UDPSocket
@@ -98,30 +104,64 @@ public:
      * Constructor for receiver.
      **/
     RTPBaseUDPIPv4Socket(const InetAddress& ia, tpport_t port) :
-        UDPSocket(ia,port)
+        UDPSocket(ia,port), ring(NULL), endpoint(NULL)
     { }
 
     inline ~RTPBaseUDPIPv4Socket()
-    { endSocket(); }
+    { setUring(NULL,NULL); endSocket(); }
+
+    /**
+     * Receive and send through an io_uring, or stop doing so.
+     *
+     * @param r ring, NULL to stop.
+     * @param tag given back by RTPUring::process() for the
+     *        datagrams received, NULL if the socket only sends.
+     * @return whether the socket is attached to the ring.
+     **/
+    inline bool
+    setUring(RTPUring* r, void* tag)
+    {
+        if ( ring )
+            ring->detach(endpoint);
+        endpoint = r ? r->attach(UDPSocket::so,tag) : NULL;
+        ring = endpoint ? r : NULL;
+        return NULL != endpoint;
+    }
 
     inline bool
     isPendingRecv(microtimeout_t timeout)
-    { return UDPSocket::isPending(UDPSocket::pendingInput, timeout); }
+    {
+        if ( endpoint )
+            return RTPUring::isPending(*endpoint);
+        return UDPSocket::isPending(UDPSocket::pendingInput, timeout);
+    }
 
     inline InetHostAddress
     getSender(tpport_t& port) const
-    { return UDPSocket::getSender(&port); }
+    {
+        if ( endpoint )
+            return RTPUring::getSender(*endpoint,port);
+        return UDPSocket::getSender(&port);
+    }
 
     inline size_t
     recv(unsigned char* buffer, size_t len)
-    { return UDPSocket::receive(buffer, len); }
+    {
+        if ( endpoint )
+            return RTPUring::recv(*endpoint,buffer,len);
+        return UDPSocket::receive(buffer, len);
+    }
 
     /**
      * Get size of next datagram waiting to be read.
      **/
     inline size_t
     getNextPacketSize() const
-    { size_t len; ccioctl(UDPSocket::so,FIONREAD,len); return len; }
+    {
+        if ( endpoint )
+            return RTPUring::getNextSize(*endpoint);
+        size_t len; ccioctl(UDPSocket::so,FIONREAD,len); return len;
+    }
 
     Socket::Error
     setMulticast(bool enable)
@@ -143,24 +183,48 @@ public:
      * Constructor for transmitter.
      **/
     RTPBaseUDPIPv4Socket() :
-        UDPSocket()
+        UDPSocket(), ring(NULL), endpoint(NULL)
     { }
 
     inline void
     setPeer(const InetAddress &ia, tpport_t port)
-        {UDPSocket::setPeer((InetHostAddress&)ia, port);}
+    {
+        if ( endpoint )
+            RTPUring::setPeer(*endpoint,ia,port);
+        UDPSocket::setPeer((InetHostAddress&)ia, port);
+    }
 
     inline size_t
     send(const unsigned char* const buffer, size_t len)
-    { return UDPSocket::send(buffer, len); }
+    {
+        if ( endpoint )
+            return RTPUring::send(*endpoint,buffer,len);
+        return UDPSocket::send(buffer, len);
+    }
 
     inline SOCKET getRecvSocket() const
     { return UDPSocket::so; }
 
+    /**
+     * The socket also receives, so it is kept open.
+     **/
+    inline void
+    closeSendSocket()
+    { }
+
+    inline size_t
+    getMemoryUsage() const
+    { return sizeof(*this); }
+
     // common
     inline void
     endSocket()
     { UDPSocket::endSocket(); }
+
+private:
+    // io_uring the socket is attached to, if any
+    RTPUring* ring;
+    RTPUringEndpoint* endpoint;
 };
 
 /**
@@ -187,11 +251,10 @@ template<class BaseSocket>
 class DualRTPChannel
 {
 public:
-    DualRTPChannel(const InetAddress& ia, tpport_t port)
-    {
-        recvSocket = new BaseSocket(ia,port);
-        sendSocket = new BaseSocket;
-    }
+    DualRTPChannel(const InetAddress& ia, tpport_t port) :
+        sendSocket(NULL), sendRing(NULL), peerPort(0), ttl(0),
+        ttlSet(false), multicast(false)
+    { recvSocket = new BaseSocket(ia,port); }
 
     inline ~DualRTPChannel()
     { delete sendSocket; delete recvSocket; }
@@ -216,7 +279,11 @@ public:
     setMulticast(bool enable)
     { Socket::Error error = recvSocket->setMulticast(enable);
       if (error) return error;
-      return sendSocket->setMulticast(enable); }
+      sendMutex.enter();
+      multicast = enable;
+      if ( sendSocket ) error = sendSocket->setMulticast(enable);
+      sendMutex.leave();
+      return error; }
 
     inline Socket::Error
     join(const InetMcastAddress& ia, uint32 iface)
@@ -227,28 +294,148 @@ public:
     { return recvSocket->drop(ia); }
 
         inline Socket::Error
-    setTimeToLive(unsigned char ttl)
-    { return sendSocket->setTimeToLive(ttl); }
+    setTimeToLive(unsigned char t)
+    { Socket::Error error = Socket::errSuccess;
+      sendMutex.enter();
+      ttl = t; ttlSet = true;
+      if ( sendSocket ) error = sendSocket->setTimeToLive(t);
+      sendMutex.leave();
+      return error; }
 
     inline void
     setPeer(const InetAddress& host, tpport_t port)
-    { sendSocket->setPeer(host,port); }
+    {
+        sendMutex.enter();
+        peerAddress = host.getAddress();
+        peerPort = port;
+        if ( sendSocket )
+            sendSocket->setPeer(host,port);
+        sendMutex.leave();
+    }
 
+    /**
+     * @return number of bytes sent, 0 if the send socket could
+     *         not be opened.
+     **/
     inline size_t
     send(const unsigned char* const buffer, size_t len)
-    { return sendSocket->send(buffer, len); }
+    {
+        size_t result = 0;
+        sendMutex.enter();
+        if ( sendSocket || openSocket() )
+            result = sendSocket->send(buffer, len);
+        sendMutex.leave();
+        return result;
+    }
 
     inline SOCKET getRecvSocket() const
     { return recvSocket->getRecvSocket(); }
 
+    /**
+     * Open the send socket now instead of on the first send, to
+     * know whether it can be opened.
+     *
+     * @return whether the send socket is open.
+     **/
+    inline bool
+    openSendSocket()
+    {
+        sendMutex.enter();
+        bool result = sendSocket || openSocket();
+        sendMutex.leave();
+        return result;
+    }
+
+    /**
+     * Close the send socket, to save it while the channel does not
+     * send. It is opened again, with the same settings, when
+     * something is sent.
+     **/
+    inline void
+    closeSendSocket()
+    {
+        sendMutex.enter();
+        delete sendSocket;
+        sendSocket = NULL;
+        sendMutex.leave();
+    }
+
+    /**
+     * Get the memory used by the channel and its sockets, not
+     * counting the buffers of the kernel.
+     **/
+    inline size_t
+    getMemoryUsage() const
+    { return sizeof(*this) + sizeof(BaseSocket) * (sendSocket ? 2 : 1); }
+
+    /**
+     * Receive and send through an io_uring, or stop doing so. The
+     * base socket must support it (see
+     * RTPBaseUDPIPv4Socket::setUring()).
+     *
+     * @param ring ring, NULL to stop.
+     * @param tag given back by RTPUring::process() for the
+     *        datagrams received.
+     * @return whether both sockets are attached to the ring.
+     **/
+    inline bool
+    setUring(RTPUring* ring, void* tag)
+    {
+        bool result = recvSocket->setUring(ring,tag);
+        sendMutex.enter();
+        sendRing = ring;
+        if ( sendSocket )
+            result = sendSocket->setUring(ring,NULL) && result;
+        sendMutex.leave();
+        return result;
+    }
+
     // common.
     inline void
     endSocket()
-    { sendSocket->endSocket(); recvSocket->endSocket(); }
+    {
+        sendMutex.enter();
+        if ( sendSocket )
+            sendSocket->endSocket();
+        sendMutex.leave();
+        recvSocket->endSocket();
+    }
 
 private:
+    // the send socket is only opened when first needed, with the
+    // settings given so far. Called with sendMutex held.
+    bool
+    openSocket()
+    {
+        BaseSocket* socket = new BaseSocket;
+        if ( INVALID_SOCKET == socket->getRecvSocket() ) {
+            delete socket;
+            return false;
+        }
+        if ( multicast )
+            socket->setMulticast(true);
+        if ( ttlSet )
+            socket->setTimeToLive(ttl);
+        if ( peerPort )
+            socket->setPeer(InetHostAddress(peerAddress),peerPort);
+        if ( sendRing )
+            socket->setUring(sendRing,NULL);
+        sendSocket = socket;
+        return true;
+    }
+
+    // application threads send too, so opening and closing the
+    // send socket, and its settings, are guarded.
+    Mutex sendMutex;
     BaseSocket* sendSocket;
     BaseSocket* recvSocket;
+    // settings of the send socket
+    RTPUring* sendRing;
+    struct in_addr peerAddress;
+    tpport_t peerPort;
+    unsigned char ttl;
+    bool ttlSet;
+    bool multicast;
 };
 
 #ifdef  CCXX_IPV6
@@ -340,6 +527,17 @@ public:
     inline SOCKET getRecvSocket() const
     { return UDPSocket::so; }
 
+    /**
+     * The socket also receives, so it is kept open.
+     **/
+    inline void
+    closeSendSocket()
+    { }
+
+    inline size_t
+    getMemoryUsage() const
+    { return sizeof(*this); }
+
     // common
     inline void
     endSocket()
@@ -370,11 +568,10 @@ template<class BaseSocket>
 class DualRTPChannelIPV6
 {
 public:
-    DualRTPChannelIPV6(const IPV6Host& ia, tpport_t port)
-    {
-        recvSocket = new BaseSocket(ia,port);
-        sendSocket = new BaseSocket;
-    }
+    DualRTPChannelIPV6(const IPV6Host& ia, tpport_t port) :
+        sendSocket(NULL), peerPort(0), ttl(0), ttlSet(false),
+        multicast(false)
+    { recvSocket = new BaseSocket(ia,port); }
 
     inline ~DualRTPChannelIPV6()
     { delete sendSocket; delete recvSocket; }
@@ -399,7 +596,11 @@ public:
     setMulticast(bool enable)
     { Socket::Error error = recvSocket->setMulticast(enable);
       if (error) return error;
-      return sendSocket->setMulticast(enable); }
+      sendMutex.enter();
+      multicast = enable;
+      if ( sendSocket ) error = sendSocket->setMulticast(enable);
+      sendMutex.leave();
+      return error; }
 
     inline Socket::Error
     join(const IPV6Multicast& ia, uint32 iface)
@@ -410,28 +611,112 @@ public:
     { return recvSocket->drop(ia); }
 
         inline Socket::Error
-    setTimeToLive(unsigned char ttl)
-    { return sendSocket->setTimeToLive(ttl); }
+    setTimeToLive(unsigned char t)
+    { Socket::Error error = Socket::errSuccess;
+      sendMutex.enter();
+      ttl = t; ttlSet = true;
+      if ( sendSocket ) error = sendSocket->setTimeToLive(t);
+      sendMutex.leave();
+      return error; }
 
     inline void
     setPeer(const IPV6Host& host, tpport_t port)
-    { sendSocket->setPeer(host,port); }
+    {
+        sendMutex.enter();
+        peerAddress = host.getAddress();
+        peerPort = port;
+        if ( sendSocket )
+            sendSocket->setPeer(host,port);
+        sendMutex.leave();
+    }
 
+    /**
+     * @return number of bytes sent, 0 if the send socket could
+     *         not be opened.
+     **/
     inline size_t
     send(const unsigned char* const buffer, size_t len)
-    { return sendSocket->send(buffer, len); }
+    {
+        size_t result = 0;
+        sendMutex.enter();
+        if ( sendSocket || openSocket() )
+            result = sendSocket->send(buffer, len);
+        sendMutex.leave();
+        return result;
+    }
 
     inline SOCKET getRecvSocket() const
     { return recvSocket->getRecvSocket(); }
 
+    /**
+     * Open the send socket now (see
+     * DualRTPChannel::openSendSocket()).
+     **/
+    inline bool
+    openSendSocket()
+    {
+        sendMutex.enter();
+        bool result = sendSocket || openSocket();
+        sendMutex.leave();
+        return result;
+    }
+
+    /**
+     * Close the send socket while the channel does not send (see
+     * DualRTPChannel::closeSendSocket()).
+     **/
+    inline void
+    closeSendSocket()
+    {
+        sendMutex.enter();
+        delete sendSocket;
+        sendSocket = NULL;
+        sendMutex.leave();
+    }
+
+    inline size_t
+    getMemoryUsage() const
+    { return sizeof(*this) + sizeof(BaseSocket) * (sendSocket ? 2 : 1); }
+
     // common.
     inline void
     endSocket()
-    { sendSocket->endSocket(); recvSocket->endSocket(); }
+    {
+        sendMutex.enter();
+        if ( sendSocket )
+            sendSocket->endSocket();
+        sendMutex.leave();
+        recvSocket->endSocket();
+    }
 
 private:
+    bool
+    openSocket()
+    {
+        BaseSocket* socket = new BaseSocket;
+        if ( INVALID_SOCKET == socket->getRecvSocket() ) {
+            delete socket;
+            return false;
+        }
+        if ( multicast )
+            socket->setMulticast(true);
+        if ( ttlSet )
+            socket->setTimeToLive(ttl);
+        if ( peerPort )
+            socket->setPeer(IPV6Host(peerAddress),peerPort);
+        sendSocket = socket;
+        return true;
+    }
+
+    Mutex sendMutex;
     BaseSocket* sendSocket;
     BaseSocket* recvSocket;
+    // settings of the send socket
+    struct in6_addr peerAddress;
+    tpport_t peerPort;
+    unsigned char ttl;
+    bool ttlSet;
+    bool multicast;
 };
 
 
@@ -441,6 +726,171 @@ typedef SingleRTPChannelIPV6 SymmetricRTPChannelIPV6;
 
 #endif
 
+/**
+ * @class DelayRTPChannel
+ * @short A channel that delays packets sent and limits their rate.
+ *
+ * Packets sent are held for a fixed delay and, optionally, go
+ * through a bottleneck link of a given bitrate whose queue drops
+ * packets when it exceeds a maximum queuing delay. This emulates a
+ * constrained network path, for instance over 127.0.0.1, to test
+ * congestion control (see AVPFQueue::setTransportCC()).
+ *
+ * Packets held are sent when due by send() and isPendingRecv(), so
+ * the channel must also be the one the service thread waits on:
+ * instantiate the RTP stack with it as the data channel, based on a
+ * single (symmetric) channel such as SingleRTPChannel.
+ **/
+template<class BaseChannel>
+class DelayRTPChannel : public BaseChannel
+{
+public:
+    /**
+     * Constructor for receiver.
+     **/
+    DelayRTPChannel(const InetAddress& ia, tpport_t port) :
+        BaseChannel(ia,port), peerPort(0), delay(0), bottleneck(0),
+        queueLimit(defaultQueueLimit), dropped(0)
+    { timerclear(&linkFree); }
+
+    /**
+     * Constructor for transmitter.
+     **/
+    DelayRTPChannel() :
+        BaseChannel(), peerPort(0), delay(0), bottleneck(0),
+        queueLimit(defaultQueueLimit), dropped(0)
+    { timerclear(&linkFree); }
+
+    /**
+     * Set the delay added to every packet.
+     *
+     * @param to delay in microseconds.
+     **/
+    inline void
+    setDelay(microtimeout_t to)
+    { delay = to; }
+
+    /**
+     * Set the bitrate of the bottleneck link.
+     *
+     * @param bps bitrate in bits per second, 0 for no limit.
+     * @param limit maximum queuing delay in microseconds, packets
+     *        that would wait longer are dropped.
+     **/
+    inline void
+    setBottleneck(uint32 bps, microtimeout_t limit = defaultQueueLimit)
+    { bottleneck = bps; queueLimit = limit; }
+
+    /**
+     * Get the number of packets dropped by the bottleneck queue.
+     **/
+    inline uint32
+    getDroppedCount() const
+    { return dropped; }
+
+    inline bool
+    isPendingRecv(microtimeout_t timeout)
+    {
+        microtimeout_t wait = flush();
+        if ( wait && wait < timeout )
+            timeout = wait;
+        return BaseChannel::isPendingRecv(timeout);
+    }
+
+    inline void
+    setPeer(const InetAddress& ia, tpport_t port)
+    { peer = InetHostAddress(ia.getAddress()); peerPort = port; }
+
+    size_t
+    send(const unsigned char* const buffer, size_t len)
+    {
+        timeval now, due;
+        SysTime::gettimeofday(&now,NULL);
+        lock.enter();
+        due = now;
+        if ( bottleneck ) {
+            if ( timercmp(&linkFree,&now,<) )
+                linkFree = now;
+            timeval queued;
+            timersub(&linkFree,&now,&queued);
+            if ( timeval2microtimeout(queued) > queueLimit ) {
+                dropped++;
+                lock.leave();
+                return len;
+            }
+            timeval tmp = microtimeout2Timeval
+                (static_cast<microtimeout_t>
+                 (static_cast<uint64>(len) * 8 * 1000000 / bottleneck));
+            timeradd(&linkFree,&tmp,&linkFree);
+            due = linkFree;
+        }
+        timeval tmp = microtimeout2Timeval(delay);
+        timeradd(&due,&tmp,&due);
+        Held held;
+        held.due = due;
+        held.data.assign(buffer,buffer + len);
+        held.peer = peer;
+        held.port = peerPort;
+        packets.push_back(held);
+        lock.leave();
+        flush();
+        return len;
+    }
+
+private:
+    static const microtimeout_t defaultQueueLimit = 500000;
+
+    struct Held
+    {
+        timeval due;
+        std::vector<unsigned char> data;
+        InetHostAddress peer;
+        tpport_t port;
+    };
+
+    /**
+     * Send the packets due.
+     *
+     * @return microseconds till the next packet is due, 0 if
+     *         none is held.
+     **/
+    microtimeout_t
+    flush()
+    {
+        timeval now;
+        SysTime::gettimeofday(&now,NULL);
+        microtimeout_t wait = 0;
+        lock.enter();
+        while ( !packets.empty() ) {
+            Held& held = packets.front();
+            if ( timercmp(&now,&held.due,<) ) {
+                timeval tmp;
+                timersub(&held.due,&now,&tmp);
+                wait = timeval2microtimeout(tmp);
+                if ( 0 == wait )
+                    wait = 1;
+                break;
+            }
+            BaseChannel::setPeer(held.peer,held.port);
+            BaseChannel::send(&held.data[0],held.data.size());
+            packets.pop_front();
+        }
+        lock.leave();
+        return wait;
+    }
+
+    Mutex lock;
+    std::deque<Held> packets;
+    InetHostAddress peer;
+    tpport_t peerPort;
+    microtimeout_t delay;
+    uint32 bottleneck;
+    microtimeout_t queueLimit;
+    // when the bottleneck link is done with the packets queued
+    timeval linkFree;
+    uint32 dropped;
+};
+
 typedef DualRTPChannel<RTPBaseUDPIPv4Socket> DualRTPUDPIPv4Channel;
 
 /**
@@ -454,6 +904,49 @@ typedef RTPBaseUDPIPv4Socket SingleRTPChannel;
  **/
 typedef SingleRTPChannel SymmetricRTPChannel;
 
+/**
+ * @class RTPSocketWait
+ * @short Waiting for packets at microsecond resolution.
+ *
+ * The isPendingRecv() methods of the sockets take milliseconds.
+ * These wait for the receive socket of a channel (see
+ * getRecvSocket()) till a deadline given in microseconds, either
+ * sleeping or spinning.
+ **/
+class __EXPORT RTPSocketWait
+{
+public:
+    /**
+     * Sleep till the socket is readable, or the timeout expires.
+     *
+     * @param so socket.
+     * @param timeout maximum wait, in microseconds.
+     * @return whether the socket is readable.
+     **/
+    static bool
+    isReadable(SOCKET so, microtimeout_t timeout);
+
+    /**
+     * Like isReadable(), but checking the socket again and again
+     * without sleeping. Uses a processor the whole time.
+     **/
+    static bool
+    spinReadable(SOCKET so, microtimeout_t timeout);
+
+    /**
+     * Let the kernel busy poll the device queue of the socket for
+     * packets, for up to the time given, when the socket is read or
+     * checked and has nothing (SO_BUSY_POLL, Linux only). Times
+     * longer than the net.core.busy_read sysctl need CAP_NET_ADMIN.
+     *
+     * @param so socket.
+     * @param usec busy poll time, 0 to stop.
+     * @return whether the option could be set.
+     **/
+    static bool
+    setBusyPoll(SOCKET so, microtimeout_t usec);
+};
+
 /** @}*/ // sockets
 
 END_NAMESPACE
@@ -0,0 +1,478 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file congestion.h
+ *
+ * @short Transport-wide congestion control: transport-cc feedback
+ * and send side bandwidth estimation.
+ **/
+
+#ifndef CCXX_RTP_CONGESTION_H_
+#define CCXX_RTP_CONGESTION_H_
+
+#include <ccrtp/hdrext.h>
+#include <map>
+#include <vector>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @defgroup congestion Congestion control.
+ * @{
+ **/
+
+/**
+ * @class TransportFeedbackRecorder
+ * @short Receiver side of transport-wide congestion control.
+ *
+ * Records the arrival time of the packets received with a
+ * transport-wide sequence number header extension, and builds the
+ * FCI of transport-cc feedback messages (RTPFB, FMT 15, as in
+ * draft-holmer-rmcat-transport-wide-cc-extensions-01) reporting
+ * them. Every packet is reported once.
+ **/
+class __EXPORT TransportFeedbackRecorder
+{
+public:
+    TransportFeedbackRecorder();
+
+    /**
+     * Record the arrival of a packet.
+     *
+     * @param seqNum transport-wide sequence number.
+     * @param mediaSSRC SSRC identifier of the packet.
+     * @param arrival arrival time.
+     **/
+    void
+    record(uint16 seqNum, uint32 mediaSSRC, const timeval& arrival);
+
+    /**
+     * Whether there are packets not reported yet.
+     **/
+    bool
+    isPending() const;
+
+    /**
+     * Build the FCI of a feedback message reporting the packets
+     * recorded since the last one, as many as fit.
+     *
+     * @param fci where to write the FCI.
+     * @param available room in fci, in octets.
+     * @param mediaSSRC set to the SSRC of the last packet recorded.
+     * @return length of the FCI, multiple of 4. 0 if there is
+     *         nothing to report or no room.
+     **/
+    size_t
+    build(unsigned char* fci, size_t available, uint32& mediaSSRC);
+
+    void
+    reset();
+
+private:
+    // arrival times in microseconds, by unwrapped sequence number
+    typedef std::map<int64,int64> ArrivalMap;
+
+    mutable Mutex lock;
+    ArrivalMap arrivals;
+    int64 lastSeqNum;
+    // first sequence number not reported yet
+    int64 nextBase;
+    bool started;
+    uint32 lastMediaSSRC;
+    uint8 feedbackCount;
+};
+
+/**
+ * @class DelayBasedEstimator
+ * @short Delay based bandwidth estimation.
+ *
+ * The delay based part of Google Congestion Control
+ * (draft-ietf-rmcat-gcc-02). Packets sent within 5 ms form a group.
+ * The variation of the one way delay between groups is filtered
+ * with a trendline estimator, and over-use is detected with an
+ * adaptive threshold. The rate is controlled with AIMD: decreased to
+ * 85% of the incoming rate on over-use, held on under-use and
+ * increased by up to 8% per second otherwise.
+ *
+ * Send and arrival times need not come from the same clock. Objects
+ * of this class are not thread safe.
+ **/
+class __EXPORT DelayBasedEstimator
+{
+public:
+    typedef enum {
+        usageNormal,    ///< Delay is stable.
+        usageOver,      ///< Delay is increasing: the path is congested.
+        usageUnder      ///< Delay is decreasing: queues are draining.
+    }       UsageState;
+
+    static const uint32 defaultStartBitrate;
+    static const uint32 defaultMinBitrate;
+    static const uint32 defaultMaxBitrate;
+
+    DelayBasedEstimator(uint32 start = defaultStartBitrate,
+                uint32 minimum = defaultMinBitrate,
+                uint32 maximum = defaultMaxBitrate);
+
+    /**
+     * Set the start, minimum and maximum bitrates and restart the
+     * estimation.
+     **/
+    void
+    reset(uint32 start, uint32 minimum, uint32 maximum);
+
+    /**
+     * Account a packet received, in order of arrival.
+     *
+     * @param sent send time in microseconds, sender clock.
+     * @param arrival arrival time in microseconds, receiver clock.
+     **/
+    void
+    addPacket(int64 sent, int64 arrival);
+
+    /**
+     * Update the bitrate after some packets have been accounted.
+     *
+     * @param incoming bitrate the receiver gets, 0 if unknown.
+     * @param now current time in microseconds.
+     * @return the new bitrate.
+     **/
+    uint32
+    update(uint32 incoming, int64 now);
+
+    inline uint32
+    getBitrate() const
+    { return bitrate; }
+
+    inline UsageState
+    getUsageState() const
+    { return usage; }
+
+private:
+    struct PacketGroup
+    {
+        int64 firstSent;
+        int64 lastSent;
+        int64 lastArrival;
+        bool empty;
+    };
+
+    void
+    updateTrendline(double sendDelta, double arrivalDelta,
+            int64 arrival);
+
+    void
+    detect(double trend, double sendDelta, int64 arrival);
+
+    uint32 minBitrate, maxBitrate, bitrate;
+    // inter-group delay variation
+    PacketGroup currentGroup, previousGroup;
+    // trendline estimator
+    double accumulatedDelay, smoothedDelay;
+    int64 firstArrival;
+    std::vector<std::pair<double,double> > delayWindow;
+    uint32 numDeltas;
+    double previousTrend;
+    // over-use detector
+    UsageState usage;
+    double threshold;
+    int64 lastThresholdUpdate;
+    double timeOverUsing;
+    uint32 overuseCount;
+    // over-use detected, not acted upon yet
+    bool overuseDetected;
+    // AIMD rate control
+    int64 lastRateUpdate;
+};
+
+/**
+ * @class SendSideEstimator
+ * @short Send side bandwidth estimation from transport-cc feedback.
+ *
+ * A delay based estimate (see DelayBasedEstimator), using the send
+ * times recorded and the arrival times reported, and a loss based
+ * estimate are combined as in Google Congestion Control. The loss
+ * based part is updated every second: decreased when more than 10%
+ * of the packets are lost and increased by 5% when less than 2% are.
+ *
+ * The target bitrate is the lower of both, within the bounds set.
+ **/
+class __EXPORT SendSideEstimator
+{
+public:
+    SendSideEstimator(uint32 start = DelayBasedEstimator::defaultStartBitrate,
+              uint32 minimum = DelayBasedEstimator::defaultMinBitrate,
+              uint32 maximum = DelayBasedEstimator::defaultMaxBitrate);
+
+    /**
+     * Set the start, minimum and maximum bitrates and restart the
+     * estimation.
+     **/
+    void
+    setBitrates(uint32 start, uint32 minimum, uint32 maximum);
+
+    /**
+     * Record a packet sent.
+     *
+     * @param seqNum transport-wide sequence number.
+     * @param size size of the packet, in octets.
+     * @param sent time it was sent.
+     **/
+    void
+    onPacketSent(uint16 seqNum, size_t size, const timeval& sent);
+
+    /**
+     * Process a transport-cc feedback message.
+     *
+     * @param fci FCI of the feedback message.
+     * @param len length of the FCI.
+     * @param now current time.
+     * @return whether the target bitrate changed.
+     **/
+    bool
+    onTransportFeedback(const unsigned char* fci, size_t len,
+                const timeval& now);
+
+    /**
+     * Get the target bitrate, in bits per second.
+     **/
+    inline uint32
+    getTargetBitrate() const
+    { return targetBitrate; }
+
+    inline uint32
+    getDelayBasedBitrate() const
+    { return delay.getBitrate(); }
+
+    inline uint32
+    getLossBasedBitrate() const
+    { return lossBitrate; }
+
+    /**
+     * Get the rate at which the receiver got packets, in bits per
+     * second. 0 if unknown yet.
+     **/
+    inline uint32
+    getAckedBitrate() const
+    { return ackedBitrate; }
+
+    /**
+     * Get the fraction of packets lost during the last second.
+     **/
+    inline float
+    getLossFraction() const
+    { return lossFraction; }
+
+    inline DelayBasedEstimator::UsageState
+    getUsageState() const
+    { return delay.getUsageState(); }
+
+private:
+    struct SentPacket
+    {
+        int64 sent;
+        size_t size;
+    };
+
+    struct PacketResult
+    {
+        int64 sent;
+        int64 arrival;
+        size_t size;
+    };
+
+    int64
+    unwrap(uint16 seqNum) const;
+
+    void
+    updateLossBitrate(uint32 lost, uint32 total, int64 now);
+
+    void
+    updateAckedBitrate(const PacketResult& packet);
+
+    typedef std::map<int64,SentPacket> SentMap;
+
+    mutable Mutex lock;
+    DelayBasedEstimator delay;
+    uint32 minBitrate, maxBitrate;
+    uint32 targetBitrate, lossBitrate, ackedBitrate;
+    float lossFraction;
+    // packets sent, by unwrapped transport-wide sequence number
+    SentMap sentPackets;
+    int64 lastSentSeqNum;
+    bool sentStarted;
+    // loss based control
+    uint32 lostPackets, reportedPackets;
+    int64 lastLossUpdate;
+    // acknowledged bitrate
+    uint64 ackedBytes;
+    int64 ackedWindowStart;
+};
+
+/**
+ * @class TransportSequenceExtension
+ * @short Transport-wide sequence number header extension.
+ *
+ * Numbers the data packets sent in a session with a two octet
+ * transport-wide sequence number, recording their send times in a
+ * SendSideEstimator, and records the arrival of the packets received
+ * numbered this way for transport-cc feedback. Register it with
+ * RTPQueueBase::addHeaderExtension().
+ **/
+class __EXPORT TransportSequenceExtension : public HeaderExtension
+{
+public:
+    /**
+     * @param estimator where to record the packets sent, NULL if
+     *        none.
+     **/
+    TransportSequenceExtension(SendSideEstimator* estimator = NULL);
+
+    /**
+     * Get the arrivals of the packets received.
+     **/
+    inline TransportFeedbackRecorder&
+    getRecorder()
+    { return recorder; }
+
+    inline uint8
+    getSendLength()
+    { return 2; }
+
+    void
+    write(unsigned char* data, uint8 len, const OutgoingRTPPkt& packet);
+
+    void
+    onSent(const unsigned char* data, uint8 len, size_t size,
+           const timeval& when);
+
+    void
+    onReceived(const unsigned char* data, uint8 len,
+           const IncomingRTPPkt& packet, const timeval& arrival);
+
+private:
+    SendSideEstimator* estimator;
+    TransportFeedbackRecorder recorder;
+    // written with the sending queue locked
+    uint16 nextSeqNum;
+};
+
+/**
+ * @class RemoteRateEstimator
+ * @short Receiver side bandwidth estimation for a media source.
+ *
+ * For senders that do not number their packets transport-wide, the
+ * delay based estimation (see DelayBasedEstimator) is run at the
+ * receiver, taking the RTP timestamps of the packets as their send
+ * times. The estimate is sent back in REMB messages
+ * (draft-alvestrand-rmcat-remb-03).
+ *
+ * Objects of this class are not thread safe.
+ **/
+class __EXPORT RemoteRateEstimator
+{
+public:
+    RemoteRateEstimator(uint32 start = DelayBasedEstimator::defaultStartBitrate,
+                uint32 minimum = DelayBasedEstimator::defaultMinBitrate,
+                uint32 maximum = DelayBasedEstimator::defaultMaxBitrate);
+
+    /**
+     * Account a packet received from the source.
+     *
+     * @param timestamp RTP timestamp of the packet.
+     * @param clockRate RTP clock rate.
+     * @param size size of the packet, in octets.
+     * @param arrival arrival time.
+     * @return whether the estimate has just fallen well below the
+     *         last one reported, so that it should be reported
+     *         without waiting.
+     **/
+    bool
+    onPacket(uint32 timestamp, uint32 clockRate, size_t size,
+         const timeval& arrival);
+
+    /**
+     * Get the estimate, in bits per second.
+     **/
+    inline uint32
+    getEstimate() const
+    { return delay.getBitrate(); }
+
+    /**
+     * Get the estimate to be reported, and remember it as the last
+     * one reported.
+     **/
+    uint32
+    report();
+
+    /**
+     * Get the rate packets are received at, in bits per second. 0
+     * if unknown yet.
+     **/
+    inline uint32
+    getIncomingBitrate() const
+    { return incomingBitrate; }
+
+    inline DelayBasedEstimator::UsageState
+    getUsageState() const
+    { return delay.getUsageState(); }
+
+private:
+    DelayBasedEstimator delay;
+    // highest RTP timestamp received, unwrapped
+    int64 lastTimestamp;
+    bool started;
+    uint32 incomingBitrate;
+    uint64 incomingBytes;
+    int64 incomingWindowStart;
+    uint32 reportedBitrate;
+    // a decrease has been signalled and not reported yet
+    bool decreasePending;
+};
+
+/** @}*/ // congestion
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_CONGESTION_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
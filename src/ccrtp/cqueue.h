@@ -45,7 +45,9 @@
 
 #include <ccrtp/ioqueue.h>
 #include <ccrtp/CryptoContextCtrl.h>
+#include <ccrtp/congestion.h>
 #include <list>
+#include <map>
 
 NAMESPACE_COMMONCPP
 
@@ -271,7 +273,7 @@ protected:
      * Build and send RTCP packets following timing rules
      * (including the "timer reconsideration" algorithm).
      **/
-    void
+    virtual void
     controlTransmissionService();
 
     /**
@@ -281,6 +283,15 @@ protected:
     void
     controlReceptionService();
 
+    /**
+     * Process an RTCP compound packet from the control reception
+     * socket, which must be readable. For services notified of
+     * readiness, instead of controlReceptionService(), which
+     * checks for packets every RTCP check interval.
+     **/
+    void
+    controlReadyService();
+
     /**
      * Appy collision and loop detection and correction algorithm
      * when receiving RTCP packets. Follows section 8.2 in
@@ -362,6 +373,15 @@ protected:
     getRTCPCheckInterval()
     { return rtcpCheckInterval; }
 
+    /**
+     * Set how often incoming RTCP packets are checked for. The
+     * default is 1/4 seconds.
+     *
+     * @param interval check interval in microseconds.
+     **/
+    void
+    setRTCPCheckInterval(microtimeout_t interval);
+
     /**
      * Get the number of data packets sent at the time the last SR
      * was generated.
@@ -405,20 +425,73 @@ protected:
     size_t
     sendControlToDestinations(unsigned char* buffer, size_t len);
 
-private:
-    QueueRTCPManager(const QueueRTCPManager &o);
-
-    QueueRTCPManager&
-    operator=(const QueueRTCPManager &o);
+    /**
+     * Computes the interval for sending RTCP compound packets,
+     * based on the average size of RTCP packets sent and
+     * received, and the current estimated number of participants
+     * in the session.
+     *
+     * @note This currently follows the rules in section 6 of
+     *       RFC 3550
+     * @todo make it more flexible as recommended in the draft. For now,
+     * we have setMinRTCPInterval.
+     *
+     * @return interval for sending RTCP compound packets
+     **/
+    virtual timeval
+    computeRTCPInterval();
 
     /**
-     * Posting of RTCP messages.
+     * Posting of RTCP messages. Profiles may call this to send a
+     * compound packet out of the regular schedule (for instance,
+     * early feedback).
      *
      * @return std::size_t number of octets sent
      */
     size_t
     dispatchControlPacket();
 
+    /**
+     * A plugin point for profile specific packets to be appended
+     * at the end of every RTCP compound packet sent (after the
+     * SDES packet). This is the sending counterpart of
+     * onGotRRSRExtension(). The default implementation appends the
+     * REMB messages of the sources whose bandwidth is estimated
+     * (see setRemoteBitrateEstimation()).
+     *
+     * @param buffer where to write the packets.
+     * @param available room in buffer, in octets.
+     * @return length of the packets written, multiple of 4.
+     **/
+    virtual uint16
+    packRTCPExtension(unsigned char* buffer, uint16 available);
+
+    /**
+     * Get the time the next regular RTCP compound packet is due.
+     **/
+    inline timeval
+    getNextRTCPTime() const
+    { return reconsInfo.rtcpTn; }
+
+    /**
+     * Get the time the next RTCP compound packet may be due, regular
+     * or not: controlTransmissionService() must be run then at the
+     * latest.
+     **/
+    inline virtual timeval
+    getNextControlTime()
+    { return reconsInfo.rtcpTn; }
+
+    inline bool
+    isControlServiceActive() const
+    { return controlServiceActive; }
+
+private:
+    QueueRTCPManager(const QueueRTCPManager &o);
+
+    QueueRTCPManager&
+    operator=(const QueueRTCPManager &o);
+
     /**
      * For picking up incoming RTCP packets if they are waiting. A
      * timeout for the maximum interval since the last RTCP packet
@@ -433,22 +506,6 @@ private:
     void
     takeInControlPacket();
 
-    /**
-     * Computes the interval for sending RTCP compound packets,
-     * based on the average size of RTCP packets sent and
-     * received, and the current estimated number of participants
-     * in the session.
-     *
-     * @note This currently follows the rules in section 6 of
-     *       RFC 3550
-     * @todo make it more flexible as recommended in the draft. For now,
-     * we have setMinRTCPInterval.
-     *
-     * @return interval for sending RTCP compound packets
-     **/
-    virtual timeval
-    computeRTCPInterval();
-
     /**
      * Choose which should be the type of the next SDES item
      * sent. This method is called when packing SDES chunks in a
@@ -520,6 +577,32 @@ private:
     uint8
     packReportBlocks(RRBlock* blocks, uint16& len, uint16& available);
 
+    /**
+     * Fill in the sender info block of a SR.
+     *
+     * @param si sender info block to fill in.
+     * @param now current time.
+     * @param rate RTP clock rate of the stream.
+     * @param initialTimestamp timestamp base of the stream.
+     * @param packets packets sent so far by the stream.
+     * @param octets payload octets sent so far by the stream.
+     **/
+    void
+    fillSenderInfo(SenderInfo& si, const timeval& now, uint32 rate,
+               uint32 initialTimestamp, uint32 packets, uint32 octets);
+
+    /**
+     * Pack a SR without report blocks for every local stream
+     * other than the main one that has sent data since the last
+     * report, while there is room for it and for its SDES CNAME
+     * chunk.
+     *
+     * @param len provisionary length of the RTCP compound packet
+     * @param available octets available for the reports.
+     **/
+    void
+    packLocalStreamsSR(uint16& len, uint16 available);
+
     /**
      * Builds an SDES RTCP packet. Each chunk is built following
      * appendix A.4 in draft-ietf-avt-rtp-new.
@@ -749,6 +832,331 @@ protected:
     { }
 };
 
+/**
+ * @class AVPFQueue
+ * @short RTP/RTCP queue for the extended audio/video profile for
+ * RTCP-based feedback (AVPF, RFC 4585).
+ *
+ * Feedback messages (generic NACK, PLI and FIR) are appended to the
+ * RTCP compound packets. When feedback is pending, an early RTCP
+ * packet is sent if the timing rules of RFC 4585 allow it: at most
+ * one early packet between two regular ones, with a random delay
+ * of up to half the regular interval when there are more than two
+ * members. After an early packet, the next regular one is delayed
+ * by one more regular interval.
+ *
+ * Gaps in the sequence numbers of the sources received are detected
+ * and the packets missing are negatively acknowledged, unless they
+ * arrive in the meantime. Incoming feedback is delivered through
+ * the onGotNACK(), onGotPLI(), onGotFIR() and onGotFeedback()
+ * virtuals.
+ *
+ * The 5 seconds minimum RTCP interval of AVP does not apply; the
+ * minimum interval between regular RTCP packets is trr-int (see
+ * setRRInterval()), 0 by default. Incoming RTCP packets are checked
+ * for every 10 ms, so that feedback is received in time.
+ **/
+class __EXPORT AVPFQueue : public AVPQueue
+{
+public:
+    /**
+     * Enable or disable the negative acknowledgement of the
+     * packets lost. It is enabled by default.
+     **/
+    void
+    setNACKEnabled(bool enable);
+
+    inline bool
+    isNACKEnabled() const
+    { return nackEnabled; }
+
+    /**
+     * Set how many RTCP packets a packet lost is negatively
+     * acknowledged in, at most.
+     *
+     * @param retries number of NACKs per packet, 2 by default.
+     **/
+    inline void
+    setNACKRetries(uint8 retries)
+    { nackRetries = retries; }
+
+    /**
+     * Set the minimum interval between regular RTCP packets
+     * (trr-int parameter of RFC 4585). Feedback may still be sent
+     * in early packets in between.
+     *
+     * @param interval minimum interval in microseconds, 0 for none.
+     **/
+    void
+    setRRInterval(microtimeout_t interval);
+
+    inline microtimeout_t
+    getRRInterval() const
+    { return rrInterval; }
+
+    /**
+     * Negatively acknowledge a packet of a source.
+     *
+     * @param ssrc SSRC identifier of the media source.
+     * @param seqNum sequence number of the packet missing.
+     **/
+    void
+    requestNACK(uint32 ssrc, uint16 seqNum);
+
+    /**
+     * Send a Picture Loss Indication to a media source.
+     *
+     * @param ssrc SSRC identifier of the media source.
+     **/
+    void
+    requestPLI(uint32 ssrc);
+
+    /**
+     * Send a Full Intra Request (RFC 5104) to a media source.
+     * Each call is a new request, with a new command sequence
+     * number.
+     *
+     * @param ssrc SSRC identifier of the media source.
+     **/
+    void
+    requestFIR(uint32 ssrc);
+
+    /**
+     * Get the number of early RTCP packets sent so far.
+     **/
+    inline uint32
+    getEarlyRTCPPacketCount() const
+    { return earlyCount; }
+
+    /**
+     * Enable transport-wide congestion control: data packets carry
+     * a transport-wide sequence number header extension, the
+     * receiver reports their arrival in transport-cc feedback
+     * messages, and the sender estimates the available bandwidth
+     * from them. The estimate sets the pacing rate (see
+     * OutgoingDataQueue::setPacingRate()) and is notified with
+     * onTargetBitrate(), for the application to adapt its encoder.
+     *
+     * Feedback messages are sent every feedback interval, in their
+     * own compound RTCP packets, regardless of the early packets
+     * rules.
+     *
+     * @param id header extension identifier (1 to 255), 0 to stop.
+     * @return whether the identifier is valid.
+     **/
+    bool
+    setTransportCC(uint8 id);
+
+    /**
+     * Set how often transport-cc feedback is sent.
+     *
+     * @param interval interval in microseconds, 100 ms by default.
+     **/
+    inline void
+    setTransportFeedbackInterval(microtimeout_t interval)
+    { transportFeedbackInterval = interval; }
+
+    /**
+     * Set the pacing rate relative to the estimated bitrate.
+     *
+     * @param factor pacing rate / target bitrate, 2.5 by default.
+     *        0 disables pacing.
+     **/
+    inline void
+    setPacingFactor(float factor)
+    { pacingFactor = factor; }
+
+    /**
+     * Get the send side bandwidth estimator, to configure it (see
+     * SendSideEstimator::setBitrates()) or query the estimates.
+     **/
+    inline SendSideEstimator&
+    getBandwidthEstimator()
+    { return estimator; }
+
+protected:
+    AVPFQueue(uint32 size = RTPDataQueue::defaultMembersHashSize,
+          RTPApplication& app = defaultApplication());
+
+    /**
+     * Local SSRC is given instead of computed by the queue.
+     **/
+    AVPFQueue(uint32 ssrc, uint32 size =
+          RTPDataQueue::defaultMembersHashSize,
+          RTPApplication& app = defaultApplication());
+
+    virtual
+    ~AVPFQueue();
+
+    /**
+     * Send an early RTCP packet if one is due, and regular ones
+     * following the AVP rules.
+     **/
+    void
+    controlTransmissionService();
+
+    /**
+     * Plug-in for generic NACKs received. The default
+     * implementation retransmits the packet if it is in the
+     * retransmission history (see
+     * OutgoingDataQueue::setRetransmissionHistory()).
+     *
+     * @param source synchronization source the NACK comes from.
+     * @param mediaSSRC SSRC identifier of the media source.
+     * @param seqNum sequence number of the packet lost.
+     **/
+    virtual void
+    onGotNACK(SyncSource& source, uint32 mediaSSRC, uint16 seqNum);
+
+    /**
+     * Plug-in for Picture Loss Indications received.
+     *
+     * @param - synchronization source the PLI comes from.
+     * @param - SSRC identifier of the media source.
+     **/
+    inline virtual void
+    onGotPLI(SyncSource&, uint32)
+    { return; }
+
+    /**
+     * Plug-in for Full Intra Requests received, called for every
+     * FCI entry. A request repeated has the same sequence number.
+     *
+     * @param - synchronization source the FIR comes from.
+     * @param - SSRC identifier of the media source.
+     * @param - command sequence number.
+     **/
+    inline virtual void
+    onGotFIR(SyncSource&, uint32, uint8)
+    { return; }
+
+    /**
+     * Plug-in for other RTPFB and PSFB feedback messages.
+     *
+     * @param - synchronization source the message comes from.
+     * @param - the feedback packet, its length is given in
+     *        the fixed header.
+     **/
+    inline virtual void
+    onGotFeedback(SyncSource&, RTCPPacket&)
+    { return; }
+
+    /**
+     * Plug-in for REMB messages received: the receiver estimates
+     * the bandwidth available for the streams of this participant.
+     *
+     * @param - synchronization source the message comes from.
+     * @param - estimated bitrate, in bits per second.
+     **/
+    inline virtual void
+    onGotREMB(SyncSource&, uint32)
+    { return; }
+
+    /**
+     * Plug-in for changes of the bitrate estimated from
+     * transport-cc feedback (see setTransportCC()).
+     *
+     * @param - target bitrate, in bits per second.
+     **/
+    inline virtual void
+    onTargetBitrate(uint32)
+    { return; }
+
+    void
+    onPacketsLost(SyncSource& source, uint16 firstSeqNum, uint16 count);
+
+    void
+    onLatePacket(SyncSource& source, uint16 seqNum);
+
+    /**
+     * Report the new estimate in an early RTCP packet.
+     **/
+    void
+    onRemoteBitrateDecrease(SyncSource& source, uint32 bitrate);
+
+    /**
+     * Request an RTCP packet for the feedback pending: an early
+     * one if the timing rules allow it, the next regular one
+     * otherwise. feedbackLock must be held.
+     **/
+    void
+    scheduleFeedback();
+
+    timeval
+    computeRTCPInterval();
+
+    /**
+     * The next regular packet, or an early one if scheduled, or
+     * transport-cc feedback if there is some to send.
+     **/
+    timeval
+    getNextControlTime();
+
+    uint16
+    packRTCPExtension(unsigned char* buffer, uint16 available);
+
+    void
+    onGotRRSRExtension(unsigned char* buffer, size_t len);
+
+    mutable Mutex feedbackLock;
+
+private:
+    void
+    initAVPF();
+
+    uint16
+    packNACKs(unsigned char* buffer, uint16 available);
+
+    uint16
+    packPLIs(unsigned char* buffer, uint16 available);
+
+    uint16
+    packFIRs(unsigned char* buffer, uint16 available);
+
+    uint16
+    packTransportFeedback(unsigned char* buffer, uint16 available);
+
+    struct LostPacket
+    {
+        uint32 ssrc;
+        uint16 seqNum;
+        // NACKs sent so far
+        uint8 nacks;
+    };
+
+    static const uint8 defaultNACKRetries;
+    static const size_t maxLostPackets;
+    static const microtimeout_t defaultFeedbackCheckInterval;
+    static const microtimeout_t defaultTransportFeedbackInterval;
+    static const float defaultPacingFactor;
+    std::list<LostPacket> lostPackets;
+    std::list<uint32> pliRequests;
+    std::list<uint32> firRequests;
+    // last FIR command sequence number for each media source
+    std::map<uint32,uint8> firSeqNums;
+    bool nackEnabled;
+    uint8 nackRetries;
+    microtimeout_t rrInterval;
+    // whether an early packet may be sent before the next regular
+    bool allowEarly;
+    bool earlyScheduled;
+    timeval earlyTime;
+    // whether the packet being built is an early one
+    bool sendingEarly;
+    // last regular interval computed (T_rr)
+    timeval regularInterval;
+    uint32 earlyCount;
+    SendSideEstimator estimator;
+    TransportSequenceExtension transportSequence;
+    // transport-wide sequence number extension id, 0 if unused
+    uint8 transportCCId;
+    microtimeout_t transportFeedbackInterval;
+    timeval lastTransportFeedback;
+    // whether the packet being built is for transport-cc feedback
+    bool sendingTransportFeedback;
+    float pacingFactor;
+};
+
 /** @}*/ // cqueue
 
 END_NAMESPACE
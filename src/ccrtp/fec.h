@@ -0,0 +1,312 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file fec.h
+ *
+ * @short Forward error correction (RFC 5109 ULPFEC) for RTP streams.
+ **/
+
+#ifndef CCXX_RTP_FEC_H_
+#define CCXX_RTP_FEC_H_
+
+#include <ccrtp/base.h>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @defgroup fec Forward error correction.
+ * @{
+ **/
+
+/**
+ * XOR a block of memory into another one: dst[i] ^= src[i]. This is
+ * the kernel of the parity computations. It uses AVX2 or SSE2
+ * instructions when the library is built for a target that supports
+ * them, and a word by word loop otherwise.
+ *
+ * @param dst block to update.
+ * @param src block to xor into dst.
+ * @param len number of octets.
+ **/
+__EXPORT void
+fecXor(unsigned char* dst, const unsigned char* src, size_t len);
+
+/**
+ * @class FECEncoder
+ * @short Generates ULPFEC (RFC 5109) parity packets for an RTP stream.
+ *
+ * Media packets are grouped in blocks of consecutive sequence
+ * numbers. For every mask, a parity (FEC) payload is computed over the
+ * packets of the block selected by the mask. Parity is accumulated as
+ * packets are given to protect(), so media packets are not copied.
+ * Only level 0 (full protection) is generated. Masks may span up to
+ * 48 packets; row/column (two dimensional) protection can be
+ * configured with setRowColumn().
+ *
+ * An encoder is used by an OutgoingDataQueue (see
+ * OutgoingDataQueue::setFECEncoder()), which sends the FEC payloads
+ * as a separate local stream.
+ **/
+class __EXPORT FECEncoder
+{
+public:
+    /// Maximum number of packets in a block.
+    static const uint8 maxBlockSize = 48;
+    /// Maximum number of masks (FEC packets per block).
+    static const uint8 maxMasks = 48;
+
+    FECEncoder();
+
+    ~FECEncoder();
+
+    /**
+     * Set the number of media packets in a block, removing all
+     * the masks.
+     *
+     * @param size block size, from 1 to maxBlockSize.
+     * @return whether the size is valid.
+     **/
+    bool
+    setBlockSize(uint8 size);
+
+    inline uint8
+    getBlockSize() const
+    { return blockSize; }
+
+    /**
+     * Add a mask: a FEC packet will protect the packets of each
+     * block whose position in the block is set in the mask (bit 0
+     * is the first packet of the block).
+     *
+     * @param mask protected packets, within the block size.
+     * @return whether the mask was added.
+     **/
+    bool
+    addMask(uint64 mask);
+
+    /**
+     * Set up row/column protection: blocks of columns * rows
+     * packets, one FEC packet for each row of consecutive packets
+     * and one for each column (packets columns apart).
+     *
+     * @param columns packets in a row.
+     * @param rows rows in a block. 1 gives a single row FEC.
+     * @return whether the block fits in maxBlockSize.
+     **/
+    bool
+    setRowColumn(uint8 columns, uint8 rows);
+
+    inline uint8
+    getMasksCount() const
+    { return masksCount; }
+
+    /**
+     * Account a media packet, as it will be sent but before any
+     * SRTP protection. A packet whose sequence number does not
+     * follow the previous one starts a new block.
+     *
+     * @param packet raw RTP packet.
+     * @param len length of the packet.
+     * @return number of FEC payloads ready (the block is complete),
+     *         to be retrieved with getFECPayload().
+     **/
+    uint8
+    protect(const unsigned char* packet, size_t len);
+
+    /**
+     * Get a FEC payload (FEC header, level 0 header and parity) of
+     * the last block completed.
+     *
+     * @param i FEC payload index, less than the value returned by
+     *        protect().
+     * @param len set to the length of the FEC payload.
+     * @return FEC payload, valid till the next call to protect().
+     **/
+    const unsigned char*
+    getFECPayload(uint8 i, size_t& len) const;
+
+    /**
+     * Restart at the beginning of a block.
+     **/
+    void
+    reset();
+
+private:
+    FECEncoder(const FECEncoder&);
+
+    FECEncoder&
+    operator=(const FECEncoder&);
+
+    struct Parity
+    {
+        uint64 mask;
+        unsigned char* buffer;
+        size_t size;
+        // length of the protected data so far
+        size_t length;
+        // offset of the FEC header, once the block is complete
+        size_t header;
+        bool empty;
+    };
+
+    uint8 blockSize;
+    uint8 masksCount;
+    Parity parities[maxMasks];
+    // position of the next packet in the block
+    uint8 position;
+    uint16 baseSeqNum;
+};
+
+/**
+ * @class FECDecoder
+ * @short Recovers lost RTP packets of a stream from ULPFEC packets.
+ *
+ * The decoder keeps a copy of the last media packets received and
+ * the FEC packets not used yet. When a FEC packet protects exactly
+ * one missing packet, the packet is rebuilt. Recovered packets are
+ * used for further recoveries, so that row/column FEC can recover
+ * bursts.
+ *
+ * A decoder is used by an IncomingDataQueue (see
+ * IncomingDataQueue::setFECDecoder()), which inserts the recovered
+ * packets in the reception queue as if they had been received.
+ **/
+class __EXPORT FECDecoder
+{
+public:
+    /// Number of media packets kept.
+    static const uint16 mediaWindow = 128;
+    /// Number of FEC packets kept.
+    static const uint8 fecWindow = 48;
+
+    FECDecoder();
+
+    ~FECDecoder();
+
+    /**
+     * Keep a copy of a media packet received (after any SRTP
+     * processing).
+     *
+     * @param packet raw RTP packet.
+     * @param len length of the packet.
+     **/
+    void
+    addMediaPacket(const unsigned char* packet, size_t len);
+
+    /**
+     * Keep a FEC packet received.
+     *
+     * @param payload payload of the FEC packet.
+     * @param len length of the payload.
+     * @return whether the payload is a valid FEC payload.
+     **/
+    bool
+    addFECPacket(const unsigned char* payload, size_t len);
+
+    /**
+     * Recover a lost packet, if possible. Should be called till it
+     * returns NULL after adding packets.
+     *
+     * @param len set to the length of the recovered packet.
+     * @return recovered raw RTP packet, allocated with new[] and
+     *         owned by the caller, or NULL.
+     **/
+    unsigned char*
+    recover(size_t& len);
+
+    /**
+     * Get the number of packets recovered so far.
+     **/
+    inline uint32
+    getRecoveredCount() const
+    { return recoveredCount; }
+
+    /**
+     * Forget all the packets kept.
+     **/
+    void
+    reset();
+
+private:
+    FECDecoder(const FECDecoder&);
+
+    FECDecoder&
+    operator=(const FECDecoder&);
+
+    struct Packet
+    {
+        unsigned char* data;
+        size_t len;
+        uint16 seqNum;
+    };
+
+    /**
+     * Find a media packet kept.
+     **/
+    const Packet*
+    findMedia(uint16 seqNum) const;
+
+    /**
+     * Rebuild the packet protected by a FEC packet.
+     **/
+    unsigned char*
+    rebuild(const Packet& fec, uint16 seqNum, size_t& len);
+
+    void
+    storeMedia(unsigned char* data, size_t len, uint16 seqNum);
+
+    Packet media[mediaWindow];
+    Packet fec[fecWindow];
+    // ssrc of the protected stream, learned from media packets
+    uint32 ssrc;
+    bool ssrcKnown;
+    uint16 highestSeqNum;
+    uint32 recoveredCount;
+};
+
+/** @}*/ // fec
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_FEC_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
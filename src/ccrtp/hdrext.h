@@ -0,0 +1,386 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file hdrext.h
+ *
+ * @short RTP header extensions (RFC 8285): registry of handlers,
+ * writer and parser.
+ **/
+
+#ifndef CCXX_RTP_HDREXT_H_
+#define CCXX_RTP_HDREXT_H_
+
+#include <ccrtp/rtppkt.h>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @defgroup hdrext RTP header extensions.
+ * @{
+ **/
+
+/**
+ * @class HeaderExtension
+ * @short Handler of an RTP header extension element.
+ *
+ * Handlers are registered for a local identifier in an RTP session
+ * (see RTPQueueBase::addHeaderExtension()), as negotiated for
+ * instance with the SDP extmap attribute. The same handler deals
+ * with the element in the packets sent and in the packets
+ * received. The default implementations do nothing.
+ **/
+class __EXPORT HeaderExtension
+{
+public:
+    virtual
+    ~HeaderExtension()
+    { }
+
+    /**
+     * Get the length of the element to add to a data packet about
+     * to be built.
+     *
+     * @return length of the element data, 0 for no element. Up to
+     *         16 octets fit in the one-byte header form, up to 255
+     *         in the two-byte one.
+     **/
+    inline virtual uint8
+    getSendLength()
+    { return 0; }
+
+    /**
+     * Write the element data of a packet being sent. Called once
+     * the header of the packet is complete, before any FEC or SRTP
+     * protection, with the sending queue locked.
+     *
+     * @param - where to write the data.
+     * @param - length of the data, as returned by getSendLength().
+     * @param - packet being sent.
+     **/
+    inline virtual void
+    write(unsigned char*, uint8, const OutgoingRTPPkt&)
+    { }
+
+    /**
+     * Called when a packet with the element is actually sent by
+     * the service thread.
+     *
+     * @param - element data.
+     * @param - length of the element data.
+     * @param - size of the packet, as sent.
+     * @param - time the packet was sent.
+     **/
+    inline virtual void
+    onSent(const unsigned char*, uint8, size_t, const timeval&)
+    { }
+
+    /**
+     * Called for an element of a data packet received, after any
+     * SRTP processing.
+     *
+     * @param - element data, valid during the call only.
+     * @param - length of the element data.
+     * @param - packet received.
+     * @param - arrival time.
+     **/
+    inline virtual void
+    onReceived(const unsigned char*, uint8, const IncomingRTPPkt&,
+           const timeval&)
+    { }
+};
+
+/**
+ * @class HeaderExtensionWriter
+ * @short Encodes header extension elements.
+ *
+ * Elements are added and then encoded in the one-byte header form
+ * if all of them allow it, in the two-byte form otherwise. The
+ * encoded extension includes the four octets preceding the elements
+ * and padding, as expected by the OutgoingRTPPkt constructor. No
+ * memory is allocated.
+ **/
+class __EXPORT HeaderExtensionWriter
+{
+public:
+    /// Maximum number of elements.
+    static const uint8 maxElements = 16;
+    /// Maximum length of the encoded extension, in octets.
+    static const size_t maxLength = 1024;
+
+    HeaderExtensionWriter();
+
+    /**
+     * Remove all the elements.
+     **/
+    void
+    reset();
+
+    /**
+     * Add an element.
+     *
+     * @param id element identifier, 1 to 255.
+     * @param data element data, NULL to leave it zeroed and write
+     *        it later.
+     * @param len length of the element data.
+     * @return whether the element fits.
+     **/
+    bool
+    add(uint8 id, const unsigned char* data, uint8 len);
+
+    inline uint8
+    getCount() const
+    { return count; }
+
+    /**
+     * Encode the elements added.
+     *
+     * @return length of the extension, 0 if there are no elements.
+     **/
+    size_t
+    build();
+
+    /**
+     * Get the extension encoded by build().
+     **/
+    inline const unsigned char*
+    getExtension() const
+    { return buffer; }
+
+    /**
+     * Get the identifier of an element.
+     **/
+    inline uint8
+    getId(uint8 i) const
+    { return elements[i].id; }
+
+    inline uint8
+    getLength(uint8 i) const
+    { return elements[i].len; }
+
+    /**
+     * Get the offset of the data of an element encoded by
+     * build(), from the content of the extension (see
+     * RTPPacket::getHdrExtContent()).
+     **/
+    inline uint16
+    getOffset(uint8 i) const
+    { return elements[i].offset; }
+
+private:
+    struct Element
+    {
+        uint8 id;
+        uint8 len;
+        const unsigned char* data;
+        uint16 offset;
+    };
+
+    Element elements[maxElements];
+    uint8 count;
+    // worst case encoded length of the elements
+    size_t size;
+    unsigned char buffer[maxLength];
+};
+
+/**
+ * @class HeaderExtensionIterator
+ * @short Iterates over the elements of the header extension of an
+ * RTP packet.
+ *
+ * Both the one-byte and the two-byte header forms are parsed, in
+ * place: the data of the elements points into the packet. Padding
+ * is skipped, and parsing stops at the first malformed element.
+ *
+ * @code
+ * for ( HeaderExtensionIterator i(packet); i.isValid(); ++i )
+ *         handle(i.getId(),i.getData(),i.getLength());
+ * @endcode
+ **/
+class __EXPORT HeaderExtensionIterator
+{
+public:
+    /**
+     * Iterate over the elements of a packet, if it has a header
+     * extension in the RFC 8285 format.
+     **/
+    HeaderExtensionIterator(const RTPPacket& packet);
+
+    /**
+     * Iterate over the elements of a header extension.
+     *
+     * @param profile first 16 bits of the extension, host order.
+     * @param content extension content, after the first 4 octets.
+     * @param len length of the content, in octets.
+     **/
+    HeaderExtensionIterator(uint16 profile, const unsigned char* content,
+                size_t len);
+
+    /**
+     * Whether the iterator is on an element.
+     **/
+    inline bool
+    isValid() const
+    { return NULL != data; }
+
+    HeaderExtensionIterator&
+    operator++();
+
+    inline uint8
+    getId() const
+    { return id; }
+
+    inline const unsigned char*
+    getData() const
+    { return data; }
+
+    inline uint8
+    getLength() const
+    { return length; }
+
+private:
+    void
+    init(uint16 profile, const unsigned char* content, size_t len);
+
+    const unsigned char* content;
+    size_t contentLength;
+    size_t pointer;
+    bool twoByte;
+    uint8 id;
+    uint8 length;
+    const unsigned char* data;
+};
+
+/**
+ * Find an element in the header extension of a packet.
+ *
+ * @param packet RTP packet.
+ * @param id element identifier.
+ * @param len set to the length of the element data.
+ * @return element data, NULL if the packet has no such element.
+ **/
+__EXPORT const unsigned char*
+findHeaderExtension(const RTPPacket& packet, uint8 id, uint8& len);
+
+/**
+ * @class HeaderExtensionRegistry
+ * @short Header extension handlers of an RTP session, by identifier.
+ *
+ * Handlers are not owned by the registry. Lookups take no lock, so
+ * handlers should be registered before packets flow, or when the
+ * service thread does not run.
+ **/
+class __EXPORT HeaderExtensionRegistry
+{
+public:
+    HeaderExtensionRegistry();
+
+    /**
+     * Register a handler.
+     *
+     * @param id identifier, 1 to 255. Identifiers above 14 force
+     *        the two-byte header form.
+     * @param ext handler.
+     * @return false if the identifier is not valid or already used.
+     **/
+    bool
+    add(uint8 id, HeaderExtension& ext);
+
+    /**
+     * @return false if no handler was registered for id.
+     **/
+    bool
+    remove(uint8 id);
+
+    inline HeaderExtension*
+    find(uint8 id) const
+    { return handlers[id]; }
+
+    inline bool
+    isEmpty() const
+    { return 0 == count; }
+
+    /**
+     * Add the elements of a packet about to be built to a writer,
+     * and encode them.
+     *
+     * @return length of the extension, 0 if there is none.
+     **/
+    size_t
+    prepare(HeaderExtensionWriter& writer) const;
+
+    /**
+     * Have the handlers write the data of the elements of a
+     * packet built with an extension prepared, once its header is
+     * complete, which is just before it is sent.
+     *
+     * @param packet packet built with a prepared extension.
+     **/
+    void
+    write(OutgoingRTPPkt& packet) const;
+
+    /**
+     * Notify the handlers of the elements of a packet sent.
+     **/
+    void
+    sent(const OutgoingRTPPkt& packet, size_t size,
+         const timeval& when) const;
+
+    /**
+     * Notify the handlers of the elements of a packet received.
+     **/
+    void
+    received(const IncomingRTPPkt& packet, const timeval& arrival) const;
+
+private:
+    HeaderExtension* handlers[256];
+    // identifiers registered, in order of registration
+    uint8 ids[255];
+    uint8 count;
+};
+
+/** @}*/ // hdrext
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_HDREXT_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
@@ -285,6 +285,9 @@ protected:
     ConflictingTransportAddress* firstConflict, * lastConflict;
 };
 
+class RemoteRateEstimator;
+class RTPDeliveryHandler;
+
 /**
  * @class MembershipBookkeeping
  * @short Controls the group membership in the current session.
@@ -351,7 +354,7 @@ protected:
     struct IncomingRTPPktLink
     {
         IncomingRTPPktLink(IncomingRTPPkt* pkt, SyncSourceLink* sLink,
-                   struct timeval& recv_ts,
+                   const struct timeval& recv_ts,
                    uint32 shifted_ts,
                    IncomingRTPPktLink* sp,
                    IncomingRTPPktLink* sn,
@@ -470,6 +473,9 @@ protected:
     {
         // 2^16
         static const uint32 SEQNUMMOD;
+        // packets that can be held for delivery in order, a
+        // power of 2.
+        static const uint16 deliveryWindow;
 
         SyncSourceLink(MembershipBookkeeping* m,
                    SyncSource* s,
@@ -480,7 +486,9 @@ protected:
                    SyncSourceLink* ncollis = NULL) :
             membership(m), source(s), first(fp), last(lp),
             prev(ps), next(ns), nextCollis(ncollis),
-            prevConflict(NULL)
+            prevConflict(NULL), rateEstimator(NULL),
+            deliveryHandler(NULL), held(NULL), heldCount(0),
+            deliveryStarted(false)
         { m->setLink(*s,this); // record that the source is associated
           initStats();         // to this link.
         }
@@ -656,6 +664,35 @@ protected:
         inline void setInitialDataTime(timeval it)
         { initialDataTime = it; }
 
+        inline RemoteRateEstimator* getRateEstimator() const
+        { return rateEstimator; }
+
+        /**
+         * Get the sequence number the next frame taken from the
+         * queue (see IncomingDataQueue::getFrame()) should start
+         * at, one past the last packet of the previous frame.
+         *
+         * @return false if no frame has been taken yet.
+         **/
+        inline bool getNextFrameSeqNum(uint16& seqNum) const
+        { seqNum = nextFrameSeqNum; return frameTaken; }
+
+        inline void setNextFrameSeqNum(uint16 seqNum)
+        { nextFrameSeqNum = seqNum; frameTaken = true; }
+
+        /**
+         * Record the sequence number of a packet inserted into
+         * the reception queue, in a window behind the highest
+         * one (32 packets).
+         *
+         * @param seqNum sequence number.
+         * @param old result for a sequence number older than the
+         *        window.
+         * @return false if the sequence number was already
+         *         recorded (the packet is a duplicate).
+         **/
+        bool recordSeqNum(uint16 seqNum, bool old);
+
         /**
          * Mark this source as having sent a BYE control packet.
          *
@@ -778,6 +815,26 @@ protected:
         float jitter;
         uint32 initialDataTimestamp;
         timeval initialDataTime;
+        // receiver side bandwidth estimation, if enabled
+        RemoteRateEstimator* rateEstimator;
+        // push delivery (see IncomingDataQueue::setDeliveryHandler):
+        // the handler of this source, if any, and the packets
+        // held until the ones before them arrive, indexed by
+        // sequence number modulo deliveryWindow.
+        RTPDeliveryHandler* deliveryHandler;
+        IncomingRTPPkt** held;
+        uint16 heldCount;
+        uint16 nextDeliverySeqNum;
+        bool deliveryStarted;
+        // last time delivery progressed while packets were held.
+        timeval heldSince;
+        // frame assembly: first sequence number of the next frame
+        uint16 nextFrameSeqNum;
+        bool frameTaken;
+        // sequence numbers inserted into the queue: bit i of
+        // seqWindow is set for seqWindowTop - i.
+        uint16 seqWindowTop;
+        uint32 seqWindow;
 
         // this flag assures we only call one gotHello and one
         // gotGoodbye for this src.
@@ -799,6 +856,16 @@ protected:
     bool
     isRegistered(uint32 ssrc);
 
+    /**
+     * Get the link of the source identified by ssrc, if there is
+     * one.
+     *
+     * @param ssrc SSRC identifier, in host order.
+     * @return NULL if no source is identified by ssrc.
+     **/
+    SyncSourceLink*
+    findSourceBySSRC(uint32 ssrc) const;
+
     /**
      * Get the description of a source by its <code>ssrc</code> identifier.
      *
@@ -833,6 +900,13 @@ protected:
     bool
     removeSource(uint32 ssrc);
 
+    /**
+     * Get the memory used by the table of members and the
+     * description of the sources.
+     **/
+    size_t
+    getMembersMemoryUsage() const;
+
     inline SyncSourceLink* getFirst()
     { return first; }
 
@@ -874,6 +948,39 @@ private:
     SyncSourceLink* first, * last;
 };
 
+class FECDecoder;
+class REDDecoder;
+class RTPDepacketizer;
+
+/**
+ * @class RTPDeliveryHandler
+ * @short Data packets pushed by an incoming data queue.
+ *
+ * Installed on a session with its setDeliveryHandler() methods (see
+ * IncomingDataQueue), for all its sources or for one of them. The
+ * data packets of the source are then given to it in sequence
+ * number order, by the thread that receives them, instead of being
+ * inserted in the reception queue.
+ **/
+class __EXPORT RTPDeliveryHandler
+{
+public:
+    virtual ~RTPDeliveryHandler()
+    { }
+
+    /**
+     * Deliver a data packet. No lock of the queue is held.
+     *
+     * @param packet data packet, only valid during the call: its
+     *        payload is not copied out of the reception buffer.
+     * @param source source of the packet.
+     * @return true if the packet has been consumed, false to have
+     *         it inserted in the reception queue as usual.
+     **/
+    virtual bool
+    onDelivery(const IncomingRTPPkt& packet, SyncSource& source) = 0;
+};
+
 /**
  * @class IncomingDataQueue
  * @short Queue for incoming RTP data packets in an RTP session.
@@ -953,6 +1060,152 @@ public:
     const AppDataUnit*
     getData(uint32 stamp, const SyncSource* src = NULL);
 
+    /**
+     * Retrieve the packets of the first frame of a source: the
+     * packets that share the timestamp of the first one in the
+     * queue of the source. The frame is over at the packet with the
+     * marker bit set, or at the last packet with its timestamp once
+     * a packet with a later timestamp has been received.
+     *
+     * Whether packets are missing is told by the sequence numbers
+     * of the packets of the frame, of the last packet of the
+     * previous frame taken, and of the packet that follows when
+     * the frame has no marker bit.
+     *
+     * @param src synchronization source.
+     * @param frame where to store the packets. Packets previously
+     *        held are released.
+     * @return whether a frame was retrieved and its packets
+     *         removed from the reception queue.
+     **/
+    bool
+    getFrame(const SyncSource& src, RTPFrame& frame);
+
+    /**
+     * Retrieve the first frame of a source, as getFrame(), rebuilt
+     * by a depacketizer for its payload format (see
+     * RTPDepacketizer). Packets missing are signalled to the
+     * depacketizer.
+     *
+     * @param src synchronization source.
+     * @param depacketizer depacketizer to rebuild the frame with.
+     * @return whether a frame was retrieved and its packets
+     *         removed from the reception queue.
+     **/
+    bool
+    getDepacketizedData(const SyncSource& src,
+                RTPDepacketizer& depacketizer);
+
+    /**
+     * Recover lost packets of a stream protected with forward
+     * error correction. Packets with the FEC payload type are
+     * given to the decoder instead of being queued, and the
+     * packets it recovers are queued as if they had been received.
+     *
+     * @param decoder FEC decoder, not owned by the queue. NULL
+     *        stops FEC processing.
+     * @param fecPT payload type of the FEC packets.
+     **/
+    void
+    setFECDecoder(FECDecoder* decoder, PayloadType fecPT);
+
+    inline FECDecoder*
+    getFECDecoder() const
+    { return fecDecoder; }
+
+    /**
+     * Decode redundant audio data (RFC 2198). The primary frame of
+     * a packet with the RED payload type is queued as the packet
+     * received, with the payload type of the frame. Redundant
+     * frames are queued in place of the previous packets when these
+     * have not been received, so that they are delivered in order.
+     *
+     * @param decoder RED decoder, not owned by the queue. NULL stops
+     *        RED processing.
+     * @param redPT payload type of the RED packets.
+     **/
+    void
+    setREDDecoder(REDDecoder* decoder, PayloadType redPT);
+
+    inline REDDecoder*
+    getREDDecoder() const
+    { return redDecoder; }
+
+    /**
+     * Estimate the bandwidth available from each source at the
+     * receiver, from the variation of the delay of its packets.
+     * The estimates are sent to the sources in REMB messages with
+     * the RTCP reports, for senders that do not support
+     * transport-cc feedback (see AVPFQueue::setTransportCC()).
+     *
+     * @param enable whether to estimate. Disabled by default.
+     **/
+    inline void
+    setRemoteBitrateEstimation(bool enable)
+    { remoteBitrateEstimation = enable; }
+
+    inline bool
+    isRemoteBitrateEstimation() const
+    { return remoteBitrateEstimation; }
+
+    /**
+     * Get the bandwidth estimated for a source.
+     *
+     * @param src synchronization source.
+     * @return estimate in bits per second, 0 if there is none.
+     **/
+    uint32
+    getRemoteBitrateEstimate(const SyncSource& src) const;
+    /**
+     * Push data packets to a handler instead of queuing them. Valid
+     * packets are given to the handler as soon as they are received
+     * in order, from the thread that receives them. A packet that
+     * arrives before the ones preceding it is held until they
+     * arrive, or until they are given up after the hold time (see
+     * setDeliveryHoldTime()), by the service of the session if no
+     * packet arrives meanwhile. Packets later than the ones already
+     * delivered are dropped.
+     *
+     * Should be set before the session is started, or from the
+     * thread serving it (e.g. in onNewSyncSource()).
+     *
+     * @param handler handler for all the sources without a handler
+     *        of their own, not owned by the queue. NULL to queue
+     *        their packets again.
+     **/
+    inline void
+    setDeliveryHandler(RTPDeliveryHandler* handler)
+    { deliveryHandler = handler; if ( handler ) deliveryUsed = true; }
+
+    /**
+     * Push the data packets of a source to a handler, as
+     * setDeliveryHandler(RTPDeliveryHandler*) does for the session.
+     *
+     * @param src synchronization source.
+     * @param handler handler for the source, NULL to use the one of
+     *        the session.
+     * @return false if the source is not from this session.
+     **/
+    bool
+    setDeliveryHandler(const SyncSource& src, RTPDeliveryHandler* handler);
+
+    inline RTPDeliveryHandler*
+    getDeliveryHandler() const
+    { return deliveryHandler; }
+
+    /**
+     * Set how long packets received out of order are held for the
+     * packets missing before them. 50 ms by default.
+     *
+     * @param t hold time, in microseconds.
+     **/
+    inline void
+    setDeliveryHoldTime(microtimeout_t t)
+    { deliveryHoldTime = t; }
+
+    inline microtimeout_t
+    getDeliveryHoldTime() const
+    { return deliveryHoldTime; }
 
     /**
      * Determine if packets are waiting in the reception queue.
@@ -1145,6 +1398,31 @@ protected:
     IncomingDataQueue::IncomingRTPPktLink*
     getWaiting(uint32 timestamp, const SyncSource *src = NULL);
 
+    /**
+     * Take the packets of the first frame of a source out of the
+     * reception queue (see getFrame()).
+     *
+     * @param src synchronization source.
+     * @param first set to the first packet of the frame, the others
+     *        follow through getSrcNext().
+     * @param missingStart set to whether packets are missing
+     *        before the first one.
+     * @param missingEnd set to whether packets are missing after
+     *        the last one.
+     * @return number of packets of the frame, 0 if none is ready.
+     **/
+    size_t
+    takeFrame(const SyncSource& src, IncomingRTPPktLink*& first,
+          bool& missingStart, bool& missingEnd);
+
+    /**
+     * Unlink a packet from the reception queue and from the queue
+     * of its source. recvLock must be held for writing. The links
+     * of the packet itself are left untouched.
+     **/
+    void
+    unlinkRecvPacket(IncomingRTPPktLink* packetLink);
+
     /**
      * Log reception of a new RTP packet from this source. Usually
      * updates data such as the packet counter, the expected
@@ -1155,6 +1433,10 @@ protected:
      * source of this packet.
      * @param pkt Packet just created and to be logged.
      * @param recvtime Reception time.
+     * @param recovered whether the packet is recovered by FEC: it
+     * is accounted in the sequence and loss statistics, but its
+     * arrival time, the one of the FEC packet, is not fed to the
+     * jitter and bandwidth estimations.
      *
      * @return whether, according to the source state and
      * statistics, the packet is considered valid and must be
@@ -1162,7 +1444,7 @@ protected:
      **/
     bool
     recordReception(SyncSourceLink& srcLink, const IncomingRTPPkt& pkt,
-            const timeval recvtime);
+            const timeval recvtime, bool recovered = false);
 
     /**
      * Log extraction of a packet from this source from the
@@ -1175,6 +1457,39 @@ protected:
 
     void purgeIncomingQueue();
 
+    /**
+     * Release the packets held for delivery (see
+     * setDeliveryHandler()) that have waited the hold time for the
+     * packets missing before them, so that they are not held while
+     * a source pauses. Run by the service of the session.
+     **/
+    void
+    releaseHeldPackets();
+
+    /**
+     * Get when releaseHeldPackets() must be run next.
+     *
+     * @return false if no packets are held.
+     **/
+    bool
+    getHeldDeadline(timeval& deadline);
+
+    /**
+     * Get the time till releaseHeldPackets() must be run next.
+     *
+     * @param max maximum timeout, returned if no packets are held.
+     * @return timeout, in microseconds.
+     **/
+    microtimeout_t
+    getHeldTimeout(microtimeout_t max);
+
+    /**
+     * Get the memory used by the reception side: sources, packets
+     * queued or held for delivery, and crypto contexts.
+     **/
+    size_t
+    getRecvMemoryUsage() const;
+
     /**
      * Virtual called when a new synchronization source has joined
      * the session.
@@ -1215,6 +1530,55 @@ protected:
      * @param - packet expired from the recv queue.
      **/
     inline virtual void onExpireRecv(IncomingRTPPkt&)
+    { return; }
+
+    /**
+     * A hook called when a data packet has been inserted in the
+     * reception queue, and the queue is no longer locked. May be
+     * used to get the data as soon as it is available, without
+     * checking isWaiting() periodically.
+     *
+     * @param - source the packet comes from.
+     **/
+    inline virtual void onDataQueued(SyncSource&)
+    { }
+
+    /**
+     * A hook called when a gap in the sequence numbers of a valid
+     * source is detected, that is, when packets have been lost or
+     * are arriving out of order.
+     *
+     * @param - source the packets come from.
+     * @param - sequence number of the first packet missing.
+     * @param - number of consecutive packets missing.
+     **/
+    inline virtual void
+    onPacketsLost(SyncSource&, uint16, uint16)
+    { return; }
+
+    /**
+     * A hook called when a packet older than the last one of its
+     * source arrives: a duplicate, a reordered, a retransmitted or
+     * a recovered packet.
+     *
+     * @param - source the packet comes from.
+     * @param - sequence number of the packet.
+     **/
+    inline virtual void
+    onLatePacket(SyncSource&, uint16)
+    { return; }
+
+    /**
+     * A hook called when the bandwidth estimated for a source (see
+     * setRemoteBitrateEstimation()) falls well below the last one
+     * reported, so that it can be reported without waiting for the
+     * next regular RTCP packet.
+     *
+     * @param - synchronization source.
+     * @param - new estimate, in bits per second.
+     **/
+    inline virtual void
+    onRemoteBitrateDecrease(SyncSource&, uint32)
     { return; }
 
         /**
@@ -1246,15 +1610,86 @@ protected:
      *
      * @param packetLink link to a packet just received and
      * generally validated and processed by onRTPPacketRecv.
+     * @param recovered whether the packet is recovered in place of
+     * a lost one, rather than received. It is then only inserted if
+     * a packet with its sequence number is known not to have been
+     * inserted before.
      *
      * @return whether the packet was successfully inserted.
-     * @retval false when the packet is duplicated (there is
-     * already a packet from the same source with the same
-     * timestamp).
+     * @retval false when the packet is duplicated (a packet from
+     * the same source with the same sequence number has already
+     * been inserted).
      * @retval true when the packet is not duplicated.
      **/
     bool
-    insertRecvPacket(IncomingRTPPktLink* packetLink);
+    insertRecvPacket(IncomingRTPPktLink* packetLink, bool recovered = false);
+
+    /**
+     * Assign a packet just received and validated to its source,
+     * and insert it in the reception queue if the source accepts
+     * it. Otherwise, the packet is deleted.
+     *
+     * @param packet packet received or recovered.
+     * @param recvtime reception time.
+     * @param network_address address the packet comes from.
+     * @param transport_port port the packet comes from.
+     * @param recovered whether the packet is recovered by FEC.
+     * @return source of the packet, NULL if it was deleted.
+     **/
+    SyncSourceLink*
+    admitDataPacket(IncomingRTPPkt* packet, const timeval& recvtime,
+            InetHostAddress& network_address,
+            tpport_t transport_port, bool recovered = false);
+
+    /**
+     * Admit the primary frame of a RED packet, and queue the
+     * redundant ones in place of the lost packets. The packet is
+     * deleted.
+     **/
+    void
+    admitREDPacket(IncomingRTPPkt* packet, const timeval& recvtime,
+               InetHostAddress& network_address,
+               tpport_t transport_port);
+
+    /**
+     * Queue the packets the FEC decoder can recover.
+     **/
+    void
+    recoverDataPackets(const timeval& recvtime,
+               InetHostAddress& network_address,
+               tpport_t transport_port);
+
+    inline bool
+    isDelivered(const SyncSourceLink& srcLink) const
+    { return srcLink.deliveryHandler || deliveryHandler ||
+            srcLink.heldCount; }
+
+    /**
+     * Deliver a packet admitted from a source with a delivery
+     * handler, or hold it until the packets before it arrive.
+     *
+     * @return false if the packet was deleted, being late or
+     *         duplicated.
+     **/
+    bool
+    deliverDataPacket(SyncSourceLink& srcLink, IncomingRTPPkt* packet,
+              const timeval& recvtime);
+
+    /**
+     * Deliver the held packets that follow in sequence, giving up
+     * the missing ones after the hold time, or right away if all.
+     **/
+    void
+    releaseHeldPackets(SyncSourceLink& srcLink, const timeval& recvtime,
+               bool all);
+
+    /**
+     * Give a packet to the delivery handler of its source, or
+     * queue it if it is not consumed.
+     **/
+    void
+    dispatchDeliveredPacket(SyncSourceLink& srcLink,
+                IncomingRTPPkt* packet, const timeval& recvtime);
 
     /**
      * This function performs the physical I/O for reading a
@@ -1288,6 +1723,15 @@ protected:
     uint8 sourceExpirationPeriod;
     mutable Mutex cryptoMutex;
         std::list<CryptoContext *> cryptoContexts;
+    FECDecoder* fecDecoder;
+    PayloadType fecPayloadType;
+    REDDecoder* redDecoder;
+    PayloadType redPayloadType;
+    bool remoteBitrateEstimation;
+    RTPDeliveryHandler* deliveryHandler;
+    microtimeout_t deliveryHoldTime;
+    // whether a delivery handler has ever been set
+    bool deliveryUsed;
 };
 
 /** @}*/ // iqueue
@@ -0,0 +1,253 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file mixer.h
+ *
+ * @short Audio mixing for RTP mixers and conference bridges.
+ **/
+
+#ifndef CCXX_RTP_MIXER_H_
+#define CCXX_RTP_MIXER_H_
+
+#include <ccrtp/iqueue.h>
+#include <ccrtp/oqueue.h>
+#include <vector>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @defgroup mixer Audio mixing.
+ * @{
+ **/
+
+/**
+ * @class AudioMixer
+ * @short Mixes G.711 audio from several sources (RFC 3550 mixer).
+ *
+ * Time aligned data units from the sources of an incoming queue are
+ * decoded to linear samples and summed. The sum is accumulated on 32
+ * bits and saturated to 16 bits when it is taken out, with SSE2 or
+ * AVX2 instructions when the library is built for a target that
+ * supports them. The sum can be taken out without one of the
+ * sources, so that each party of a conference gets all the others
+ * (N-1 mixing) at the cost of one subtraction.
+ *
+ * When the mix is sent, the CSRC list of the outgoing queue is set
+ * to the loudest sources (see OutgoingDataQueue::setContributors()).
+ *
+ * Objects of this class are not thread safe.
+ **/
+class __EXPORT AudioMixer
+{
+public:
+    /**
+     * @param pt PCMU (sptPCMU) or PCMA (sptPCMA), for both the
+     *        data mixed and the mix.
+     **/
+    AudioMixer(PayloadType pt = sptPCMU);
+
+    /**
+     * Set the payload type of the data mixed and of the mix.
+     *
+     * @return false if pt is not PCMU or PCMA.
+     **/
+    bool
+    setPayloadType(PayloadType pt);
+
+    inline PayloadType
+    getPayloadType() const
+    { return payloadType; }
+
+    /**
+     * Start a new mix, without any source.
+     **/
+    void
+    clear();
+
+    /**
+     * Add the data of a source to the mix. Sources of different
+     * lengths are mixed as if the shorter ones were padded with
+     * silence.
+     *
+     * @param ssrc SSRC identifier of the source.
+     * @param data G.711 encoded samples.
+     * @param len number of samples.
+     **/
+    void
+    add(uint32 ssrc, const unsigned char* data, size_t len);
+
+    /**
+     * Start a new mix with the data units of a timestamp from
+     * every source of a queue. Sources with no unit for the
+     * timestamp are left out, their older units are discarded.
+     *
+     * @param queue queue to take the data units from.
+     * @param stamp timestamp of the units.
+     * @return number of sources mixed.
+     **/
+    size_t
+    mix(IncomingDataQueue& queue, uint32 stamp);
+
+    inline size_t
+    getSourcesCount() const
+    { return active; }
+
+    /**
+     * Get the length of the mix, in samples.
+     **/
+    inline size_t
+    getSamplesCount() const
+    { return samplesCount; }
+
+    /**
+     * Get the mix in linear form.
+     *
+     * @param samples where to store getSamplesCount() samples.
+     **/
+    void
+    getLinear(int16* samples) const;
+
+    /**
+     * Get the mix in linear form, without a source.
+     *
+     * @param samples where to store getSamplesCount() samples.
+     * @param exclude SSRC identifier of the source to leave out.
+     **/
+    void
+    getLinear(int16* samples, uint32 exclude) const;
+
+    /**
+     * Get the mix encoded with the payload type of the mixer.
+     *
+     * @param data where to store getSamplesCount() octets.
+     * @return length of the mix.
+     **/
+    size_t
+    encode(unsigned char* data);
+
+    /**
+     * Get the mix encoded with the payload type of the mixer,
+     * without a source.
+     *
+     * @param data where to store getSamplesCount() octets.
+     * @param exclude SSRC identifier of the source to leave out.
+     * @return length of the mix.
+     **/
+    size_t
+    encode(unsigned char* data, uint32 exclude);
+
+    /**
+     * Get the loudest sources of the mix.
+     *
+     * @param csrcs where to store up to
+     *        OutgoingDataQueue::maxContributors SSRC identifiers,
+     *        the loudest first.
+     * @return number of sources stored.
+     **/
+    uint8
+    getContributors(uint32* csrcs);
+
+    /**
+     * Send the mix through a queue, with the loudest sources as
+     * contributors.
+     *
+     * @param queue queue to send the mix through.
+     * @param stamp timestamp of the packet.
+     **/
+    void
+    send(OutgoingDataQueue& queue, uint32 stamp);
+
+    /**
+     * Send the mix without a source through a queue, as for the
+     * leg of that source in a conference.
+     *
+     * @param queue queue to send the mix through.
+     * @param stamp timestamp of the packet.
+     * @param exclude SSRC identifier of the source to leave out.
+     **/
+    void
+    send(OutgoingDataQueue& queue, uint32 stamp, uint32 exclude);
+
+private:
+    struct Source
+    {
+        uint32 ssrc;
+        // decoded samples, kept for N-1 mixing
+        std::vector<int16> samples;
+        size_t count;
+        // sum of the absolute values of the samples
+        uint64 energy;
+    };
+
+    const Source*
+    find(uint32 ssrc) const;
+
+    void
+    saturate(int16* samples, const Source* exclude) const;
+
+    size_t
+    encodeMix(unsigned char* data, const Source* exclude);
+
+    uint8
+    rankContributors(uint32* csrcs, const Source* exclude);
+
+    void
+    sendMix(OutgoingDataQueue& queue, uint32 stamp, const Source* exclude);
+
+    PayloadType payloadType;
+    // sources are kept between mixes to reuse their buffers
+    std::vector<Source> sources;
+    size_t active;
+    std::vector<int32> sum;
+    size_t samplesCount;
+    std::vector<int16> linear;
+    std::vector<unsigned char> encoded;
+    std::vector<std::pair<uint64,uint32> > ranking;
+};
+
+/** @}*/ // mixer
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_MIXER_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
@@ -46,6 +46,7 @@
 #include <ccrtp/queuebase.h>
 #include <ccrtp/CryptoContext.h>
 #include <list>
+#include <map>
 
 NAMESPACE_COMMONCPP
 
@@ -54,12 +55,65 @@ NAMESPACE_COMMONCPP
  * @{
  **/
 
+/**
+ * @class SnapshotEpoch
+ *
+ * Read-copy-update style synchronization between lock-free readers
+ * of an immutable snapshot and the writers that replace it. Readers
+ * bracket their use of the snapshot with enterRead() and
+ * leaveRead(). A writer first publishes the new snapshot and then
+ * calls synchronize(), after which no reader can still be using the
+ * old one, so it can be deleted. Writers must be serialized by the
+ * caller, and a thread must not call synchronize() from within a
+ * read-side section.
+ **/
+class __EXPORT SnapshotEpoch
+{
+public:
+    SnapshotEpoch();
+
+    /**
+     * Enter a read-side section.
+     *
+     * @return epoch to be passed to leaveRead().
+     **/
+    uint32
+    enterRead() const;
+
+    /**
+     * Leave a read-side section.
+     *
+     * @param epoch value returned by the matching enterRead().
+     **/
+    void
+    leaveRead(uint32 epoch) const;
+
+    /**
+     * Wait for every read-side section entered before this call
+     * to be left.
+     **/
+    void
+    synchronize();
+
+private:
+    volatile uint32 epoch;
+    mutable volatile uint32 readers[2];
+    // only used where atomic builtins are not available.
+    mutable Mutex epochLock;
+};
+
 /**
  * @class DestinationListHandler
  *
  * This class handles a list of destination addresses. Stores network
  * addresses as InetAddress objects.
  *
+ * Besides the list, which is protected by a lock, the destinations
+ * are published as an immutable snapshot that is replaced as a
+ * whole whenever a destination is added or removed. Packet
+ * dispatching reads the snapshot (see acquireDestinations()) without
+ * taking any lock.
+ *
  * @author Federico Montesino Pouzols <fedemp@altern.org>
  **/
 class __EXPORT DestinationListHandler
@@ -68,6 +122,15 @@ protected:
     struct TransportAddress;
     std::list<TransportAddress*> destList;
 
+    /**
+     * Immutable array of destinations.
+     **/
+    struct DestinationSnapshot
+    {
+        size_t count;
+        TransportAddress** destinations;
+    };
+
 public:
     DestinationListHandler();
 
@@ -92,6 +155,22 @@ protected:
     inline void writeLockDestinationList() const
     { destinationLock.writeLock(); }
 
+    /**
+     * Get the current snapshot of the destination list, without
+     * taking any lock. The snapshot remains valid until
+     * releaseDestinations() is called.
+     *
+     * @param epoch set to the value to pass to releaseDestinations().
+     * @return current destinations snapshot.
+     **/
+    inline const DestinationSnapshot*
+    acquireDestinations(uint32& epoch) const
+    { epoch = destinationEpoch.enterRead(); return destSnapshot; }
+
+    inline void
+    releaseDestinations(uint32 epoch) const
+    { destinationEpoch.leaveRead(epoch); }
+
     /**
      * Locks the object before modifying it.
      **/
@@ -127,7 +206,19 @@ protected:
     };
 
 private:
+    /**
+     * Publish a new snapshot built from destList and wait until
+     * the previous one is no longer used. destinationLock must be
+     * held for writing.
+     *
+     * @param removed destination to delete with the old snapshot.
+     **/
+    void
+    publishDestinations(TransportAddress* removed = NULL);
+
     mutable ThreadLock destinationLock;
+    DestinationSnapshot* volatile destSnapshot;
+    mutable SnapshotEpoch destinationEpoch;
 };
 
 #ifdef  CCXX_IPV6
@@ -145,6 +236,15 @@ protected:
     struct TransportAddressIPV6;
     std::list<TransportAddressIPV6*> destListIPV6;
 
+    /**
+     * Immutable array of destinations.
+     **/
+    struct DestinationSnapshotIPV6
+    {
+        size_t count;
+        TransportAddressIPV6** destinations;
+    };
+
 public:
     DestinationListHandlerIPV6();
 
@@ -169,6 +269,22 @@ protected:
     inline void writeLockDestinationListIPV6() const
     { destinationLock.writeLock(); }
 
+    /**
+     * Get the current snapshot of the destination list, without
+     * taking any lock. The snapshot remains valid until
+     * releaseDestinationsIPV6() is called.
+     *
+     * @param epoch set to the value to pass to releaseDestinationsIPV6().
+     * @return current destinations snapshot.
+     **/
+    inline const DestinationSnapshotIPV6*
+    acquireDestinationsIPV6(uint32& epoch) const
+    { epoch = destinationEpoch.enterRead(); return destSnapshot; }
+
+    inline void
+    releaseDestinationsIPV6(uint32 epoch) const
+    { destinationEpoch.leaveRead(epoch); }
+
     /**
      * Locks the object before modifying it.
      **/
@@ -204,11 +320,121 @@ protected:
     };
 
 private:
+    /**
+     * Publish a new snapshot built from destListIPV6 and wait
+     * until the previous one is no longer used. destinationLock
+     * must be held for writing.
+     *
+     * @param removed destination to delete with the old snapshot.
+     **/
+    void
+    publishDestinationsIPV6(TransportAddressIPV6* removed = NULL);
+
     mutable ThreadLock destinationLock;
+    DestinationSnapshotIPV6* volatile destSnapshot;
+    mutable SnapshotEpoch destinationEpoch;
 };
 
 #endif
 
+class FECEncoder;
+class RTPPacketizer;
+class REDEncoder;
+
+/**
+ * @class RTPLateness
+ * @short Histogram of how late packets are sent.
+ *
+ * Packets are counted in buckets by the time between their
+ * timestamp and their sending, in powers of 2 microseconds: bucket
+ * 0 holds packets sent less than 1 usec from their time, bucket i
+ * those sent between 2^(i-1) and 2^i usecs from it, and the last
+ * bucket anything later. Packets sent early are counted apart,
+ * likewise.
+ **/
+class __EXPORT RTPLateness
+{
+public:
+    static const unsigned bucketsCount = 24;
+
+    RTPLateness();
+
+    void
+    clear();
+
+    /**
+     * Count a packet.
+     *
+     * @param late whether the packet was sent after its time.
+     * @param delay time between the time of the packet and its
+     *        sending, in microseconds.
+     **/
+    void
+    add(bool late, microtimeout_t delay);
+
+    /**
+     * Get the number of packets counted, early or late.
+     **/
+    uint32
+    getCount() const;
+
+    /**
+     * Get the number of packets sent early, at least 1 usec.
+     **/
+    uint32
+    getEarlyCount() const;
+
+    inline uint32
+    getLate(unsigned bucket) const
+    { return (bucket < bucketsCount) ? late[bucket] : 0; }
+
+    inline uint32
+    getEarly(unsigned bucket) const
+    { return (bucket < bucketsCount) ? early[bucket] : 0; }
+
+    /**
+     * Get the upper bound of a bucket, in microseconds.
+     **/
+    static microtimeout_t
+    getBucketLimit(unsigned bucket);
+
+    /**
+     * Get an upper bound of the lateness of a fraction of the
+     * packets, packets sent early counting as not late.
+     *
+     * @param p fraction, 0.99 for the 99th percentile.
+     * @return upper bound of the bucket in microseconds.
+     **/
+    microtimeout_t
+    getPercentile(float p) const;
+
+private:
+    uint32 late[bucketsCount];
+    uint32 early[bucketsCount];
+};
+
+/**
+ * @class RTPSendListener
+ * @short Notified when an outgoing data queue gets packets to send.
+ *
+ * Lets whatever serves the queue (see RTPSessionPool) leave it
+ * alone while it has nothing to send.
+ **/
+class __EXPORT RTPSendListener
+{
+public:
+    virtual ~RTPSendListener()
+    { }
+
+    /**
+     * Called when packets are queued for sending and there were
+     * none. The sending queue is locked: no methods of the queue
+     * must be called from here.
+     **/
+    virtual void
+    onSendQueued() = 0;
+};
+
 /**
  * @class OutgoingDataQueue
  *
@@ -257,10 +483,14 @@ public:
               tpport_t dataPort = DefaultRTPDataPort,
               tpport_t controlPort = 0);
 
+    /// Maximum number of CSRC identifiers in a packet.
+    static const uint8 maxContributors = 15;
+
     /**
      * Add csrc as the CSRC identifier of a new contributor. This
      * method adds the CSRC identifier to a list of contributors
      * that will be inserted in every packet enqueued from now on.
+     * Contributors beyond maxContributors are ignored.
      **/
     void
     addContributor(uint32 csrc);
@@ -271,6 +501,27 @@ public:
     bool
     removeContributor(uint32 csrc);
 
+    /**
+     * Replace the list of contributors, as a mixer does for every
+     * packet it sends. A CNAME SDES chunk is sent in RTCP packets
+     * for each contributor whose CNAME is known.
+     *
+     * @param csrcs CSRC identifiers.
+     * @param count number of identifiers, up to maxContributors.
+     **/
+    void
+    setContributors(const uint32* csrcs, uint8 count);
+
+    /**
+     * Get the list of contributors.
+     *
+     * @param csrcs where to copy the CSRC identifiers, room for
+     *        maxContributors.
+     * @return number of contributors.
+     **/
+    uint8
+    getContributors(uint32* csrcs) const;
+
     /**
      * Determine if outgoing packets are waiting to send.
      *
@@ -279,6 +530,114 @@ public:
     bool
     isSending() const;
 
+    /**
+     * Get the number of data packets waiting to be sent, of all
+     * the send classes and streams.
+     **/
+    inline size_t
+    getSendQueueLength() const
+    { return sendQueueLength; }
+
+    /**
+     * Policies to choose the send class of the next packet to be
+     * sent when packets of several send classes are due.
+     **/
+    typedef enum {
+        sendStrictPriority,     ///< always the highest priority class.
+        sendWeightedFair        ///< share the link by class weight.
+    }       SendSchedulingPolicy;
+
+    /**
+     * Number of send classes of the sending queue.
+     **/
+    static const uint8 maxSendClasses = 4;
+
+    /**
+     * Set the send class that packets enqueued from now on with
+     * putData() will belong to. Every send class has its own
+     * queue, priority, weight and deadline. By default all the
+     * packets belong to class 0.
+     *
+     * @param sendClass send class, less than maxSendClasses.
+     * @return whether sendClass is a valid send class.
+     **/
+    bool
+    setSendClass(uint8 sendClass);
+
+    inline uint8
+    getSendClass() const
+    { return currentSendClass; }
+
+    /**
+     * Set the priority of a send class. Under the
+     * sendStrictPriority policy, due packets of the class with the
+     * highest priority are sent first. Expired packets of lower
+     * priority classes are dropped first. Classes have priority 0
+     * by default.
+     *
+     * @param sendClass send class.
+     * @param priority priority, the higher the more important.
+     * @return whether sendClass is a valid send class.
+     **/
+    bool
+    setSendClassPriority(uint8 sendClass, uint8 priority);
+
+    /**
+     * Set the weight of a send class for the sendWeightedFair
+     * policy. Due packets are served by deficit round robin, each
+     * round giving every class a quantum of weight times the
+     * default quantum (1500 octets). Classes have weight 1 by
+     * default.
+     *
+     * @param sendClass send class.
+     * @param weight weight, at least 1.
+     * @return whether the parameters are valid.
+     **/
+    bool
+    setSendClassWeight(uint8 sendClass, uint16 weight);
+
+    /**
+     * Set how late the packets of a send class can be before they
+     * are dropped from the sending queue (and onExpireSend() is
+     * called).
+     *
+     * @param sendClass send class.
+     * @param deadline deadline in microseconds, 0 means the queue
+     *        expire timeout (see setExpireTimeout()).
+     * @return whether sendClass is a valid send class.
+     **/
+    bool
+    setSendClassDeadline(uint8 sendClass, microtimeout_t deadline);
+
+    /**
+     * Get the number of packets of a send class dropped because
+     * they expired in the sending queue.
+     **/
+    uint32
+    getSendClassExpiredCount(uint8 sendClass) const;
+
+    /**
+     * Get the histogram of how late data packets were dispatched,
+     * with respect to their timestamps, since the queue was created
+     * or the histogram reset. Tells how precise the scheduling of
+     * the thread serving the queue is.
+     *
+     * @param lateness copy of the histogram.
+     **/
+    void
+    getSendLateness(RTPLateness& lateness) const;
+
+    void
+    resetSendLateness();
+
+    inline void
+    setSendSchedulingPolicy(SendSchedulingPolicy policy)
+    { sendPolicy = policy; }
+
+    inline SendSchedulingPolicy
+    getSendSchedulingPolicy() const
+    { return sendPolicy; }
+
 
     /**
      * This is used to create a data packet in the send queue.
@@ -310,6 +669,24 @@ public:
         void
         sendImmediate(uint32 stamp, const unsigned char* data = NULL, size_t len = 0);
 
+    /**
+     * Like putData(), but split the data in packets following a
+     * payload format (see RTPPacketizer), instead of at
+     * getMaxSendSegmentSize() octets boundaries. Payloads are
+     * written directly in the packets by the packetizer, of up to
+     * getMaxSendSegmentSize() octets. All the packets carry the
+     * same timestamp, and the marker bit is set in the last one,
+     * as video payload formats require.
+     *
+     * @param stamp Timestamp for expected send time of packets.
+     * @param data Frame, for instance an H.264 access unit.
+     * @param len Length of the frame.
+     * @param packetizer Packetizer for the payload format.
+     **/
+    void
+    putPacketizedData(uint32 stamp, const unsigned char* data, size_t len,
+              RTPPacketizer& packetizer);
+
 
     /**
      * Set padding. All outgoing packets will be transparently
@@ -341,7 +718,7 @@ public:
      * Set partial data for an already queued packet.  This is often
      * used for multichannel data.
      *
-     * @param timestamp Timestamp of packet.
+     * @param timestamp Timestamp of packet, as given to putData().
      * @param data Buffer to copy from.
      * @param offset Offset to copy from.
      * @param max Maximum data size.
@@ -350,6 +727,224 @@ public:
     size_t
     setPartial(uint32 timestamp, unsigned char* data, size_t offset, size_t max);
 
+    /**
+     * Set partial data for an already queued packet, looking it up
+     * by its queue sequence number instead of by its timestamp.
+     * This is the way to reach any segment other than the first
+     * one of data that putData() had to split in several packets.
+     *
+     * @param seqNum Queue sequence number of the queued packet.
+     * @see getQueueSequenceNumber
+     * @param data Buffer to copy from.
+     * @param offset Offset to copy from.
+     * @param max Maximum data size.
+     * @return Number of packet data bytes set.
+     **/
+    size_t
+    setPartialBySeqNum(uint16 seqNum, unsigned char* data, size_t offset, size_t max);
+
+    /**
+     * Add a local stream to be sent besides the main one (the one
+     * identified by getLocalSSRC()), as for simulcast layers. The
+     * packets of every local stream are sent through the same
+     * sockets, to the same destinations and by the same service
+     * thread, but each stream has its own SSRC, sequence numbers,
+     * timestamp base and payload format, and is protected with the
+     * SRTP context for its own SSRC. Sender reports for every
+     * local stream are sent in the same RTCP compound packet.
+     *
+     * @param ssrc SSRC identifier of the new stream.
+     * @param pf payload format of the new stream.
+     * @return whether the stream was added, false if ssrc is
+     *         already used by a local stream.
+     **/
+    bool
+    addLocalStream(uint32 ssrc, const PayloadFormat& pf);
+
+    /**
+     * Remove a local stream added with addLocalStream(). Packets of
+     * the stream still in the sending queue are discarded.
+     *
+     * @param ssrc SSRC identifier of the stream.
+     * @return whether the stream was found.
+     **/
+    bool
+    removeLocalStream(uint32 ssrc);
+
+    /**
+     * Get the number of local streams added with addLocalStream().
+     **/
+    size_t
+    getLocalStreamsCount() const;
+
+    /**
+     * Like putData(), but for a local stream added with
+     * addLocalStream().
+     *
+     * @param ssrc SSRC identifier of the stream.
+     * @param stamp Timestamp for expected send time of packet,
+     *        relative to the timestamp base of the stream.
+     * @param data Value or NULL if special "silent" packet.
+     * @param len May be 0 to indicate a default by payload type.
+     * @param mark Marker bit value for the first packet.
+     * @return whether ssrc identifies a local stream.
+     **/
+    bool
+    putStreamData(uint32 ssrc, uint32 stamp, const unsigned char* data,
+              size_t len, bool mark = false);
+
+    /**
+     * Keep sent packets for a while so that they can be
+     * retransmitted with retransmit(), as requested by receivers
+     * through NACK feedback. Packets are not copied: the packet
+     * objects just sent are kept instead of being destroyed, with
+     * a copy of the payload in clear if they are protected. Each
+     * local stream has its own history, a ring indexed by sequence
+     * number.
+     *
+     * @param duration how long sent packets are kept, in
+     *        microseconds. 0 (the default) disables the history
+     *        and releases the packets kept so far.
+     * @param maxPackets maximum number of packets kept for each
+     *        stream, rounded up to a power of two.
+     **/
+    void
+    setRetransmissionHistory(microtimeout_t duration,
+                 uint16 maxPackets = 1024);
+
+    inline microtimeout_t
+    getRetransmissionHistory() const
+    { return retransmissionHistory; }
+
+    /**
+     * Retransmit packets of a local stream as RFC 4588 RTX
+     * packets, with their own SSRC, payload type and sequence
+     * numbers, instead of in-band (the packet is just sent
+     * again).
+     *
+     * @param ssrc SSRC identifier of the main or a local stream.
+     * @param rtxSSRC SSRC identifier of the retransmission stream.
+     * @param rtxPT payload type negotiated for RTX.
+     * @return whether ssrc identifies a local stream.
+     *
+     * @note Streams protected with SRTP are only retransmitted
+     *       as RTX: receivers reject a packet sent again with the
+     *       same SRTP index as a replay (RFC 3711, section 3.3.2).
+     *       Their history keeps a copy of the payload in clear, so
+     *       that RTX packets are protected with the context of
+     *       rtxSSRC.
+     **/
+    bool
+    setRetransmissionStream(uint32 ssrc, uint32 rtxSSRC, PayloadType rtxPT);
+
+    /**
+     * Go back to in-band retransmission for a local stream.
+     *
+     * @param ssrc SSRC identifier of the main or a local stream.
+     * @return whether ssrc identifies a local stream.
+     **/
+    bool
+    clearRetransmissionStream(uint32 ssrc);
+
+    /**
+     * Set the minimum time between two retransmissions of the
+     * same packet. Requests arriving sooner are ignored.
+     *
+     * @param interval minimum interval in microseconds.
+     **/
+    inline void
+    setRetransmissionInterval(microtimeout_t interval)
+    { retransmissionInterval = interval; }
+
+    inline microtimeout_t
+    getRetransmissionInterval() const
+    { return retransmissionInterval; }
+
+    /**
+     * Retransmit a packet still in the retransmission history, in
+     * band or as RTX (see setRetransmissionStream()). Packets of
+     * streams protected with SRTP are only retransmitted as RTX.
+     *
+     * @param ssrc SSRC identifier of the main or a local stream.
+     * @param seqNum sequence number of the packet.
+     * @return whether the packet was retransmitted. It is not if
+     *         it is no longer in the history, if it was
+     *         retransmitted less than the retransmission interval
+     *         ago or if it would be in band but is protected.
+     **/
+    bool
+    retransmit(uint32 ssrc, uint16 seqNum);
+
+    /**
+     * Get the number of packets retransmitted so far.
+     **/
+    inline uint32
+    getRetransmittedPacketCount() const
+    { return retransmittedCount; }
+
+    /**
+     * Protect the packets of the main stream with forward error
+     * correction. The FEC packets generated by the encoder are sent
+     * as a local stream (see addLocalStream()) with their own SSRC
+     * and payload type, and the clock rate of the main stream.
+     *
+     * @param encoder FEC encoder, not owned by the queue. NULL
+     *        stops sending FEC and removes the FEC stream.
+     * @param fecSSRC SSRC identifier of the FEC stream.
+     * @param pt payload type of the FEC packets (dynamic).
+     * @return whether the FEC stream could be added.
+     **/
+    bool
+    setFECEncoder(FECEncoder* encoder, uint32 fecSSRC, PayloadType pt);
+
+    inline FECEncoder*
+    getFECEncoder() const
+    { return fecEncoder; }
+
+    /**
+     * Send the data put with putData() as redundant audio data
+     * (RFC 2198): each packet carries a frame and previous ones, in
+     * a payload of type pt. The frames keep the current payload
+     * type (see setPayloadFormat()). Data should be put in frames
+     * that fit in a packet, from a single thread.
+     *
+     * @param encoder RED encoder, not owned by the queue. NULL
+     *        stops sending redundant data.
+     * @param pt payload type of the RED packets (dynamic).
+     **/
+    void
+    setREDEncoder(REDEncoder* encoder, PayloadType pt);
+
+    inline REDEncoder*
+    getREDEncoder() const
+    { return redEncoder; }
+
+    /**
+     * Set who is notified when packets are queued for sending
+     * and there were none. Once this returns, the previous
+     * listener is no longer called.
+     *
+     * @param listener listener, not owned by the queue, NULL for
+     *        none.
+     **/
+    void
+    setSendListener(RTPSendListener* listener);
+
+    /**
+     * Pace the data packets: the service thread will not send
+     * faster than the given bitrate, which should be somewhat
+     * higher than the media bitrate so that bursts are smoothed,
+     * not delayed.
+     *
+     * @param bps bitrate in bits per second, 0 for no pacing.
+     **/
+    void
+    setPacingRate(uint32 bps);
+
+    inline uint32
+    getPacingRate() const
+    { return pacingRate; }
+
     inline microtimeout_t
     getDefaultSchedulingTimeout() const
     { return defaultSchedulingTimeout; }
@@ -409,6 +1004,19 @@ public:
         getSequenceNumber() const
         { return sendInfo.sendSeq; }
 
+        /**
+         * Get the queue sequence number of the next packet put
+         * with putData(), the following ones get consecutive
+         * numbers. Packets get their sequence number when they are
+         * sent, so it is the one they are sent with only as long
+         * as packets are sent in the order they are put.
+         *
+         * @return the 16 bit queue sequence number.
+         **/
+        inline uint16
+        getQueueSequenceNumber() const
+        { return sendInfo.queueSeq; }
+
         /**
          * Set ouput queue CryptoContext.
          *
@@ -445,18 +1053,122 @@ public:
 protected:
     OutgoingDataQueue();
 
-    virtual ~OutgoingDataQueue()
-    { }
+    virtual ~OutgoingDataQueue();
+
+    /**
+     * Recently sent packets of a stream, indexed by sequence number
+     * in a ring, and the state to retransmit them as RTX.
+     **/
+    struct RetransmissionHistory
+    {
+        RetransmissionHistory();
+
+        ~RetransmissionHistory();
+
+        /**
+         * Release the packets kept and allocate room for a number
+         * of packets, a power of two (or 0).
+         **/
+        void
+        resize(uint32 size);
+
+        /**
+         * Keep a packet just sent, taking ownership of it.
+         *
+         * @param packet packet sent.
+         * @param now time it was sent.
+         * @param payload copy of its payload in clear, allocated
+         *        with new[], if the packet was protected with SRTP.
+         **/
+        void
+        store(OutgoingRTPPkt* packet, const timeval& now,
+              unsigned char* payload = NULL);
+
+        struct Entry
+        {
+            OutgoingRTPPkt* packet;
+            // payload in clear of protected packets, NULL otherwise
+            unsigned char* payload;
+            timeval sent;
+            timeval retransmitted;
+        };
+
+        /**
+         * Find a packet kept for less than duration.
+         *
+         * @return entry of the packet, NULL if not found.
+         **/
+        Entry*
+        find(uint16 seqNum, const timeval& now, microtimeout_t duration);
+
+        Entry* entries;
+        uint32 mask;
+        // RTX stream, if rtx
+        bool rtx;
+        uint32 rtxSSRC;
+        PayloadType rtxPT;
+        uint16 rtxSeq;
+    };
+
+    /**
+     * State of a local stream added with addLocalStream(). The
+     * main stream state is kept in sendInfo instead.
+     **/
+    struct LocalStream
+    {
+        uint32 ssrc;
+        uint32 ssrcNetwork;
+        // the sequence number of the next packet to sent
+        uint16 sendSeq;
+        // ramdonly generated offset for the timestamp of sent packets
+        uint32 initialTimestamp;
+        PayloadType payloadType;
+        uint32 clockRate;
+        // number of packets sent from the beginning
+        uint32 packetCount;
+        // number of payload octets sent from the beginning
+        uint32 octetCount;
+        // number of packets sent when the last SR was built
+        uint32 reportedPacketCount;
+        RetransmissionHistory history;
+    };
+
+    // local streams other than the main one, protected by the
+    // sending queue lock
+    std::list<LocalStream*> localStreams;
+
+    inline void lockLocalStreams() const
+    { sendLock.readLock(); }
+
+    inline void unlockLocalStreams() const
+    { sendLock.unlock(); }
 
     struct OutgoingRTPPktLink
     {
         OutgoingRTPPktLink(OutgoingRTPPkt* pkt,
                    OutgoingRTPPktLink* p,
                    OutgoingRTPPktLink* n) :
-            packet(pkt), prev(p), next(n) { }
+            packet(pkt), prev(p), next(n), sendClass(0),
+            stream(NULL), stamp(0), seq(0) { }
 
         ~OutgoingRTPPktLink() { delete packet; }
 
+        inline uint8 getSendClass() const { return sendClass; }
+
+        inline void setSendClass(uint8 c) { sendClass = c; }
+
+        inline LocalStream* getStream() const { return stream; }
+
+        inline void setStream(LocalStream* s) { stream = s; }
+
+        inline uint32 getStamp() const { return stamp; }
+
+        inline void setStamp(uint32 st) { stamp = st; }
+
+        inline uint16 getSeqNum() const { return seq; }
+
+        inline void setSeqNum(uint16 sq) { seq = sq; }
+
         inline OutgoingRTPPkt* getPacket() { return packet; }
 
         inline void setPacket(OutgoingRTPPkt* pkt) { packet = pkt; }
@@ -471,10 +1183,123 @@ protected:
 
         // the packet this link refers to.
         OutgoingRTPPkt* packet;
-        // global outgoing packets queue.
+        // outgoing packets queue of its send class.
         OutgoingRTPPktLink * prev, * next;
+        // send class the packet belongs to.
+        uint8 sendClass;
+        // local stream, NULL for the main one.
+        LocalStream* stream;
+        // timestamp relative to the timestamp base of the
+        // stream, which orders the queues.
+        uint32 stamp;
+        // number setPartialBySeqNum() finds a packet of the main
+        // stream by, the packet gets its sequence number when sent.
+        uint16 seq;
+    };
+
+    /**
+     * Strict weak ordering of 32-bit RTP timestamps in serial
+     * number arithmetic, so that the order survives a timestamp
+     * wrap-around while the queued packets span less than 2^31
+     * timestamp units.
+     **/
+    struct TimestampOrder
+    {
+        inline bool operator()(uint32 l, uint32 r) const
+        { return static_cast<int32>(l - r) < 0; }
+    };
+
+    /**
+     * Strict weak ordering of 16-bit sequence numbers in serial
+     * number arithmetic.
+     **/
+    struct SeqNumOrder
+    {
+        inline bool operator()(uint16 l, uint16 r) const
+        { return static_cast<int16>(l - r) < 0; }
     };
 
+    // first queued packet for each timestamp.
+    typedef std::map<uint32, OutgoingRTPPktLink*, TimestampOrder> SendTimestampIndex;
+    // queued packets of the main stream by queue sequence number.
+    typedef std::map<uint16, OutgoingRTPPktLink*, SeqNumOrder> SendSeqNumIndex;
+
+    /**
+     * Queue and scheduling parameters of a send class.
+     **/
+    struct SendClass
+    {
+        // packets queue, ordered by timestamp
+        OutgoingRTPPktLink* first, * last;
+        // first packet for each timestamp
+        SendTimestampIndex stampIndex;
+        uint8 priority;
+        uint16 weight;
+        // 0 for the queue expire timeout
+        microtimeout_t deadline;
+        // deficit round robin counter, in octets
+        int32 deficit;
+        uint32 expiredCount;
+    };
+
+    /**
+     * Insert a packet in the queue of its send class, keeping the
+     * queue ordered by timestamp. Packets with the same timestamp
+     * keep the order in which they were inserted. sendLock must be
+     * held for writing.
+     *
+     * @param link link to the packet to insert.
+     * @param first whether to insert it before the packets with
+     *        the same timestamp instead of after them.
+     **/
+    void
+    insertSendPacket(OutgoingRTPPktLink* link, bool first = false);
+
+    /**
+     * Unlink a packet from the queue of its send class and the
+     * indexes. The link is not deleted. sendLock must be held for
+     * writing.
+     *
+     * @param link link to the packet to unlink.
+     **/
+    void
+    unlinkSendPacket(OutgoingRTPPktLink* link);
+
+    /**
+     * Copy data into the payload of a queued packet. sendLock
+     * must be held for writing.
+     *
+     * @return Number of packet data bytes set.
+     **/
+    size_t
+    setPartialData(OutgoingRTPPktLink* link, unsigned char* data,
+               size_t offset, size_t max);
+
+    /**
+     * Compute when a queued packet is scheduled to be sent,
+     * relative to now.
+     *
+     * @param link link to the queued packet.
+     * @param now current time.
+     * @param late set to whether the packet should have been sent
+     *        already.
+     * @return microseconds to wait or, if late, microseconds the
+     *         packet is late.
+     **/
+    microtimeout_t
+    getSendDelay(OutgoingRTPPktLink& link, const timeval& now, bool& late);
+
+    /**
+     * Choose the send class to serve next among the classes with
+     * due packets, according to the scheduling policy. sendLock
+     * must be held for writing.
+     *
+     * @param due which classes have due packets, at least one.
+     * @return chosen send class.
+     **/
+    uint8
+    selectSendClass(const bool due[]);
+
     /**
      * This is used to write the RTP data packet to one or more
      * destinations.  It is used by both sendImmediate and by
@@ -492,6 +1317,13 @@ protected:
      * forms the "isPending()" timeout of the rtp receiver in the
      * service thread.
      *
+     * Packets at the head of every send class are considered. Late
+     * packets beyond the deadline of their class are dropped,
+     * lowest priority classes first. When several classes have due
+     * packets, the one to be served by the next
+     * dispatchDataPacket() is chosen according to the scheduling
+     * policy.
+     *
      * @return timeout until next packet is scheduled to send.
      **/
     microtimeout_t
@@ -534,8 +1366,23 @@ protected:
     getInitialTimestamp()
     { return initialTimestamp; }
 
+    /**
+     * A hook called when a data packet has left the sending queue,
+     * sent or expired, and the queue is no longer locked. May be
+     * used to put more data as soon as there is room for it.
+     **/
+    inline virtual void onSendDequeued()
+    { }
+
     void purgeOutgoingQueue();
 
+    /**
+     * Get the memory used by the sending side: packets queued and
+     * crypto contexts.
+     **/
+    size_t
+    getSendMemoryUsage() const;
+
         virtual void
         setControlPeer(const InetAddress &host, tpport_t port) {}
 
@@ -549,6 +1396,37 @@ protected:
         std::list<CryptoContext *> cryptoContexts;
 
 private:
+    /**
+     * Segment data into packets of the main stream or of a local
+     * stream and insert them in the sending queue.
+     *
+     * @param stream local stream, NULL for the main one.
+     * @param packetizer packetizer to split data with, NULL to
+     *        segment it according to getMaxSendSegmentSize().
+     **/
+    void
+    putStreamPackets(LocalStream* stream, uint32 stamp,
+             const unsigned char* data, size_t datalen, bool mark,
+             RTPPacketizer* packetizer = NULL);
+
+    /**
+     * Get the retransmission history of a local stream. sendLock
+     * must be held.
+     *
+     * @return history, NULL if ssrc is not a local stream.
+     **/
+    RetransmissionHistory*
+    findRetransmissionHistory(uint32 ssrc);
+
+    /**
+     * Get the SRTP context for a local SSRC, deriving it from the
+     * default context (for SSRC 0) if there is none yet.
+     *
+     * @return crypto context, or NULL if SRTP is not used.
+     **/
+    CryptoContext*
+    getSendCryptoContext(uint32 ssrc);
+
         /**
      * A hook to filter packets being sent that have been expired.
      *
@@ -585,8 +1463,40 @@ private:
     static const microtimeout_t defaultSchedulingTimeout;
     static const microtimeout_t defaultExpireTimeout;
     mutable ThreadLock sendLock;
-    // outgoing data packets queue
-    OutgoingRTPPktLink* sendFirst, * sendLast;
+    // outgoing data packets queues, one per send class
+    SendClass sendClasses[maxSendClasses];
+    // index over all the outgoing data packets queues
+    SendSeqNumIndex sendSeqIndex;
+    // packets in all the queues
+    size_t sendQueueLength;
+    // send class of packets given to putData
+    uint8 currentSendClass;
+    SendSchedulingPolicy sendPolicy;
+    // next class to visit in weighted fair scheduling
+    uint8 sendRoundRobin;
+    // class chosen by getSchedulingTimeout, or maxSendClasses
+    uint8 sendNextClass;
+    static const int32 defaultSendQuantum;
+    // how long sent packets are kept, 0 if not at all
+    microtimeout_t retransmissionHistory;
+    // minimum time between retransmissions of a packet
+    microtimeout_t retransmissionInterval;
+    uint32 retransmittedCount;
+    RetransmissionHistory mainHistory;
+    static const microtimeout_t defaultRetransmissionInterval;
+    // FEC for the main stream, and the stream FEC packets go in
+    FECEncoder* fecEncoder;
+    LocalStream* fecStream;
+    // redundant audio data for the main stream
+    REDEncoder* redEncoder;
+    PayloadType redPayloadType;
+    // notified when the queue gets packets to send
+    RTPSendListener* sendListener;
+    // pacing bitrate, 0 if not paced, and when the next packet can go
+    uint32 pacingRate;
+    timeval pacingNextSend;
+    // how late packets are dispatched
+    RTPLateness sendLateness;
     uint32 initialTimestamp;
     // transmission scheduling timeout for the service thread
     microtimeout_t schedulingTimeout;
@@ -601,6 +1511,8 @@ private:
         uint32 octetCount;
         // the sequence number of the next packet to sent
         uint16 sendSeq;
+        // the queue sequence number of the next packet put
+        uint16 queueSeq;
         // contributing sources
         uint32 sendSources[16];
         // how many CSRCs to send.
@@ -0,0 +1,452 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file packetizer.h
+ *
+ * @short Payload format specific packetization: H.264 (RFC 6184)
+ * and H.265 (RFC 7798).
+ **/
+
+#ifndef CCXX_RTP_PACKETIZER_H_
+#define CCXX_RTP_PACKETIZER_H_
+
+#include <ccrtp/base.h>
+#include <vector>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @defgroup packetizer Payload packetization.
+ * @{
+ **/
+
+/**
+ * @class RTPPacketizer
+ * @short Splits frames in RTP payloads following a payload format.
+ *
+ * A packetizer is given to OutgoingDataQueue::putPacketizedData(),
+ * which asks it for the size of every payload and has it write the
+ * payload directly in the packet to be sent, so that the frame data
+ * is copied once.
+ **/
+class __EXPORT RTPPacketizer
+{
+public:
+    virtual
+    ~RTPPacketizer()
+    { }
+
+    /**
+     * Start packetizing a frame.
+     *
+     * @param data frame, must be valid until the whole frame has
+     *        been written.
+     * @param len length of the frame.
+     * @param maxPayload maximum size of a payload.
+     **/
+    virtual void
+    setFrame(const unsigned char* data, size_t len, size_t maxPayload) = 0;
+
+    /**
+     * Get the size of the next payload.
+     *
+     * @return size of the payload, 0 once the whole frame has been
+     *         written.
+     **/
+    virtual size_t
+    getNextSize() const = 0;
+
+    /**
+     * Write the next payload, of getNextSize() octets, and move on
+     * to the following one.
+     *
+     * @param payload where to write the payload.
+     **/
+    virtual void
+    writeNext(unsigned char* payload) = 0;
+
+protected:
+    RTPPacketizer()
+    { }
+};
+
+/**
+ * @class NALUnitPacketizer
+ * @short Packetization of NAL unit based video formats.
+ *
+ * Frames (access units) are given in Annex B byte stream format,
+ * that is, NAL units preceded by start codes. A frame without a
+ * leading start code is taken as a single NAL unit. NAL units that
+ * fit in a payload are sent alone or, when several consecutive ones
+ * fit, in an aggregation packet. Bigger NAL units are split in
+ * fragmentation units.
+ **/
+class __EXPORT NALUnitPacketizer : public RTPPacketizer
+{
+public:
+    void
+    setFrame(const unsigned char* data, size_t len, size_t maxPayload);
+
+    inline size_t
+    getNextSize() const
+    { return nextSize; }
+
+    void
+    writeNext(unsigned char* payload);
+
+    /**
+     * Enable or disable aggregation packets, enabled by default.
+     **/
+    inline void
+    setAggregation(bool enable)
+    { aggregation = enable; }
+
+protected:
+    /**
+     * @param headerSize NAL unit header size.
+     * @param aggregationSize aggregation packet header size.
+     * @param fragmentSize fragmentation unit headers size.
+     **/
+    NALUnitPacketizer(size_t headerSize, size_t aggregationSize,
+              size_t fragmentSize);
+
+    /**
+     * Write the header of an aggregation packet, merging the header
+     * of every NAL unit aggregated in turn.
+     *
+     * @param payload where to write it.
+     * @param nal a NAL unit aggregated.
+     * @param first whether nal is the first one.
+     **/
+    virtual void
+    writeAggregationHeader(unsigned char* payload, const unsigned char* nal,
+                   bool first) = 0;
+
+    /**
+     * Write the headers of a fragmentation unit.
+     *
+     * @param payload where to write them.
+     * @param nal the NAL unit fragmented.
+     * @param start whether this is the first fragment.
+     * @param end whether this is the last fragment.
+     **/
+    virtual void
+    writeFragmentHeader(unsigned char* payload, const unsigned char* nal,
+                bool start, bool end) = 0;
+
+private:
+    struct NALUnit
+    {
+        const unsigned char* data;
+        size_t len;
+    };
+
+    // compute the next payload
+    void
+    plan();
+
+    size_t nalHeaderSize, aggregationHeaderSize, fragmentHeaderSize;
+    bool aggregation;
+    size_t maxPayloadSize;
+    // NAL units of the frame, the vector is reused between frames
+    std::vector<NALUnit> nals;
+    size_t nextNAL;
+    // offset in the NAL unit being fragmented, 0 if none
+    size_t fragmentOffset;
+    size_t nextSize;
+    // NAL units in the next payload, 0 for a fragment
+    size_t nextCount;
+};
+
+/**
+ * @class H264Packetizer
+ * @short H.264 packetization (RFC 6184), non-interleaved mode:
+ * single NAL unit, STAP-A and FU-A packets.
+ **/
+class __EXPORT H264Packetizer : public NALUnitPacketizer
+{
+public:
+    H264Packetizer();
+
+protected:
+    void
+    writeAggregationHeader(unsigned char* payload, const unsigned char* nal,
+                   bool first);
+
+    void
+    writeFragmentHeader(unsigned char* payload, const unsigned char* nal,
+                bool start, bool end);
+};
+
+/**
+ * @class H265Packetizer
+ * @short H.265 packetization (RFC 7798), without DONL fields:
+ * single NAL unit, AP and FU packets.
+ **/
+class __EXPORT H265Packetizer : public NALUnitPacketizer
+{
+public:
+    H265Packetizer();
+
+protected:
+    void
+    writeAggregationHeader(unsigned char* payload, const unsigned char* nal,
+                   bool first);
+
+    void
+    writeFragmentHeader(unsigned char* payload, const unsigned char* nal,
+                bool start, bool end);
+};
+
+/**
+ * @class RTPDepacketizer
+ * @short Rebuilds frames from RTP payloads following a payload format.
+ *
+ * A depacketizer is given to
+ * IncomingDataQueue::getDepacketizedData(), which feeds it the
+ * payloads of the packets of a frame in sequence order. The frame
+ * is rebuilt in a contiguous buffer owned by the depacketizer and
+ * reused from frame to frame.
+ **/
+class __EXPORT RTPDepacketizer
+{
+public:
+    virtual
+    ~RTPDepacketizer();
+
+    /**
+     * Start rebuilding a new frame.
+     *
+     * @param stamp timestamp of the frame.
+     **/
+    virtual void
+    reset(uint32 stamp);
+
+    /**
+     * Add the payload of the next packet of the frame.
+     *
+     * @param payload payload.
+     * @param len length of the payload.
+     * @return false if the payload is not valid.
+     **/
+    virtual bool
+    add(const unsigned char* payload, size_t len) = 0;
+
+    /**
+     * Signal that packets of the frame are missing before the next
+     * payload added. The frame is marked incomplete.
+     **/
+    virtual void
+    lost();
+
+    /**
+     * Signal that every payload of the frame has been added.
+     **/
+    virtual void
+    finish();
+
+    inline const unsigned char*
+    getData() const
+    { return buffer; }
+
+    inline size_t
+    getSize() const
+    { return size; }
+
+    inline uint32
+    getTimestamp() const
+    { return timestamp; }
+
+    /**
+     * Whether the frame is complete: no packet was missing and
+     * every payload was valid.
+     **/
+    inline bool
+    isComplete() const
+    { return complete; }
+
+protected:
+    RTPDepacketizer();
+
+    /**
+     * Make room for len more octets at the end of the frame.
+     *
+     * @return where to write them.
+     **/
+    unsigned char*
+    append(size_t len);
+
+    /**
+     * Drop the octets of the frame from offset on.
+     **/
+    inline void
+    truncate(size_t offset)
+    { if ( offset < size ) size = offset; }
+
+    inline void
+    setIncomplete()
+    { complete = false; }
+
+private:
+    RTPDepacketizer(const RTPDepacketizer&);
+
+    RTPDepacketizer&
+    operator=(const RTPDepacketizer&);
+
+    unsigned char* buffer;
+    size_t size, capacity;
+    uint32 timestamp;
+    bool complete;
+};
+
+/**
+ * @class NALUnitDepacketizer
+ * @short Rebuilds frames of NAL unit based video formats.
+ *
+ * Frames are rebuilt in Annex B byte stream format, every NAL unit
+ * preceded by a four octets start code. A NAL unit whose fragments
+ * are not all received is left out of the frame.
+ **/
+class __EXPORT NALUnitDepacketizer : public RTPDepacketizer
+{
+public:
+    void
+    reset(uint32 stamp);
+
+    bool
+    add(const unsigned char* payload, size_t len);
+
+    void
+    lost();
+
+    void
+    finish();
+
+protected:
+    /**
+     * @param headerSize NAL unit header size.
+     **/
+    NALUnitDepacketizer(size_t headerSize);
+
+    typedef enum {
+        packetSingle,       ///< A single NAL unit.
+        packetAggregation,  ///< Several NAL units.
+        packetFragment,     ///< A fragment of a NAL unit.
+        packetInvalid       ///< Not supported.
+    }       PacketKind;
+
+    /**
+     * Tell the kind of a payload from its header.
+     **/
+    virtual PacketKind
+    getPacketKind(const unsigned char* payload) const = 0;
+
+    /**
+     * Parse the headers of a fragmentation unit.
+     *
+     * @param payload the payload, at least getNALHeaderSize() + 1
+     *        octets long.
+     * @param header where to rebuild the NAL unit header.
+     * @param start set to whether this is the first fragment.
+     * @param end set to whether this is the last fragment.
+     **/
+    virtual void
+    parseFragmentHeader(const unsigned char* payload,
+                unsigned char* header, bool& start, bool& end) const = 0;
+
+    inline size_t
+    getNALHeaderSize() const
+    { return nalHeaderSize; }
+
+private:
+    void
+    addNALUnit(const unsigned char* nal, size_t len);
+
+    size_t nalHeaderSize;
+    // offset of the NAL unit being defragmented, if any
+    size_t fragmentStart;
+    bool fragmenting;
+};
+
+/**
+ * @class H264Depacketizer
+ * @short H.264 depacketization (RFC 6184), non-interleaved mode.
+ **/
+class __EXPORT H264Depacketizer : public NALUnitDepacketizer
+{
+public:
+    H264Depacketizer();
+
+protected:
+    PacketKind
+    getPacketKind(const unsigned char* payload) const;
+
+    void
+    parseFragmentHeader(const unsigned char* payload,
+                unsigned char* header, bool& start, bool& end) const;
+};
+
+/**
+ * @class H265Depacketizer
+ * @short H.265 depacketization (RFC 7798), without DONL fields.
+ **/
+class __EXPORT H265Depacketizer : public NALUnitDepacketizer
+{
+public:
+    H265Depacketizer();
+
+protected:
+    PacketKind
+    getPacketKind(const unsigned char* payload) const;
+
+    void
+    parseFragmentHeader(const unsigned char* payload,
+                unsigned char* header, bool& start, bool& end) const;
+};
+
+/** @}*/ // packetizer
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_PACKETIZER_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
@@ -43,7 +43,11 @@
 #define CCXX_RTP_POOL_H
 
 #include <list>
+#include <vector>
 #include <ccrtp/rtp.h>
+#ifndef _MSWINDOWS_
+#include <poll.h>
+#endif
 
 NAMESPACE_COMMONCPP
 using std::list;
@@ -75,11 +79,153 @@ public:
     controlTransmissionService(RTPSessionBase& s)
     { s.controlTransmissionService(); }
 
+    void
+    controlReadyService(RTPSessionBase& s)
+    { s.controlReadyService(); }
+
     inline SOCKET getDataRecvSocket(RTPSessionBase& s) const
     { return s.getDataRecvSocket(); }
 
     inline SOCKET getControlRecvSocket(RTPSessionBase& s) const
     { return s.getControlRecvSocket(); }
+
+    inline bool isSending(RTPSessionBase& s) const
+    { return s.isSending(); }
+
+    inline timeval getNextControlTime(RTPSessionBase& s) const
+    { return s.getNextControlTime(); }
+
+    inline void releaseHeldPackets(RTPSessionBase& s)
+    { s.releaseHeldPackets(); }
+
+    inline bool getHeldDeadline(RTPSessionBase& s, timeval& deadline)
+    { return s.getHeldDeadline(deadline); }
+
+    inline bool isControlServiceActive(RTPSessionBase& s) const
+    { return s.isControlServiceActive(); }
+
+    inline bool setDataUring(RTPSessionBase& s, RTPUring* r, void* tag)
+    { return s.getDSO()->setUring(r,tag); }
+};
+
+/**
+ * @class RTPTimerWheel
+ * @short Hierarchical timing wheel.
+ *
+ * Timers are kept in the slots of a few wheels, each one with
+ * coarser slots than the previous one, and move to a finer wheel
+ * as their deadline gets near. Scheduling, cancelling and expiring
+ * a timer take constant time, whatever the number of timers.
+ *
+ * Deadlines are absolute times in microseconds. Timers expire at
+ * the resolution of the wheel: up to one slot early.
+ **/
+class __EXPORT RTPTimerWheel
+{
+public:
+    /**
+     * A timer. Objects to be scheduled derive from it.
+     **/
+    class __EXPORT Timer
+    {
+    public:
+        Timer() : deadline(0), pprev(NULL), next(NULL), level(0)
+        { }
+
+        inline bool
+        isScheduled() const
+        { return NULL != pprev; }
+
+        inline uint64
+        getDeadline() const
+        { return deadline; }
+
+    private:
+        friend class RTPTimerWheel;
+        uint64 deadline;
+        // link to this timer in its slot list
+        Timer** pprev;
+        Timer* next;
+        uint8 level;
+    };
+
+    /**
+     * @param resolution time of the slots of the finest wheel, in
+     *        microseconds.
+     **/
+    RTPTimerWheel(microtimeout_t resolution = 1000);
+
+    /**
+     * Schedule a timer, or change its deadline.
+     **/
+    void
+    schedule(Timer& timer, uint64 deadline);
+
+    void
+    cancel(Timer& timer);
+
+    /**
+     * Take out the timers expired at the given time.
+     *
+     * @param now current time, in microseconds.
+     * @param expired where the timers expired are appended.
+     * @return number of timers expired.
+     **/
+    size_t
+    expire(uint64 now, std::vector<Timer*>& expired);
+
+    /**
+     * Get how long till the wheel must be expired again.
+     *
+     * @param now current time, in microseconds.
+     * @param max timeout when no timer is scheduled that soon.
+     **/
+    microtimeout_t
+    getTimeout(uint64 now, microtimeout_t max) const;
+
+    inline size_t
+    size() const
+    { return count; }
+
+    /**
+     * Get the current time, in microseconds, as used for
+     * deadlines.
+     **/
+    static uint64
+    getTime();
+
+private:
+    static const unsigned levels = 4;
+    static const unsigned slotBits = 6;
+    static const unsigned slots = 1 << slotBits;
+
+    void
+    insert(Timer& timer);
+
+    void
+    cascade(unsigned level);
+
+    Timer* wheels[levels][slots];
+    size_t levelCount[levels];
+    microtimeout_t resolution;
+    // first tick not expired yet
+    uint64 currentTick;
+    size_t count;
+    // timers were scheduled already due
+    bool late;
+};
+
+class RTPSessionPool;
+class SessionListElement;
+
+/**
+ * What a readiness notification of a session pool refers to: the
+ * data or the control socket of a session.
+ **/
+struct PollTarget
+{
+    SessionListElement* element;
+    bool control;
 };
 
 /**
@@ -89,21 +235,50 @@ public:
  * @author Jorgen Terner
  **/
 
-class SessionListElement {
+class SessionListElement :
+    public RTPTimerWheel::Timer,
+    public RTPSendListener
+{
 private:
     RTPSessionBase* elem;
     bool cleared;
+    // position in the registry, and next element in the same bucket
+    size_t index;
+    SessionListElement* nextHashed;
+
+    friend class SessionRegistry;
 
 public:
     SessionListElement(RTPSessionBase* e);
     void clear();
+    RTPSessionBase* release();
     bool isCleared();
     RTPSessionBase* get();
+
+    /**
+     * Schedules the session in its pool.
+     **/
+    void onSendQueued();
+
+    // registered for readiness notifications of the sockets
+    PollTarget dataTarget;
+    PollTarget controlTarget;
+    SOCKET dataSocket;
+    SOCKET controlSocket;
+    // the data socket is served by the io_uring of the pool
+    bool dataUring;
+    // pool serving the session
+    RTPSessionPool* pool;
 };
 
 
 inline SessionListElement::SessionListElement(RTPSessionBase* e)
-    : elem(e), cleared(false) {
+    : elem(e), cleared(false), index(0), nextHashed(NULL),
+      dataSocket(INVALID_SOCKET), controlSocket(INVALID_SOCKET),
+      dataUring(false), pool(NULL) {
+    dataTarget.element = controlTarget.element = this;
+    dataTarget.control = false;
+    controlTarget.control = true;
 }
 
 inline void SessionListElement::clear() {
@@ -112,6 +287,16 @@ inline void SessionListElement::clear() {
     elem = 0;
 }
 
+/**
+ * Like clear(), but the session is not deleted.
+ **/
+inline RTPSessionBase* SessionListElement::release() {
+    RTPSessionBase* e = elem;
+    cleared = true;
+    elem = 0;
+    return e;
+}
+
 inline bool SessionListElement::isCleared() {
     return cleared;
 }
@@ -138,6 +323,140 @@ public:
     }
 };
 
+/**
+ * Sessions of a pool. Elements are kept in an array, to go through
+ * them, and in a hash table by session, so that adding, finding and
+ * removing a session take constant time.
+ **/
+class __EXPORT SessionRegistry
+{
+public:
+    SessionRegistry();
+
+    ~SessionRegistry();
+
+    /**
+     * Add a session.
+     *
+     * @return new element of the session, NULL if it was already
+     *         there.
+     **/
+    SessionListElement*
+    add(RTPSessionBase* session);
+
+    SessionListElement*
+    find(RTPSessionBase* session) const;
+
+    /**
+     * Take an element out of the registry, without deleting it.
+     **/
+    void
+    remove(SessionListElement* element);
+
+    inline size_t
+    size() const
+    { return elements.size(); }
+
+    inline SessionListElement*
+    operator[](size_t i) const
+    { return elements[i]; }
+
+private:
+    SessionRegistry(const SessionRegistry&);
+
+    SessionRegistry&
+    operator=(const SessionRegistry&);
+
+    size_t
+    bucket(const RTPSessionBase* session) const;
+
+    void
+    rehash(size_t count);
+
+    std::vector<SessionListElement*> elements;
+    std::vector<SessionListElement*> buckets;
+};
+
+/**
+ * Load of a session pool, or of a shard of a threaded pool.
+ **/
+struct RTPPoolLoad
+{
+    /// Sessions served.
+    size_t sessions;
+    /// Data packets read since the pool started.
+    uint64 packetsReceived;
+    /// Data packets sent since the pool started.
+    uint64 packetsSent;
+    /// Fraction of the time spent serving sessions rather than
+    /// waiting, averaged over the last iterations.
+    float busy;
+};
+
+/**
+ * @class RTPSessionPoolBase
+ * @short Interface of the RTP session pools.
+ *
+ * What is common to the pools serving sessions themselves (see
+ * RTPSessionPool) and to those handing them over to other pools
+ * (see ThreadedRTPSessionPool).
+ **/
+class __EXPORT RTPSessionPoolBase
+{
+public:
+    RTPSessionPoolBase() :
+        poolActive(false)
+    { }
+
+    inline virtual ~RTPSessionPoolBase()
+    { }
+
+    virtual bool
+    addSession(RTPSessionBase& session) = 0;
+
+    /**
+     * Remove a session from the pool, and delete it.
+     **/
+    virtual bool
+    removeSession(RTPSessionBase& session) = 0;
+
+    virtual size_t
+    getPoolLength() const = 0;
+
+    /**
+     * Get the load of the pool.
+     **/
+    virtual void
+    getLoad(RTPPoolLoad& load) const = 0;
+
+    /**
+     * Receive and send the data packets of the sessions through an
+     * io_uring (see RTPUring), rather than reading each socket
+     * when it is readable. RTCP packets are not affected. Must be
+     * called before the pool starts running.
+     *
+     * @return whether io_uring is used, false where it is not
+     *         available.
+     **/
+    virtual bool
+    enableUring() = 0;
+
+    virtual void startRunning() = 0;
+
+    inline bool isActive()
+    { return poolActive; }
+
+protected:
+    inline void setActive()
+    { poolActive = true; }
+
+    inline void setInactive()
+    { poolActive = false; }
+
+private:
+    mutable bool poolActive;
+};
+
 /**
  * This class is a base class for classes that define a group of RTP
  * sessions that will be served by one or more execution
@@ -149,34 +468,52 @@ public:
  * objects). Then, add the RTPSessionBase objects to an RTP session
  * "pool" and call startRunning() method of the session pool.
  *
+ * The data and control sockets of the sessions are registered when
+ * they are added, with epoll where available (poll otherwise), so
+ * that waiting for packets does not depend on the number of
+ * sessions.
+ *
+ * The next send and RTCP deadlines of each session are kept in a
+ * timing wheel, and the pool waits till the earliest one: only
+ * sessions with a deadline expired are served, and sessions with
+ * nothing to do cost nothing. Sessions with nothing to send are
+ * woken up when data is put. RTCP packets are read when the control
+ * socket is readable, and sent when the RTCP deadline expires.
+ *
+ * Data packets may be received and sent through an io_uring instead
+ * (see enableUring()).
+ *
  * @author Federico Montesino Pouzols <fedemp@altern.org>
  **/
-class __EXPORT RTPSessionPool: public RTPSessionBaseHandler
+class __EXPORT RTPSessionPool:
+        public RTPSessionPoolBase,
+        public RTPSessionBaseHandler
 {
 public:
     RTPSessionPool();
 
-    inline virtual ~RTPSessionPool()
-    { }
+    virtual ~RTPSessionPool();
 
-    bool
+    virtual bool
     addSession(RTPSessionBase& session);
 
-    bool
+    virtual bool
     removeSession(RTPSessionBase& session);
 
-    size_t
+    virtual size_t
     getPoolLength() const;
 
-    virtual void startRunning() = 0;
+    virtual void
+    getLoad(RTPPoolLoad& load) const;
 
-    inline bool isActive()
-    { return poolActive; }
+    virtual bool
+    enableUring();
 
 protected:
-    inline void setActive()
-    { poolActive = true; }
-
+    /**
+     * Get the maximum time the pool waits, when no deadline is
+     * nearer.
+     **/
     inline timeval getPoolTimeout()
     { return poolTimeout; }
 
@@ -186,19 +523,112 @@ protected:
     inline void setPoolTimeout(struct timeval to)
     { poolTimeout = to; }
 
-    std::list<SessionListElement*> sessionList;
-    typedef std::list<SessionListElement*>::iterator PoolIterator;
+    /**
+     * Wait till sockets of the sessions are readable, without
+     * holding the pool lock.
+     *
+     * @param timeout maximum wait.
+     * @return number of targets ready, in readyTargets.
+     **/
+    size_t
+    waitReady(const timeval& timeout);
 
-    mutable ThreadLock poolLock;
+    /**
+     * Make the thread serving the pool stop waiting.
+     **/
+    void
+    wakeUp();
 
-#ifndef _MSWINDOWS_
-    fd_set recvSocketSet;
-    SOCKET highestSocket;  // highest socket number + 1
-#endif
+    /**
+     * Serve the sessions once: packets received, and sessions
+     * with their send or RTCP deadline expired. Waits till the
+     * next deadline, at most the pool timeout.
+     **/
+    void
+    serviceSessions();
+
+    /**
+     * Take a session out of the pool, without deleting it, to be
+     * served by another pool.
+     *
+     * @return session, NULL if the pool has none.
+     **/
+    RTPSessionBase*
+    releaseSession();
+
+    /**
+     * Delete the elements of the sessions removed. Elements stay
+     * valid till then, so that notifications already taken for
+     * them can be checked with SessionListElement::isCleared().
+     **/
+    void
+    purgeSessions();
+
+    SessionRegistry sessions;
+    // removed, to be deleted by purgeSessions()
+    std::vector<SessionListElement*> removedSessions;
+    std::vector<PollTarget*> readyTargets;
+
+    mutable ThreadLock poolLock;
 
 private:
+    friend class SessionListElement;
+
+    /**
+     * Watch the sockets of a session.
+     *
+     * @param ring whether the data socket is read through the
+     *        io_uring, if enabled.
+     **/
+    void
+    watch(SessionListElement& element, bool ring = true);
+
+    void
+    unwatch(SessionListElement& element);
+
+    /**
+     * Schedule a session to be served now.
+     **/
+    void
+    scheduleNow(SessionListElement& element);
+
+    /**
+     * Schedule a session at its next send or RTCP deadline.
+     **/
+    void
+    scheduleNext(SessionListElement& element);
+
+    void
+    drainWakeUps();
+
+    void
+    processUring();
+
     timeval poolTimeout;
-    mutable bool poolActive;
+    // epoll instance, -1 when the sockets are polled
+    int pollHandle;
+    // io_uring serving the data sockets, if enabled
+    RTPUring* uring;
+    PollTarget uringTarget;
+    std::vector<void*> uringReady;
+    std::vector<void*> uringFailed;
+    // deadlines of the sessions, and the sessions expired
+    Mutex timerLock;
+    RTPTimerWheel timers;
+    std::vector<RTPTimerWheel::Timer*> expiredTimers;
+    // the serving thread is waiting, and a pipe to wake it up
+    bool waiting;
+    int wakeHandles[2];
+    PollTarget wakeTarget;
+    // load accounting, updated by the serving thread
+    mutable Mutex loadLock;
+    uint64 packetsReceived;
+    uint64 packetsSent;
+    float busy;
+#ifndef _MSWINDOWS_
+    std::vector<struct pollfd> pollSet;
+    std::vector<PollTarget*> pollSetTargets;
+#endif
 };
 
 
@@ -229,6 +659,105 @@ protected:
     void run();
 };
 
+/**
+ * @class ThreadedRTPSessionPool
+ * @short Sessions served by several threads.
+ *
+ * Each thread serves a shard of the sessions, with its own readiness
+ * notifications, and may be pinned to a processor. Sessions are
+ * added to the shard with the least sessions. A shard that is mostly
+ * idle takes sessions, one at a time, from a shard busy most of the
+ * time (see setBalancing()). The pool itself only hands sessions
+ * over to the shards, and has no event loop of its own.
+ **/
+class __EXPORT ThreadedRTPSessionPool : public RTPSessionPoolBase
+{
+public:
+    /**
+     * @param shards number of threads, 0 for one per processor.
+     * @param pin whether to pin the thread of each shard to a
+     *        processor.
+     * @param pri optional thread priority value.
+     **/
+    ThreadedRTPSessionPool(unsigned shards = 0, bool pin = true,
+                   int pri = 0);
+
+    /**
+     * Stop the threads. The sessions are not deleted.
+     **/
+    ~ThreadedRTPSessionPool();
+
+    bool
+    addSession(RTPSessionBase& session);
+
+    bool
+    removeSession(RTPSessionBase& session);
+
+    size_t
+    getPoolLength() const;
+
+    /**
+     * Get the load of all the shards: sums, and the average of the
+     * busy fractions.
+     **/
+    void
+    getLoad(RTPPoolLoad& load) const;
+
+    /**
+     * Enable io_uring in every shard, each one with its own ring.
+     **/
+    bool
+    enableUring();
+
+    void
+    startRunning();
+
+    inline unsigned
+    getShardsCount() const
+    { return static_cast<unsigned>(shards.size()); }
+
+    /**
+     * Get the load of a shard.
+     *
+     * @param shard shard index, less than getShardsCount().
+     * @param load load of the shard.
+     **/
+    void
+    getShardLoad(unsigned shard, RTPPoolLoad& load) const;
+
+    /**
+     * Set when sessions are moved between shards: a shard busy less
+     * than low takes a session from the busiest shard, if it is busy
+     * more than high and has more sessions. 0 and 1 stop moving
+     * sessions.
+     **/
+    void
+    setBalancing(float low, float high);
+
+    /**
+     * Get the number of sessions moved between shards so far.
+     **/
+    inline uint32
+    getMigratedCount() const
+    { return migratedCount; }
+
+private:
+    class Shard;
+    friend class Shard;
+
+    /**
+     * Called by an idle shard after serving its sessions.
+     **/
+    void
+    rebalance(Shard& shard);
+
+    std::vector<Shard*> shards;
+    // sessions are added, removed and moved with this lock
+    mutable Mutex migrationLock;
+    float lowLoad, highLoad;
+    uint32 migratedCount;
+};
+
 END_NAMESPACE
 
 #endif //CCXX_RTP_POOL_H
@@ -46,6 +46,8 @@
 #include <commoncpp/pointer.h>
 #include <ccrtp/rtppkt.h>
 #include <ccrtp/sources.h>
+#include <ccrtp/hdrext.h>
+#include <vector>
 
 NAMESPACE_COMMONCPP
 
@@ -156,6 +158,117 @@ private:
     const SyncSource* source;
 };
 
+/**
+ * @class RTPFrame
+ * @short A frame received over RTP packets, as a scatter list.
+ *
+ * Holds the packets of a source that share a timestamp, up to the
+ * one with the marker bit set (see IncomingDataQueue::getFrame()).
+ * Payloads are not copied: each segment of the list points to the
+ * payload of a packet, which is owned by the frame until clear() is
+ * called or the frame is destroyed. An object can be reused for
+ * successive frames.
+ **/
+class __EXPORT RTPFrame
+{
+public:
+    /// A payload of the frame.
+    struct Segment
+    {
+        const uint8* data;
+        size_t size;
+    };
+
+    RTPFrame();
+
+    ~RTPFrame();
+
+    /**
+     * Release the packets of the frame.
+     **/
+    void
+    clear();
+
+    /**
+     * Get the number of segments (packets) in the frame.
+     **/
+    inline size_t
+    getSegmentsCount() const
+    { return segments.size(); }
+
+    /**
+     * Get the segments of the frame, in sequence order.
+     *
+     * @return NULL if the frame is empty.
+     **/
+    inline const Segment*
+    getSegments() const
+    { return segments.empty() ? NULL : &segments[0]; }
+
+    /**
+     * Get the total size of the payloads.
+     **/
+    inline size_t
+    getSize() const
+    { return size; }
+
+    /**
+     * Get the timestamp of the frame, as for
+     * IncomingDataQueue::getFirstTimestamp().
+     **/
+    inline uint32
+    getTimestamp() const
+    { return timestamp; }
+
+    /**
+     * Get the payload type of the first packet.
+     **/
+    inline PayloadType
+    getType() const
+    { return packets.empty() ? ptINVALID : packets[0]->getPayloadType(); }
+
+    /**
+     * @return Source that sent this frame, NULL if empty.
+     **/
+    inline const SyncSource*
+    getSource() const
+    { return source; }
+
+    inline uint16
+    getFirstSeqNum() const
+    { return packets.empty() ? 0 : packets.front()->getSeqNum(); }
+
+    inline uint16
+    getLastSeqNum() const
+    { return packets.empty() ? 0 : packets.back()->getSeqNum(); }
+
+    /**
+     * Whether the frame is complete: no packet is missing before,
+     * within or after the packets received.
+     **/
+    inline bool
+    isComplete() const
+    { return complete; }
+
+private:
+    friend class IncomingDataQueue;
+
+    RTPFrame(const RTPFrame&);
+
+    RTPFrame&
+    operator=(const RTPFrame&);
+
+    void
+    add(IncomingRTPPkt* packet);
+
+    std::vector<IncomingRTPPkt*> packets;
+    std::vector<Segment> segments;
+    size_t size;
+    uint32 timestamp;
+    const SyncSource* source;
+    bool complete;
+};
+
 /**
  * @class RTPQueueBase
  *
@@ -201,6 +314,24 @@ public:
     inline timeval getInitialTime() const
     { return initialTime; }
 
+    /**
+     * Register the handler of an RTP header extension element for
+     * the data packets sent and received in this session.
+     *
+     * @param id local identifier, 1 to 255, as negotiated with the
+     *        peers. Identifiers up to 14 allow the more compact
+     *        one-byte header form.
+     * @param ext handler, not owned by the queue.
+     * @return false if the identifier is not valid or already used.
+     **/
+    inline bool
+    addHeaderExtension(uint8 id, HeaderExtension& ext)
+    { return headerExtensions.add(id,ext); }
+
+    inline bool
+    removeHeaderExtension(uint8 id)
+    { return headerExtensions.remove(id); }
+
 protected:
     /**
      * @param ssrc If not null, the local SSRC identifier for this
@@ -232,6 +363,10 @@ protected:
     renewLocalSSRC()
     { }
 
+    inline const HeaderExtensionRegistry&
+    getHeaderExtensions() const
+    { return headerExtensions; }
+
 private:
     // local SSRC 32-bit identifier
     uint32 localSSRC;
@@ -244,6 +379,8 @@ private:
     PayloadType currentPayloadType;
     // when the queue is created
     timeval initialTime;
+    // header extension handlers, by identifier
+    HeaderExtensionRegistry headerExtensions;
 };
 
 /**
@@ -0,0 +1,251 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file red.h
+ *
+ * @short Redundant audio data (RFC 2198).
+ **/
+
+#ifndef CCXX_RTP_RED_H_
+#define CCXX_RTP_RED_H_
+
+#include <ccrtp/packetizer.h>
+#include <ccrtp/formats.h>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @defgroup red Redundant audio data.
+ * @{
+ **/
+
+/**
+ * @class REDEncoder
+ * @short Packs the current audio frame and previous ones in RED
+ * payloads (RFC 2198).
+ *
+ * Every payload carries the frame put (primary encoding) and up to
+ * getRedundancy() previous frames, oldest first, with the offsets of
+ * their timestamps. Each frame is copied once in the history of the
+ * encoder, and from there directly in the payloads it is repeated
+ * in. Previous frames that do not fit in a payload, or whose offset
+ * or length can not be represented, are left out, along with the
+ * older ones.
+ *
+ * An encoder is used by an OutgoingDataQueue (see
+ * OutgoingDataQueue::setREDEncoder()), with one frame per packet.
+ **/
+class __EXPORT REDEncoder : public RTPPacketizer
+{
+public:
+    /// Maximum number of previous frames in a payload.
+    static const uint8 maxRedundancy = 8;
+
+    /**
+     * @param redundancy number of previous frames in a payload.
+     **/
+    REDEncoder(uint8 redundancy = 1);
+
+    /**
+     * Set the number of previous frames in a payload.
+     *
+     * @param redundancy number of frames, up to maxRedundancy.
+     * @return whether the number is valid.
+     **/
+    bool
+    setRedundancy(uint8 redundancy);
+
+    inline uint8
+    getRedundancy() const
+    { return redundancy; }
+
+    /**
+     * Set the timestamp and payload type of the next frame. Called
+     * by the queue before setFrame().
+     **/
+    inline void
+    setPrimary(uint32 stamp, PayloadType pt)
+    { primaryStamp = stamp; primaryType = pt; }
+
+    /**
+     * Prepare the payload of a frame. The frame is sent whole, in a
+     * single payload, even if it does not fit in maxPayload.
+     **/
+    void
+    setFrame(const unsigned char* data, size_t len, size_t maxPayload);
+
+    inline size_t
+    getNextSize() const
+    { return nextSize; }
+
+    /**
+     * Write the payload, and keep the frame for the following ones.
+     **/
+    void
+    writeNext(unsigned char* payload);
+
+    /**
+     * Forget the previous frames.
+     **/
+    void
+    reset();
+
+private:
+    struct Frame
+    {
+        uint32 stamp;
+        PayloadType type;
+        // grows to the largest frame kept in this entry
+        std::vector<unsigned char> data;
+        size_t len;
+    };
+
+    uint8 redundancy;
+    // history of the previous frames, newest at latest
+    Frame history[maxRedundancy];
+    uint8 latest;
+    uint8 kept;
+    uint32 primaryStamp;
+    PayloadType primaryType;
+    const unsigned char* primaryData;
+    size_t primaryLength;
+    // previous frames in the next payload
+    uint8 included;
+    size_t nextSize;
+};
+
+/**
+ * @class REDDecoder
+ * @short Splits RED payloads (RFC 2198) in RTP packets.
+ *
+ * A packet with a RED payload is decoded into one RTP packet per
+ * block: the primary one takes the sequence number and timestamp of
+ * the packet, the redundant ones the timestamps given by their
+ * offsets. Senders put one frame per packet, but may leave frames
+ * out of the redundant blocks (as with a redundancy distance of
+ * two), so the sequence number of a redundant block is told from
+ * its timestamp offset: it must be a multiple of the timestamp
+ * interval between the last packets with consecutive sequence
+ * numbers. Blocks whose offset is not are left out.
+ *
+ * A decoder is used by an IncomingDataQueue (see
+ * IncomingDataQueue::setREDDecoder()), which queues the primary
+ * block as the packet received, and the redundant blocks in place of
+ * the packets not received.
+ **/
+class __EXPORT REDDecoder
+{
+public:
+    /// Maximum number of blocks in a payload.
+    static const uint8 maxBlocks = 16;
+
+    REDDecoder();
+
+    /**
+     * Parse the RED payload of a packet.
+     *
+     * @param header raw RTP packet, its fixed header and CSRC list
+     *        are kept for the packets of the blocks.
+     * @param payload RED payload of the packet.
+     * @param len length of the payload.
+     * @return number of blocks, the last one being the primary, 0
+     *         if the payload is not valid.
+     **/
+    uint8
+    decode(const unsigned char* header, const unsigned char* payload,
+           size_t len);
+
+    /**
+     * Build the RTP packet of a block of the payload decoded. The
+     * payload given to decode() must still be valid.
+     *
+     * @param i block index, less than the value returned by decode().
+     * @param len set to the length of the packet.
+     * @return raw RTP packet, allocated with new[] and owned by the
+     *         caller, NULL for a redundant block whose sequence
+     *         number can not be told from its timestamp.
+     **/
+    unsigned char*
+    getPacket(uint8 i, size_t& len) const;
+
+    /**
+     * Get the number of packets recovered so far.
+     **/
+    inline uint32
+    getRecoveredCount() const
+    { return recoveredCount; }
+
+    /**
+     * Account a packet queued in place of a lost one.
+     **/
+    inline void
+    recovered()
+    { recoveredCount++; }
+
+private:
+    struct Block
+    {
+        PayloadType type;
+        uint16 offset;
+        const unsigned char* data;
+        size_t len;
+    };
+
+    const unsigned char* header;
+    Block blocks[maxBlocks];
+    uint8 count;
+    uint32 recoveredCount;
+    // latest packet decoded, and the timestamp interval between
+    // consecutive packets of its source, 0 if not known yet.
+    uint32 lastSSRC;
+    uint16 lastSeqNum;
+    uint32 lastStamp;
+    uint32 interval;
+};
+
+/** @}*/ // red
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_RED_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
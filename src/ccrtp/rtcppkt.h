@@ -242,6 +242,45 @@ public:
         uint16 blp;            ///< Bitmask of following Lost Packets.
     };
 
+    /**
+     * @struct FeedbackPacket
+     *
+     * @short Struct for transport layer (RTPFB) and payload
+     * specific (PSFB) feedback messages (RFC 4585). The feedback
+     * message type is given in the block_count field of the fixed
+     * header.
+     **/
+    struct FeedbackPacket
+    {
+        uint32 ssrc;           ///< ssrc identifier of the sender.
+        uint32 mediaSSRC;      ///< ssrc identifier of the media source.
+        unsigned char fci[1];  ///< feedback control information.
+    };
+
+    /**
+     * @struct GenericNACK
+     *
+     * @short FCI entry of generic NACK (RTPFB) messages.
+     **/
+    struct GenericNACK
+    {
+        uint16 pid;            ///< Packet ID: sequence number lost.
+        uint16 blp;            ///< Bitmask of following Lost Packets.
+    };
+
+    /**
+     * @struct FIREntry
+     *
+     * @short FCI entry of Full Intra Request (PSFB) messages, as
+     * defined in RFC 5104.
+     **/
+    struct FIREntry
+    {
+        uint32 ssrc;           ///< ssrc identifier of the media source.
+        uint8 seqNum;          ///< command sequence number.
+        uint8 reserved[3];     ///< must be 0.
+    };
+
     /**
      * @struct RTCPFixedHeader
      * Fixed RTCP packet header. First 32-bit word in any RTCP
@@ -289,9 +328,25 @@ public:
             tAPP,           ///< APPlication specific.
             tFIR   = 192,   ///< Full Intra-frame request.
             tNACK  = 193,   ///< Negative ACK.
-            tXR             ///< Extended Report.
+            tXR,            ///< Extended Report.
+            tRTPFB = 205,   ///< Transport layer feedback (RFC 4585).
+            tPSFB  = 206    ///< Payload specific feedback (RFC 4585).
         }       Type;
 
+        /**
+         * @enum FeedbackType rtp.h cc++/rtp.h
+         *
+         * Feedback message types (FMT field) of RTPFB and PSFB
+         * packets.
+         */
+        typedef enum {
+            fbGenericNACK = 1,  ///< RTPFB: generic NACK.
+            fbPLI = 1,          ///< PSFB: Picture Loss Indication.
+            fbFIR = 4,          ///< PSFB: Full Intra Request.
+            fbTransportCC = 15, ///< RTPFB: transport-wide congestion control.
+            fbAFB = 15          ///< Application layer feedback.
+        }       FeedbackType;
+
         /**
          * Get the packet length specified in its header, in
          * octets and in host order.
@@ -320,6 +375,7 @@ public:
             APPPacket APP;
             NACKPacket NACK;
             FIRPacket FIR;
+            FeedbackPacket FB;
         }       info;        ///< Union for SR, RR, SDES, BYE and APP
     };
 #ifdef  CCXX_PACKED
@@ -347,11 +403,38 @@ protected:
     bool
     checkCompoundRTCPHeader(size_t len);
 
-    // buffer to hold RTCP compound packets being sent. Allocated
-    // in construction time
+    /**
+     * Allocate the buffer for RTCP compound packets being sent,
+     * if it is not yet: the buffers are allocated when first
+     * needed, with the path MTU at that time.
+     **/
+    inline void
+    allocRTCPSendBuffer()
+    { if ( !rtcpSendBuffer ) rtcpSendBuffer = new unsigned char[pathMTU](); }
+
+    inline void
+    allocRTCPRecvBuffer()
+    { if ( !rtcpRecvBuffer ) rtcpRecvBuffer = new unsigned char[pathMTU](); }
+
+    /**
+     * Free the buffers, while no RTCP packets are sent nor
+     * received. They are allocated again when needed.
+     **/
+    void
+    freeRTCPBuffers();
+
+    /**
+     * Get the memory used by the buffers allocated.
+     **/
+    inline size_t
+    getRTCPBuffersSize() const
+    { return ((rtcpSendBuffer ? 1 : 0) + (rtcpRecvBuffer ? 1 : 0)) * pathMTU; }
+
+    // buffer to hold RTCP compound packets being sent (see
+    // allocRTCPSendBuffer()).
     unsigned char* rtcpSendBuffer;
-    // buffer to hold RTCP compound packets being
-    // received. Allocated at construction time
+    // buffer to hold RTCP compound packets being received (see
+    // allocRTCPRecvBuffer()).
     unsigned char* rtcpRecvBuffer;
 
     friend class RTCPSenderInfo;
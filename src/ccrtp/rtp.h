@@ -50,6 +50,11 @@
 
 #include <ccrtp/cqueue.h>
 #include <ccrtp/channel.h>
+#include <ccrtp/fec.h>
+#include <ccrtp/packetizer.h>
+#include <ccrtp/mixer.h>
+#include <ccrtp/audio.h>
+#include <ccrtp/red.h>
 
 NAMESPACE_COMMONCPP
 
@@ -58,6 +63,20 @@ NAMESPACE_COMMONCPP
  * @{
  **/
 
+/**
+ * A handle the event loop of the application waits for, when it
+ * serves a session (see TRTPSessionBase::getReactorHandles()).
+ **/
+struct RTPReactorHandle
+{
+    SOCKET handle;
+    /// Wait for the handle to be readable.
+    bool readable;
+    /// Wait for the handle to be writable (datagrams are sent
+    /// right away, so never at present).
+    bool writable;
+};
+
 /**
  * @class RTPSessionBase
  *
@@ -74,7 +93,9 @@ NAMESPACE_COMMONCPP
  *
  * RTPSessionBase objects do not have any threading policy, thus
  * allowing to customize this aspect in derived classes (see
- * SingleThreadRTPSession or RTPSessionPoolBase).
+ * SingleThreadRTPSession or RTPSessionPoolBase). They may also be
+ * served by the event loop of the application, without any thread
+ * (see getReactorHandles()).
  *
  * @author David Sugar <dyfet@ostel.com>
  * @short RTP protocol stack based on Common C++.
@@ -189,6 +210,140 @@ NAMESPACE_COMMONCPP
         inline RTPDataChannel *getDSO(void)
             {return dso;}
 
+        /**
+         * Get the handles to wait for when the session is served by the
+         * event loop of the application (reactor mode), rather than by a
+         * thread or a pool: the data and the control reception sockets.
+         *
+         * @param handles where the handles are written, 2 at most.
+         * @return number of handles.
+         **/
+        inline size_t
+        getReactorHandles(RTPReactorHandle handles[2]) const
+            {
+                handles[0].handle = dso->getRecvSocket();
+                handles[1].handle = cso->getRecvSocket();
+                handles[0].readable = handles[1].readable = true;
+                handles[0].writable = handles[1].writable = false;
+                return ( handles[1].handle == handles[0].handle ) ? 1 : 2;
+            }
+
+        /**
+         * Get when onTimer() must be called next, in reactor mode: the
+         * send deadline if there are packets to send, the RTCP deadline
+         * (early feedback included), when packets held for delivery
+         * are given up, and at least every RTCP check interval. It changes when the
+         * session is served, and when data is put while there was nothing
+         * to send: it must be got again then.
+         *
+         * @param now current time, as given by gettimeofday().
+         * @return absolute time of the next deadline.
+         **/
+        timeval
+        getReactorDeadline(const timeval& now)
+            {
+                timeval deadline;
+                timeval interval = ServiceQueue::getRTCPCheckInterval();
+                timeradd(&now,&interval,&deadline);
+                if ( ServiceQueue::isControlServiceActive() ) {
+                    timeval rtcp = ServiceQueue::getNextControlTime();
+                    // a control socket of its own is read when readable
+                    if ( timercmp(&rtcp,&deadline,<) ||
+                         cso->getRecvSocket() != dso->getRecvSocket() )
+                        deadline = rtcp;
+                }
+                timeval held;
+                if ( ServiceQueue::getHeldDeadline(held) &&
+                     timercmp(&held,&deadline,<) )
+                    deadline = held;
+                if ( ServiceQueue::isSending() ) {
+                    timeval send;
+                    timeval wait =
+                        microtimeout2Timeval(ServiceQueue::getSchedulingTimeout());
+                    timeradd(&now,&wait,&send);
+                    if ( timercmp(&send,&deadline,<) )
+                        deadline = send;
+                }
+                return deadline;
+            }
+
+        /**
+         * Serve a handle found readable, in reactor mode: a data packet
+         * is read, or an RTCP compound packet. Only one packet is read:
+         * the handles are meant to be waited for level triggered.
+         *
+         * @param handle one of the handles of getReactorHandles().
+         **/
+        void
+        onReadable(SOCKET handle)
+            {
+                if ( handle == dso->getRecvSocket() )
+                    ServiceQueue::takeInDataPacket();
+                else if ( handle == cso->getRecvSocket() )
+                    ServiceQueue::controlReadyService();
+            }
+
+        /**
+         * Serve the session at its deadline, in reactor mode: data
+         * packets due are sent, and RTCP packets when it is time. No
+         * thread is used; the BYE packet must be sent by the application
+         * when it is done (see dispatchBYE()).
+         *
+         * @param now current time, as given by gettimeofday().
+         * @return next deadline (see getReactorDeadline()).
+         **/
+        timeval
+        onTimer(const timeval& now)
+            {
+                if ( cso->getRecvSocket() == dso->getRecvSocket() )
+                    ServiceQueue::controlReceptionService();
+                ServiceQueue::controlTransmissionService();
+                ServiceQueue::releaseHeldPackets();
+                while ( ServiceQueue::isSending() &&
+                        0 == ServiceQueue::getSchedulingTimeout() &&
+                        ServiceQueue::dispatchDataPacket() )
+                    ;
+                return getReactorDeadline(now);
+            }
+
+        /**
+         * Park the session while it is idle or on hold: the send
+         * sockets are closed, and the RTCP buffers and the packets
+         * queued are freed. The reception sockets are kept, so that
+         * the ports stay bound. All of it is allocated again when
+         * first used: serving the session again resumes it.
+         *
+         * The session must not be served meanwhile: it is removed from
+         * its pool first (see RTPSessionPool::removeSession()), or
+         * parked from the event loop serving it in reactor mode. A
+         * pool serves idle sessions with no thread of their own.
+         **/
+        void
+        park()
+            {
+                ServiceQueue::purgeOutgoingQueue();
+                ServiceQueue::purgeIncomingQueue();
+                ServiceQueue::freeRTCPBuffers();
+                dso->closeSendSocket();
+                cso->closeSendSocket();
+            }
+
+        /**
+         * Get an estimate of the memory used by the session: its
+         * channels, RTCP buffers, sources, packets queued and crypto
+         * contexts. The buffers of the kernel are not counted. It is
+         * got while the session is not being served, as for park().
+         **/
+        size_t
+        getMemoryUsage() const
+            {
+                return sizeof(*this) + dso->getMemoryUsage() +
+                    cso->getMemoryUsage() +
+                    ServiceQueue::getRTCPBuffersSize() +
+                    ServiceQueue::getRecvMemoryUsage() +
+                    ServiceQueue::getSendMemoryUsage();
+            }
+
     protected:
         /**
          * @param timeout maximum timeout to wait, in microseconds
@@ -399,6 +554,16 @@ NAMESPACE_COMMONCPP
         friend class RTPSessionBaseHandler;
     };
 
+/**
+ * @enum RTPSchedulingMode
+ * @short How the thread of a session waits for its next deadline.
+ **/
+typedef enum {
+    schedulingMilliseconds, ///< Waits in milliseconds, packets due within one are sent (the default)
+    schedulingMicroseconds, ///< Sleeps till the deadline, at microsecond resolution
+    schedulingBusyPoll      ///< Spins till the deadline, with busy polling of the data socket
+}       RTPSchedulingMode;
+
 /**
  * @class SingleThreadRTPSession
  *
@@ -431,7 +596,8 @@ NAMESPACE_COMMONCPP
         ):
         Thread(pri),
         TRTPSessionBase<RTPDataChannel,RTCPChannel,ServiceQueue>
-        (ia,dataPort,controlPort,memberssize,app)
+        (ia,dataPort,controlPort,memberssize,app),
+        schedulingMode(schedulingMilliseconds)
         { }
 #endif
 
@@ -448,7 +614,8 @@ NAMESPACE_COMMONCPP
     ):
     Thread(pri),
     TRTPSessionBase<RTPDataChannel,RTCPChannel,ServiceQueue>
-    (ssrc, ia,dataPort,controlPort,memberssize,app)
+    (ssrc, ia,dataPort,controlPort,memberssize,app),
+    schedulingMode(schedulingMilliseconds)
 { }
 #endif
 
@@ -466,7 +633,8 @@ SingleThreadRTPSession(const InetMcastAddress& ia,
         ):
         Thread(pri),
         TRTPSessionBase<RTPDataChannel,RTCPChannel,ServiceQueue>
-        (ia,dataPort,controlPort,memberssize,app,iface)
+        (ia,dataPort,controlPort,memberssize,app,iface),
+        schedulingMode(schedulingMilliseconds)
         { }
 #endif
 
@@ -484,7 +652,8 @@ SingleThreadRTPSession(uint32 ssrc, const InetMcastAddress& ia,
                 ):
                 Thread(pri),
                 TRTPSessionBase<RTPDataChannel,RTCPChannel,ServiceQueue>
-                (ssrc,ia,dataPort,controlPort,memberssize,app,iface)
+                (ssrc,ia,dataPort,controlPort,memberssize,app,iface),
+                schedulingMode(schedulingMilliseconds)
 { }
 #endif
 
@@ -507,6 +676,30 @@ startRunning()
 { enableStack(); Thread::start(); }
 #endif
 
+/**
+ * Set how the service thread waits for its next deadline. Should
+ * be called before startRunning().
+ *
+ * @param mode scheduling mode.
+ * @param busyPoll busy poll time of the data socket, in
+ *        microseconds, for schedulingBusyPoll.
+ * @return false if busy polling could not be set up (see
+ *         RTPSocketWait::setBusyPoll()). The thread spins anyway.
+ **/
+bool
+setScheduling(RTPSchedulingMode mode, microtimeout_t busyPoll = 50)
+{
+    schedulingMode = mode;
+    bool result = RTPSocketWait::setBusyPoll(
+        TRTPSessionBase<RTPDataChannel,RTCPChannel,ServiceQueue>::getDataRecvSocket(),
+        ( schedulingBusyPoll == mode ) ? busyPoll : 0);
+    return result || schedulingBusyPoll != mode;
+}
+
+inline RTPSchedulingMode
+getScheduling() const
+{ return schedulingMode; }
+
 
 protected:
 inline void disableStack(void)
@@ -552,13 +745,18 @@ virtual void run(void)
 {
     microtimeout_t timeout = 0;
     while ( ServiceQueue::isActive() ) {
+        if ( schedulingMilliseconds != schedulingMode ) {
+            servicePrecise();
+            continue;
+        }
         if ( timeout < 1000 ){ // !(timeout/1000)
             timeout = getSchedulingTimeout();
         }
         controlReceptionService();
         controlTransmissionService();
-        microtimeout_t maxWait =
-            timeval2microtimeout(getRTCPCheckInterval());
+        ServiceQueue::releaseHeldPackets();
+        microtimeout_t maxWait = ServiceQueue::getHeldTimeout(
+            timeval2microtimeout(getRTCPCheckInterval()));
         // make sure the scheduling timeout is
         // <= the check interval for RTCP
         // packets
@@ -584,8 +782,40 @@ virtual void run(void)
 inline size_t takeInDataPacket(void)
 {return TRTPSessionBase<RTPDataChannel,RTCPChannel,ServiceQueue>::takeInDataPacket();}
 
+/**
+ * One iteration of run() with microsecond deadlines: packets are
+ * dispatched when due, not up to a millisecond early, and the wait
+ * for packets ends at the next deadline. The data socket is waited
+ * for directly, not through isPendingData().
+ **/
+void servicePrecise(void)
+{
+    controlReceptionService();
+    controlTransmissionService();
+    ServiceQueue::releaseHeldPackets();
+    microtimeout_t timeout = getSchedulingTimeout();
+    microtimeout_t maxWait = ServiceQueue::getHeldTimeout(
+        timeval2microtimeout(getRTCPCheckInterval()));
+    timeout = (timeout > maxWait)? maxWait : timeout;
+    if ( 0 == timeout ) {
+        dispatchDataPacket();
+        timerTick();
+        return;
+    }
+    SOCKET so =
+        TRTPSessionBase<RTPDataChannel,RTCPChannel,ServiceQueue>::getDataRecvSocket();
+    bool pending = ( schedulingBusyPoll == schedulingMode ) ?
+        RTPSocketWait::spinReadable(so,timeout) :
+        RTPSocketWait::isReadable(so,timeout);
+    if ( pending && ServiceQueue::isActive() )
+        takeInDataPacket();
+}
+
 inline size_t dispatchBYE(const std::string &str)
 {return TRTPSessionBase<RTPDataChannel,RTCPChannel,ServiceQueue>::dispatchBYE(str);}
+
+private:
+    RTPSchedulingMode schedulingMode;
 };
 
 /**
@@ -616,6 +846,17 @@ typedef RTPSession RTPSocket;
 typedef SingleThreadRTPSession<SymmetricRTPChannel,
                    SymmetricRTPChannel> SymmetricRTPSession;
 
+/**
+ * @typedef AVPFSession
+ *
+ * Uses two pairs of sockets for RTP data and RTCP
+ * transmission/reception, with RTCP-based feedback (AVPF).
+ *
+ * @short UDP/IPv4 AVPF RTP session scheduled by one thread of execution.
+ **/
+typedef SingleThreadRTPSession<DualRTPUDPIPv4Channel,
+                   DualRTPUDPIPv4Channel, AVPFQueue> AVPFSession;
+
 #ifdef  CCXX_IPV6
 
 /**
@@ -634,7 +875,9 @@ typedef SingleThreadRTPSession<SymmetricRTPChannel,
  *
  * RTPSessionBase objects do not have any threading policy, thus
  * allowing to customize this aspect in derived classes (see
- * SingleThreadRTPSession or RTPSessionPoolBase).
+ * SingleThreadRTPSession or RTPSessionPoolBase). They may also be
+ * served by the event loop of the application, without any thread
+ * (see getReactorHandles()).
  *
  * @author David Sugar <dyfet@ostel.com>
  * @short RTP protocol stack based on Common C++.
@@ -731,6 +974,130 @@ TRTPSessionBaseIPV6(const IPV6Host& ia, tpport_t dataPort,
     inline RTPDataChannel *getDSO(void)
         {return dso;}
 
+    /**
+     * Get the handles to wait for when the session is served by the
+     * event loop of the application (reactor mode), rather than by a
+     * thread or a pool: the data and the control reception sockets.
+     *
+     * @param handles where the handles are written, 2 at most.
+     * @return number of handles.
+     **/
+    inline size_t
+    getReactorHandles(RTPReactorHandle handles[2]) const
+        {
+            handles[0].handle = dso->getRecvSocket();
+            handles[1].handle = cso->getRecvSocket();
+            handles[0].readable = handles[1].readable = true;
+            handles[0].writable = handles[1].writable = false;
+            return ( handles[1].handle == handles[0].handle ) ? 1 : 2;
+        }
+
+    /**
+     * Get when onTimer() must be called next, in reactor mode: the
+     * send deadline if there are packets to send, the RTCP deadline
+     * (early feedback included), when packets held for delivery
+     * are given up, and at least every RTCP check interval. It changes when the
+     * session is served, and when data is put while there was nothing
+     * to send: it must be got again then.
+     *
+     * @param now current time, as given by gettimeofday().
+     * @return absolute time of the next deadline.
+     **/
+    timeval
+    getReactorDeadline(const timeval& now)
+        {
+            timeval deadline;
+            timeval interval = ServiceQueue::getRTCPCheckInterval();
+            timeradd(&now,&interval,&deadline);
+            if ( ServiceQueue::isControlServiceActive() ) {
+                timeval rtcp = ServiceQueue::getNextControlTime();
+                // a control socket of its own is read when readable
+                if ( timercmp(&rtcp,&deadline,<) ||
+                     cso->getRecvSocket() != dso->getRecvSocket() )
+                    deadline = rtcp;
+            }
+            timeval held;
+            if ( ServiceQueue::getHeldDeadline(held) &&
+                 timercmp(&held,&deadline,<) )
+                deadline = held;
+            if ( ServiceQueue::isSending() ) {
+                timeval send;
+                timeval wait =
+                    microtimeout2Timeval(ServiceQueue::getSchedulingTimeout());
+                timeradd(&now,&wait,&send);
+                if ( timercmp(&send,&deadline,<) )
+                    deadline = send;
+            }
+            return deadline;
+        }
+
+    /**
+     * Serve a handle found readable, in reactor mode: a data packet
+     * is read, or an RTCP compound packet. Only one packet is read:
+     * the handles are meant to be waited for level triggered.
+     *
+     * @param handle one of the handles of getReactorHandles().
+     **/
+    void
+    onReadable(SOCKET handle)
+        {
+            if ( handle == dso->getRecvSocket() )
+                ServiceQueue::takeInDataPacket();
+            else if ( handle == cso->getRecvSocket() )
+                ServiceQueue::controlReadyService();
+        }
+
+    /**
+     * Serve the session at its deadline, in reactor mode: data
+     * packets due are sent, and RTCP packets when it is time. No
+     * thread is used; the BYE packet must be sent by the application
+     * when it is done (see dispatchBYE()).
+     *
+     * @param now current time, as given by gettimeofday().
+     * @return next deadline (see getReactorDeadline()).
+     **/
+    timeval
+    onTimer(const timeval& now)
+        {
+            if ( cso->getRecvSocket() == dso->getRecvSocket() )
+                ServiceQueue::controlReceptionService();
+            ServiceQueue::controlTransmissionService();
+            ServiceQueue::releaseHeldPackets();
+            while ( ServiceQueue::isSending() &&
+                    0 == ServiceQueue::getSchedulingTimeout() &&
+                    ServiceQueue::dispatchDataPacket() )
+                ;
+            return getReactorDeadline(now);
+        }
+
+    /**
+     * Park the session while it is idle or on hold (see
+     * TRTPSessionBase::park()).
+     **/
+    void
+    park()
+        {
+            ServiceQueue::purgeOutgoingQueue();
+            ServiceQueue::purgeIncomingQueue();
+            ServiceQueue::freeRTCPBuffers();
+            dso->closeSendSocket();
+            cso->closeSendSocket();
+        }
+
+    /**
+     * Get an estimate of the memory used by the session (see
+     * TRTPSessionBase::getMemoryUsage()).
+     **/
+    size_t
+    getMemoryUsage() const
+        {
+            return sizeof(*this) + dso->getMemoryUsage() +
+                cso->getMemoryUsage() +
+                ServiceQueue::getRTCPBuffersSize() +
+                ServiceQueue::getRecvMemoryUsage() +
+                ServiceQueue::getSendMemoryUsage();
+        }
+
 protected:
     /**
      * @param timeout maximum timeout to wait, in microseconds
@@ -986,7 +1353,8 @@ public:
     ):
     Thread(pri),
     TRTPSessionBaseIPV6<RTPDataChannel,RTCPChannel,ServiceQueue>
-    (ia,dataPort,controlPort,memberssize,app)
+    (ia,dataPort,controlPort,memberssize,app),
+    schedulingMode(schedulingMilliseconds)
 { }
 #endif
 
@@ -1004,7 +1372,8 @@ SingleThreadRTPSessionIPV6(const IPV6Multicast& ia,
         ):
         Thread(pri),
         TRTPSessionBaseIPV6<RTPDataChannel,RTCPChannel,ServiceQueue>
-        (ia,dataPort,controlPort,memberssize,app,iface)
+        (ia,dataPort,controlPort,memberssize,app,iface),
+        schedulingMode(schedulingMilliseconds)
 { }
 #endif
 
@@ -1026,6 +1395,30 @@ startRunning()
 { enableStack(); Thread::start(); }
 #endif
 
+/**
+ * Set how the service thread waits for its next deadline. Should
+ * be called before startRunning().
+ *
+ * @param mode scheduling mode.
+ * @param busyPoll busy poll time of the data socket, in
+ *        microseconds, for schedulingBusyPoll.
+ * @return false if busy polling could not be set up (see
+ *         RTPSocketWait::setBusyPoll()). The thread spins anyway.
+ **/
+bool
+setScheduling(RTPSchedulingMode mode, microtimeout_t busyPoll = 50)
+{
+    schedulingMode = mode;
+    bool result = RTPSocketWait::setBusyPoll(
+        TRTPSessionBaseIPV6<RTPDataChannel,RTCPChannel,ServiceQueue>::getDataRecvSocket(),
+        ( schedulingBusyPoll == mode ) ? busyPoll : 0);
+    return result || schedulingBusyPoll != mode;
+}
+
+inline RTPSchedulingMode
+getScheduling() const
+{ return schedulingMode; }
+
 
 protected:
 inline void enableStack(void)
@@ -1071,13 +1464,18 @@ virtual void run(void)
 {
     microtimeout_t timeout = 0;
     while ( ServiceQueue::isActive() ) {
+        if ( schedulingMilliseconds != schedulingMode ) {
+            servicePrecise();
+            continue;
+        }
         if ( timeout < 1000 ){ // !(timeout/1000)
             timeout = getSchedulingTimeout();
         }
         controlReceptionService();
         controlTransmissionService();
-        microtimeout_t maxWait =
-            timeval2microtimeout(getRTCPCheckInterval());
+        ServiceQueue::releaseHeldPackets();
+        microtimeout_t maxWait = ServiceQueue::getHeldTimeout(
+            timeval2microtimeout(getRTCPCheckInterval()));
         // make sure the scheduling timeout is
         // <= the check interval for RTCP
         // packets
@@ -1101,8 +1499,40 @@ virtual void run(void)
 inline size_t takeInDataPacket(void)
 {return TRTPSessionBaseIPV6<RTPDataChannel,RTCPChannel,ServiceQueue>::takeInDataPacket();}
 
+/**
+ * One iteration of run() with microsecond deadlines: packets are
+ * dispatched when due, not up to a millisecond early, and the wait
+ * for packets ends at the next deadline. The data socket is waited
+ * for directly, not through isPendingData().
+ **/
+void servicePrecise(void)
+{
+    controlReceptionService();
+    controlTransmissionService();
+    ServiceQueue::releaseHeldPackets();
+    microtimeout_t timeout = getSchedulingTimeout();
+    microtimeout_t maxWait = ServiceQueue::getHeldTimeout(
+        timeval2microtimeout(getRTCPCheckInterval()));
+    timeout = (timeout > maxWait)? maxWait : timeout;
+    if ( 0 == timeout ) {
+        dispatchDataPacket();
+        timerTick();
+        return;
+    }
+    SOCKET so =
+        TRTPSessionBaseIPV6<RTPDataChannel,RTCPChannel,ServiceQueue>::getDataRecvSocket();
+    bool pending = ( schedulingBusyPoll == schedulingMode ) ?
+        RTPSocketWait::spinReadable(so,timeout) :
+        RTPSocketWait::isReadable(so,timeout);
+    if ( pending && ServiceQueue::isActive() )
+        takeInDataPacket();
+}
+
 inline size_t dispatchBYE(const std::string &str)
 {return TRTPSessionBaseIPV6<RTPDataChannel,RTCPChannel,ServiceQueue>::dispatchBYE(str);}
+
+private:
+    RTPSchedulingMode schedulingMode;
 };
 
 /**
@@ -1133,6 +1563,17 @@ typedef RTPSessionIPV6 RTPSocketIPV6;
  typedef SingleThreadRTPSessionIPV6<SymmetricRTPChannelIPV6,
                     SymmetricRTPChannelIPV6> SymmetricRTPSessionIPV6;
 
+/**
+ * @typedef AVPFSessionIPV6
+ *
+ * Uses two pairs of sockets for RTP data and RTCP
+ * transmission/reception, with RTCP-based feedback (AVPF).
+ *
+ * @short UDP/IPv6 AVPF RTP session scheduled by one thread of execution.
+ **/
+typedef SingleThreadRTPSessionIPV6<DualRTPUDPIPv6Channel,
+                   DualRTPUDPIPv6Channel, AVPFQueue> AVPFSessionIPV6;
+
 
 #endif
 
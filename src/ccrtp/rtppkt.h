@@ -350,7 +350,7 @@ protected:
 
     inline void
     setbuffer(const void* src, size_t len, size_t pos)
-    { memcpy(buffer + pos,src,len); }
+    { if ( src ) memcpy(buffer + pos,src,len); }
 
     /// Packet sequence number in host order.
     uint16 cachedSeqNum;
@@ -0,0 +1,212 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+/**
+ * @file uring.h
+ *
+ * @short Datagram reception and transmission through io_uring.
+ **/
+
+#ifndef CCXX_RTP_URING_H_
+#define CCXX_RTP_URING_H_
+
+#include <ccrtp/base.h>
+#include <commoncpp/socket.h>
+#include <vector>
+
+NAMESPACE_COMMONCPP
+
+/**
+ * @defgroup uring Reception and transmission through io_uring.
+ * @{
+ **/
+
+class RTPUringEndpoint;
+
+/**
+ * @class RTPUring
+ * @short An io_uring serving the sockets of many sessions.
+ *
+ * Each socket attached for reception has a multishot recvmsg
+ * request, taking its buffers from a ring of buffers provided to
+ * the kernel: datagrams are received without a system call per
+ * datagram, nor per socket. Datagrams sent are copied in send
+ * buffers allocated with the ring, one for each submission entry
+ * and as large as the reception buffers, queued as sendmsg requests
+ * and submitted in batches with submit().
+ *
+ * Sockets of the UDP/IPv4 channels are attached with
+ * RTPBaseUDPIPv4Socket::setUring(), and then read and written as
+ * usual: receiving takes the datagrams completed, sending queues a
+ * request. Session pools do this with RTPSessionPool::enableUring().
+ *
+ * Needs multishot reception (Linux 6.0 or later). No privileges
+ * are needed. The kernel is probed for the operations used when the
+ * ring is built, and for multishot reception when it is first armed:
+ * if it is refused, the endpoints are given up as failing (see
+ * process()) and isAvailable() becomes false. Where it is not
+ * available, nothing can be attached.
+ **/
+class __EXPORT RTPUring
+{
+public:
+    /**
+     * @param entries size of the submission queue.
+     * @param buffers number of reception buffers, a power of 2.
+     * @param bufferSize size of each reception buffer.
+     **/
+    RTPUring(unsigned entries = 256, unsigned buffers = 1024,
+         size_t bufferSize = 2048);
+
+    /**
+     * Closes the ring. Sockets still attached must not be used
+     * any more.
+     **/
+    ~RTPUring();
+
+    bool
+    isAvailable() const;
+
+    /**
+     * Get the descriptor of the ring, readable when completions
+     * are waiting to be processed (see process()).
+     **/
+    int
+    getHandle() const;
+
+    /**
+     * Attach a socket.
+     *
+     * @param so socket.
+     * @param tag given back by process() for each datagram
+     *        received, NULL if the socket is used only for
+     *        sending.
+     * @return endpoint, NULL if the ring is not available.
+     **/
+    RTPUringEndpoint*
+    attach(SOCKET so, void* tag);
+
+    /**
+     * Detach a socket. Datagrams received and not read yet are
+     * dropped. Its reception is cancelled, by process() or submit()
+     * if the submission queue is full.
+     **/
+    void
+    detach(RTPUringEndpoint* endpoint);
+
+    /**
+     * Process the completions waiting: datagrams received are
+     * queued in their endpoints, and reception is started again
+     * where it stopped, also after an error. Endpoints whose
+     * reception keeps failing are given up: their sockets must be
+     * read directly, once detached.
+     *
+     * @param ready where the tag of the endpoint is appended for
+     *        each datagram received.
+     * @param failed where the tag of the endpoints given up is
+     *        appended.
+     * @return number of datagrams received.
+     **/
+    size_t
+    process(std::vector<void*>& ready, std::vector<void*>* failed = NULL);
+
+    /**
+     * Submit the requests queued, sendings above all, and start
+     * reception again where it stopped for lack of buffers.
+     * Datagrams sent from the thread that calls process() are
+     * submitted here; from other threads, right away.
+     **/
+    void
+    submit();
+
+    /**
+     * @name Socket side.
+     * Operations of attached sockets.
+     **/
+    //@{
+    static bool
+    isPending(RTPUringEndpoint& endpoint);
+
+    static size_t
+    getNextSize(RTPUringEndpoint& endpoint);
+
+    static InetHostAddress
+    getSender(RTPUringEndpoint& endpoint, tpport_t& port);
+
+    /**
+     * Take the next datagram received.
+     *
+     * @return length of the datagram, 0 if there is none.
+     **/
+    static size_t
+    recv(RTPUringEndpoint& endpoint, unsigned char* buffer, size_t len);
+
+    static void
+    setPeer(RTPUringEndpoint& endpoint, const InetAddress& ia,
+        tpport_t port);
+
+    /**
+     * Queue a datagram to the peer.
+     *
+     * @return len if the datagram could be queued, 0 otherwise.
+     **/
+    static size_t
+    send(RTPUringEndpoint& endpoint, const unsigned char* buffer,
+         size_t len);
+    //@}
+
+private:
+    RTPUring(const RTPUring&);
+
+    RTPUring&
+    operator=(const RTPUring&);
+
+    struct Rings;
+    Rings* rings;
+};
+
+/** @}*/ // uring
+
+END_NAMESPACE
+
+#endif  //CCXX_RTP_URING_H_
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 8
+ * End:
+ */
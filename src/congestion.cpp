@@ -0,0 +1,679 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+#include "private.h"
+#include <ccrtp/congestion.h>
+#include <algorithm>
+#include <cmath>
+
+NAMESPACE_COMMONCPP
+
+static inline int64
+toMicroseconds(const timeval& t)
+{ return static_cast<int64>(t.tv_sec) * 1000000 + t.tv_usec; }
+
+static inline void
+putShort(unsigned char* p, uint16 v)
+{ p[0] = (unsigned char)(v >> 8); p[1] = (unsigned char)v; }
+
+static inline uint16
+getShort(const unsigned char* p)
+{ return (uint16)((p[0] << 8) | p[1]); }
+
+// transport-cc packet status symbols
+static const uint8 statusNotReceived = 0;
+static const uint8 statusSmallDelta = 1;
+static const uint8 statusLargeDelta = 2;
+// receive deltas are in multiples of 250 us, the reference time
+// in multiples of 64 ms.
+static const int64 deltaUnit = 250;
+static const int64 referenceUnit = 64000;
+static const size_t feedbackHeaderSize = 8;
+static const uint16 maxRunLength = 0x1fff;
+
+TransportFeedbackRecorder::TransportFeedbackRecorder() :
+lastSeqNum(0), nextBase(0), started(false), lastMediaSSRC(0),
+feedbackCount(0)
+{ }
+
+void
+TransportFeedbackRecorder::reset()
+{
+    lock.enter();
+    arrivals.clear();
+    started = false;
+    feedbackCount = 0;
+    lock.leave();
+}
+
+void
+TransportFeedbackRecorder::record(uint16 seqNum, uint32 mediaSSRC,
+const timeval& arrival)
+{
+    lock.enter();
+    int64 seq;
+    if ( !started ) {
+        seq = lastSeqNum = nextBase = seqNum;
+        started = true;
+    } else {
+        seq = lastSeqNum + static_cast<int16>(seqNum -
+                              static_cast<uint16>(lastSeqNum));
+    }
+    // already reported (as lost)
+    if ( seq >= nextBase ) {
+        if ( seq > lastSeqNum )
+            lastSeqNum = seq;
+        arrivals[seq] = toMicroseconds(arrival);
+        lastMediaSSRC = mediaSSRC;
+    }
+    lock.leave();
+}
+
+bool
+TransportFeedbackRecorder::isPending() const
+{
+    lock.enter();
+    bool pending = !arrivals.empty();
+    lock.leave();
+    return pending;
+}
+
+size_t
+TransportFeedbackRecorder::build(unsigned char* fci, size_t available,
+uint32& mediaSSRC)
+{
+    lock.enter();
+    if ( arrivals.empty() || available < feedbackHeaderSize + 4 ) {
+        lock.leave();
+        return 0;
+    }
+    // worst case: 2 octets of delta and 2 of chunk per packet.
+    size_t maxCount = (available - feedbackHeaderSize) / 4;
+    if ( maxCount > 0xffff )
+        maxCount = 0xffff;
+    // report the packets lost since the last message too, unless
+    // there are too many.
+    int64 base = nextBase;
+    if ( static_cast<size_t>(arrivals.begin()->first - base) >= maxCount / 2 )
+        base = arrivals.begin()->first;
+    int64 reference = arrivals.begin()->second / referenceUnit;
+    int64 previous = reference * referenceUnit;
+
+    std::vector<uint8> symbols;
+    std::vector<int16> deltas;
+    int64 last = base;
+    for ( ArrivalMap::iterator i = arrivals.begin();
+          arrivals.end() != i; i++ ) {
+        if ( static_cast<size_t>(i->first - base) >= maxCount )
+            break;
+        int64 delta = (i->second - previous) / deltaUnit;
+        // can not be represented, report it in the next message.
+        if ( delta < -32768 || delta > 32767 )
+            break;
+        while ( last < i->first ) {
+            symbols.push_back(statusNotReceived);
+            last++;
+        }
+        symbols.push_back( (delta >= 0 && delta <= 255) ?
+                   statusSmallDelta : statusLargeDelta );
+        deltas.push_back(static_cast<int16>(delta));
+        previous += delta * deltaUnit;
+        last = i->first + 1;
+    }
+
+    putShort(fci,static_cast<uint16>(base));
+    putShort(fci + 2,static_cast<uint16>(symbols.size()));
+    fci[4] = (unsigned char)(reference >> 16);
+    fci[5] = (unsigned char)(reference >> 8);
+    fci[6] = (unsigned char)reference;
+    fci[7] = feedbackCount++;
+    size_t len = feedbackHeaderSize;
+
+    // packet status chunks: run length chunks for runs of 7 or
+    // more, two bit status vectors of 7 symbols otherwise.
+    size_t s = 0;
+    while ( s < symbols.size() ) {
+        size_t run = 1;
+        while ( s + run < symbols.size() && run < maxRunLength &&
+            symbols[s + run] == symbols[s] )
+            run++;
+        uint16 chunk;
+        if ( run >= 7 ) {
+            chunk = (uint16)((symbols[s] << 13) | run);
+            s += run;
+        } else {
+            chunk = 0xc000;
+            for ( uint8 k = 0; k < 7; k++ ) {
+                uint8 symbol = (s + k < symbols.size()) ?
+                    symbols[s + k] : statusNotReceived;
+                chunk |= symbol << (2 * (6 - k));
+            }
+            s += 7;
+        }
+        putShort(fci + len,chunk);
+        len += 2;
+    }
+
+    // receive deltas
+    size_t d = 0;
+    for ( s = 0; s < symbols.size(); s++ ) {
+        if ( statusSmallDelta == symbols[s] ) {
+            fci[len++] = static_cast<unsigned char>(deltas[d++]);
+        } else if ( statusLargeDelta == symbols[s] ) {
+            putShort(fci + len,static_cast<uint16>(deltas[d++]));
+            len += 2;
+        }
+    }
+    while ( len & 0x03 )
+        fci[len++] = 0;
+
+    // forget the packets reported.
+    nextBase = base + symbols.size();
+    arrivals.erase(arrivals.begin(),arrivals.lower_bound(nextBase));
+    mediaSSRC = lastMediaSSRC;
+    lock.leave();
+    return len;
+}
+
+const uint32 DelayBasedEstimator::defaultStartBitrate = 300000;
+const uint32 DelayBasedEstimator::defaultMinBitrate = 30000;
+const uint32 DelayBasedEstimator::defaultMaxBitrate = 10000000;
+
+// packets sent within this interval (us) form a group
+static const int64 burstInterval = 5000;
+// how many packets sent are remembered
+static const size_t maxSentPackets = 8192;
+// trendline estimator
+static const size_t trendlineWindow = 20;
+static const double trendlineSmoothing = 0.9;
+static const double trendlineGain = 4.0;
+// over-use detector, in ms
+static const double initialThreshold = 12.5;
+static const double overusingTime = 10.0;
+static const double thresholdUp = 0.0087;
+static const double thresholdDown = 0.039;
+// AIMD
+static const double decreaseFactor = 0.85;
+static const double increasePerSecond = 1.08;
+// loss based control
+static const int64 lossInterval = 1000000;
+static const int64 ackedWindow = 500000;
+
+DelayBasedEstimator::DelayBasedEstimator(uint32 start, uint32 minimum,
+uint32 maximum)
+{
+    reset(start,minimum,maximum);
+}
+
+void
+DelayBasedEstimator::reset(uint32 start, uint32 minimum, uint32 maximum)
+{
+    minBitrate = minimum;
+    maxBitrate = maximum > minimum ? maximum : minimum;
+    bitrate = std::max(minBitrate,std::min(maxBitrate,start));
+    currentGroup.empty = previousGroup.empty = true;
+    accumulatedDelay = smoothedDelay = 0;
+    firstArrival = 0;
+    delayWindow.clear();
+    numDeltas = 0;
+    previousTrend = 0;
+    usage = usageNormal;
+    threshold = initialThreshold;
+    lastThresholdUpdate = 0;
+    timeOverUsing = -1;
+    overuseCount = 0;
+    overuseDetected = false;
+    lastRateUpdate = 0;
+}
+
+void
+DelayBasedEstimator::addPacket(int64 sent, int64 arrival)
+{
+    if ( !currentGroup.empty &&
+         sent - currentGroup.firstSent <= burstInterval ) {
+        // same burst
+        if ( sent > currentGroup.lastSent )
+            currentGroup.lastSent = sent;
+        currentGroup.lastArrival = arrival;
+        return;
+    }
+    // out of order packets sent before the current group
+    if ( !currentGroup.empty && sent < currentGroup.firstSent )
+        return;
+
+    if ( !currentGroup.empty && !previousGroup.empty ) {
+        double sendDelta = (currentGroup.lastSent -
+                    previousGroup.lastSent) / 1000.0;
+        double arrivalDelta = (currentGroup.lastArrival -
+                       previousGroup.lastArrival) / 1000.0;
+        updateTrendline(sendDelta,arrivalDelta,
+                currentGroup.lastArrival);
+    }
+    if ( !currentGroup.empty )
+        previousGroup = currentGroup;
+    currentGroup.firstSent = currentGroup.lastSent = sent;
+    currentGroup.lastArrival = arrival;
+    currentGroup.empty = false;
+}
+
+void
+DelayBasedEstimator::updateTrendline(double sendDelta, double arrivalDelta,
+int64 arrival)
+{
+    numDeltas++;
+    if ( 0 == firstArrival )
+        firstArrival = arrival;
+    accumulatedDelay += arrivalDelta - sendDelta;
+    smoothedDelay = trendlineSmoothing * smoothedDelay +
+        (1 - trendlineSmoothing) * accumulatedDelay;
+    delayWindow.push_back(std::make_pair((arrival - firstArrival) / 1000.0,
+                         smoothedDelay));
+    if ( delayWindow.size() > trendlineWindow )
+        delayWindow.erase(delayWindow.begin());
+
+    double trend = previousTrend;
+    if ( delayWindow.size() == trendlineWindow ) {
+        // least squares slope of the smoothed delay
+        double meanX = 0, meanY = 0;
+        for ( size_t i = 0; i < delayWindow.size(); i++ ) {
+            meanX += delayWindow[i].first;
+            meanY += delayWindow[i].second;
+        }
+        meanX /= delayWindow.size();
+        meanY /= delayWindow.size();
+        double num = 0, den = 0;
+        for ( size_t i = 0; i < delayWindow.size(); i++ ) {
+            double x = delayWindow[i].first - meanX;
+            num += x * (delayWindow[i].second - meanY);
+            den += x * x;
+        }
+        if ( den != 0 )
+            trend = num / den;
+    }
+    detect(trend,sendDelta,arrival);
+    previousTrend = trend;
+}
+
+void
+DelayBasedEstimator::detect(double trend, double sendDelta, int64 arrival)
+{
+    double modified = std::min(numDeltas,static_cast<uint32>(60)) *
+        trend * trendlineGain;
+    if ( modified > threshold ) {
+        if ( timeOverUsing < 0 )
+            timeOverUsing = sendDelta / 2;
+        else
+            timeOverUsing += sendDelta;
+        overuseCount++;
+        if ( timeOverUsing > overusingTime && overuseCount > 1 &&
+             trend >= previousTrend ) {
+            timeOverUsing = 0;
+            overuseCount = 0;
+            usage = usageOver;
+            overuseDetected = true;
+        }
+    } else if ( modified < -threshold ) {
+        timeOverUsing = -1;
+        overuseCount = 0;
+        usage = usageUnder;
+    } else {
+        timeOverUsing = -1;
+        overuseCount = 0;
+        usage = usageNormal;
+    }
+
+    // adapt the threshold, ignoring sudden spikes.
+    double absModified = fabs(modified);
+    if ( 0 == lastThresholdUpdate )
+        lastThresholdUpdate = arrival;
+    if ( absModified <= threshold + 15 ) {
+        double k = absModified < threshold ? thresholdDown : thresholdUp;
+        double dt = std::min((arrival - lastThresholdUpdate) / 1000.0,
+                     100.0);
+        threshold += k * (absModified - threshold) * dt;
+        threshold = std::max(6.0,std::min(600.0,threshold));
+    }
+    lastThresholdUpdate = arrival;
+}
+
+uint32
+DelayBasedEstimator::update(uint32 incoming, int64 now)
+{
+    if ( 0 == lastRateUpdate )
+        lastRateUpdate = now;
+    double dt = std::min((now - lastRateUpdate) / 1000000.0,1.0);
+    lastRateUpdate = now;
+
+    double rate = bitrate;
+    if ( overuseDetected ) {
+        // decrease below what gets through
+        overuseDetected = false;
+        double decreased = decreaseFactor *
+            (incoming ? incoming : bitrate);
+        if ( decreased < rate )
+            rate = decreased;
+    } else if ( usageNormal == usage ) {
+        rate *= pow(increasePerSecond,dt);
+        // do not go far beyond what gets through
+        if ( incoming && rate > 1.5 * incoming + 10000 )
+            rate = std::max<double>(bitrate,1.5 * incoming + 10000);
+    }
+    // hold while over-using or under-using
+    rate = std::max<double>(minBitrate,std::min<double>(maxBitrate,rate));
+    bitrate = static_cast<uint32>(rate);
+    return bitrate;
+}
+
+SendSideEstimator::SendSideEstimator(uint32 start, uint32 minimum,
+uint32 maximum) :
+delay(start,minimum,maximum)
+{
+    setBitrates(start,minimum,maximum);
+}
+
+void
+SendSideEstimator::setBitrates(uint32 start, uint32 minimum,
+uint32 maximum)
+{
+    lock.enter();
+    minBitrate = minimum;
+    maxBitrate = maximum > minimum ? maximum : minimum;
+    delay.reset(start,minimum,maximum);
+    targetBitrate = lossBitrate = delay.getBitrate();
+    ackedBitrate = 0;
+    lossFraction = 0;
+    sentPackets.clear();
+    lastSentSeqNum = 0;
+    sentStarted = false;
+    lostPackets = reportedPackets = 0;
+    lastLossUpdate = 0;
+    ackedBytes = 0;
+    ackedWindowStart = 0;
+    lock.leave();
+}
+
+int64
+SendSideEstimator::unwrap(uint16 seqNum) const
+{
+    return lastSentSeqNum +
+        static_cast<int16>(seqNum - static_cast<uint16>(lastSentSeqNum));
+}
+
+void
+SendSideEstimator::onPacketSent(uint16 seqNum, size_t size,
+const timeval& sent)
+{
+    lock.enter();
+    int64 seq = sentStarted ? unwrap(seqNum) : seqNum;
+    if ( !sentStarted || seq > lastSentSeqNum )
+        lastSentSeqNum = seq;
+    sentStarted = true;
+    SentPacket& p = sentPackets[seq];
+    p.sent = toMicroseconds(sent);
+    p.size = size;
+    while ( sentPackets.size() > maxSentPackets )
+        sentPackets.erase(sentPackets.begin());
+    lock.leave();
+}
+
+static bool
+arrivedBefore(const std::pair<int64,int64>& a,
+          const std::pair<int64,int64>& b)
+{ return a.second < b.second; }
+
+bool
+SendSideEstimator::onTransportFeedback(const unsigned char* fci,
+size_t len, const timeval& tnow)
+{
+    if ( len < feedbackHeaderSize )
+        return false;
+    lock.enter();
+    if ( !sentStarted ) {
+        lock.leave();
+        return false;
+    }
+    int64 now = toMicroseconds(tnow);
+    int64 base = unwrap(getShort(fci));
+    uint16 count = getShort(fci + 2);
+    int32 reference = (fci[4] << 16) | (fci[5] << 8) | fci[6];
+    // sign extension of the 24 bits reference time
+    if ( reference & 0x800000 )
+        reference -= 0x1000000;
+
+    // packet status chunks
+    std::vector<uint8> symbols;
+    size_t pointer = feedbackHeaderSize;
+    while ( symbols.size() < count && pointer + 2 <= len ) {
+        uint16 chunk = getShort(fci + pointer);
+        pointer += 2;
+        if ( !(chunk & 0x8000) ) {
+            uint8 symbol = (chunk >> 13) & 0x03;
+            for ( uint16 r = 0; r < (chunk & maxRunLength) &&
+                      symbols.size() < count; r++ )
+                symbols.push_back(symbol);
+        } else if ( !(chunk & 0x4000) ) {
+            for ( int8 k = 13; k >= 0 && symbols.size() < count; k-- )
+                symbols.push_back((chunk >> k) & 0x01);
+        } else {
+            for ( int8 k = 6; k >= 0 && symbols.size() < count; k-- )
+                symbols.push_back((chunk >> (2 * k)) & 0x03);
+        }
+    }
+
+    // receive deltas: arrival times of the packets received, by
+    // sequence number.
+    std::vector<std::pair<int64,int64> > received;
+    int64 arrival = static_cast<int64>(reference) * referenceUnit;
+    uint32 lost = 0;
+    for ( size_t s = 0; s < symbols.size(); s++ ) {
+        if ( statusSmallDelta == symbols[s] ) {
+            if ( pointer + 1 > len )
+                break;
+            arrival += fci[pointer++] * deltaUnit;
+        } else if ( statusLargeDelta == symbols[s] ) {
+            if ( pointer + 2 > len )
+                break;
+            arrival += static_cast<int16>(getShort(fci + pointer)) *
+                deltaUnit;
+            pointer += 2;
+        } else {
+            lost++;
+            continue;
+        }
+        received.push_back(std::make_pair(base + (int64)s,arrival));
+    }
+
+    // inter-group delay variation, in order of arrival.
+    std::sort(received.begin(),received.end(),arrivedBefore);
+    for ( size_t r = 0; r < received.size(); r++ ) {
+        SentMap::iterator i = sentPackets.find(received[r].first);
+        if ( sentPackets.end() == i )
+            continue;
+        PacketResult packet;
+        packet.sent = i->second.sent;
+        packet.arrival = received[r].second;
+        packet.size = i->second.size;
+        updateAckedBitrate(packet);
+        delay.addPacket(packet.sent,packet.arrival);
+        sentPackets.erase(i);
+    }
+
+    uint32 previousTarget = targetBitrate;
+    uint32 delayBitrate = delay.update(ackedBitrate,now);
+    updateLossBitrate(lost,symbols.size(),now);
+    uint32 target = std::min(delayBitrate,lossBitrate);
+    target = std::max(minBitrate,std::min(maxBitrate,target));
+    targetBitrate = target;
+    lock.leave();
+    return target != previousTarget;
+}
+
+void
+SendSideEstimator::updateAckedBitrate(const PacketResult& packet)
+{
+    if ( 0 == ackedWindowStart )
+        ackedWindowStart = packet.arrival;
+    ackedBytes += packet.size;
+    int64 span = packet.arrival - ackedWindowStart;
+    if ( span >= ackedWindow ) {
+        uint32 sample = static_cast<uint32>(ackedBytes * 8 * 1000000 / span);
+        ackedBitrate = ackedBitrate ? (ackedBitrate + sample) / 2 : sample;
+        ackedBytes = 0;
+        ackedWindowStart = packet.arrival;
+    }
+}
+
+void
+SendSideEstimator::updateLossBitrate(uint32 lost, uint32 total, int64 now)
+{
+    lostPackets += lost;
+    reportedPackets += total;
+    if ( 0 == lastLossUpdate )
+        lastLossUpdate = now;
+    if ( now - lastLossUpdate < lossInterval || 0 == reportedPackets )
+        return;
+
+    lossFraction = static_cast<float>(lostPackets) / reportedPackets;
+    double rate = lossBitrate;
+    if ( lossFraction > 0.1f )
+        rate *= 1 - 0.5 * lossFraction;
+    else if ( lossFraction < 0.02f ) {
+        rate *= 1.05;
+        if ( ackedBitrate && rate > 1.5 * ackedBitrate + 10000 )
+            rate = std::max<double>(lossBitrate,1.5 * ackedBitrate + 10000);
+    }
+    rate = std::max<double>(minBitrate,std::min<double>(maxBitrate,rate));
+    lossBitrate = static_cast<uint32>(rate);
+    lostPackets = reportedPackets = 0;
+    lastLossUpdate = now;
+}
+
+TransportSequenceExtension::TransportSequenceExtension(SendSideEstimator* e) :
+estimator(e), recorder(), nextSeqNum(0)
+{ }
+
+void
+TransportSequenceExtension::write(unsigned char* data, uint8 len,
+                  const OutgoingRTPPkt&)
+{
+    if ( len < 2 )
+        return;
+    data[0] = static_cast<unsigned char>(nextSeqNum >> 8);
+    data[1] = static_cast<unsigned char>(nextSeqNum);
+    nextSeqNum++;
+}
+
+void
+TransportSequenceExtension::onSent(const unsigned char* data, uint8 len,
+                   size_t size, const timeval& when)
+{
+    if ( estimator && 2 == len )
+        estimator->onPacketSent(static_cast<uint16>(data[0] << 8 | data[1]),
+                    size,when);
+}
+
+void
+TransportSequenceExtension::onReceived(const unsigned char* data, uint8 len,
+                       const IncomingRTPPkt& packet,
+                       const timeval& arrival)
+{
+    if ( 2 == len )
+        recorder.record(static_cast<uint16>(data[0] << 8 | data[1]),
+                packet.getSSRC(),arrival);
+}
+
+/// A remote estimate this much below the one reported is reported early.
+static const double remoteDecreaseReport = 0.97;
+
+RemoteRateEstimator::RemoteRateEstimator(uint32 start, uint32 minimum,
+uint32 maximum) :
+delay(start,minimum,maximum), lastTimestamp(0), started(false),
+incomingBitrate(0), incomingBytes(0), incomingWindowStart(0),
+reportedBitrate(0), decreasePending(false)
+{ }
+
+bool
+RemoteRateEstimator::onPacket(uint32 timestamp, uint32 clockRate,
+size_t size, const timeval& tarrival)
+{
+    if ( 0 == clockRate )
+        return false;
+    int64 arrival = toMicroseconds(tarrival);
+    int64 stamp = started ? lastTimestamp +
+        static_cast<int32>(timestamp - static_cast<uint32>(lastTimestamp)) :
+        timestamp;
+    if ( !started || stamp > lastTimestamp )
+        lastTimestamp = stamp;
+    started = true;
+
+    if ( 0 == incomingWindowStart )
+        incomingWindowStart = arrival;
+    incomingBytes += size;
+    int64 span = arrival - incomingWindowStart;
+    if ( span >= ackedWindow ) {
+        uint32 sample =
+            static_cast<uint32>(incomingBytes * 8 * 1000000 / span);
+        incomingBitrate = incomingBitrate ?
+            (incomingBitrate + sample) / 2 : sample;
+        incomingBytes = 0;
+        incomingWindowStart = arrival;
+    }
+
+    delay.addPacket(stamp * 1000000 / clockRate,arrival);
+    uint32 estimate = delay.update(incomingBitrate,arrival);
+    if ( decreasePending || 0 == reportedBitrate ||
+         estimate >= remoteDecreaseReport * reportedBitrate )
+        return false;
+    decreasePending = true;
+    return true;
+}
+
+uint32
+RemoteRateEstimator::report()
+{
+    decreasePending = false;
+    reportedBitrate = delay.getBitrate();
+    return reportedBitrate;
+}
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
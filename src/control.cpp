@@ -96,11 +96,8 @@ queueApplication(app), srtcpIndex(0)
     leavingDelay = 1000000; // 1 second
     end2EndDelay = getDefaultEnd2EndDelay();
 
-    // Fill in fixed fields that will never change
-    RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(rtcpSendBuffer);
-    pkt->fh.version = CCRTP_VERSION;
-    // (SSRCCollision will have to take this into account)
-    pkt->info.SR.ssrc = getLocalSSRCNetwork();
+    // the RTCP buffers are allocated when first used, and every
+    // compound packet sent is filled in completely.
 
     // allow to start RTCP service once everything is set up
     controlServiceActive = true;
@@ -148,11 +145,8 @@ queueApplication(app), srtcpIndex(0)
     leavingDelay = 1000000; // 1 second
     end2EndDelay = getDefaultEnd2EndDelay();
 
-    // Fill in fixed fields that will never change
-    RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(rtcpSendBuffer);
-    pkt->fh.version = CCRTP_VERSION;
-    // (SSRCCollision will have to take this into account)
-    pkt->info.SR.ssrc = getLocalSSRCNetwork();
+    // the RTCP buffers are allocated when first used, and every
+    // compound packet sent is filled in completely.
 
     // allow to start RTCP service once everything is set up
     controlServiceActive = true;
@@ -260,6 +254,20 @@ void QueueRTCPManager::controlReceptionService()
     }
 }
 
+void QueueRTCPManager::controlReadyService()
+{
+    if ( controlServiceActive ) {
+        takeInControlPacket();
+        return;
+    }
+    // not served yet: the packet is read anyway, so that the
+    // socket is no longer readable.
+    InetHostAddress network_address;
+    tpport_t transport_port;
+    allocRTCPRecvBuffer();
+    recvControl(rtcpRecvBuffer,getPathMTU(),network_address,transport_port);
+}
+
 void QueueRTCPManager::controlTransmissionService()
 {
     if ( !controlServiceActive )
@@ -290,6 +298,13 @@ void QueueRTCPManager::controlTransmissionService()
     }
 }
 
+void QueueRTCPManager::setRTCPCheckInterval(microtimeout_t interval)
+{
+    rtcpCheckInterval.tv_sec = interval / 1000000;
+    rtcpCheckInterval.tv_usec = interval % 1000000;
+    timeradd(&rtcpLastCheck,&rtcpCheckInterval,&rtcpNextCheck);
+}
+
 bool QueueRTCPManager::timerReconsideration()
 {
     bool result = false;
@@ -315,6 +330,7 @@ QueueRTCPManager::takeInControlPacket()
     size_t len = 0;
     InetHostAddress network_address;
     tpport_t transport_port;
+    allocRTCPRecvBuffer();
     len = recvControl(rtcpRecvBuffer,getPathMTU(),network_address, transport_port);
 
     // get time of arrival
@@ -825,6 +841,7 @@ void QueueRTCPManager::getOnlyBye()
     size_t len = 0;
     InetHostAddress network_address;
     tpport_t transport_port;
+    allocRTCPRecvBuffer();
     while ( (len = recvControl(rtcpRecvBuffer,getPathMTU(),
                   network_address,transport_port)) ) {
         // Process a <code>len<code> octets long RTCP compound packet
@@ -863,6 +880,7 @@ size_t QueueRTCPManager::dispatchControlPacket(void)
     // (A) SR or RR, depending on whether we sent.
     // pkt will point to the packets of the compound
 
+    allocRTCPSendBuffer();
     RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(rtcpSendBuffer);
     // Fixed header of the first report
     pkt->fh.padding = 0;
@@ -885,20 +903,9 @@ size_t QueueRTCPManager::dispatchControlPacket(void)
         // accurate if this were done as late as possible.
         timeval now;
         SysTime::gettimeofday(&now,NULL);
-        // NTP MSB and MSB: dependent on current payload type.
-        pkt->info.SR.sinfo.NTPMSW = htonl(now.tv_sec + NTP_EPOCH_OFFSET);
-        pkt->info.SR.sinfo.NTPLSW = htonl((uint32)(((double)(now.tv_usec)*(uint32)(~0))/1000000.0));
-        // RTP timestamp
-        int32 tstamp = now.tv_usec - getInitialTime().tv_usec;
-        tstamp *= (getCurrentRTPClockRate()/1000);
-        tstamp /= 1000;
-        tstamp += (now.tv_sec - getInitialTime().tv_sec) *
-            getCurrentRTPClockRate();
-        tstamp += getInitialTimestamp();
-        pkt->info.SR.sinfo.RTPTimestamp = htonl(tstamp);
-        // sender's packet and octet count
-        pkt->info.SR.sinfo.packetCount = htonl(getSendPacketCount());
-        pkt->info.SR.sinfo.octetCount = htonl(getSendOctetCount());
+        fillSenderInfo(pkt->info.SR.sinfo,now,getCurrentRTPClockRate(),
+                   getInitialTimestamp(),getSendPacketCount(),
+                   getSendOctetCount());
         len += sizeof(SenderInfo);
     } else {
         // RR
@@ -957,12 +964,18 @@ size_t QueueRTCPManager::dispatchControlPacket(void)
         }
     } while ( (len < available) && another );
 
+    // (B') SRs for the other local streams
+    packLocalStreamsSR(len,available);
+
     // (C) SDES (CNAME)
     // each SDES chunk must be 32-bit multiple long
     // fill the padding with 0s
     packSDES(len);
 
-    // TODO: virtual for sending APP RTCP packets?
+    // (D) profile specific packets
+    uint16 room = getPathMTU() - lowerHeadersSize - 100;
+    if ( len < room )
+        len += packRTCPExtension(rtcpSendBuffer + len,room - len);
 
     // actually send the packet.
     size_t count = sendControlToDestinations(rtcpSendBuffer,len);
@@ -973,6 +986,58 @@ size_t QueueRTCPManager::dispatchControlPacket(void)
     return count;
 }
 
+void QueueRTCPManager::fillSenderInfo(SenderInfo& si, const timeval& now,
+uint32 rate, uint32 initialTimestamp, uint32 packets, uint32 octets)
+{
+    // NTP MSB and MSB: dependent on current payload type.
+    si.NTPMSW = htonl(now.tv_sec + NTP_EPOCH_OFFSET);
+    si.NTPLSW = htonl((uint32)(((double)(now.tv_usec)*(uint32)(~0))/1000000.0));
+    // RTP timestamp
+    int32 tstamp = now.tv_usec - getInitialTime().tv_usec;
+    tstamp *= (rate/1000);
+    tstamp /= 1000;
+    tstamp += (now.tv_sec - getInitialTime().tv_sec) * rate;
+    tstamp += initialTimestamp;
+    si.RTPTimestamp = htonl(tstamp);
+    // sender's packet and octet count
+    si.packetCount = htonl(packets);
+    si.octetCount = htonl(octets);
+}
+
+void QueueRTCPManager::packLocalStreamsSR(uint16 &len, uint16 available)
+{
+    // room for the SR and for the CNAME chunk in the SDES
+    uint16 cnameLen = (uint16)
+        getApplication().getSDESItem(SDESItemTypeCNAME).length();
+    uint16 needed = sizeof(RTCPFixedHeader) + sizeof(uint32) +
+        sizeof(SenderInfo) + ((sizeof(uint32) + 2 + cnameLen + 4) & ~0x03);
+    timeval now;
+    SysTime::gettimeofday(&now,NULL);
+
+    lockLocalStreams();
+    for (std::list<LocalStream*>::iterator i = localStreams.begin();
+         localStreams.end() != i && (len + needed) < available; i++) {
+        LocalStream* stream = *i;
+        if ( stream->reportedPacketCount == stream->packetCount )
+            continue;
+        stream->reportedPacketCount = stream->packetCount;
+        RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(rtcpSendBuffer + len);
+        pkt->fh.version = CCRTP_VERSION;
+        pkt->fh.padding = 0;
+        pkt->fh.block_count = 0;
+        pkt->fh.type = RTCPPacket::tSR;
+        pkt->info.SR.ssrc = stream->ssrcNetwork;
+        fillSenderInfo(pkt->info.SR.sinfo,now,stream->clockRate,
+                   stream->initialTimestamp,stream->packetCount,
+                   stream->octetCount);
+        uint16 srLen = sizeof(RTCPFixedHeader) + sizeof(uint32) +
+            sizeof(SenderInfo);
+        pkt->fh.length = htons((srLen >> 2) - 1);
+        len += srLen;
+    }
+    unlockLocalStreams();
+}
+
 void QueueRTCPManager::packSDES(uint16 &len)
 {
     uint16 prevlen = len;
@@ -1023,9 +1088,103 @@ void QueueRTCPManager::packSDES(uint16 &len)
         memset((rtcpSendBuffer + len),SDESItemTypeEND,padding);
         len += padding;
     }
+
+    // a CNAME chunk for each of the other local streams, so that
+    // receivers can bind them to this participant.
+    uint16 chunkLen = (uint16)((sizeof(uint32) + 2 + cnameLen + 4) & ~0x03);
+    lockLocalStreams();
+    for (std::list<LocalStream*>::iterator i = localStreams.begin();
+         localStreams.end() != i && pkt->fh.block_count < 31 &&
+         (len + chunkLen) <= (getPathMTU() - lowerHeadersSize); i++) {
+        uint32 ssrc = (*i)->ssrcNetwork;
+        memcpy(rtcpSendBuffer + len,&ssrc,sizeof(ssrc));
+        len += sizeof(ssrc);
+        rtcpSendBuffer[len++] = SDESItemTypeCNAME;
+        rtcpSendBuffer[len++] = (uint8)cnameLen;
+        memcpy(rtcpSendBuffer + len,cname,cnameLen);
+        len += (uint16)cnameLen;
+        // END item and padding
+        padding = 4 - (len & 0x03);
+        memset((rtcpSendBuffer + len),SDESItemTypeEND,padding);
+        len += padding;
+        pkt->fh.block_count++;
+    }
+    unlockLocalStreams();
+
+    // as a mixer, a CNAME chunk for each contributing source whose
+    // CNAME is known (RFC 3550, section 7.1).
+    uint32 csrcs[maxContributors];
+    uint8 numcsrc = getContributors(csrcs);
+    for ( uint8 i = 0; i < numcsrc && pkt->fh.block_count < 31; i++ ) {
+        SyncSourceLink* link = findSourceBySSRC(csrcs[i]);
+        Participant* part = link ? link->getSource()->getParticipant() : NULL;
+        if ( !part )
+            continue;
+        const std::string& csrcName = part->getSDESItem(SDESItemTypeCNAME);
+        if ( csrcName.empty() )
+            continue;
+        uint16 csrcNameLen = (uint16)csrcName.length();
+        uint16 csrcChunkLen =
+            (uint16)((sizeof(uint32) + 2 + csrcNameLen + 4) & ~0x03);
+        if ( csrcNameLen > 255 ||
+             (len + csrcChunkLen) > (getPathMTU() - lowerHeadersSize) )
+            break;
+        uint32 csrc = htonl(csrcs[i]);
+        memcpy(rtcpSendBuffer + len,&csrc,sizeof(csrc));
+        len += sizeof(csrc);
+        rtcpSendBuffer[len++] = SDESItemTypeCNAME;
+        rtcpSendBuffer[len++] = (uint8)csrcNameLen;
+        memcpy(rtcpSendBuffer + len,csrcName.c_str(),csrcNameLen);
+        len += csrcNameLen;
+        padding = 4 - (len & 0x03);
+        memset((rtcpSendBuffer + len),SDESItemTypeEND,padding);
+        len += padding;
+        pkt->fh.block_count++;
+    }
     pkt->fh.length = htons((len - prevlen - 1) >>2);
 }
 
+uint16
+QueueRTCPManager::packRTCPExtension(unsigned char* buffer, uint16 available)
+{
+    if ( !isRemoteBitrateEstimation() )
+        return 0;
+    // one REMB message per source: fixed header, sender and media
+    // SSRC, "REMB", number of SSRCs, exponent and mantissa, SSRC.
+    const uint16 plen = sizeof(RTCPFixedHeader) + 5 * sizeof(uint32);
+    uint16 len = 0;
+    for ( SyncSourceLink* i = getFirst();
+          i != NULL && len + plen <= available; i = i->getNext() ) {
+        RemoteRateEstimator* estimator = i->getRateEstimator();
+        if ( !estimator || !i->getSource()->isSender() )
+            continue;
+        uint32 bitrate = estimator->report();
+        uint8 exp = 0;
+        while ( bitrate > 0x3ffff ) {
+            bitrate >>= 1;
+            exp++;
+        }
+        RTCPPacket* pkt = reinterpret_cast<RTCPPacket*>(buffer + len);
+        pkt->fh.version = CCRTP_VERSION;
+        pkt->fh.padding = 0;
+        pkt->fh.block_count = RTCPPacket::fbAFB;
+        pkt->fh.type = RTCPPacket::tPSFB;
+        pkt->fh.length = htons((plen >> 2) - 1);
+        pkt->info.FB.ssrc = getLocalSSRCNetwork();
+        pkt->info.FB.mediaSSRC = 0;
+        unsigned char* fci = pkt->info.FB.fci;
+        memcpy(fci,"REMB",4);
+        fci[4] = 1;
+        fci[5] = static_cast<unsigned char>(exp << 2 | bitrate >> 16);
+        fci[6] = static_cast<unsigned char>(bitrate >> 8);
+        fci[7] = static_cast<unsigned char>(bitrate);
+        uint32 ssrc = htonl(i->getSource()->getID());
+        memcpy(fci + 8,&ssrc,sizeof(ssrc));
+        len += plen;
+    }
+    return len;
+}
+
 uint8 QueueRTCPManager::packReportBlocks(RRBlock* blocks, uint16 &len, uint16& available)
 {
     uint8 j = 0;
@@ -1123,7 +1282,8 @@ SDESItemType QueueRTCPManager::nextSDESType(SDESItemType t)
 size_t QueueRTCPManager::sendControlToDestinations(unsigned char* buffer, size_t len)
 {
     size_t count = 0;
-    lockDestinationList();
+    uint32 epoch;
+    const DestinationSnapshot* dests = acquireDestinations(epoch);
 
     // Cast to have easy access to ssrc et al
     RTCPPacket *pkt = reinterpret_cast<RTCPPacket *>(buffer);
@@ -1146,19 +1306,18 @@ size_t QueueRTCPManager::sendControlToDestinations(unsigned char* buffer, size_t
         len = protect(buffer, len, pcc);
     }
 
-    if ( isSingleDestination() ) {
+    if ( 1 == dests->count ) {
         count = sendControl(buffer,len);
     } else {
-        // when no destination has been added, NULL == dest.
-        for (std::list<TransportAddress*>::iterator i =
-                 destList.begin(); destList.end() != i; i++) {
-            TransportAddress* dest = *i;
+        // when no destination has been added, count is 0.
+        for (size_t i = 0; i < dests->count; i++) {
+            TransportAddress* dest = dests->destinations[i];
             setControlPeer(dest->getNetworkAddress(),
                        dest->getControlTransportPort());
             count += sendControl(buffer,len);
         }
     }
-    unlockDestinationList();
+    releaseDestinations(epoch);
 
     return count;
 }
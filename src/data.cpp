@@ -37,7 +37,7 @@
 
 /**
  * @file data.cpp
- * @short AppDataUnit class implementation.
+ * @short AppDataUnit and RTPFrame classes implementation.
  **/
 
 #include "private.h"
@@ -64,6 +64,40 @@ AppDataUnit& AppDataUnit::operator=(const AppDataUnit &rhs)
     return *this;
 }
 
+RTPFrame::RTPFrame() :
+packets(), segments(), size(0), timestamp(0), source(NULL), complete(false)
+{ }
+
+RTPFrame::~RTPFrame()
+{
+    clear();
+}
+
+void
+RTPFrame::clear()
+{
+    for ( size_t i = 0; i < packets.size(); i++ )
+        delete packets[i];
+    // the vectors keep their capacity for the next frame
+    packets.clear();
+    segments.clear();
+    size = 0;
+    timestamp = 0;
+    source = NULL;
+    complete = false;
+}
+
+void
+RTPFrame::add(IncomingRTPPkt* packet)
+{
+    Segment segment;
+    segment.data = packet->getPayload();
+    segment.size = packet->getPayloadSize();
+    packets.push_back(packet);
+    segments.push_back(segment);
+    size += segment.size;
+}
+
 END_NAMESPACE
 
 /** EMACS **
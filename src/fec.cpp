@@ -0,0 +1,504 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+#include "private.h"
+#include <ccrtp/fec.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+NAMESPACE_COMMONCPP
+
+// RFC 5109: FEC header and level 0 header sizes.
+static const size_t fecHeaderSize = 10;
+static const size_t fecShortLevelSize = 4;
+static const size_t fecLongLevelSize = 8;
+// parities are accumulated this far from the beginning of the
+// buffer, so that there is room for the longest headers.
+static const size_t fecDataOffset = fecHeaderSize + fecLongLevelSize;
+// RTP fixed header size.
+static const size_t rtpHeaderSize = 12;
+
+void
+fecXor(unsigned char* dst, const unsigned char* src, size_t len)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for ( ; i + 32 <= len; i += 32 ) {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i*>(dst + i));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                    _mm256_xor_si256(d,s));
+    }
+#endif
+#if defined(__SSE2__)
+    for ( ; i + 16 <= len; i += 16 ) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i*>(dst + i));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                 _mm_xor_si128(d,s));
+    }
+#endif
+    // word by word, then the remaining octets.
+    for ( ; i + sizeof(uint32) <= len; i += sizeof(uint32) ) {
+        uint32 d, s;
+        memcpy(&d,dst + i,sizeof(d));
+        memcpy(&s,src + i,sizeof(s));
+        d ^= s;
+        memcpy(dst + i,&d,sizeof(d));
+    }
+    for ( ; i < len; i++ )
+        dst[i] ^= src[i];
+}
+
+static inline uint16
+getShort(const unsigned char* p)
+{ return (uint16)((p[0] << 8) | p[1]); }
+
+static inline void
+putShort(unsigned char* p, uint16 v)
+{ p[0] = (unsigned char)(v >> 8); p[1] = (unsigned char)v; }
+
+// the 48-bit (or 16-bit) mask of a FEC payload, MSB first.
+static uint64
+getFECMask(const unsigned char* payload, bool longMask)
+{
+    uint64 mask = 0;
+    size_t octets = longMask ? 6 : 2;
+    for ( size_t i = 0; i < octets; i++ )
+        mask = (mask << 8) | payload[fecHeaderSize + 2 + i];
+    return mask;
+}
+
+const uint8 FECEncoder::maxBlockSize;
+const uint8 FECEncoder::maxMasks;
+
+FECEncoder::FECEncoder() :
+blockSize(0), masksCount(0), position(0), baseSeqNum(0)
+{
+    for ( uint8 i = 0; i < maxMasks; i++ ) {
+        parities[i].mask = 0;
+        parities[i].buffer = NULL;
+        parities[i].size = 0;
+        parities[i].length = 0;
+        parities[i].header = 0;
+        parities[i].empty = true;
+    }
+}
+
+FECEncoder::~FECEncoder()
+{
+    for ( uint8 i = 0; i < maxMasks; i++ )
+        delete [] parities[i].buffer;
+}
+
+bool
+FECEncoder::setBlockSize(uint8 size)
+{
+    if ( 0 == size || size > maxBlockSize )
+        return false;
+    blockSize = size;
+    masksCount = 0;
+    reset();
+    return true;
+}
+
+bool
+FECEncoder::addMask(uint64 mask)
+{
+    uint64 block = (static_cast<uint64>(1) << blockSize) - 1;
+    if ( !mask || (mask & ~block) || masksCount >= maxMasks )
+        return false;
+    parities[masksCount++].mask = mask;
+    reset();
+    return true;
+}
+
+bool
+FECEncoder::setRowColumn(uint8 columns, uint8 rows)
+{
+    if ( !columns || !rows || columns * rows > maxBlockSize )
+        return false;
+    setBlockSize(columns * rows);
+    uint64 row = (static_cast<uint64>(1) << columns) - 1;
+    for ( uint8 r = 0; r < rows; r++ )
+        addMask(row << (r * columns));
+    if ( rows > 1 ) {
+        for ( uint8 c = 0; c < columns; c++ ) {
+            uint64 column = 0;
+            for ( uint8 r = 0; r < rows; r++ )
+                column |= static_cast<uint64>(1) << (r * columns + c);
+            addMask(column);
+        }
+    }
+    return true;
+}
+
+void
+FECEncoder::reset()
+{
+    position = 0;
+    for ( uint8 i = 0; i < masksCount; i++ ) {
+        Parity& p = parities[i];
+        if ( p.buffer )
+            memset(p.buffer,0,p.size);
+        p.length = 0;
+        p.empty = true;
+    }
+}
+
+uint8
+FECEncoder::protect(const unsigned char* packet, size_t len)
+{
+    if ( !blockSize || !masksCount || len < rtpHeaderSize )
+        return 0;
+
+    uint16 seqNum = getShort(packet + 2);
+    if ( position == blockSize ||
+         (position && seqNum != (uint16)(baseSeqNum + position)) )
+        reset();
+    if ( 0 == position )
+        baseSeqNum = seqNum;
+
+    size_t dataLen = len - rtpHeaderSize;
+    uint64 bit = static_cast<uint64>(1) << position;
+    for ( uint8 i = 0; i < masksCount; i++ ) {
+        Parity& p = parities[i];
+        if ( !(p.mask & bit) )
+            continue;
+        if ( p.size < fecDataOffset + dataLen ) {
+            // grow, keeping the parity so far.
+            size_t size = fecDataOffset + dataLen;
+            unsigned char* buffer = new unsigned char[size];
+            memset(buffer,0,size);
+            if ( p.buffer )
+                memcpy(buffer,p.buffer,p.size);
+            delete [] p.buffer;
+            p.buffer = buffer;
+            p.size = size;
+        }
+        // P, X, CC, M, PT and timestamp recovery fields.
+        p.buffer[0] ^= packet[0];
+        p.buffer[1] ^= packet[1];
+        fecXor(p.buffer + 4,packet + 4,4);
+        // length recovery
+        uint16 l = getShort(p.buffer + 8) ^ (uint16)dataLen;
+        putShort(p.buffer + 8,l);
+        fecXor(p.buffer + fecDataOffset,packet + rtpHeaderSize,dataLen);
+        if ( dataLen > p.length )
+            p.length = dataLen;
+        p.empty = false;
+    }
+
+    if ( ++position < blockSize )
+        return 0;
+
+    // block completed: write the headers in front of the parities
+    // of each mask, right before the data.
+    uint8 ready = 0;
+    for ( uint8 i = 0; i < masksCount; i++ ) {
+        Parity& p = parities[i];
+        if ( p.empty )
+            continue;
+        // SN base is the first protected packet.
+        uint8 first = 0;
+        while ( !(p.mask & (static_cast<uint64>(1) << first)) )
+            first++;
+        uint64 mask = p.mask >> first;
+        uint8 span = 0;
+        while ( mask >> span )
+            span++;
+        bool longMask = span > 16;
+        size_t hdrLen = fecHeaderSize +
+            (longMask ? fecLongLevelSize : fecShortLevelSize);
+        // the header may overlap the accumulated fields.
+        unsigned char acc[fecHeaderSize];
+        memcpy(acc,p.buffer,sizeof(acc));
+        p.header = fecDataOffset - hdrLen;
+        unsigned char* h = p.buffer + p.header;
+        // E = 0, L, and the recovered P, X, CC
+        h[0] = (unsigned char)((acc[0] & 0x3f) | (longMask ? 0x40 : 0));
+        h[1] = acc[1];
+        putShort(h + 2,(uint16)(baseSeqNum + first));
+        memcpy(h + 4,acc + 4,6);
+        putShort(h + fecHeaderSize,(uint16)p.length);
+        // mask, MSB is SN base
+        uint8 bits = longMask ? 48 : 16;
+        uint64 wire = 0;
+        for ( uint8 b = 0; b < span; b++ ) {
+            if ( mask & (static_cast<uint64>(1) << b) )
+                wire |= static_cast<uint64>(1) << (bits - 1 - b);
+        }
+        for ( uint8 o = 0; o < bits / 8; o++ )
+            h[fecHeaderSize + 2 + o] =
+                (unsigned char)(wire >> (bits - 8 - 8 * o));
+        // reorder so that the ready payloads come first.
+        if ( i != ready ) {
+            Parity tmp = parities[ready];
+            parities[ready] = p;
+            parities[i] = tmp;
+        }
+        ready++;
+    }
+    return ready;
+}
+
+const unsigned char*
+FECEncoder::getFECPayload(uint8 i, size_t& len) const
+{
+    if ( i >= masksCount || parities[i].empty ) {
+        len = 0;
+        return NULL;
+    }
+    const Parity& p = parities[i];
+    len = fecDataOffset - p.header + p.length;
+    return p.buffer + p.header;
+}
+
+const uint16 FECDecoder::mediaWindow;
+const uint8 FECDecoder::fecWindow;
+
+FECDecoder::FECDecoder() :
+ssrc(0), ssrcKnown(false), highestSeqNum(0), recoveredCount(0)
+{
+    for ( uint16 i = 0; i < mediaWindow; i++ )
+        media[i].data = NULL;
+    for ( uint8 i = 0; i < fecWindow; i++ )
+        fec[i].data = NULL;
+}
+
+FECDecoder::~FECDecoder()
+{
+    reset();
+}
+
+void
+FECDecoder::reset()
+{
+    for ( uint16 i = 0; i < mediaWindow; i++ ) {
+        delete [] media[i].data;
+        media[i].data = NULL;
+    }
+    for ( uint8 i = 0; i < fecWindow; i++ ) {
+        delete [] fec[i].data;
+        fec[i].data = NULL;
+    }
+    ssrcKnown = false;
+}
+
+void
+FECDecoder::storeMedia(unsigned char* data, size_t len, uint16 seqNum)
+{
+    Packet& p = media[seqNum % mediaWindow];
+    delete [] p.data;
+    p.data = data;
+    p.len = len;
+    p.seqNum = seqNum;
+    if ( static_cast<int16>(seqNum - highestSeqNum) > 0 )
+        highestSeqNum = seqNum;
+}
+
+void
+FECDecoder::addMediaPacket(const unsigned char* packet, size_t len)
+{
+    if ( len < rtpHeaderSize )
+        return;
+    uint32 s = (uint32(packet[8]) << 24) | (uint32(packet[9]) << 16) |
+        (uint32(packet[10]) << 8) | packet[11];
+    if ( !ssrcKnown ) {
+        ssrc = s;
+        ssrcKnown = true;
+        highestSeqNum = getShort(packet + 2);
+    } else if ( s != ssrc ) {
+        return;
+    }
+    unsigned char* data = new unsigned char[len];
+    memcpy(data,packet,len);
+    storeMedia(data,len,getShort(packet + 2));
+}
+
+bool
+FECDecoder::addFECPacket(const unsigned char* payload, size_t len)
+{
+    if ( len < fecHeaderSize + fecShortLevelSize )
+        return false;
+    bool longMask = (payload[0] & 0x40) != 0;
+    size_t hdrLen = fecHeaderSize +
+        (longMask ? fecLongLevelSize : fecShortLevelSize);
+    // E must be 0, and the protected data must be there.
+    if ( (payload[0] & 0x80) || len < hdrLen ||
+         len - hdrLen < getShort(payload + fecHeaderSize) )
+        return false;
+
+    // take a free slot or replace the oldest FEC packet.
+    uint8 slot = 0;
+    for ( uint8 i = 0; i < fecWindow; i++ ) {
+        if ( !fec[i].data ) {
+            slot = i;
+            break;
+        }
+        if ( static_cast<int16>(fec[i].seqNum - fec[slot].seqNum) < 0 )
+            slot = i;
+    }
+    delete [] fec[slot].data;
+    fec[slot].data = new unsigned char[len];
+    memcpy(fec[slot].data,payload,len);
+    fec[slot].len = len;
+    fec[slot].seqNum = getShort(payload + 2);
+    return true;
+}
+
+const FECDecoder::Packet*
+FECDecoder::findMedia(uint16 seqNum) const
+{
+    const Packet& p = media[seqNum % mediaWindow];
+    if ( p.data && p.seqNum == seqNum )
+        return &p;
+    return NULL;
+}
+
+unsigned char*
+FECDecoder::rebuild(const Packet& f, uint16 seqNum, size_t& len)
+{
+    bool longMask = (f.data[0] & 0x40) != 0;
+    size_t hdrLen = fecHeaderSize +
+        (longMask ? fecLongLevelSize : fecShortLevelSize);
+    uint16 base = getShort(f.data + 2);
+    uint64 mask = getFECMask(f.data,longMask);
+    uint8 bits = longMask ? 48 : 16;
+    size_t protLen = getShort(f.data + fecHeaderSize);
+
+    // start from the FEC fields and xor the packets present
+    unsigned char head[10];
+    memcpy(head,f.data,sizeof(head));
+    unsigned char* data = new unsigned char[rtpHeaderSize + protLen];
+    memcpy(data + rtpHeaderSize,f.data + hdrLen,protLen);
+    for ( uint8 b = 0; b < bits; b++ ) {
+        if ( !(mask & (static_cast<uint64>(1) << (bits - 1 - b))) )
+            continue;
+        uint16 s = (uint16)(base + b);
+        if ( s == seqNum )
+            continue;
+        const Packet* p = findMedia(s);
+        size_t dataLen = p->len - rtpHeaderSize;
+        head[0] ^= p->data[0];
+        head[1] ^= p->data[1];
+        fecXor(head + 4,p->data + 4,4);
+        putShort(head + 8,getShort(head + 8) ^ (uint16)dataLen);
+        fecXor(data + rtpHeaderSize,p->data + rtpHeaderSize,
+               dataLen < protLen ? dataLen : protLen);
+    }
+    size_t dataLen = getShort(head + 8);
+    if ( dataLen > protLen ) {
+        delete [] data;
+        return NULL;
+    }
+    data[0] = (unsigned char)((CCRTP_VERSION << 6) | (head[0] & 0x3f));
+    data[1] = head[1];
+    putShort(data + 2,seqNum);
+    memcpy(data + 4,head + 4,4);
+    data[8] = (unsigned char)(ssrc >> 24);
+    data[9] = (unsigned char)(ssrc >> 16);
+    data[10] = (unsigned char)(ssrc >> 8);
+    data[11] = (unsigned char)ssrc;
+    len = rtpHeaderSize + dataLen;
+    return data;
+}
+
+unsigned char*
+FECDecoder::recover(size_t& len)
+{
+    if ( !ssrcKnown )
+        return NULL;
+    for ( uint8 i = 0; i < fecWindow; i++ ) {
+        Packet& f = fec[i];
+        if ( !f.data )
+            continue;
+        bool longMask = (f.data[0] & 0x40) != 0;
+        uint16 base = getShort(f.data + 2);
+        uint64 mask = getFECMask(f.data,longMask);
+        uint8 bits = longMask ? 48 : 16;
+
+        // too old: the protected packets are out of the window.
+        if ( static_cast<int16>(highestSeqNum - base) >=
+             static_cast<int16>(mediaWindow - bits) ) {
+            delete [] f.data;
+            f.data = NULL;
+            continue;
+        }
+
+        uint8 missing = 0;
+        uint16 lost = 0;
+        for ( uint8 b = 0; b < bits && missing < 2; b++ ) {
+            if ( !(mask & (static_cast<uint64>(1) << (bits - 1 - b))) )
+                continue;
+            uint16 s = (uint16)(base + b);
+            if ( !findMedia(s) ) {
+                missing++;
+                lost = s;
+            }
+        }
+        if ( missing > 1 )
+            continue;
+        unsigned char* packet = NULL;
+        if ( 1 == missing )
+            packet = rebuild(f,lost,len);
+        // this FEC packet is of no further use.
+        delete [] f.data;
+        f.data = NULL;
+        if ( packet ) {
+            // keep a copy for further recoveries.
+            unsigned char* copy = new unsigned char[len];
+            memcpy(copy,packet,len);
+            storeMedia(copy,len,lost);
+            recoveredCount++;
+            return packet;
+        }
+    }
+    return NULL;
+}
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
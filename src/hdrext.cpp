@@ -0,0 +1,290 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+#include "private.h"
+#include <ccrtp/hdrext.h>
+#include <cstring>
+
+NAMESPACE_COMMONCPP
+
+// "defined by profile" values of RFC 8285
+static const uint16 oneByteProfile = 0xBEDE;
+static const uint16 twoByteProfile = 0x1000;
+static const uint16 twoByteProfileMask = 0xfff0;
+// the one-byte form ends at an element with this identifier
+static const uint8 oneByteStop = 15;
+
+const uint8 HeaderExtensionWriter::maxElements;
+const size_t HeaderExtensionWriter::maxLength;
+
+HeaderExtensionWriter::HeaderExtensionWriter() :
+count(0), size(0)
+{ }
+
+void
+HeaderExtensionWriter::reset()
+{
+    count = 0;
+    size = 0;
+}
+
+bool
+HeaderExtensionWriter::add(uint8 id, const unsigned char* data, uint8 len)
+{
+    // room for the extension header and padding
+    if ( 0 == id || count == maxElements ||
+         4 + size + 2 + len + 3 > maxLength )
+        return false;
+    Element& e = elements[count++];
+    e.id = id;
+    e.len = len;
+    e.data = data;
+    e.offset = 0;
+    size += 2 + len;
+    return true;
+}
+
+size_t
+HeaderExtensionWriter::build()
+{
+    if ( 0 == count )
+        return 0;
+    bool twoByte = false;
+    for ( uint8 i = 0; i < count; i++ ) {
+        if ( elements[i].id >= oneByteStop || 0 == elements[i].len ||
+             elements[i].len > 16 )
+            twoByte = true;
+    }
+
+    size_t pointer = 4;
+    for ( uint8 i = 0; i < count; i++ ) {
+        Element& e = elements[i];
+        if ( twoByte ) {
+            buffer[pointer++] = e.id;
+            buffer[pointer++] = e.len;
+        } else {
+            buffer[pointer++] = static_cast<unsigned char>
+                (e.id << 4 | (e.len - 1));
+        }
+        e.offset = static_cast<uint16>(pointer - 4);
+        if ( e.data )
+            memcpy(buffer + pointer,e.data,e.len);
+        else
+            memset(buffer + pointer,0,e.len);
+        pointer += e.len;
+    }
+    while ( pointer & 0x03 )
+        buffer[pointer++] = 0;
+
+    uint16 profile = twoByte ? twoByteProfile : oneByteProfile;
+    uint16 words = static_cast<uint16>((pointer - 4) >> 2);
+    buffer[0] = static_cast<unsigned char>(profile >> 8);
+    buffer[1] = static_cast<unsigned char>(profile);
+    buffer[2] = static_cast<unsigned char>(words >> 8);
+    buffer[3] = static_cast<unsigned char>(words);
+    return pointer;
+}
+
+HeaderExtensionIterator::HeaderExtensionIterator(const RTPPacket& packet)
+{
+    if ( packet.isExtended() )
+        init(ntohs(packet.getHdrExtUndefined()),
+             packet.getHdrExtContent(),packet.getHdrExtSize());
+    else
+        init(0,NULL,0);
+}
+
+HeaderExtensionIterator::HeaderExtensionIterator(uint16 profile,
+const unsigned char* content, size_t len)
+{
+    init(profile,content,len);
+}
+
+void
+HeaderExtensionIterator::init(uint16 profile, const unsigned char* c,
+size_t len)
+{
+    content = c;
+    contentLength = len;
+    pointer = 0;
+    id = length = 0;
+    data = NULL;
+    if ( oneByteProfile == profile )
+        twoByte = false;
+    else if ( twoByteProfile == (profile & twoByteProfileMask) )
+        twoByte = true;
+    else
+        // not an RFC 8285 extension
+        contentLength = 0;
+    ++(*this);
+}
+
+HeaderExtensionIterator&
+HeaderExtensionIterator::operator++()
+{
+    data = NULL;
+    while ( pointer < contentLength ) {
+        if ( 0 == content[pointer] ) {
+            // padding
+            pointer++;
+            continue;
+        }
+        size_t header;
+        if ( twoByte ) {
+            if ( pointer + 2 > contentLength )
+                break;
+            id = content[pointer];
+            length = content[pointer + 1];
+            header = 2;
+        } else {
+            id = content[pointer] >> 4;
+            length = (content[pointer] & 0x0f) + 1;
+            header = 1;
+            if ( oneByteStop == id )
+                break;
+        }
+        if ( pointer + header + length > contentLength )
+            break;
+        data = content + pointer + header;
+        pointer += header + length;
+        return *this;
+    }
+    // done, or malformed
+    pointer = contentLength;
+    return *this;
+}
+
+const unsigned char*
+findHeaderExtension(const RTPPacket& packet, uint8 id, uint8& len)
+{
+    for ( HeaderExtensionIterator i(packet); i.isValid(); ++i ) {
+        if ( i.getId() == id ) {
+            len = i.getLength();
+            return i.getData();
+        }
+    }
+    return NULL;
+}
+
+HeaderExtensionRegistry::HeaderExtensionRegistry() :
+count(0)
+{
+    for ( size_t i = 0; i < 256; i++ )
+        handlers[i] = NULL;
+}
+
+bool
+HeaderExtensionRegistry::add(uint8 id, HeaderExtension& ext)
+{
+    if ( 0 == id || handlers[id] )
+        return false;
+    handlers[id] = &ext;
+    ids[count++] = id;
+    return true;
+}
+
+bool
+HeaderExtensionRegistry::remove(uint8 id)
+{
+    if ( !handlers[id] )
+        return false;
+    handlers[id] = NULL;
+    for ( uint8 i = 0; i < count; i++ ) {
+        if ( ids[i] == id ) {
+            memmove(ids + i,ids + i + 1,count - i - 1);
+            count--;
+            break;
+        }
+    }
+    return true;
+}
+
+size_t
+HeaderExtensionRegistry::prepare(HeaderExtensionWriter& writer) const
+{
+    writer.reset();
+    for ( uint8 i = 0; i < count; i++ ) {
+        HeaderExtension* ext = handlers[ids[i]];
+        if ( !ext )
+            continue;
+        uint8 len = ext->getSendLength();
+        if ( len )
+            writer.add(ids[i],NULL,len);
+    }
+    return writer.build();
+}
+
+void
+HeaderExtensionRegistry::write(OutgoingRTPPkt& packet) const
+{
+    for ( HeaderExtensionIterator i(packet); i.isValid(); ++i ) {
+        HeaderExtension* ext = handlers[i.getId()];
+        if ( ext )
+            ext->write(const_cast<unsigned char*>(i.getData()),
+                   i.getLength(),packet);
+    }
+}
+
+void
+HeaderExtensionRegistry::sent(const OutgoingRTPPkt& packet, size_t size,
+const timeval& when) const
+{
+    for ( HeaderExtensionIterator i(packet); i.isValid(); ++i ) {
+        HeaderExtension* ext = handlers[i.getId()];
+        if ( ext )
+            ext->onSent(i.getData(),i.getLength(),size,when);
+    }
+}
+
+void
+HeaderExtensionRegistry::received(const IncomingRTPPkt& packet,
+const timeval& arrival) const
+{
+    for ( HeaderExtensionIterator i(packet); i.isValid(); ++i ) {
+        HeaderExtension* ext = handlers[i.getId()];
+        if ( ext )
+            ext->onReceived(i.getData(),i.getLength(),packet,arrival);
+    }
+}
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
@@ -37,6 +37,10 @@
 
 #include "private.h"
 #include <ccrtp/iqueue.h>
+#include <ccrtp/fec.h>
+#include <ccrtp/congestion.h>
+#include <ccrtp/packetizer.h>
+#include <ccrtp/red.h>
 
 NAMESPACE_COMMONCPP
 
@@ -99,6 +103,39 @@ IncomingDataQueueBase(), MembershipBookkeeping(size)
     minValidPacketSequence = getDefaultMinValidPacketSequence();
     maxPacketDropout = getDefaultMaxPacketDropout();
     maxPacketMisorder = getDefaultMaxPacketMisorder();
+    fecDecoder = NULL;
+    fecPayloadType = 0;
+    redDecoder = NULL;
+    redPayloadType = 0;
+    remoteBitrateEstimation = false;
+    deliveryHandler = NULL;
+    deliveryUsed = false;
+    deliveryHoldTime = 50000;
+}
+
+void
+IncomingDataQueue::setFECDecoder(FECDecoder* decoder, PayloadType fecPT)
+{
+    if ( decoder )
+        decoder->reset();
+    fecDecoder = decoder;
+    fecPayloadType = fecPT;
+}
+
+void
+IncomingDataQueue::setREDDecoder(REDDecoder* decoder, PayloadType redPT)
+{
+    redDecoder = decoder;
+    redPayloadType = redPT;
+}
+
+uint32
+IncomingDataQueue::getRemoteBitrateEstimate(const SyncSource& src) const
+{
+    if ( !isMine(src) )
+        return 0;
+    RemoteRateEstimator* estimator = getLink(src)->getRateEstimator();
+    return estimator ? estimator->getEstimate() : 0;
 }
 
 void
@@ -243,6 +280,43 @@ IncomingDataQueue::takeInDataPacket(void)
         return 0;
     }
 
+    if ( packet->isExtended() && !getHeaderExtensions().isEmpty() )
+        getHeaderExtensions().received(*packet,recvtime);
+
+    if ( fecDecoder ) {
+        if ( packet->getPayloadType() == fecPayloadType ) {
+            // FEC packets are not queued.
+            fecDecoder->addFECPacket(packet->getPayload(),
+                         packet->getPayloadSize());
+            delete packet;
+        } else {
+            fecDecoder->addMediaPacket(packet->getRawPacket(),
+                           packet->getRawPacketSize());
+            admitDataPacket(packet,recvtime,network_address,
+                    transport_port);
+        }
+        recoverDataPackets(recvtime,network_address,transport_port);
+    } else {
+        admitDataPacket(packet,recvtime,network_address,transport_port);
+    }
+
+    // ccRTP keeps packets from the new source, but avoids
+    // flip-flopping. This allows losing less packets and for
+    // mobile telephony applications or other apps that may change
+    // the source transport address during the session.
+    return rtn;
+}
+
+IncomingDataQueue::SyncSourceLink*
+IncomingDataQueue::admitDataPacket(IncomingRTPPkt* packet,
+const timeval& recvtime, InetHostAddress& network_address,
+tpport_t transport_port, bool recovered)
+{
+    if ( redDecoder && packet->getPayloadType() == redPayloadType ) {
+        admitREDPacket(packet,recvtime,network_address,transport_port);
+        return NULL;
+    }
+
     bool source_created;
     SyncSourceLink* sourceLink =
         getSourceBySSRC(packet->getSSRC(),source_created);
@@ -273,7 +347,11 @@ IncomingDataQueue::takeInDataPacket(void)
     // TODO: also check CSRC identifiers.
     if ( checkSSRCInIncomingRTPPkt(*sourceLink,source_created,
                        network_address,transport_port) &&
-         recordReception(*sourceLink,*packet,recvtime) ) {
+         recordReception(*sourceLink,*packet,recvtime,recovered) ) {
+        if ( isDelivered(*sourceLink) ) {
+            deliverDataPacket(*sourceLink,packet,recvtime);
+            return sourceLink;
+        }
         // now the packet link is linked in the queues
         IncomingRTPPktLink* packetLink =
             new IncomingRTPPktLink(packet,
@@ -282,18 +360,256 @@ IncomingDataQueue::takeInDataPacket(void)
                            packet->getTimestamp() -
                            sourceLink->getInitialDataTimestamp(),
                            NULL,NULL,NULL,NULL);
-        insertRecvPacket(packetLink);
-    } else {
-        // must be discarded due to collision or loop or
-        // invalid source
+        insertRecvPacket(packetLink,recovered);
+        return sourceLink;
+    }
+    // must be discarded due to collision or loop or invalid source
+    delete packet;
+    return NULL;
+}
+
+void
+IncomingDataQueue::admitREDPacket(IncomingRTPPkt* packet,
+const timeval& recvtime, InetHostAddress& network_address,
+tpport_t transport_port)
+{
+    uint8 count = redDecoder->decode(packet->getRawPacket(),
+                     packet->getPayload(),
+                     packet->getPayloadSize());
+    // the packets of the blocks are built before the RED one goes
+    IncomingRTPPkt* blocks[REDDecoder::maxBlocks];
+    for ( uint8 i = 0; i < count; i++ ) {
+        size_t len;
+        unsigned char* buffer = redDecoder->getPacket(i,len);
+        blocks[i] = buffer ? new IncomingRTPPkt(buffer,len) : NULL;
+    }
+    delete packet;
+    if ( !count )
+        return;
+
+    // the primary block stands for the packet received, nested RED
+    // payloads are not accepted.
+    IncomingRTPPkt* primary = blocks[count - 1];
+    SyncSourceLink* srcLink = NULL;
+    if ( primary->isHeaderValid() &&
+         primary->getPayloadType() != redPayloadType )
+        srcLink = admitDataPacket(primary,recvtime,network_address,
+                      transport_port);
+    else
+        delete primary;
+
+    // redundant blocks are not accounted as received, and are only
+    // queued in place of the packets not received.
+    for ( uint8 i = 0; i + 1 < count; i++ ) {
+        IncomingRTPPkt* block = blocks[i];
+        if ( !srcLink || !block || !block->isHeaderValid() ) {
+            delete block;
+            continue;
+        }
+        if ( isDelivered(*srcLink) ) {
+            if ( deliverDataPacket(*srcLink,block,recvtime) )
+                redDecoder->recovered();
+            continue;
+        }
+        IncomingRTPPktLink* packetLink =
+            new IncomingRTPPktLink(block,srcLink,recvtime,
+                           block->getTimestamp() -
+                           srcLink->getInitialDataTimestamp(),
+                           NULL,NULL,NULL,NULL);
+        if ( insertRecvPacket(packetLink,true) )
+            redDecoder->recovered();
+    }
+}
+
+void
+IncomingDataQueue::recoverDataPackets(const timeval& recvtime,
+InetHostAddress& network_address, tpport_t transport_port)
+{
+    size_t len;
+    unsigned char* buffer;
+    while ( NULL != (buffer = fecDecoder->recover(len)) ) {
+        IncomingRTPPkt* packet = new IncomingRTPPkt(buffer,len);
+        if ( packet->isHeaderValid() )
+            admitDataPacket(packet,recvtime,network_address,
+                    transport_port,true);
+        else
+            delete packet;
+    }
+}
+
+size_t
+IncomingDataQueue::getRecvMemoryUsage() const
+{
+    size_t size = getMembersMemoryUsage();
+    recvLock.readLock();
+    for ( IncomingRTPPktLink* l = recvFirst; l; l = l->getNext() )
+        size += sizeof(IncomingRTPPktLink) + sizeof(IncomingRTPPkt) +
+            l->getPacket()->getRawPacketSize();
+    recvLock.unlock();
+    cryptoMutex.enter();
+    size += cryptoContexts.size() * sizeof(CryptoContext);
+    cryptoMutex.leave();
+    return size;
+}
+
+bool
+IncomingDataQueue::setDeliveryHandler(const SyncSource& src,
+RTPDeliveryHandler* handler)
+{
+    if ( !isMine(src) )
+        return false;
+    getLink(src)->deliveryHandler = handler;
+    if ( handler )
+        deliveryUsed = true;
+    return true;
+}
+
+bool
+IncomingDataQueue::deliverDataPacket(SyncSourceLink& srcLink,
+IncomingRTPPkt* packet, const timeval& recvtime)
+{
+    const uint16 window = SyncSourceLink::deliveryWindow;
+    uint16 seq = packet->getSeqNum();
+    if ( !srcLink.deliveryStarted ) {
+        srcLink.nextDeliverySeqNum = seq;
+        srcLink.deliveryStarted = true;
+    }
+    int16 delta = static_cast<int16>(seq - srcLink.nextDeliverySeqNum);
+    if ( delta >= window || delta <= -window ) {
+        // the sequence numbers jumped: the missing packets are
+        // not waited for any longer.
+        releaseHeldPackets(srcLink,recvtime,true);
+        srcLink.nextDeliverySeqNum = seq;
+        delta = 0;
+    } else if ( delta < 0 ) {
+        // late or duplicated, its turn has passed
         delete packet;
+        return false;
     }
 
-    // ccRTP keeps packets from the new source, but avoids
-    // flip-flopping. This allows losing less packets and for
-    // mobile telephony applications or other apps that may change
-    // the source transport address during the session.
-    return rtn;
+    if ( 0 == delta ) {
+        srcLink.nextDeliverySeqNum++;
+        srcLink.heldSince = recvtime;
+        dispatchDeliveredPacket(srcLink,packet,recvtime);
+    } else {
+        if ( !srcLink.held ) {
+            srcLink.held = new IncomingRTPPkt*[window];
+            for ( uint16 i = 0; i < window; i++ )
+                srcLink.held[i] = NULL;
+        }
+        // the held packets are all within the window, so one in
+        // this slot is a duplicate.
+        IncomingRTPPkt*& slot = srcLink.held[seq % window];
+        if ( slot ) {
+            delete packet;
+            return false;
+        }
+        slot = packet;
+        if ( 0 == srcLink.heldCount++ )
+            srcLink.heldSince = recvtime;
+    }
+    releaseHeldPackets(srcLink,recvtime,false);
+    return true;
+}
+
+void
+IncomingDataQueue::releaseHeldPackets(SyncSourceLink& srcLink,
+const timeval& recvtime, bool all)
+{
+    const uint16 window = SyncSourceLink::deliveryWindow;
+    // whether the missing packets are given up
+    bool expired = all;
+    while ( srcLink.heldCount ) {
+        IncomingRTPPkt*& slot =
+            srcLink.held[srcLink.nextDeliverySeqNum % window];
+        if ( !slot ) {
+            if ( !expired ) {
+                // a packet is missing: wait for it, at most the
+                // hold time since delivery last progressed.
+                timeval hold = microtimeout2Timeval(deliveryHoldTime);
+                timeval limit;
+                timeradd(&srcLink.heldSince,&hold,&limit);
+                if ( timercmp(&recvtime,&limit,<) )
+                    return;
+                expired = true;
+            }
+            // given up, with the rest of the run of missing ones
+            srcLink.nextDeliverySeqNum++;
+            continue;
+        }
+        IncomingRTPPkt* packet = slot;
+        slot = NULL;
+        srcLink.heldCount--;
+        srcLink.nextDeliverySeqNum++;
+        srcLink.heldSince = recvtime;
+        expired = all;
+        dispatchDeliveredPacket(srcLink,packet,recvtime);
+    }
+}
+
+void
+IncomingDataQueue::releaseHeldPackets()
+{
+    if ( !deliveryUsed )
+        return;
+    timeval now;
+    SysTime::gettimeofday(&now,NULL);
+    for ( SyncSourceLink* l = getFirst(); l; l = l->getNext() )
+        if ( l->heldCount )
+            releaseHeldPackets(*l,now,false);
+}
+
+bool
+IncomingDataQueue::getHeldDeadline(timeval& deadline)
+{
+    if ( !deliveryUsed )
+        return false;
+    bool held = false;
+    timeval hold = microtimeout2Timeval(deliveryHoldTime);
+    for ( SyncSourceLink* l = getFirst(); l; l = l->getNext() ) {
+        if ( !l->heldCount )
+            continue;
+        timeval limit;
+        timeradd(&(l->heldSince),&hold,&limit);
+        if ( !held || timercmp(&limit,&deadline,<) )
+            deadline = limit;
+        held = true;
+    }
+    return held;
+}
+
+microtimeout_t
+IncomingDataQueue::getHeldTimeout(microtimeout_t max)
+{
+    timeval deadline;
+    if ( !getHeldDeadline(deadline) )
+        return max;
+    timeval now, wait;
+    SysTime::gettimeofday(&now,NULL);
+    if ( !timercmp(&deadline,&now,>) )
+        return 0;
+    timersub(&deadline,&now,&wait);
+    microtimeout_t timeout = timeval2microtimeout(wait);
+    return ( timeout < max ) ? timeout : max;
+}
+
+void
+IncomingDataQueue::dispatchDeliveredPacket(SyncSourceLink& srcLink,
+IncomingRTPPkt* packet, const timeval& recvtime)
+{
+    RTPDeliveryHandler* handler = srcLink.deliveryHandler ?
+        srcLink.deliveryHandler : deliveryHandler;
+    if ( handler && handler->onDelivery(*packet,*(srcLink.getSource())) ) {
+        delete packet;
+        return;
+    }
+    // not consumed, or no handler any more
+    IncomingRTPPktLink* packetLink =
+        new IncomingRTPPktLink(packet,&srcLink,recvtime,
+                       packet->getTimestamp() -
+                       srcLink.getInitialDataTimestamp(),
+                       NULL,NULL,NULL,NULL);
+    insertRecvPacket(packetLink);
 }
 
 bool IncomingDataQueue::checkSSRCInIncomingRTPPkt(SyncSourceLink& sourceLink,
@@ -366,15 +682,27 @@ bool is_new, InetAddress& network_address, tpport_t transport_port)
 }
 
 bool
-IncomingDataQueue::insertRecvPacket(IncomingRTPPktLink* packetLink)
+IncomingDataQueue::insertRecvPacket(IncomingRTPPktLink* packetLink,
+bool recovered)
 {
     SyncSourceLink *srcLink = packetLink->getSourceLink();
     unsigned short seq = packetLink->getPacket()->getSeqNum();
     recvLock.writeLock();
+    // packets already inserted, even if no longer queued, are
+    // duplicates. Recovered packets older than the window may have
+    // been received.
+    if ( !srcLink->recordSeqNum(seq,!recovered) ) {
+        recvLock.unlock();
+        VDL(("Duplicated packet: seqnum %d, SSRC:",
+             seq,srcLink->getSource()->getID()));
+        delete packetLink->getPacket();
+        delete packetLink;
+        return false;
+    }
     IncomingRTPPktLink* plink = srcLink->getLast();
     if ( plink && (seq < plink->getPacket()->getSeqNum()) ) {
         // a disordered packet, so look for its place
-        while ( plink && (seq < plink->getPacket()->getSeqNum()) ){
+        while ( plink && (seq <= plink->getPacket()->getSeqNum()) ){
             // the packet is a duplicate
             if ( seq == plink->getPacket()->getSeqNum() ) {
                 recvLock.unlock();
@@ -465,6 +793,7 @@ IncomingDataQueue::insertRecvPacket(IncomingRTPPktLink* packetLink)
     srcLink->recordInsertion(*packetLink);
     recvLock.unlock();
     // packet successfully inserted
+    onDataQueued(*(srcLink->getSource()));
     return true;
 }
 
@@ -491,6 +820,142 @@ IncomingDataQueue::getData(uint32 stamp, const SyncSource* src)
     return result;
 }
 
+size_t
+IncomingDataQueue::takeFrame(const SyncSource& src, IncomingRTPPktLink*& first,
+bool& missingStart, bool& missingEnd)
+{
+    if ( !isMine(src) )
+        return 0;
+
+    recvLock.writeLock();
+    SyncSourceLink* srcLink = getLink(src);
+    first = srcLink->getFirst();
+    if ( !first ) {
+        recvLock.unlock();
+        return 0;
+    }
+    // find the end of the first frame
+    uint32 stamp = first->getTimestamp();
+    size_t count = 0;
+    IncomingRTPPktLink* last = NULL;
+    IncomingRTPPktLink* following = NULL;
+    for ( IncomingRTPPktLink* l = first; l; l = l->getSrcNext() ) {
+        if ( l->getTimestamp() != stamp ) {
+            following = l;
+            break;
+        }
+        count++;
+        last = l;
+        if ( l->getPacket()->isMarked() )
+            break;
+    }
+    if ( !last->getPacket()->isMarked() && !following ) {
+        // more packets of the frame may come
+        recvLock.unlock();
+        return 0;
+    }
+
+    uint16 seqNum;
+    missingStart = srcLink->getNextFrameSeqNum(seqNum) &&
+        first->getPacket()->getSeqNum() != seqNum;
+    seqNum = last->getPacket()->getSeqNum() + 1;
+    missingEnd = following &&
+        following->getPacket()->getSeqNum() != seqNum;
+    srcLink->setNextFrameSeqNum(seqNum);
+
+    // take the packets out of the queues, the caller goes through
+    // them without holding the lock
+    IncomingRTPPktLink* l = first;
+    for ( size_t i = 0; i < count; i++ ) {
+        unlinkRecvPacket(l);
+        l = l->getSrcNext();
+    }
+    recvLock.unlock();
+    return count;
+}
+
+bool
+IncomingDataQueue::getFrame(const SyncSource& src, RTPFrame& frame)
+{
+    IncomingRTPPktLink* l;
+    bool missingStart, missingEnd;
+    size_t count = takeFrame(src,l,missingStart,missingEnd);
+    if ( !count )
+        return false;
+
+    frame.clear();
+    frame.timestamp = l->getTimestamp();
+    frame.source = l->getSourceLink()->getSource();
+    frame.complete = !missingStart && !missingEnd;
+    for ( size_t i = 0; i < count; i++ ) {
+        IncomingRTPPktLink* next = l->getSrcNext();
+        IncomingRTPPkt* packet = l->getPacket();
+        if ( i && packet->getSeqNum() !=
+             static_cast<uint16>(frame.getLastSeqNum() + 1) )
+            frame.complete = false;
+        // the frame owns the packet from now on
+        frame.add(packet);
+        delete l;
+        l = next;
+    }
+    return true;
+}
+
+bool
+IncomingDataQueue::getDepacketizedData(const SyncSource& src,
+RTPDepacketizer& depacketizer)
+{
+    IncomingRTPPktLink* l;
+    bool missingStart, missingEnd;
+    size_t count = takeFrame(src,l,missingStart,missingEnd);
+    if ( !count )
+        return false;
+
+    depacketizer.reset(l->getTimestamp());
+    if ( missingStart )
+        depacketizer.lost();
+    uint16 seqNum = l->getPacket()->getSeqNum();
+    for ( size_t i = 0; i < count; i++ ) {
+        IncomingRTPPktLink* next = l->getSrcNext();
+        IncomingRTPPkt* packet = l->getPacket();
+        if ( i && packet->getSeqNum() != static_cast<uint16>(seqNum + 1) )
+            depacketizer.lost();
+        seqNum = packet->getSeqNum();
+        depacketizer.add(packet->getPayload(),packet->getPayloadSize());
+        delete packet;
+        delete l;
+        l = next;
+    }
+    if ( missingEnd )
+        depacketizer.lost();
+    depacketizer.finish();
+    return true;
+}
+
+void
+IncomingDataQueue::unlinkRecvPacket(IncomingRTPPktLink* l)
+{
+    // unlink from the global queue
+    if ( l->getPrev() )
+        l->getPrev()->setNext(l->getNext());
+    else
+        recvFirst = l->getNext();
+    if ( l->getNext() )
+        l->getNext()->setPrev(l->getPrev());
+    else
+        recvLast = l->getPrev();
+    // unlink from the queue of its source
+    SyncSourceLink* srcLink = l->getSourceLink();
+    if ( l->getSrcPrev() )
+        l->getSrcPrev()->setSrcNext(l->getSrcNext());
+    else
+        srcLink->setFirst(l->getSrcNext());
+    if ( l->getSrcNext() )
+        l->getSrcNext()->setSrcPrev(l->getSrcPrev());
+    else
+        srcLink->setLast(l->getSrcPrev());
+}
+
 // FIX: try to merge and organize
 IncomingDataQueue::IncomingRTPPktLink*
 IncomingDataQueue::getWaiting(uint32 timestamp, const SyncSource* src)
@@ -630,7 +1095,7 @@ IncomingDataQueue::getWaiting(uint32 timestamp, const SyncSource* src)
 
 bool
 IncomingDataQueue::recordReception(SyncSourceLink& srcLink,
-const IncomingRTPPkt& pkt, const timeval recvtime)
+const IncomingRTPPkt& pkt, const timeval recvtime, bool recovered)
 {
     bool result = true;
 
@@ -663,6 +1128,8 @@ const IncomingRTPPkt& pkt, const timeval recvtime)
                 // sequene number wrapped.
                 srcLink.incSeqNumAccum();
             }
+            if ( step > 1 )
+                onPacketsLost(*src,srcLink.getMaxSeqNum() + 1,step - 1);
             srcLink.setMaxSeqNum(pkt.getSeqNum());
         } else if ( step <= (SEQNUMMOD - getMaxPacketMisorder()) ) {
             // too high step of the sequence number.
@@ -682,6 +1149,7 @@ const IncomingRTPPkt& pkt, const timeval recvtime)
             }
         } else {
             // duplicate or reordered packet
+            onLatePacket(*src,pkt.getSeqNum());
         }
     }
 
@@ -700,6 +1168,11 @@ const IncomingRTPPkt& pkt, const timeval recvtime)
         // needed to time out old senders that are no sending
         // any longer.
 
+        // recovered packets arrived with the FEC packet, their
+        // arrival time tells nothing of the network.
+        if ( recovered )
+            return result;
+
         // compute the interarrival jitter estimation.
         timeval tarrival;
         timeval lastT = srcLink.getLastPacketTime();
@@ -717,6 +1190,18 @@ const IncomingRTPPkt& pkt, const timeval recvtime)
                    (1.0f / 16.0f) *
                   (static_cast<float>(delta) -
                    srcLink.getJitter()));
+
+        // the same arrival times and timestamps feed the
+        // bandwidth estimation.
+        if ( remoteBitrateEstimation ) {
+            if ( !srcLink.rateEstimator )
+                srcLink.rateEstimator = new RemoteRateEstimator();
+            if ( srcLink.rateEstimator->
+                 onPacket(pkt.getTimestamp(),getCurrentRTPClockRate(),
+                      pkt.getRawPacketSize(),recvtime) )
+                onRemoteBitrateDecrease(*src,
+                            srcLink.rateEstimator->getEstimate());
+        }
     }
     return result;
 }
@@ -49,10 +49,12 @@
 
 #include "private.h"
 #include <ccrtp/cqueue.h>
+#include <ccrtp/congestion.h>
 
 NAMESPACE_COMMONCPP
 
 const uint32 MembershipBookkeeping::SyncSourceLink::SEQNUMMOD = (1<<16);
+const uint16 MembershipBookkeeping::SyncSourceLink::deliveryWindow = 64;
 
 MembershipBookkeeping::SyncSourceLink::~SyncSourceLink()
 {
@@ -63,6 +65,12 @@ MembershipBookkeeping::SyncSourceLink::~SyncSourceLink()
         delete prevConflict;
         delete receiverInfo;
         delete senderInfo;
+        delete rateEstimator;
+        if ( held ) {
+            for ( uint16 i = 0; i < deliveryWindow; i++ )
+                delete held[i];
+            delete [] held;
+        }
 #ifdef  CCXX_EXCEPTIONS
     } catch (...) { }
 #endif
@@ -85,6 +93,10 @@ MembershipBookkeeping::SyncSourceLink::initStats()
     jitter = 0;
     initialDataTimestamp = 0;
     initialDataTime.tv_sec = initialDataTime.tv_usec = 0;
+    nextFrameSeqNum = 0;
+    frameTaken = false;
+    seqWindowTop = 0;
+    seqWindow = 0;
     flag = false;
 
     badSeqNum = SEQNUMMOD + 1;
@@ -140,6 +152,31 @@ MembershipBookkeeping::SyncSourceLink::
 recordInsertion(const IncomingRTPPktLink&)
 {}
 
+bool
+MembershipBookkeeping::SyncSourceLink::
+recordSeqNum(uint16 seqNum, bool old)
+{
+    // an empty window starts at the first packet
+    if ( 0 == seqWindow ) {
+        seqWindowTop = seqNum;
+        seqWindow = 1;
+        return true;
+    }
+    int16 delta = static_cast<int16>(seqNum - seqWindowTop);
+    if ( delta > 0 ) {
+        seqWindow = ( delta < 32 ) ? (seqWindow << delta) | 1 : 1;
+        seqWindowTop = seqNum;
+        return true;
+    }
+    if ( -delta >= 32 )
+        return old;
+    uint32 bit = static_cast<uint32>(1) << -delta;
+    if ( seqWindow & bit )
+        return false;
+    seqWindow |= bit;
+    return true;
+}
+
 void
 MembershipBookkeeping::SyncSourceLink::
 setSenderInfo(unsigned char* si)
@@ -201,16 +238,43 @@ MembershipBookkeeping::endMembers()
 #endif
 }
 
+size_t
+MembershipBookkeeping::getMembersMemoryUsage() const
+{
+    size_t size = sourceBucketsNum * sizeof(SyncSourceLink*);
+    for ( SyncSourceLink* l = first; l; l = l->getNext() ) {
+        size += sizeof(SyncSourceLink) + sizeof(SyncSource);
+        if ( l->senderInfo )
+            size += sizeof(RTCPCompoundHandler::SenderInfo);
+        if ( l->receiverInfo )
+            size += sizeof(RTCPCompoundHandler::ReceiverInfo);
+        if ( l->rateEstimator )
+            size += sizeof(RemoteRateEstimator);
+        if ( !l->held )
+            continue;
+        size += SyncSourceLink::deliveryWindow * sizeof(IncomingRTPPkt*);
+        for ( uint16 i = 0; i < SyncSourceLink::deliveryWindow; i++ )
+            if ( l->held[i] )
+                size += sizeof(IncomingRTPPkt) +
+                    l->held[i]->getRawPacketSize();
+    }
+    return size;
+}
+
 bool
 MembershipBookkeeping::isRegistered(uint32 ssrc)
 {
-    bool result = false;
+    return NULL != findSourceBySSRC(ssrc);
+}
+
+MembershipBookkeeping::SyncSourceLink*
+MembershipBookkeeping::findSourceBySSRC(uint32 ssrc) const
+{
     SyncSourceLink* sl = sourceLinks[ HASH(ssrc) ];
 
     while ( sl != NULL ) {
         if ( ssrc == sl->getSource()->getID() ) {
-            result = true;
-            break;
+            return sl;
         } else if ( ssrc < sl->getSource()->getID() ) {
             break;
         } else {
@@ -218,7 +282,7 @@ MembershipBookkeeping::isRegistered(uint32 ssrc)
             sl = sl->getNextCollis();
         }
     }
-    return result;
+    return NULL;
 }
 
 // Gets or creates the source and its link structure.
@@ -0,0 +1,347 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+
+#include "private.h"
+#include <ccrtp/mixer.h>
+#include <ccrtp/audio.h>
+#include <algorithm>
+#include <functional>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+NAMESPACE_COMMONCPP
+
+// sum[i] += samples[i]
+static void
+accumulate(int32* sum, const int16* samples, size_t count)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for ( ; i + 16 <= count; i += 16 ) {
+        __m256i x = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(samples + i));
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x,1));
+        __m256i* s = reinterpret_cast<__m256i*>(sum + i);
+        _mm256_storeu_si256(s,_mm256_add_epi32(_mm256_loadu_si256(s),lo));
+        _mm256_storeu_si256(s + 1,
+                    _mm256_add_epi32(_mm256_loadu_si256(s + 1),hi));
+    }
+#elif defined(__SSE2__)
+    for ( ; i + 8 <= count; i += 8 ) {
+        __m128i x = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(samples + i));
+        // sign extension to 32 bits
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x,x),16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x,x),16);
+        __m128i* s = reinterpret_cast<__m128i*>(sum + i);
+        _mm_storeu_si128(s,_mm_add_epi32(_mm_loadu_si128(s),lo));
+        _mm_storeu_si128(s + 1,_mm_add_epi32(_mm_loadu_si128(s + 1),hi));
+    }
+#endif
+    for ( ; i < count; i++ )
+        sum[i] += samples[i];
+}
+
+static inline int16
+saturate16(int32 s)
+{
+    if ( s > 32767 )
+        return 32767;
+    else if ( s < -32768 )
+        return -32768;
+    return static_cast<int16>(s);
+}
+
+// samples[i] = saturate(sum[i] - minus[i]), minus[i] = 0 from
+// minusCount on.
+static void
+saturateSum(int16* samples, const int32* sum, size_t count,
+const int16* minus, size_t minusCount)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for ( ; i + 16 <= minusCount; i += 16 ) {
+        __m256i m = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(minus + i));
+        __m256i a = _mm256_sub_epi32(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(sum + i)),
+            _mm256_cvtepi16_epi32(_mm256_castsi256_si128(m)));
+        __m256i b = _mm256_sub_epi32(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(sum + i + 8)),
+            _mm256_cvtepi16_epi32(_mm256_extracti128_si256(m,1)));
+        // packs works within 128 bits lanes
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i),
+                    _mm256_permute4x64_epi64(
+                        _mm256_packs_epi32(a,b),0xd8));
+    }
+    for ( ; i < minusCount; i++ )
+        samples[i] = saturate16(sum[i] - minus[i]);
+    for ( ; i + 16 <= count; i += 16 ) {
+        __m256i a = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(sum + i));
+        __m256i b = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(sum + i + 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i),
+                    _mm256_permute4x64_epi64(
+                        _mm256_packs_epi32(a,b),0xd8));
+    }
+#elif defined(__SSE2__)
+    for ( ; i + 8 <= minusCount; i += 8 ) {
+        __m128i m = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(minus + i));
+        __m128i a = _mm_sub_epi32(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(sum + i)),
+            _mm_srai_epi32(_mm_unpacklo_epi16(m,m),16));
+        __m128i b = _mm_sub_epi32(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(sum + i + 4)),
+            _mm_srai_epi32(_mm_unpackhi_epi16(m,m),16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i),
+                 _mm_packs_epi32(a,b));
+    }
+    for ( ; i < minusCount; i++ )
+        samples[i] = saturate16(sum[i] - minus[i]);
+    for ( ; i + 8 <= count; i += 8 ) {
+        __m128i a = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(sum + i));
+        __m128i b = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(sum + i + 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i),
+                 _mm_packs_epi32(a,b));
+    }
+#endif
+    for ( ; i < minusCount; i++ )
+        samples[i] = saturate16(sum[i] - minus[i]);
+    for ( ; i < count; i++ )
+        samples[i] = saturate16(sum[i]);
+}
+
+AudioMixer::AudioMixer(PayloadType pt) :
+payloadType(sptPCMU), sources(), active(0), sum(), samplesCount(0),
+linear(), encoded(), ranking()
+{
+    setPayloadType(pt);
+}
+
+bool
+AudioMixer::setPayloadType(PayloadType pt)
+{
+    if ( sptPCMU != pt && sptPCMA != pt )
+        return false;
+    payloadType = pt;
+    return true;
+}
+
+void
+AudioMixer::clear()
+{
+    active = 0;
+    samplesCount = 0;
+}
+
+void
+AudioMixer::add(uint32 ssrc, const unsigned char* data, size_t len)
+{
+    if ( active == sources.size() )
+        sources.push_back(Source());
+    Source& source = sources[active++];
+    source.ssrc = ssrc;
+    if ( source.samples.size() < len )
+        source.samples.resize(len);
+    source.count = len;
+
+    // decode, and measure the level to choose the contributors
+    int16* samples = len ? &source.samples[0] : NULL;
+    if ( sptPCMU == payloadType )
+        ulawToLinear(samples,data,len);
+    else
+        alawToLinear(samples,data,len);
+    uint64 energy = 0;
+    for ( size_t i = 0; i < len; i++ )
+        energy += ( samples[i] < 0 ) ? -samples[i] : samples[i];
+    source.energy = energy;
+
+    if ( len > samplesCount ) {
+        if ( sum.size() < len )
+            sum.resize(len);
+        std::fill(sum.begin() + samplesCount,sum.begin() + len,0);
+        samplesCount = len;
+    }
+    accumulate(len ? &sum[0] : NULL,samples,len);
+}
+
+size_t
+AudioMixer::mix(IncomingDataQueue& queue, uint32 stamp)
+{
+    clear();
+    for ( IncomingDataQueue::SyncSourcesIterator i = queue.begin();
+          i != queue.end(); i++ ) {
+        const AppDataUnit* unit = queue.getData(stamp,&(*i));
+        if ( !unit )
+            continue;
+        if ( unit->getType() == payloadType )
+            add(i->getID(),unit->getData(),unit->getSize());
+        delete unit;
+    }
+    return active;
+}
+
+const AudioMixer::Source*
+AudioMixer::find(uint32 ssrc) const
+{
+    for ( size_t i = 0; i < active; i++ ) {
+        if ( sources[i].ssrc == ssrc )
+            return &sources[i];
+    }
+    return NULL;
+}
+
+void
+AudioMixer::saturate(int16* samples, const Source* exclude) const
+{
+    if ( !samplesCount )
+        return;
+    if ( exclude && exclude->count )
+        saturateSum(samples,&sum[0],samplesCount,&exclude->samples[0],
+                exclude->count);
+    else
+        saturateSum(samples,&sum[0],samplesCount,NULL,0);
+}
+
+void
+AudioMixer::getLinear(int16* samples) const
+{
+    saturate(samples,NULL);
+}
+
+void
+AudioMixer::getLinear(int16* samples, uint32 exclude) const
+{
+    saturate(samples,find(exclude));
+}
+
+size_t
+AudioMixer::encodeMix(unsigned char* data, const Source* exclude)
+{
+    if ( linear.size() < samplesCount )
+        linear.resize(samplesCount);
+    if ( !samplesCount )
+        return 0;
+    saturate(&linear[0],exclude);
+    if ( sptPCMU == payloadType )
+        linearToUlaw(data,&linear[0],samplesCount);
+    else
+        linearToAlaw(data,&linear[0],samplesCount);
+    return samplesCount;
+}
+
+size_t
+AudioMixer::encode(unsigned char* data)
+{
+    return encodeMix(data,NULL);
+}
+
+size_t
+AudioMixer::encode(unsigned char* data, uint32 exclude)
+{
+    return encodeMix(data,find(exclude));
+}
+
+uint8
+AudioMixer::rankContributors(uint32* csrcs, const Source* exclude)
+{
+    ranking.clear();
+    for ( size_t i = 0; i < active; i++ ) {
+        if ( &sources[i] != exclude )
+            ranking.push_back(std::make_pair(sources[i].energy,
+                             sources[i].ssrc));
+    }
+    size_t count = ranking.size();
+    if ( count > OutgoingDataQueue::maxContributors )
+        count = OutgoingDataQueue::maxContributors;
+    std::partial_sort(ranking.begin(),ranking.begin() + count,
+              ranking.end(),
+              std::greater<std::pair<uint64,uint32> >());
+    for ( size_t i = 0; i < count; i++ )
+        csrcs[i] = ranking[i].second;
+    return static_cast<uint8>(count);
+}
+
+uint8
+AudioMixer::getContributors(uint32* csrcs)
+{
+    return rankContributors(csrcs,NULL);
+}
+
+void
+AudioMixer::sendMix(OutgoingDataQueue& queue, uint32 stamp,
+const Source* exclude)
+{
+    if ( !samplesCount )
+        return;
+    if ( encoded.size() < samplesCount )
+        encoded.resize(samplesCount);
+    size_t len = encodeMix(&encoded[0],exclude);
+    uint32 csrcs[OutgoingDataQueue::maxContributors];
+    queue.setContributors(csrcs,rankContributors(csrcs,exclude));
+    queue.putData(stamp,&encoded[0],len);
+}
+
+void
+AudioMixer::send(OutgoingDataQueue& queue, uint32 stamp)
+{
+    sendMix(queue,stamp,NULL);
+}
+
+void
+AudioMixer::send(OutgoingDataQueue& queue, uint32 stamp, uint32 exclude)
+{
+    sendMix(queue,stamp,find(exclude));
+}
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
@@ -37,6 +37,9 @@
 
 #include "private.h"
 #include <ccrtp/oqueue.h>
+#include <ccrtp/fec.h>
+#include <ccrtp/packetizer.h>
+#include <ccrtp/red.h>
 
 NAMESPACE_COMMONCPP
 
@@ -48,9 +51,89 @@ OutgoingDataQueueBase::OutgoingDataQueueBase()
     setMaxSendSegmentSize(getDefaultMaxSendSegmentSize());
 }
 
+// Make sure that the contents of a snapshot are visible to other
+// threads before the snapshot itself is published. Elsewhere, rely
+// on volatile stores not being reordered (as on x86 with MSVC).
+#if defined(__GNUC__)
+#define SNAPSHOT_BARRIER() __sync_synchronize()
+#else
+#define SNAPSHOT_BARRIER()
+#endif
+
+SnapshotEpoch::SnapshotEpoch() :
+epoch(0), epochLock()
+{
+    readers[0] = readers[1] = 0;
+}
+
+uint32
+SnapshotEpoch::enterRead() const
+{
+#if defined(__GNUC__)
+    for(;;) {
+        uint32 e = epoch & 1;
+        __sync_fetch_and_add(&readers[e],1);
+        // if a writer flipped the epoch in the meantime, it may
+        // not wait for us: count in the new epoch instead.
+        if ( (epoch & 1) == e )
+            return e;
+        __sync_fetch_and_sub(&readers[e],1);
+    }
+#else
+    epochLock.enter();
+    uint32 e = epoch & 1;
+    readers[e]++;
+    epochLock.leave();
+    return e;
+#endif
+}
+
+void
+SnapshotEpoch::leaveRead(uint32 e) const
+{
+#if defined(__GNUC__)
+    __sync_fetch_and_sub(&readers[e],1);
+#else
+    epochLock.enter();
+    readers[e]--;
+    epochLock.leave();
+#endif
+}
+
+void
+SnapshotEpoch::synchronize()
+{
+    uint32 old;
+#if defined(__GNUC__)
+    __sync_synchronize();
+    old = epoch & 1;
+    epoch = epoch + 1;
+    __sync_synchronize();
+    while ( readers[old] )
+        Thread::yield();
+#else
+    epochLock.enter();
+    old = epoch & 1;
+    epoch = epoch + 1;
+    epochLock.leave();
+    for(;;) {
+        epochLock.enter();
+        bool idle = (0 == readers[old]);
+        epochLock.leave();
+        if ( idle )
+            break;
+        Thread::yield();
+    }
+#endif
+}
+
 DestinationListHandler::DestinationListHandler() :
-destList(), destinationLock()
-{}
+destList(), destinationLock(), destSnapshot(NULL), destinationEpoch()
+{
+    destSnapshot = new DestinationSnapshot;
+    destSnapshot->count = 0;
+    destSnapshot->destinations = NULL;
+}
 
 DestinationListHandler::~DestinationListHandler()
 {
@@ -67,9 +150,32 @@ DestinationListHandler::~DestinationListHandler()
         } catch (...) {}
 #endif
     }
+    delete [] destSnapshot->destinations;
+    delete destSnapshot;
     unlockDestinationList();
 }
 
+void
+DestinationListHandler::publishDestinations(TransportAddress* removed)
+{
+    DestinationSnapshot* snapshot = new DestinationSnapshot;
+    snapshot->count = destList.size();
+    snapshot->destinations = new TransportAddress*[snapshot->count];
+    size_t n = 0;
+    for (std::list<TransportAddress*>::iterator i = destList.begin();
+         destList.end() != i; i++)
+        snapshot->destinations[n++] = *i;
+
+    DestinationSnapshot* old = destSnapshot;
+    SNAPSHOT_BARRIER();
+    destSnapshot = snapshot;
+    // wait for dispatchers still using the old snapshot
+    destinationEpoch.synchronize();
+    delete [] old->destinations;
+    delete old;
+    delete removed;
+}
+
 bool
 DestinationListHandler::addDestinationToList(const InetAddress& ia,
 tpport_t data, tpport_t control)
@@ -77,6 +183,7 @@ tpport_t data, tpport_t control)
     TransportAddress* addr = new TransportAddress(ia,data,control);
     writeLockDestinationList();
     destList.push_back(addr);
+    publishDestinations();
     unlockDestinationList();
     return true;
 }
@@ -89,7 +196,7 @@ tpport_t dataPort, tpport_t controlPort)
     writeLockDestinationList();
     TransportAddress* tmp;
     for (std::list<TransportAddress*>::iterator i = destList.begin();
-         destList.end() != i && !result; ) {
+         destList.end() != i; i++) {
         tmp = *i;
         if ( ia == tmp->getNetworkAddress() &&
              dataPort == tmp->getDataTransportPort() &&
@@ -97,9 +204,8 @@ tpport_t dataPort, tpport_t controlPort)
             // matches. -> remove it.
             result = true;
             destList.erase(i);
-            delete tmp;
-        } else{
-            i++;
+            publishDestinations(tmp);
+            break;
         }
     }
     unlockDestinationList();
@@ -109,8 +215,12 @@ tpport_t dataPort, tpport_t controlPort)
 #ifdef  CCXX_IPV6
 
 DestinationListHandlerIPV6::DestinationListHandlerIPV6() :
-destListIPV6(), destinationLock()
-{}
+destListIPV6(), destinationLock(), destSnapshot(NULL), destinationEpoch()
+{
+    destSnapshot = new DestinationSnapshotIPV6;
+    destSnapshot->count = 0;
+    destSnapshot->destinations = NULL;
+}
 
 DestinationListHandlerIPV6::~DestinationListHandlerIPV6()
 {
@@ -127,9 +237,32 @@ DestinationListHandlerIPV6::~DestinationListHandlerIPV6()
         } catch (...) {}
 #endif
     }
+    delete [] destSnapshot->destinations;
+    delete destSnapshot;
     unlockDestinationListIPV6();
 }
 
+void
+DestinationListHandlerIPV6::publishDestinationsIPV6(TransportAddressIPV6* removed)
+{
+    DestinationSnapshotIPV6* snapshot = new DestinationSnapshotIPV6;
+    snapshot->count = destListIPV6.size();
+    snapshot->destinations = new TransportAddressIPV6*[snapshot->count];
+    size_t n = 0;
+    for (std::list<TransportAddressIPV6*>::iterator i = destListIPV6.begin();
+         destListIPV6.end() != i; i++)
+        snapshot->destinations[n++] = *i;
+
+    DestinationSnapshotIPV6* old = destSnapshot;
+    SNAPSHOT_BARRIER();
+    destSnapshot = snapshot;
+    // wait for dispatchers still using the old snapshot
+    destinationEpoch.synchronize();
+    delete [] old->destinations;
+    delete old;
+    delete removed;
+}
+
 bool
 DestinationListHandlerIPV6::addDestinationToListIPV6(const IPV6Address& ia,
 tpport_t data, tpport_t control)
@@ -137,6 +270,7 @@ tpport_t data, tpport_t control)
     TransportAddressIPV6* addr = new TransportAddressIPV6(ia,data,control);
     writeLockDestinationListIPV6();
     destListIPV6.push_back(addr);
+    publishDestinationsIPV6();
     unlockDestinationListIPV6();
     return true;
 }
@@ -149,7 +283,7 @@ tpport_t dataPort, tpport_t controlPort)
     writeLockDestinationListIPV6();
     TransportAddressIPV6* tmp;
     for (std::list<TransportAddressIPV6*>::iterator i = destListIPV6.begin();
-    destListIPV6.end() != i && !result; ) {
+    destListIPV6.end() != i; i++) {
         tmp = *i;
         if ( ia == tmp->getNetworkAddress() &&
              dataPort == tmp->getDataTransportPort() &&
@@ -157,9 +291,8 @@ tpport_t dataPort, tpport_t controlPort)
             // matches. -> remove it.
             result = true;
             destListIPV6.erase(i);
-            delete tmp;
-        } else {
-            i++;
+            publishDestinationsIPV6(tmp);
+            break;
         }
     }
     unlockDestinationListIPV6();
@@ -169,18 +302,111 @@ tpport_t dataPort, tpport_t controlPort)
 
 #endif
 
+const unsigned RTPLateness::bucketsCount;
+
+RTPLateness::RTPLateness()
+{
+    clear();
+}
+
+void
+RTPLateness::clear()
+{
+    for ( unsigned i = 0; i < bucketsCount; i++ )
+        late[i] = early[i] = 0;
+}
+
+void
+RTPLateness::add(bool isLate, microtimeout_t delay)
+{
+    unsigned bucket = 0;
+    while ( delay && bucket < bucketsCount - 1 ) {
+        delay >>= 1;
+        bucket++;
+    }
+    // less than 1 usec early is on time
+    if ( isLate || !bucket )
+        late[bucket]++;
+    else
+        early[bucket]++;
+}
+
+uint32
+RTPLateness::getCount() const
+{
+    uint32 count = 0;
+    for ( unsigned i = 0; i < bucketsCount; i++ )
+        count += late[i] + early[i];
+    return count;
+}
+
+uint32
+RTPLateness::getEarlyCount() const
+{
+    uint32 count = 0;
+    for ( unsigned i = 0; i < bucketsCount; i++ )
+        count += early[i];
+    return count;
+}
+
+microtimeout_t
+RTPLateness::getBucketLimit(unsigned bucket)
+{
+    if ( bucket >= bucketsCount - 1 )
+        return ~static_cast<microtimeout_t>(0);
+    return static_cast<microtimeout_t>(1) << bucket;
+}
+
+microtimeout_t
+RTPLateness::getPercentile(float p) const
+{
+    uint32 count = getCount();
+    if ( !count )
+        return 0;
+    // packets sent early go first, as not late
+    uint32 rank = static_cast<uint32>(p * (count - 1)) + 1;
+    uint32 seen = getEarlyCount();
+    for ( unsigned i = 0; i < bucketsCount; i++ ) {
+        seen += late[i];
+        if ( seen >= rank )
+            return getBucketLimit(i);
+    }
+    return getBucketLimit(bucketsCount - 1);
+}
+
 /// Schedule at 8 ms.
 const microtimeout_t OutgoingDataQueue::defaultSchedulingTimeout = 8000;
 /// Packets unsent will expire after 40 ms.
 const microtimeout_t OutgoingDataQueue::defaultExpireTimeout = 40000;
+/// Weighted fair scheduling quantum, in octets, for weight 1.
+const int32 OutgoingDataQueue::defaultSendQuantum = 1500;
+const uint8 OutgoingDataQueue::maxSendClasses;
+const uint8 OutgoingDataQueue::maxContributors;
+/// Do not retransmit a packet more often than every 10 ms.
+const microtimeout_t OutgoingDataQueue::defaultRetransmissionInterval = 10000;
 
 OutgoingDataQueue::OutgoingDataQueue() :
 OutgoingDataQueueBase(),
 #ifdef  CCXX_IPV6
 DestinationListHandlerIPV6(),
 #endif
-DestinationListHandler(), sendLock(), sendFirst(NULL), sendLast(NULL)
+DestinationListHandler(), sendLock(), sendSeqIndex(), sendQueueLength(0),
+currentSendClass(0), sendPolicy(sendStrictPriority), sendRoundRobin(0),
+sendNextClass(maxSendClasses), retransmissionHistory(0),
+retransmissionInterval(defaultRetransmissionInterval), retransmittedCount(0),
+mainHistory(), fecEncoder(NULL), fecStream(NULL), redEncoder(NULL),
+redPayloadType(0), sendListener(NULL), pacingRate(0), sendLateness()
 {
+    timerclear(&pacingNextSend);
+    for ( uint8 c = 0; c < maxSendClasses; c++ ) {
+        SendClass& sc = sendClasses[c];
+        sc.first = sc.last = NULL;
+        sc.priority = 0;
+        sc.weight = 1;
+        sc.deadline = 0;
+        sc.deficit = 0;
+        sc.expiredCount = 0;
+    }
     setInitialTimestamp(random32());
     setSchedulingTimeout(getDefaultSchedulingTimeout());
     setExpireTimeout(getDefaultExpireTimeout());
@@ -188,33 +414,65 @@ DestinationListHandler(), sendLock(), sendFirst(NULL), sendLast(NULL)
     sendInfo.packetCount = 0;
     sendInfo.octetCount = 0;
     sendInfo.sendSeq = random16();    // random initial sequence number
+    sendInfo.queueSeq = sendInfo.sendSeq;
     sendInfo.sendCC = 0;    // initially, 0 CSRC identifiers follow the fixed heade
     sendInfo.paddinglen = 0;          // do not add padding bits.
     sendInfo.marked = false;
     sendInfo.complete = true;
-    // the local source is the first contributing source
-    sendInfo.sendSources[0] = getLocalSSRC();
     // this will be an accumulator for the successive cycles of timestamp
     sendInfo.overflowTime.tv_sec = getInitialTime().tv_sec;
     sendInfo.overflowTime.tv_usec = getInitialTime().tv_usec;
 }
 
+OutgoingDataQueue::~OutgoingDataQueue()
+{
+    purgeOutgoingQueue();
+    for (std::list<LocalStream*>::iterator i = localStreams.begin();
+         localStreams.end() != i; i++)
+        delete *i;
+}
+
 void
 OutgoingDataQueue::purgeOutgoingQueue()
 {
     OutgoingRTPPktLink* sendnext;
-    // flush the sending queue (delete outgoing packets
+    // flush the sending queues (delete outgoing packets
     // unsent so far)
     sendLock.writeLock();
-    while ( sendFirst ) {
-        sendnext = sendFirst->getNext();
-        delete sendFirst;
-        sendFirst = sendnext;
+    for ( uint8 c = 0; c < maxSendClasses; c++ ) {
+        SendClass& sc = sendClasses[c];
+        while ( sc.first ) {
+            sendnext = sc.first->getNext();
+            delete sc.first;
+            sc.first = sendnext;
+        }
+        sc.last = NULL;
+        sc.stampIndex.clear();
+        sc.deficit = 0;
     }
-    sendLast = NULL;
+    sendSeqIndex.clear();
+    sendQueueLength = 0;
+    sendNextClass = maxSendClasses;
     sendLock.unlock();
 }
 
+size_t
+OutgoingDataQueue::getSendMemoryUsage() const
+{
+    size_t size = 0;
+    sendLock.readLock();
+    for ( uint8 c = 0; c < maxSendClasses; c++ )
+        for ( OutgoingRTPPktLink* l = sendClasses[c].first; l;
+              l = l->getNext() )
+            size += sizeof(OutgoingRTPPktLink) + sizeof(OutgoingRTPPkt) +
+                l->getPacket()->getRawPacketSize();
+    sendLock.unlock();
+    cryptoMutex.enter();
+    size += cryptoContexts.size() * sizeof(CryptoContext);
+    cryptoMutex.leave();
+    return size;
+}
+
 bool
 OutgoingDataQueue::addDestination(const InetHostAddress& ia,
 tpport_t dataPort, tpport_t controlPort)
@@ -290,111 +548,321 @@ tpport_t dataPort, tpport_t controlPort)
 
 #endif
 
+void
+OutgoingDataQueue::addContributor(uint32 csrc)
+{
+    sendLock.writeLock();
+    bool found = false;
+    for ( uint16 i = 0; i < sendInfo.sendCC; i++ ) {
+        if ( sendInfo.sendSources[i] == csrc ) {
+            found = true;
+            break;
+        }
+    }
+    if ( !found && sendInfo.sendCC < maxContributors )
+        sendInfo.sendSources[sendInfo.sendCC++] = csrc;
+    sendLock.unlock();
+}
+
 bool
-OutgoingDataQueue::isSending(void) const
+OutgoingDataQueue::removeContributor(uint32 csrc)
 {
-    if(sendFirst)
-        return true;
+    bool found = false;
+    sendLock.writeLock();
+    for ( uint16 i = 0; i < sendInfo.sendCC; i++ ) {
+        if ( sendInfo.sendSources[i] == csrc ) {
+            found = true;
+            sendInfo.sendCC--;
+            for ( uint16 j = i; j < sendInfo.sendCC; j++ )
+                sendInfo.sendSources[j] = sendInfo.sendSources[j + 1];
+            break;
+        }
+    }
+    sendLock.unlock();
+    return found;
+}
+
+void
+OutgoingDataQueue::setContributors(const uint32* csrcs, uint8 count)
+{
+    if ( count > maxContributors )
+        count = maxContributors;
+    sendLock.writeLock();
+    for ( uint8 i = 0; i < count; i++ )
+        sendInfo.sendSources[i] = csrcs[i];
+    sendInfo.sendCC = count;
+    sendLock.unlock();
+}
+
+uint8
+OutgoingDataQueue::getContributors(uint32* csrcs) const
+{
+    sendLock.readLock();
+    uint8 count = static_cast<uint8>(sendInfo.sendCC);
+    for ( uint8 i = 0; i < count; i++ )
+        csrcs[i] = sendInfo.sendSources[i];
+    sendLock.unlock();
+    return count;
+}
 
+bool
+OutgoingDataQueue::isSending(void) const
+{
+    for ( uint8 c = 0; c < maxSendClasses; c++ ) {
+        if ( sendClasses[c].first )
+            return true;
+    }
     return false;
 }
 
+bool
+OutgoingDataQueue::setSendClass(uint8 sendClass)
+{
+    if ( sendClass >= maxSendClasses )
+        return false;
+    currentSendClass = sendClass;
+    return true;
+}
+
+bool
+OutgoingDataQueue::setSendClassPriority(uint8 sendClass, uint8 priority)
+{
+    if ( sendClass >= maxSendClasses )
+        return false;
+    sendLock.writeLock();
+    sendClasses[sendClass].priority = priority;
+    sendLock.unlock();
+    return true;
+}
+
+bool
+OutgoingDataQueue::setSendClassWeight(uint8 sendClass, uint16 weight)
+{
+    if ( sendClass >= maxSendClasses || 0 == weight )
+        return false;
+    sendLock.writeLock();
+    sendClasses[sendClass].weight = weight;
+    sendLock.unlock();
+    return true;
+}
+
+bool
+OutgoingDataQueue::setSendClassDeadline(uint8 sendClass, microtimeout_t deadline)
+{
+    if ( sendClass >= maxSendClasses )
+        return false;
+    sendLock.writeLock();
+    sendClasses[sendClass].deadline = deadline;
+    sendLock.unlock();
+    return true;
+}
+
+uint32
+OutgoingDataQueue::getSendClassExpiredCount(uint8 sendClass) const
+{
+    if ( sendClass >= maxSendClasses )
+        return 0;
+    return sendClasses[sendClass].expiredCount;
+}
+
+void
+OutgoingDataQueue::getSendLateness(RTPLateness& lateness) const
+{
+    sendLock.readLock();
+    lateness = sendLateness;
+    sendLock.unlock();
+}
+
+void
+OutgoingDataQueue::resetSendLateness()
+{
+    sendLock.writeLock();
+    sendLateness.clear();
+    sendLock.unlock();
+}
+
 microtimeout_t
-OutgoingDataQueue::getSchedulingTimeout(void)
+OutgoingDataQueue::getSendDelay(OutgoingRTPPktLink& link, const timeval& now,
+bool& late)
 {
-    struct timeval send, now;
+    struct timeval send;
     uint32 rate;
     uint32 rem;
 
-    for(;;) {
-        // if there is no packet to send, use the default scheduling
-        // timeout
-        if( !sendFirst )
-            return schedulingTimeout;
-
-        uint32 stamp = sendFirst->getPacket()->getTimestamp();
-        stamp -= getInitialTimestamp();
-        rate = getCurrentRTPClockRate();
-
-        // now we want to get in <code>send</code> _when_ the
-        // packet is scheduled to be sent.
-
-        // translate timestamp to timeval
-        send.tv_sec = stamp / rate;
-        rem = stamp % rate;
-        send.tv_usec = (1000ul*rem) / (rate/1000ul); // 10^6 * rem/rate
-
-        // add timevals. Overflow holds the inital time
-        // plus the time accumulated through successive
-        // overflows of timestamp. See below.
-        timeradd(&send,&(sendInfo.overflowTime),&send);
-        SysTime::gettimeofday(&now, NULL);
+    uint32 stamp = link.getStamp();
+    rate = link.getStream() ? link.getStream()->clockRate :
+        getCurrentRTPClockRate();
+
+    // now we want to get in <code>send</code> _when_ the
+    // packet is scheduled to be sent.
+
+    // translate timestamp to timeval
+    send.tv_sec = stamp / rate;
+    rem = stamp % rate;
+    send.tv_usec = (1000ul*rem) / (rate/1000ul); // 10^6 * rem/rate
+
+    // add timevals. Overflow holds the inital time
+    // plus the time accumulated through successive
+    // overflows of timestamp. See below.
+    timeradd(&send,&(sendInfo.overflowTime),&send);
+
+    // Problem: when timestamp overflows, time goes back.
+    // We MUST ensure that _send_ is not too lower than
+    // _now_, otherwise, we MUST keep how many time was
+    // lost because of overflow. We assume that _send_
+    // 5000 seconds lower than now suggests timestamp
+    // overflow.  (Remember than the 32 bits of the
+    // timestamp field are 47722 seconds under a sampling
+    // clock of 90000 hz.)  This is not a perfect
+    // solution. Disorderedly timestamped packets coming
+    // after an overflowed one will be wrongly
+    // corrected. Nevertheless, this may only corrupt a
+    // handful of those packets every more than 13 hours
+    // (if timestamp started from 0).
+    if ( now.tv_sec - send.tv_sec > 5000) {
+        timeval overflow;
+        overflow.tv_sec =(~static_cast<uint32>(0)) / rate;
+        overflow.tv_usec = (~static_cast<uint32>(0)) % rate *
+            1000000ul / rate;
+        do {
+            timeradd(&send,&overflow,&send);
+            timeradd(&(sendInfo.overflowTime),&overflow,
+                 &(sendInfo.overflowTime));
+        } while ( now.tv_sec - send.tv_sec > 5000 );
+    }
 
-        // Problem: when timestamp overflows, time goes back.
-        // We MUST ensure that _send_ is not too lower than
-        // _now_, otherwise, we MUST keep how many time was
-        // lost because of overflow. We assume that _send_
-        // 5000 seconds lower than now suggests timestamp
-        // overflow.  (Remember than the 32 bits of the
-        // timestamp field are 47722 seconds under a sampling
-        // clock of 90000 hz.)  This is not a perfect
-        // solution. Disorderedly timestamped packets coming
-        // after an overflowed one will be wrongly
-        // corrected. Nevertheless, this may only corrupt a
-        // handful of those packets every more than 13 hours
-        // (if timestamp started from 0).
-        if ( now.tv_sec - send.tv_sec > 5000) {
-            timeval overflow;
-            overflow.tv_sec =(~static_cast<uint32>(0)) / rate;
-            overflow.tv_usec = (~static_cast<uint32>(0)) % rate *
-                1000000ul / rate;
-            do {
-                timeradd(&send,&overflow,&send);
-                timeradd(&(sendInfo.overflowTime),&overflow,
-                     &(sendInfo.overflowTime));
-            } while ( now.tv_sec - send.tv_sec > 5000 );
-        }
+    // This tries to solve the aforementioned problem
+    // about disordered packets coming after an overflowed
+    // one. Now we apply the reverse idea.
+    if ( send.tv_sec - now.tv_sec > 20000 ) {
+        timeval overflow;
+        overflow.tv_sec = (~static_cast<uint32>(0)) / rate;
+        overflow.tv_usec = (~static_cast<uint32>(0)) % rate *
+            1000000ul / rate;
+        timersub(&send,&overflow,&send);
+    }
 
-        // This tries to solve the aforementioned problem
-        // about disordered packets coming after an overflowed
-        // one. Now we apply the reverse idea.
-        if ( send.tv_sec - now.tv_sec > 20000 ) {
-            timeval overflow;
-            overflow.tv_sec = (~static_cast<uint32>(0)) / rate;
-            overflow.tv_usec = (~static_cast<uint32>(0)) % rate *
-                1000000ul / rate;
-            timersub(&send,&overflow,&send);
+    // A: This sets a maximum timeout of 1 hour.
+    if ( send.tv_sec - now.tv_sec > 3600 ) {
+        late = false;
+        return 3600000000ul;
+    }
+    int32 diff =
+        ((send.tv_sec - now.tv_sec) * 1000000ul) +
+        send.tv_usec - now.tv_usec;
+    // B: wait <code>diff</code> usecs more before sending
+    late = (diff < 0);
+    return late? static_cast<microtimeout_t>(-diff) :
+        static_cast<microtimeout_t>(diff);
+}
+
+uint8
+OutgoingDataQueue::selectSendClass(const bool due[])
+{
+    uint8 c, chosen = maxSendClasses;
+    if ( sendStrictPriority == sendPolicy ) {
+        for ( c = 0; c < maxSendClasses; c++ ) {
+            if ( due[c] && (maxSendClasses == chosen ||
+                    sendClasses[c].priority > sendClasses[chosen].priority) )
+                chosen = c;
         }
+        return chosen;
+    }
 
-        // A: This sets a maximum timeout of 1 hour.
-        if ( send.tv_sec - now.tv_sec > 3600 ) {
-            return 3600000000ul;
+    // deficit round robin: a class is served when its deficit
+    // covers the size of its head packet. The deficit is charged
+    // when the packet is dispatched.
+    for(;;) {
+        c = sendRoundRobin;
+        if ( due[c] ) {
+            SendClass& sc = sendClasses[c];
+            if ( sc.deficit >=
+                 static_cast<int32>(sc.first->getPacket()->getRawPacketSize()) )
+                return c;
+            sc.deficit += sc.weight * defaultSendQuantum;
         }
-        int32 diff =
-            ((send.tv_sec - now.tv_sec) * 1000000ul) +
-            send.tv_usec - now.tv_usec;
-        // B: wait <code>diff</code> usecs more before sending
-        if ( diff >= 0 ) {
-            return static_cast<microtimeout_t>(diff);
+        sendRoundRobin = (c + 1) % maxSendClasses;
+    }
+    I( false );
+    return chosen;
+}
+
+microtimeout_t
+OutgoingDataQueue::getSchedulingTimeout(void)
+{
+    struct timeval now;
+    bool due[maxSendClasses];
+
+    for(;;) {
+        SysTime::gettimeofday(&now, NULL);
+        microtimeout_t timeout = 0;
+        bool anyDue = false, anyWaiting = false;
+        OutgoingRTPPktLink* expired = NULL;
+
+        sendLock.writeLock();
+        for ( uint8 c = 0; c < maxSendClasses; c++ ) {
+            SendClass& sc = sendClasses[c];
+            due[c] = false;
+            if ( !sc.first )
+                continue;
+            bool late;
+            microtimeout_t delay =
+                getSendDelay(*(sc.first),now,late);
+            if ( !late ) {
+                // B: wait <code>delay</code> usecs more before
+                // sending
+                if ( 0 == delay ) {
+                    due[c] = anyDue = true;
+                } else if ( !anyWaiting || delay < timeout ) {
+                    timeout = delay;
+                    anyWaiting = true;
+                }
+                continue;
+            }
+            microtimeout_t deadline = sc.deadline ?
+                sc.deadline : getExpireTimeout();
+            if ( delay <= deadline ) {
+                // C: the packet must be sent right now
+                due[c] = anyDue = true;
+            } else if ( !expired ||
+                        sc.priority <
+                        sendClasses[expired->getSendClass()].priority ) {
+                // D: the packet has expired. Drop the lowest
+                // priority ones first.
+                expired = sc.first;
+            }
         }
 
-        // C: the packet must be sent right now
-        if ( (diff < 0) &&
-             static_cast<microtimeout_t>(-diff) <= getExpireTimeout() ) {
-            return 0;
+        if ( expired ) {
+            // D: the packet has expired -> delete it.
+            sendClasses[expired->getSendClass()].expiredCount++;
+            unlinkSendPacket(expired);
+            onExpireSend(*(expired->getPacket()));  // new virtual to notify
+            delete expired;
+            sendLock.unlock();
+            onSendDequeued();
+            continue;
         }
 
-        // D: the packet has expired -> delete it.
-        sendLock.writeLock();
-        OutgoingRTPPktLink* packet = sendFirst;
-        sendFirst = sendFirst->getNext();
-        onExpireSend(*(packet->getPacket()));  // new virtual to notify
-        delete packet;
-        if ( sendFirst )
-            sendFirst->setPrev(NULL);
-        else
-            sendLast = NULL;
+        if ( anyDue && pacingRate &&
+             timercmp(&now,&pacingNextSend,<) ) {
+            // paced: wait till the next packet can go
+            timeval wait;
+            timersub(&pacingNextSend,&now,&wait);
+            sendNextClass = maxSendClasses;
+            timeout = timeval2microtimeout(wait);
+        } else if ( anyDue ) {
+            sendNextClass = selectSendClass(due);
+            timeout = 0;
+        } else {
+            sendNextClass = maxSendClasses;
+            // if there is no packet to send, use the default
+            // scheduling timeout
+            if ( !anyWaiting )
+                timeout = schedulingTimeout;
+        }
         sendLock.unlock();
+        return timeout;
     }
     I( false );
     return 0;
@@ -402,70 +870,294 @@ OutgoingDataQueue::getSchedulingTimeout(void)
 
 void
 OutgoingDataQueue::putData(uint32 stamp, const unsigned char *data, size_t datalen)
+{
+    bool mark = getMark();
+    setMark(false);
+    if ( redEncoder && data && datalen ) {
+        // the encoder writes the frame and the previous ones in
+        // a single payload
+        redEncoder->setPrimary(stamp,getCurrentPayloadType());
+        redEncoder->setFrame(data,datalen,getMaxSendSegmentSize());
+        putStreamPackets(NULL,stamp,data,datalen,mark,redEncoder);
+    } else {
+        putStreamPackets(NULL,stamp,data,datalen,mark);
+    }
+}
+
+void
+OutgoingDataQueue::putPacketizedData(uint32 stamp, const unsigned char *data,
+size_t datalen, RTPPacketizer& packetizer)
 {
     if ( !data || !datalen )
         return;
+    packetizer.setFrame(data,datalen,getMaxSendSegmentSize());
+    putStreamPackets(NULL,stamp,data,datalen,true,&packetizer);
+}
 
-    size_t step = 0, offset = 0;
-    while ( offset < datalen ) {
-        // remainder and step take care of segmentation
-        // according to getMaxSendSegmentSize()
-        size_t remainder = datalen - offset;
-        step = ( remainder > getMaxSendSegmentSize() ) ?
-            getMaxSendSegmentSize() : remainder;
-
-                CryptoContext* pcc = getOutQueueCryptoContext(getLocalSSRC());
-                if (pcc == NULL) {
-                    pcc = getOutQueueCryptoContext(0);
-                    if (pcc != NULL) {
-                        pcc = pcc->newCryptoContextForSSRC(getLocalSSRC(), 0, 0L);
-                        if (pcc != NULL) {
-                            pcc->deriveSrtpKeys(0);
-                            setOutQueueCryptoContext(pcc);
-                        }
-                    }
-                }
-                OutgoingRTPPkt* packet;
-        if ( sendInfo.sendCC )
-            packet = new OutgoingRTPPkt(sendInfo.sendSources,15,data + offset,step, sendInfo.paddinglen, pcc);
-        else
-            packet = new OutgoingRTPPkt(data + offset,step,sendInfo.paddinglen, pcc);
+bool
+OutgoingDataQueue::putStreamData(uint32 ssrc, uint32 stamp,
+const unsigned char *data, size_t datalen, bool mark)
+{
+    LocalStream* stream = NULL;
+    sendLock.readLock();
+    for (std::list<LocalStream*>::iterator i = localStreams.begin();
+         localStreams.end() != i; i++) {
+        if ( (*i)->ssrc == ssrc ) {
+            stream = *i;
+            break;
+        }
+    }
+    sendLock.unlock();
+    if ( !stream )
+        return false;
+    putStreamPackets(stream,stamp,data,datalen,mark);
+    return true;
+}
 
-        packet->setPayloadType(getCurrentPayloadType());
-        packet->setSeqNum(sendInfo.sendSeq++);
-        packet->setTimestamp(stamp + getInitialTimestamp());
+CryptoContext*
+OutgoingDataQueue::getSendCryptoContext(uint32 ssrc)
+{
+    CryptoContext* pcc = getOutQueueCryptoContext(ssrc);
+    if (pcc == NULL) {
+        pcc = getOutQueueCryptoContext(0);
+        if (pcc != NULL) {
+            pcc = pcc->newCryptoContextForSSRC(ssrc, 0, 0L);
+            if (pcc != NULL) {
+                pcc->deriveSrtpKeys(0);
+                setOutQueueCryptoContext(pcc);
+            }
+        }
+    }
+    return pcc;
+}
 
-        packet->setSSRCNetwork(getLocalSSRCNetwork());
-        if ( (0 == offset) && getMark() ) {
-            packet->setMarker(true);
-            setMark(false);
+void
+OutgoingDataQueue::putStreamPackets(LocalStream* stream, uint32 stamp,
+const unsigned char *data, size_t datalen, bool mark,
+RTPPacketizer* packetizer)
+{
+    if ( !data || !datalen )
+        return;
+
+    uint32 ssrc = stream ? stream->ssrc : getLocalSSRC();
+    // contributing sources when the data is put
+    uint32 csrcs[maxContributors];
+    uint8 numcsrc = getContributors(csrcs);
+    size_t step = 0, offset = 0;
+    while ( packetizer ? 0 != packetizer->getNextSize() :
+        offset < datalen ) {
+        if ( packetizer ) {
+            step = packetizer->getNextSize();
         } else {
-            packet->setMarker(false);
+            // remainder and step take care of segmentation
+            // according to getMaxSendSegmentSize()
+            size_t remainder = datalen - offset;
+            step = ( remainder > getMaxSendSegmentSize() ) ?
+                getMaxSendSegmentSize() : remainder;
         }
-        if (pcc != NULL) {
-            packet->protect(getLocalSSRC(), pcc);
+        // the packetizer writes the payload once the packet
+        // is allocated
+        const unsigned char* payload = packetizer ? NULL : data + offset;
+
+        CryptoContext* pcc = getSendCryptoContext(ssrc);
+        OutgoingRTPPkt* packet;
+        // header extension elements, their data is written when
+        // the packet is sent.
+        HeaderExtensionWriter extWriter;
+        size_t extLen = 0;
+        if ( !getHeaderExtensions().isEmpty() )
+            extLen = getHeaderExtensions().prepare(extWriter);
+        if ( extLen )
+            packet = new OutgoingRTPPkt(csrcs,numcsrc,
+                            extWriter.getExtension(),extLen,
+                            payload,step,
+                            sendInfo.paddinglen,pcc);
+        else if ( numcsrc )
+            packet = new OutgoingRTPPkt(csrcs,numcsrc,payload,step, sendInfo.paddinglen, pcc);
+        else
+            packet = new OutgoingRTPPkt(payload,step,sendInfo.paddinglen, pcc);
+        bool last = false;
+        if ( packetizer ) {
+            packetizer->writeNext(const_cast<uint8*>(packet->getPayload()));
+            last = ( 0 == packetizer->getNextSize() );
         }
-        // insert the packet into the "tail" of the sending queue
-        sendLock.writeLock();
-        OutgoingRTPPktLink *link =
-            new OutgoingRTPPktLink(packet,sendLast,NULL);
-        if (sendLast)
-            sendLast->setNext(link);
+
+        if ( stream ) {
+            packet->setPayloadType(stream->payloadType);
+            packet->setTimestamp(stamp + stream->initialTimestamp);
+            packet->setSSRCNetwork(stream->ssrcNetwork);
+        } else {
+            if ( packetizer && packetizer == redEncoder )
+                packet->setPayloadType(redPayloadType);
+            else
+                packet->setPayloadType(getCurrentPayloadType());
+            packet->setTimestamp(stamp + getInitialTimestamp());
+            packet->setSSRCNetwork(getLocalSSRCNetwork());
+        }
+        if ( packetizer )
+            packet->setMarker( last && mark );
         else
-            sendFirst = link;
-        sendLast = link;
+            packet->setMarker( (0 == offset) && mark );
+
+        // insert the packet into the sending queue, usually at
+        // the "tail". The sequence number, the header extension
+        // data, FEC and SRTP are left for dispatchDataPacket(), as
+        // packets are not sent in the order they are put.
+        sendLock.writeLock();
+        bool wasIdle = sendListener && !isSending();
+        OutgoingRTPPktLink* link = new OutgoingRTPPktLink(packet,NULL,NULL);
+        link->setSendClass(currentSendClass);
+        link->setStream(stream);
+        link->setStamp(stamp);
+        if ( !stream )
+            link->setSeqNum(sendInfo.queueSeq++);
+        insertSendPacket(link);
+        if ( wasIdle )
+            sendListener->onSendQueued();
         sendLock.unlock();
 
         offset += step;
     }
 }
 
+bool
+OutgoingDataQueue::addLocalStream(uint32 ssrc, const PayloadFormat& pf)
+{
+    if ( ssrc == getLocalSSRC() )
+        return false;
+    sendLock.writeLock();
+    for (std::list<LocalStream*>::iterator i = localStreams.begin();
+         localStreams.end() != i; i++) {
+        if ( (*i)->ssrc == ssrc ) {
+            sendLock.unlock();
+            return false;
+        }
+    }
+    LocalStream* stream = new LocalStream;
+    stream->ssrc = ssrc;
+    stream->ssrcNetwork = htonl(ssrc);
+    stream->sendSeq = random16();
+    stream->initialTimestamp = random32();
+    stream->payloadType = pf.getPayloadType();
+    stream->clockRate = pf.getRTPClockRate();
+    stream->packetCount = stream->octetCount = 0;
+    stream->reportedPacketCount = 0;
+    stream->history.resize(mainHistory.entries ? mainHistory.mask + 1 : 0);
+    localStreams.push_back(stream);
+    sendLock.unlock();
+    return true;
+}
+
+bool
+OutgoingDataQueue::removeLocalStream(uint32 ssrc)
+{
+    LocalStream* stream = NULL;
+    sendLock.writeLock();
+    for (std::list<LocalStream*>::iterator i = localStreams.begin();
+         localStreams.end() != i; i++) {
+        if ( (*i)->ssrc == ssrc ) {
+            stream = *i;
+            localStreams.erase(i);
+            break;
+        }
+    }
+    if ( stream ) {
+        // discard its queued packets
+        for ( uint8 c = 0; c < maxSendClasses; c++ ) {
+            OutgoingRTPPktLink* link = sendClasses[c].first;
+            while ( link ) {
+                OutgoingRTPPktLink* next = link->getNext();
+                if ( link->getStream() == stream ) {
+                    unlinkSendPacket(link);
+                    delete link;
+                }
+                link = next;
+            }
+        }
+        sendNextClass = maxSendClasses;
+        if ( stream == fecStream ) {
+            fecStream = NULL;
+            fecEncoder = NULL;
+        }
+        delete stream;
+    }
+    sendLock.unlock();
+    return (NULL != stream);
+}
+
+bool
+OutgoingDataQueue::setFECEncoder(FECEncoder* encoder, uint32 fecSSRC,
+PayloadType pt)
+{
+    sendLock.readLock();
+    bool previous = (NULL != fecStream);
+    uint32 previousSSRC = previous ? fecStream->ssrc : 0;
+    sendLock.unlock();
+    if ( previous )
+        removeLocalStream(previousSSRC);
+    if ( !encoder )
+        return true;
+
+    if ( !addLocalStream(fecSSRC,
+                 DynamicPayloadFormat(pt,getCurrentRTPClockRate())) )
+        return false;
+    sendLock.writeLock();
+    for (std::list<LocalStream*>::iterator i = localStreams.begin();
+         localStreams.end() != i; i++) {
+        if ( (*i)->ssrc == fecSSRC )
+            fecStream = *i;
+    }
+    encoder->reset();
+    fecEncoder = encoder;
+    sendLock.unlock();
+    return true;
+}
+
+void
+OutgoingDataQueue::setREDEncoder(REDEncoder* encoder, PayloadType pt)
+{
+    sendLock.writeLock();
+    if ( encoder )
+        encoder->reset();
+    redEncoder = encoder;
+    redPayloadType = pt;
+    sendLock.unlock();
+}
+
+void
+OutgoingDataQueue::setSendListener(RTPSendListener* listener)
+{
+    sendLock.writeLock();
+    sendListener = listener;
+    sendLock.unlock();
+}
+
+void
+OutgoingDataQueue::setPacingRate(uint32 bps)
+{
+    sendLock.writeLock();
+    pacingRate = bps;
+    timerclear(&pacingNextSend);
+    sendLock.unlock();
+}
+
+size_t
+OutgoingDataQueue::getLocalStreamsCount() const
+{
+    sendLock.readLock();
+    size_t result = localStreams.size();
+    sendLock.unlock();
+    return result;
+}
+
 void
 OutgoingDataQueue::sendImmediate(uint32 stamp, const unsigned char *data, size_t datalen)
 {
     if ( !data || !datalen )
         return;
 
+    uint32 csrcs[maxContributors];
+    uint8 numcsrc = getContributors(csrcs);
     size_t step = 0, offset = 0;
     while ( offset < datalen ) {
         // remainder and step take care of segmentation
@@ -477,8 +1169,8 @@ OutgoingDataQueue::sendImmediate(uint32 stamp, const unsigned char *data, size_t
         CryptoContext* pcc = getOutQueueCryptoContext(getLocalSSRC());
 
         OutgoingRTPPkt* packet;
-        if ( sendInfo.sendCC )
-            packet = new OutgoingRTPPkt(sendInfo.sendSources,15,data + offset,step,sendInfo.paddinglen, pcc);
+        if ( numcsrc )
+            packet = new OutgoingRTPPkt(csrcs,numcsrc,data + offset,step,sendInfo.paddinglen, pcc);
         else
             packet = new OutgoingRTPPkt(data + offset,step,sendInfo.paddinglen, pcc);
 
@@ -504,27 +1196,29 @@ OutgoingDataQueue::sendImmediate(uint32 stamp, const unsigned char *data, size_t
 
 void OutgoingDataQueue::dispatchImmediate(OutgoingRTPPkt *packet)
 {
-    lockDestinationList();
-    if ( isSingleDestination() ) {
-        TransportAddress* tmp = destList.front();
+    uint32 epoch;
+    const DestinationSnapshot* dests = acquireDestinations(epoch);
+    if ( 1 == dests->count ) {
+        TransportAddress* tmp = dests->destinations[0];
         // if going from multi destinations to single destinations.
         setDataPeer(tmp->getNetworkAddress(), tmp->getDataTransportPort());
 
         sendData(packet->getRawPacket(), packet->getRawPacketSizeSrtp());
     } else {
-        // when no destination has been added, NULL == dest.
-        for (std::list<TransportAddress*>::iterator i = destList.begin(); destList.end() != i; i++) {
-            TransportAddress* dest = *i;
+        // when no destination has been added, count is 0.
+        for (size_t i = 0; i < dests->count; i++) {
+            TransportAddress* dest = dests->destinations[i];
             setDataPeer(dest->getNetworkAddress(), dest->getDataTransportPort());
             sendData(packet->getRawPacket(), packet->getRawPacketSizeSrtp());
         }
     }
-    unlockDestinationList();
+    releaseDestinations(epoch);
 
 #ifdef  CCXX_IPV6
-    lockDestinationListIPV6();
-    if ( isSingleDestinationIPV6() ) {
-        TransportAddressIPV6* tmp6 = destListIPV6.front();
+    uint32 epoch6;
+    const DestinationSnapshotIPV6* dests6 = acquireDestinationsIPV6(epoch6);
+    if ( 1 == dests6->count ) {
+        TransportAddressIPV6* tmp6 = dests6->destinations[0];
         // if going from multi destinations to single destinations.
         setDataPeerIPV6(tmp6->getNetworkAddress(),
             tmp6->getDataTransportPort());
@@ -532,75 +1226,233 @@ void OutgoingDataQueue::dispatchImmediate(OutgoingRTPPkt *packet)
         sendDataIPV6(packet->getRawPacket(),
             packet->getRawPacketSizeSrtp());
     } else {
-        // when no destination has been added, NULL == dest.
-        for (std::list<TransportAddressIPV6*>::iterator i6 = destListIPV6.begin(); destListIPV6.end() != i6; i6++) {
-            TransportAddressIPV6* dest6 = *i6;
+        // when no destination has been added, count is 0.
+        for (size_t i6 = 0; i6 < dests6->count; i6++) {
+            TransportAddressIPV6* dest6 = dests6->destinations[i6];
             setDataPeerIPV6(dest6->getNetworkAddress(),
                 dest6->getDataTransportPort());
             sendDataIPV6(packet->getRawPacket(),
                 packet->getRawPacketSizeSrtp());
         }
     }
-    unlockDestinationListIPV6();
+    releaseDestinationsIPV6(epoch6);
 #endif
 }
 
 size_t
 OutgoingDataQueue::dispatchDataPacket(void)
 {
+    timeval now;
+    SysTime::gettimeofday(&now, NULL);
     sendLock.writeLock();
-    OutgoingRTPPktLink* packetLink = sendFirst;
+    if ( pacingRate && timercmp(&now,&pacingNextSend,<) ) {
+        sendLock.unlock();
+        return 0;
+    }
+    // serve the class chosen by getSchedulingTimeout or, if there
+    // is none, the highest priority class with queued packets.
+    uint8 c = sendNextClass;
+    if ( c >= maxSendClasses || !sendClasses[c].first ) {
+        c = maxSendClasses;
+        for ( uint8 i = 0; i < maxSendClasses; i++ ) {
+            if ( sendClasses[i].first && (maxSendClasses == c ||
+                    sendClasses[i].priority > sendClasses[c].priority) )
+                c = i;
+        }
+    }
+    sendNextClass = maxSendClasses;
+    OutgoingRTPPktLink* packetLink = ( c < maxSendClasses ) ?
+        sendClasses[c].first : NULL;
 
     if ( !packetLink ){
         sendLock.unlock();
         return 0;
     }
 
+    bool late;
+    microtimeout_t delay = getSendDelay(*packetLink,now,late);
+    sendLateness.add(late,delay);
+
     OutgoingRTPPkt* packet = packetLink->getPacket();
+    LocalStream* stream = packetLink->getStream();
+    // sequence numbers are given here so that they follow the
+    // order of the packets on the wire, whatever the order they
+    // were put in and the send classes they were put in.
+    uint32 ssrc;
+    if ( stream ) {
+        packet->setSeqNum(stream->sendSeq++);
+        ssrc = stream->ssrc;
+    } else {
+        packet->setSeqNum(sendInfo.sendSeq++);
+        ssrc = getLocalSSRC();
+    }
+    if ( packet->isExtended() && !getHeaderExtensions().isEmpty() )
+        getHeaderExtensions().write(*packet);
+    // FEC is computed over the packets in clear
+    uint8 fecReady = 0;
+    if ( !stream && fecEncoder )
+        fecReady = fecEncoder->protect(packet->getRawPacket(),
+                           packet->getRawPacketSize());
+    // packets are built with room for the tag of the crypto
+    // context there was when they were put.
+    CryptoContext* pcc = getSendCryptoContext(ssrc);
+    unsigned char* clear = NULL;
+    if ( pcc && packet->getRawPacketSizeSrtp() ==
+         packet->getRawPacketSize() + pcc->getTagLength() +
+         pcc->getMkiLength() ) {
+        // RTX packets are built from the payload in clear
+        if ( retransmissionHistory ) {
+            clear = new unsigned char[packet->getPayloadSize()];
+            memcpy(clear,packet->getPayload(),packet->getPayloadSize());
+        }
+        packet->protect(ssrc,pcc);
+    }
     uint32 rtn = packet->getPayloadSize();
     dispatchImmediate(packet);
+    size_t sent = packet->getRawPacketSizeSrtp();
+    if ( pacingRate ) {
+        // do not save up for bursts while idle
+        if ( timercmp(&pacingNextSend,&now,<) )
+            pacingNextSend = now;
+        microtimeout_t interval = static_cast<microtimeout_t>
+            (static_cast<uint64>(sent) * 8 * 1000000 / pacingRate);
+        timeval tmp = microtimeout2Timeval(interval);
+        timeradd(&pacingNextSend,&tmp,&pacingNextSend);
+    }
+    if ( packet->isExtended() && !getHeaderExtensions().isEmpty() )
+        getHeaderExtensions().sent(*packet,sent,now);
 
     // unlink the sent packet from the queue and destroy it. Also
     // record the sending.
-    sendFirst = sendFirst->getNext();
-    if ( sendFirst ) {
-        sendFirst->setPrev(NULL);
-    } else {
-        sendLast = NULL;
+    sendClasses[c].deficit -= packet->getRawPacketSize();
+    unlinkSendPacket(packetLink);
+    // FEC packets follow the last packet of each block, before
+    // the packets left with its timestamp. They are inserted
+    // backwards, each one before the previous one.
+    for ( uint8 i = fecReady; i > 0 && fecStream; i-- ) {
+        size_t fecLen;
+        const unsigned char* payload =
+            fecEncoder->getFECPayload(i - 1,fecLen);
+        OutgoingRTPPkt* fecPacket = new OutgoingRTPPkt(payload,fecLen,0,
+            getSendCryptoContext(fecStream->ssrc));
+        fecPacket->setPayloadType(fecStream->payloadType);
+        fecPacket->setTimestamp(packetLink->getStamp() +
+                    fecStream->initialTimestamp);
+        fecPacket->setSSRCNetwork(fecStream->ssrcNetwork);
+        OutgoingRTPPktLink* fecLink =
+            new OutgoingRTPPktLink(fecPacket,NULL,NULL);
+        fecLink->setSendClass(c);
+        fecLink->setStream(fecStream);
+        fecLink->setStamp(packetLink->getStamp());
+        insertSendPacket(fecLink,true);
     }
     // for general accounting and RTCP SR statistics
-    sendInfo.packetCount++;
-    sendInfo.octetCount += packet->getPayloadSize();
+    if ( stream ) {
+        stream->packetCount++;
+        stream->octetCount += packet->getPayloadSize();
+    } else {
+        sendInfo.packetCount++;
+        sendInfo.octetCount += packet->getPayloadSize();
+    }
+    if ( retransmissionHistory ) {
+        // keep the packet instead of destroying it
+        (stream ? stream->history : mainHistory).store(packet,now,clear);
+        packetLink->setPacket(NULL);
+    }
     delete packetLink;
 
     sendLock.unlock();
+    onSendDequeued();
     return rtn;
 }
 
-size_t
-OutgoingDataQueue::setPartial(uint32 stamp, unsigned char *data,
-size_t offset, size_t max)
+void
+OutgoingDataQueue::insertSendPacket(OutgoingRTPPktLink* link, bool first)
 {
-    sendLock.writeLock();
-    OutgoingRTPPktLink* packetLink = sendFirst;
-    while ( packetLink )
-    {
-        uint32 pstamp = packetLink->getPacket()->getTimestamp();
-        if ( pstamp > stamp ) {
-            packetLink = NULL;
-            break;
-        } else if ( pstamp == stamp ) {
-            break;
-        }
-
-        packetLink = packetLink->getNext();
+    uint32 stamp = link->getStamp();
+    SendClass& sc = sendClasses[link->getSendClass()];
+    TimestampOrder before;
+
+    if ( !sc.last || before(sc.last->getStamp(),stamp) ||
+         (!first && stamp == sc.last->getStamp()) ) {
+        // in order: append at the tail.
+        link->setPrev(sc.last);
+        link->setNext(NULL);
+        if ( sc.last )
+            sc.last->setNext(link);
+        else
+            sc.first = link;
+        sc.last = link;
+    } else {
+        // out of order: insert before the first packet with a
+        // later timestamp, or the same one if first. There must
+        // be one, as stamp is not later than the timestamp of the
+        // last packet.
+        SendTimestampIndex::iterator i = first ?
+            sc.stampIndex.lower_bound(stamp) :
+            sc.stampIndex.upper_bound(stamp);
+        I( i != sc.stampIndex.end() );
+        OutgoingRTPPktLink* next = i->second;
+        link->setPrev(next->getPrev());
+        link->setNext(next);
+        if ( next->getPrev() )
+            next->getPrev()->setNext(link);
+        else
+            sc.first = link;
+        next->setPrev(link);
     }
-    if ( !packetLink ) {
-        sendLock.unlock();
-        return 0;
+    // does nothing if there was already a packet with this
+    // timestamp, which is then the first one.
+    if ( first )
+        sc.stampIndex[stamp] = link;
+    else
+        sc.stampIndex.insert(std::make_pair(stamp,link));
+    // only packets of the main stream are indexed by sequence
+    // number, as sequence numbers of different streams collide.
+    if ( !link->getStream() )
+        sendSeqIndex[link->getSeqNum()] = link;
+    sendQueueLength++;
+}
+
+void
+OutgoingDataQueue::unlinkSendPacket(OutgoingRTPPktLink* link)
+{
+    uint32 stamp = link->getStamp();
+    SendClass& sc = sendClasses[link->getSendClass()];
+    OutgoingRTPPktLink* next = link->getNext();
+
+    SendTimestampIndex::iterator i = sc.stampIndex.find(stamp);
+    if ( i != sc.stampIndex.end() && i->second == link ) {
+        if ( next && next->getStamp() == stamp )
+            i->second = next;
+        else
+            sc.stampIndex.erase(i);
     }
+    SendSeqNumIndex::iterator j = sendSeqIndex.find(link->getSeqNum());
+    if ( j != sendSeqIndex.end() && j->second == link )
+        sendSeqIndex.erase(j);
+
+    if ( link->getPrev() )
+        link->getPrev()->setNext(next);
+    else
+        sc.first = next;
+    if ( next )
+        next->setPrev(link->getPrev());
+    else
+        sc.last = link->getPrev();
+    link->setPrev(NULL);
+    link->setNext(NULL);
+    sendQueueLength--;
+    // idle classes do not keep their deficit
+    if ( !sc.first )
+        sc.deficit = 0;
+}
 
-    OutgoingRTPPkt* packet = packetLink->getPacket();
+size_t
+OutgoingDataQueue::setPartialData(OutgoingRTPPktLink* link,
+unsigned char *data, size_t offset, size_t max)
+{
+    OutgoingRTPPkt* packet = link->getPacket();
     if ( offset >= packet->getPayloadSize() )
         return 0;
 
@@ -609,10 +1461,239 @@ size_t offset, size_t max)
 
     memcpy((unsigned char*)(packet->getPayload()) + offset,
            data, max);
-    sendLock.unlock();
     return max;
 }
 
+size_t
+OutgoingDataQueue::setPartial(uint32 stamp, unsigned char *data,
+size_t offset, size_t max)
+{
+    size_t result = 0;
+    sendLock.writeLock();
+    for ( uint8 c = 0; c < maxSendClasses && !result; c++ ) {
+        SendTimestampIndex& index = sendClasses[c].stampIndex;
+        SendTimestampIndex::iterator i = index.find(stamp);
+        if ( i == index.end() )
+            continue;
+        // the first packet of the main stream with this timestamp
+        OutgoingRTPPktLink* link = i->second;
+        while ( link && link->getStamp() == stamp && link->getStream() )
+            link = link->getNext();
+        if ( link && link->getStamp() == stamp )
+            result = setPartialData(link,data,offset,max);
+    }
+    sendLock.unlock();
+    return result;
+}
+
+size_t
+OutgoingDataQueue::setPartialBySeqNum(uint16 seqNum, unsigned char *data,
+size_t offset, size_t max)
+{
+    size_t result = 0;
+    sendLock.writeLock();
+    SendSeqNumIndex::iterator i = sendSeqIndex.find(seqNum);
+    if ( i != sendSeqIndex.end() )
+        result = setPartialData(i->second,data,offset,max);
+    sendLock.unlock();
+    return result;
+}
+
+OutgoingDataQueue::RetransmissionHistory::RetransmissionHistory() :
+entries(NULL), mask(0), rtx(false), rtxSSRC(0), rtxPT(0), rtxSeq(0)
+{ }
+
+OutgoingDataQueue::RetransmissionHistory::~RetransmissionHistory()
+{
+    resize(0);
+}
+
+void
+OutgoingDataQueue::RetransmissionHistory::resize(uint32 size)
+{
+    if ( entries ) {
+        for ( uint32 i = 0; i <= mask; i++ ) {
+            delete entries[i].packet;
+            delete [] entries[i].payload;
+        }
+        delete [] entries;
+        entries = NULL;
+        mask = 0;
+    }
+    if ( !size )
+        return;
+    entries = new Entry[size];
+    for ( uint32 i = 0; i < size; i++ ) {
+        entries[i].packet = NULL;
+        entries[i].payload = NULL;
+    }
+    mask = size - 1;
+}
+
+void
+OutgoingDataQueue::RetransmissionHistory::store(OutgoingRTPPkt* packet,
+const timeval& now, unsigned char* payload)
+{
+    if ( !entries ) {
+        delete packet;
+        delete [] payload;
+        return;
+    }
+    Entry& e = entries[packet->getSeqNum() & mask];
+    // replaces the packet sent size packets ago
+    delete e.packet;
+    delete [] e.payload;
+    e.packet = packet;
+    e.payload = payload;
+    e.sent = now;
+    timerclear(&(e.retransmitted));
+}
+
+OutgoingDataQueue::RetransmissionHistory::Entry*
+OutgoingDataQueue::RetransmissionHistory::find(uint16 seqNum,
+const timeval& now, microtimeout_t duration)
+{
+    if ( !entries )
+        return NULL;
+    Entry& e = entries[seqNum & mask];
+    if ( !e.packet || e.packet->getSeqNum() != seqNum )
+        return NULL;
+    timeval age;
+    timersub(&now,&(e.sent),&age);
+    if ( timeval2microtimeout(age) > duration ) {
+        delete e.packet;
+        delete [] e.payload;
+        e.packet = NULL;
+        e.payload = NULL;
+        return NULL;
+    }
+    return &e;
+}
+
+void
+OutgoingDataQueue::setRetransmissionHistory(microtimeout_t duration,
+uint16 maxPackets)
+{
+    uint32 size = 0;
+    if ( duration ) {
+        size = 1;
+        while ( size < maxPackets )
+            size <<= 1;
+    }
+    sendLock.writeLock();
+    retransmissionHistory = duration;
+    mainHistory.resize(size);
+    for (std::list<LocalStream*>::iterator i = localStreams.begin();
+         localStreams.end() != i; i++)
+        (*i)->history.resize(size);
+    sendLock.unlock();
+}
+
+OutgoingDataQueue::RetransmissionHistory*
+OutgoingDataQueue::findRetransmissionHistory(uint32 ssrc)
+{
+    if ( ssrc == getLocalSSRC() )
+        return &mainHistory;
+    for (std::list<LocalStream*>::iterator i = localStreams.begin();
+         localStreams.end() != i; i++) {
+        if ( (*i)->ssrc == ssrc )
+            return &((*i)->history);
+    }
+    return NULL;
+}
+
+bool
+OutgoingDataQueue::setRetransmissionStream(uint32 ssrc, uint32 rtxSSRC,
+PayloadType rtxPT)
+{
+    sendLock.writeLock();
+    RetransmissionHistory* history = findRetransmissionHistory(ssrc);
+    if ( history ) {
+        history->rtx = true;
+        history->rtxSSRC = rtxSSRC;
+        history->rtxPT = rtxPT;
+        history->rtxSeq = random16();
+    }
+    sendLock.unlock();
+    return (NULL != history);
+}
+
+bool
+OutgoingDataQueue::clearRetransmissionStream(uint32 ssrc)
+{
+    sendLock.writeLock();
+    RetransmissionHistory* history = findRetransmissionHistory(ssrc);
+    if ( history )
+        history->rtx = false;
+    sendLock.unlock();
+    return (NULL != history);
+}
+
+bool
+OutgoingDataQueue::retransmit(uint32 ssrc, uint16 seqNum)
+{
+    timeval now;
+    SysTime::gettimeofday(&now, NULL);
+
+    sendLock.writeLock();
+    RetransmissionHistory* history = findRetransmissionHistory(ssrc);
+    RetransmissionHistory::Entry* e = history ?
+        history->find(seqNum,now,retransmissionHistory) : NULL;
+    if ( !e ) {
+        sendLock.unlock();
+        return false;
+    }
+    // per packet rate limiting
+    if ( timerisset(&(e->retransmitted)) ) {
+        timeval elapsed;
+        timersub(&now,&(e->retransmitted),&elapsed);
+        if ( timeval2microtimeout(elapsed) < retransmissionInterval ) {
+            sendLock.unlock();
+            return false;
+        }
+    }
+    // the very same SRTP packet would be rejected as a replay
+    if ( !history->rtx && e->payload ) {
+        sendLock.unlock();
+        return false;
+    }
+    e->retransmitted = now;
+
+    OutgoingRTPPkt* packet = e->packet;
+    if ( !history->rtx ) {
+        // in-band: the very same packet again.
+        dispatchImmediate(packet);
+    } else {
+        // RFC 4588: the original sequence number followed by the
+        // original payload, same timestamp and marker.
+        size_t len = 2 + packet->getPayloadSize();
+        unsigned char* data = new unsigned char[len];
+        uint16 osn = htons(seqNum);
+        memcpy(data,&osn,2);
+        memcpy(data + 2,e->payload ? e->payload : packet->getPayload(),
+               packet->getPayloadSize());
+        uint32 csrcs[15];
+        uint16 cc = packet->getCSRCsCount();
+        for ( uint16 i = 0; i < cc; i++ )
+            csrcs[i] = ntohl(packet->getCSRCs()[i]);
+
+        CryptoContext* pcc = getSendCryptoContext(history->rtxSSRC);
+        OutgoingRTPPkt rtx(csrcs,cc,data,len,sendInfo.paddinglen,pcc);
+        delete [] data;
+        rtx.setPayloadType(history->rtxPT);
+        rtx.setSeqNum(history->rtxSeq++);
+        rtx.setTimestamp(packet->getTimestamp());
+        rtx.setSSRC(history->rtxSSRC);
+        rtx.setMarker(packet->isMarked());
+        if ( pcc != NULL )
+            rtx.protect(history->rtxSSRC,pcc);
+        dispatchImmediate(&rtx);
+    }
+    retransmittedCount++;
+    sendLock.unlock();
+    return true;
+}
+
 void
 OutgoingDataQueue::setOutQueueCryptoContext(CryptoContext* cc)
 {
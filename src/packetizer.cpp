@@ -0,0 +1,483 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+#include "private.h"
+#include <ccrtp/packetizer.h>
+#include <cstring>
+
+NAMESPACE_COMMONCPP
+
+// H.264 NAL unit types of the RTP payload format (RFC 6184).
+static const uint8 h264TypeSTAPA = 24;
+static const uint8 h264TypeFUA = 28;
+// H.265 NAL unit types of the RTP payload format (RFC 7798).
+static const uint8 h265TypeAP = 48;
+static const uint8 h265TypeFU = 49;
+
+// Annex B start code written before every NAL unit rebuilt.
+static const unsigned char startCode[] = { 0x00, 0x00, 0x00, 0x01 };
+
+NALUnitPacketizer::NALUnitPacketizer(size_t headerSize,
+size_t aggregationSize, size_t fragmentSize) :
+RTPPacketizer(),
+nalHeaderSize(headerSize), aggregationHeaderSize(aggregationSize),
+fragmentHeaderSize(fragmentSize), aggregation(true), maxPayloadSize(0),
+nals(), nextNAL(0), fragmentOffset(0), nextSize(0), nextCount(0)
+{ }
+
+void
+NALUnitPacketizer::setFrame(const unsigned char* data, size_t len,
+size_t maxPayload)
+{
+    nals.clear();
+    nextNAL = 0;
+    fragmentOffset = 0;
+    maxPayloadSize = maxPayload;
+
+    NALUnit nal;
+    if ( len < 3 || data[0] || data[1] ||
+         (1 != data[2] && (len < 4 || data[2] || 1 != data[3])) ) {
+        // no start code: a single NAL unit
+        if ( len > nalHeaderSize ) {
+            nal.data = data;
+            nal.len = len;
+            nals.push_back(nal);
+        }
+        plan();
+        return;
+    }
+
+    // split the byte stream at every 0x000001 start code
+    size_t start = 0;
+    bool started = false;
+    for ( size_t i = 0; i + 2 < len; ) {
+        if ( data[i + 2] > 1 ) {
+            // no start code begins at i, i + 1 or i + 2
+            i += 3;
+        } else if ( 1 == data[i + 2] && 0 == data[i + 1] &&
+                0 == data[i] ) {
+            if ( started ) {
+                // leave out trailing zeros, including the
+                // first octet of a four octets start code
+                size_t end = i;
+                while ( end > start && 0 == data[end - 1] )
+                    end--;
+                if ( end - start > nalHeaderSize ) {
+                    nal.data = data + start;
+                    nal.len = end - start;
+                    nals.push_back(nal);
+                }
+            }
+            i += 3;
+            start = i;
+            started = true;
+        } else {
+            i++;
+        }
+    }
+    if ( started && len - start > nalHeaderSize ) {
+        nal.data = data + start;
+        nal.len = len - start;
+        nals.push_back(nal);
+    }
+    plan();
+}
+
+void
+NALUnitPacketizer::plan()
+{
+    nextSize = 0;
+    nextCount = 0;
+    if ( nextNAL >= nals.size() )
+        return;
+
+    const NALUnit& nal = nals[nextNAL];
+    if ( 0 == fragmentOffset && nal.len <= maxPayloadSize ) {
+        // aggregate as many following NAL units as fit
+        size_t count = 1;
+        size_t size = aggregationHeaderSize + 2 + nal.len;
+        while ( aggregation && nextNAL + count < nals.size() &&
+            size + 2 + nals[nextNAL + count].len <= maxPayloadSize ) {
+            size += 2 + nals[nextNAL + count].len;
+            count++;
+        }
+        if ( count > 1 )
+            nextSize = size;
+        else
+            nextSize = nal.len;
+        nextCount = count;
+        return;
+    }
+
+    // fragment the NAL unit, its header is carried in the
+    // fragmentation unit headers
+    if ( 0 == fragmentOffset )
+        fragmentOffset = nalHeaderSize;
+    size_t room = ( maxPayloadSize > fragmentHeaderSize ) ?
+        maxPayloadSize - fragmentHeaderSize : 1;
+    size_t remainder = nal.len - fragmentOffset;
+    nextSize = fragmentHeaderSize + (( remainder > room ) ? room : remainder);
+}
+
+void
+NALUnitPacketizer::writeNext(unsigned char* payload)
+{
+    if ( 0 == nextSize )
+        return;
+
+    const NALUnit& nal = nals[nextNAL];
+    if ( nextCount > 1 ) {
+        unsigned char* p = payload + aggregationHeaderSize;
+        for ( size_t i = 0; i < nextCount; i++ ) {
+            const NALUnit& n = nals[nextNAL + i];
+            writeAggregationHeader(payload,n.data,0 == i);
+            p[0] = static_cast<unsigned char>(n.len >> 8);
+            p[1] = static_cast<unsigned char>(n.len);
+            memcpy(p + 2,n.data,n.len);
+            p += 2 + n.len;
+        }
+        nextNAL += nextCount;
+    } else if ( 1 == nextCount ) {
+        memcpy(payload,nal.data,nal.len);
+        nextNAL++;
+    } else {
+        size_t len = nextSize - fragmentHeaderSize;
+        bool start = ( nalHeaderSize == fragmentOffset );
+        bool end = ( fragmentOffset + len == nal.len );
+        writeFragmentHeader(payload,nal.data,start,end);
+        memcpy(payload + fragmentHeaderSize,nal.data + fragmentOffset,len);
+        if ( end ) {
+            fragmentOffset = 0;
+            nextNAL++;
+        } else {
+            fragmentOffset += len;
+        }
+    }
+    plan();
+}
+
+H264Packetizer::H264Packetizer() :
+NALUnitPacketizer(1,1,2)
+{ }
+
+void
+H264Packetizer::writeAggregationHeader(unsigned char* payload,
+const unsigned char* nal, bool first)
+{
+    if ( first ) {
+        payload[0] = (nal[0] & 0xe0) | h264TypeSTAPA;
+        return;
+    }
+    // F is set if set for any, NRI is the highest
+    uint8 nri = payload[0] & 0x60;
+    if ( (nal[0] & 0x60) > nri )
+        nri = nal[0] & 0x60;
+    payload[0] = ((payload[0] | nal[0]) & 0x80) | nri | h264TypeSTAPA;
+}
+
+void
+H264Packetizer::writeFragmentHeader(unsigned char* payload,
+const unsigned char* nal, bool start, bool end)
+{
+    // FU indicator, FU header
+    payload[0] = (nal[0] & 0xe0) | h264TypeFUA;
+    payload[1] = (start ? 0x80 : 0) | (end ? 0x40 : 0) | (nal[0] & 0x1f);
+}
+
+H265Packetizer::H265Packetizer() :
+NALUnitPacketizer(2,2,3)
+{ }
+
+void
+H265Packetizer::writeAggregationHeader(unsigned char* payload,
+const unsigned char* nal, bool first)
+{
+    if ( first ) {
+        payload[0] = (nal[0] & 0x81) | (h265TypeAP << 1);
+        payload[1] = nal[1];
+        return;
+    }
+    // F is set if set for any, LayerId and TID are the lowest
+    uint8 layer = ((payload[0] & 0x01) << 5) | (payload[1] >> 3);
+    uint8 tid = payload[1] & 0x07;
+    uint8 nalLayer = ((nal[0] & 0x01) << 5) | (nal[1] >> 3);
+    if ( nalLayer < layer )
+        layer = nalLayer;
+    if ( (nal[1] & 0x07) < tid )
+        tid = nal[1] & 0x07;
+    payload[0] = ((payload[0] | nal[0]) & 0x80) | (h265TypeAP << 1) |
+        (layer >> 5);
+    payload[1] = static_cast<unsigned char>((layer << 3) | tid);
+}
+
+void
+H265Packetizer::writeFragmentHeader(unsigned char* payload,
+const unsigned char* nal, bool start, bool end)
+{
+    // payload header, FU header
+    payload[0] = (nal[0] & 0x81) | (h265TypeFU << 1);
+    payload[1] = nal[1];
+    payload[2] = (start ? 0x80 : 0) | (end ? 0x40 : 0) |
+        ((nal[0] >> 1) & 0x3f);
+}
+
+RTPDepacketizer::RTPDepacketizer() :
+buffer(NULL), size(0), capacity(0), timestamp(0), complete(true)
+{ }
+
+RTPDepacketizer::~RTPDepacketizer()
+{
+    delete [] buffer;
+}
+
+void
+RTPDepacketizer::reset(uint32 stamp)
+{
+    size = 0;
+    timestamp = stamp;
+    complete = true;
+}
+
+void
+RTPDepacketizer::lost()
+{
+    complete = false;
+}
+
+void
+RTPDepacketizer::finish()
+{ }
+
+unsigned char*
+RTPDepacketizer::append(size_t len)
+{
+    if ( size + len > capacity ) {
+        // the buffer grows geometrically and is kept between frames
+        size_t newCapacity = capacity ? capacity * 2 : 4096;
+        while ( newCapacity < size + len )
+            newCapacity *= 2;
+        unsigned char* newBuffer = new unsigned char[newCapacity];
+        if ( size )
+            memcpy(newBuffer,buffer,size);
+        delete [] buffer;
+        buffer = newBuffer;
+        capacity = newCapacity;
+    }
+    unsigned char* p = buffer + size;
+    size += len;
+    return p;
+}
+
+NALUnitDepacketizer::NALUnitDepacketizer(size_t headerSize) :
+RTPDepacketizer(), nalHeaderSize(headerSize), fragmentStart(0),
+fragmenting(false)
+{ }
+
+void
+NALUnitDepacketizer::reset(uint32 stamp)
+{
+    RTPDepacketizer::reset(stamp);
+    fragmenting = false;
+}
+
+void
+NALUnitDepacketizer::lost()
+{
+    RTPDepacketizer::lost();
+    // the NAL unit being defragmented misses some fragment
+    if ( fragmenting ) {
+        truncate(fragmentStart);
+        fragmenting = false;
+    }
+}
+
+void
+NALUnitDepacketizer::finish()
+{
+    if ( fragmenting ) {
+        // the last fragment is missing
+        truncate(fragmentStart);
+        fragmenting = false;
+        setIncomplete();
+    }
+}
+
+void
+NALUnitDepacketizer::addNALUnit(const unsigned char* nal, size_t len)
+{
+    unsigned char* p = append(sizeof(startCode) + len);
+    memcpy(p,startCode,sizeof(startCode));
+    memcpy(p + sizeof(startCode),nal,len);
+}
+
+bool
+NALUnitDepacketizer::add(const unsigned char* payload, size_t len)
+{
+    if ( len <= nalHeaderSize ) {
+        setIncomplete();
+        return false;
+    }
+
+    PacketKind kind = getPacketKind(payload);
+    if ( fragmenting && packetFragment != kind ) {
+        // the last fragment is missing
+        truncate(fragmentStart);
+        fragmenting = false;
+        setIncomplete();
+    }
+
+    switch ( kind ) {
+    case packetSingle:
+        addNALUnit(payload,len);
+        break;
+    case packetAggregation:
+    {
+        // aggregation header, then NAL units preceded by their size
+        const unsigned char* p = payload + nalHeaderSize;
+        const unsigned char* end = payload + len;
+        while ( p + 2 <= end ) {
+            size_t nalLen = p[0] << 8 | p[1];
+            p += 2;
+            if ( nalLen <= nalHeaderSize ||
+                 nalLen > static_cast<size_t>(end - p) ) {
+                setIncomplete();
+                return false;
+            }
+            addNALUnit(p,nalLen);
+            p += nalLen;
+        }
+        break;
+    }
+    case packetFragment:
+    {
+        size_t headerLen = nalHeaderSize + 1;
+        if ( len <= headerLen ) {
+            setIncomplete();
+            return false;
+        }
+        unsigned char header[2];
+        bool start, last;
+        parseFragmentHeader(payload,header,start,last);
+        if ( start ) {
+            if ( fragmenting ) {
+                truncate(fragmentStart);
+                setIncomplete();
+            }
+            fragmentStart = getSize();
+            fragmenting = true;
+            unsigned char* p = append(sizeof(startCode) + nalHeaderSize);
+            memcpy(p,startCode,sizeof(startCode));
+            memcpy(p + sizeof(startCode),header,nalHeaderSize);
+        } else if ( !fragmenting ) {
+            // the first fragment is missing
+            setIncomplete();
+            return true;
+        }
+        memcpy(append(len - headerLen),payload + headerLen,len - headerLen);
+        if ( last )
+            fragmenting = false;
+        break;
+    }
+    default:
+        setIncomplete();
+        return false;
+    }
+    return true;
+}
+
+H264Depacketizer::H264Depacketizer() :
+NALUnitDepacketizer(1)
+{ }
+
+NALUnitDepacketizer::PacketKind
+H264Depacketizer::getPacketKind(const unsigned char* payload) const
+{
+    uint8 type = payload[0] & 0x1f;
+    if ( type > 0 && type < h264TypeSTAPA )
+        return packetSingle;
+    else if ( h264TypeSTAPA == type )
+        return packetAggregation;
+    else if ( h264TypeFUA == type )
+        return packetFragment;
+    // interleaved mode packets are not supported
+    return packetInvalid;
+}
+
+void
+H264Depacketizer::parseFragmentHeader(const unsigned char* payload,
+unsigned char* header, bool& start, bool& end) const
+{
+    header[0] = (payload[0] & 0xe0) | (payload[1] & 0x1f);
+    start = ( 0 != (payload[1] & 0x80) );
+    end = ( 0 != (payload[1] & 0x40) );
+}
+
+H265Depacketizer::H265Depacketizer() :
+NALUnitDepacketizer(2)
+{ }
+
+NALUnitDepacketizer::PacketKind
+H265Depacketizer::getPacketKind(const unsigned char* payload) const
+{
+    uint8 type = (payload[0] >> 1) & 0x3f;
+    if ( type < h265TypeAP )
+        return packetSingle;
+    else if ( h265TypeAP == type )
+        return packetAggregation;
+    else if ( h265TypeFU == type )
+        return packetFragment;
+    // PACI packets are not supported
+    return packetInvalid;
+}
+
+void
+H265Depacketizer::parseFragmentHeader(const unsigned char* payload,
+unsigned char* header, bool& start, bool& end) const
+{
+    header[0] = (payload[0] & 0x81) | ((payload[2] & 0x3f) << 1);
+    header[1] = payload[1];
+    start = ( 0 != (payload[2] & 0x80) );
+    end = ( 0 != (payload[2] & 0x40) );
+}
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
@@ -39,16 +39,475 @@
 #include <ccrtp/pool.h>
 
 #include <algorithm>
+#ifdef  HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef  HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+#ifndef _MSWINDOWS_
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 NAMESPACE_COMMONCPP
 using std::list;
 
-RTPSessionPool::RTPSessionPool()
+// readiness notifications taken per wait
+static const int poolMaxEvents = 256;
+// weight of the last iteration in the busy fraction
+static const float poolBusyWeight = 1.0f / 16;
+// minimum time between two sessions moved to a shard
+static const microtimeout_t poolBalancePeriod = 100000;
+
+RTPTimerWheel::RTPTimerWheel(microtimeout_t r) :
+resolution(r ? r : 1), count(0), late(false)
 {
+    for ( unsigned l = 0; l < levels; l++ ) {
+        levelCount[l] = 0;
+        for ( unsigned i = 0; i < slots; i++ )
+            wheels[l][i] = NULL;
+    }
+    currentTick = getTime() / resolution;
+}
+
+uint64
+RTPTimerWheel::getTime()
+{
+    timeval now;
+    SysTime::gettimeofday(&now,NULL);
+    return static_cast<uint64>(now.tv_sec) * 1000000 + now.tv_usec;
+}
+
+void
+RTPTimerWheel::insert(Timer& timer)
+{
+    uint64 tick = timer.deadline / resolution;
+    if ( tick < currentTick ) {
+        // already due: expired with the current tick, or before
+        tick = currentTick;
+        late = true;
+    }
+    uint64 delta = tick - currentTick;
+    unsigned level = 0;
+    while ( level + 1 < levels &&
+            delta >= (static_cast<uint64>(1) << (slotBits * (level + 1))) )
+        level++;
+    // beyond the last wheel: kept in it till the deadline is
+    // nearer
+    uint64 span = static_cast<uint64>(1) << (slotBits * levels);
+    if ( delta >= span )
+        tick = currentTick + span - 1;
+    Timer** slot = &wheels[level][(tick >> (slotBits * level)) & (slots - 1)];
+    timer.level = static_cast<uint8>(level);
+    timer.next = *slot;
+    if ( timer.next )
+        timer.next->pprev = &timer.next;
+    timer.pprev = slot;
+    *slot = &timer;
+    levelCount[level]++;
+}
+
+void
+RTPTimerWheel::schedule(Timer& timer, uint64 deadline)
+{
+    if ( timer.isScheduled() )
+        cancel(timer);
+    timer.deadline = deadline;
+    insert(timer);
+    count++;
+}
+
+void
+RTPTimerWheel::cancel(Timer& timer)
+{
+    if ( !timer.isScheduled() )
+        return;
+    *timer.pprev = timer.next;
+    if ( timer.next )
+        timer.next->pprev = timer.pprev;
+    timer.pprev = NULL;
+    timer.next = NULL;
+    levelCount[timer.level]--;
+    count--;
+}
+
+void
+RTPTimerWheel::cascade(unsigned level)
+{
+    unsigned index = (currentTick >> (slotBits * level)) & (slots - 1);
+    // the next wheel turns when this one starts a new round
+    if ( 0 == index && level + 1 < levels )
+        cascade(level + 1);
+    Timer* t = wheels[level][index];
+    wheels[level][index] = NULL;
+    while ( t ) {
+        Timer* next = t->next;
+        levelCount[level]--;
+        insert(*t);
+        t = next;
+    }
+}
+
+size_t
+RTPTimerWheel::expire(uint64 now, std::vector<Timer*>& expired)
+{
+    uint64 nowTick = now / resolution;
+    size_t result = 0;
+    while ( count && currentTick <= nowTick ) {
+        unsigned index = currentTick & (slots - 1);
+        if ( 0 == index && count > levelCount[0] )
+            cascade(1);
+        Timer* t = wheels[0][index];
+        wheels[0][index] = NULL;
+        while ( t ) {
+            Timer* next = t->next;
+            t->pprev = NULL;
+            t->next = NULL;
+            levelCount[0]--;
+            count--;
+            expired.push_back(t);
+            result++;
+            t = next;
+        }
+        currentTick++;
+    }
+    // nothing to go through till now
+    if ( currentTick <= nowTick )
+        currentTick = nowTick + 1;
+    if ( late ) {
+        // timers scheduled already due are in the slot of the
+        // current tick
+        Timer** link = &wheels[0][currentTick & (slots - 1)];
+        while ( *link ) {
+            Timer* t = *link;
+            if ( t->deadline / resolution < currentTick ) {
+                *link = t->next;
+                if ( t->next )
+                    t->next->pprev = link;
+                t->pprev = NULL;
+                t->next = NULL;
+                levelCount[0]--;
+                count--;
+                expired.push_back(t);
+                result++;
+            } else {
+                link = &t->next;
+            }
+        }
+        late = false;
+    }
+    return result;
+}
+
+microtimeout_t
+RTPTimerWheel::getTimeout(uint64 now, microtimeout_t max) const
+{
+    if ( !count )
+        return max;
+    if ( late )
+        return 0;
+    // the first slot of the finest wheel with timers, or the next
+    // turn of the coarser ones.
+    bool coarser = count > levelCount[0];
+    uint64 tick = currentTick;
+    for ( unsigned i = 0; i < slots; i++, tick++ ) {
+        if ( wheels[0][tick & (slots - 1)] ||
+             (coarser && 0 == (tick & (slots - 1))) )
+            break;
+    }
+    uint64 at = tick * resolution;
+    if ( at <= now )
+        return 0;
+    return ( at - now < max ) ? static_cast<microtimeout_t>(at - now) : max;
+}
+
+SessionRegistry::SessionRegistry() :
+elements(), buckets(16,static_cast<SessionListElement*>(NULL))
+{ }
+
+SessionRegistry::~SessionRegistry()
+{
+    for ( size_t i = 0; i < elements.size(); i++ )
+        delete elements[i];
+}
+
+size_t
+SessionRegistry::bucket(const RTPSessionBase* session) const
+{
+    // sessions are allocated objects: the low bits of their
+    // addresses carry no information.
+    size_t h = reinterpret_cast<size_t>(session) >> 4;
+    h ^= h >> 9;
+    return h & (buckets.size() - 1);
+}
+
+void
+SessionRegistry::rehash(size_t count)
+{
+    buckets.assign(count,static_cast<SessionListElement*>(NULL));
+    for ( size_t i = 0; i < elements.size(); i++ ) {
+        SessionListElement* e = elements[i];
+        size_t b = bucket(e->get());
+        e->nextHashed = buckets[b];
+        buckets[b] = e;
+    }
+}
+
+SessionListElement*
+SessionRegistry::find(RTPSessionBase* session) const
+{
+    SessionListElement* e = buckets[bucket(session)];
+    while ( e && e->get() != session )
+        e = e->nextHashed;
+    return e;
+}
+
+SessionListElement*
+SessionRegistry::add(RTPSessionBase* session)
+{
+    if ( find(session) )
+        return NULL;
+    SessionListElement* e = new SessionListElement(session);
+    e->index = elements.size();
+    elements.push_back(e);
+    if ( elements.size() > buckets.size() ) {
+        rehash(buckets.size() * 2);
+    } else {
+        size_t b = bucket(session);
+        e->nextHashed = buckets[b];
+        buckets[b] = e;
+    }
+    return e;
+}
+
+void
+SessionRegistry::remove(SessionListElement* element)
+{
+    SessionListElement** link = &buckets[bucket(element->get())];
+    while ( *link && *link != element )
+        link = &(*link)->nextHashed;
+    if ( !*link )
+        return;
+    *link = element->nextHashed;
+    element->nextHashed = NULL;
+    // the last element takes its place in the array
+    SessionListElement* last = elements.back();
+    elements[element->index] = last;
+    last->index = element->index;
+    elements.pop_back();
+}
+
+RTPSessionPool::RTPSessionPool() :
+RTPSessionPoolBase(), sessions(), removedSessions(), readyTargets(),
+pollHandle(-1), uring(NULL), uringReady(), uringFailed(), timerLock(),
+timers(), expiredTimers(), waiting(false), loadLock(), packetsReceived(0),
+packetsSent(0), busy(0)
+{
+    setPoolTimeout(1,0);
+    wakeHandles[0] = wakeHandles[1] = -1;
+    wakeTarget.element = uringTarget.element = NULL;
+    wakeTarget.control = uringTarget.control = false;
+#ifdef  HAVE_SYS_EPOLL_H
+    pollHandle = epoll_create(poolMaxEvents);
+#endif
 #ifndef _MSWINDOWS_
-    highestSocket = 0;
-    setPoolTimeout(0,3000);
-    FD_ZERO(&recvSocketSet);
+    if ( 0 == pipe(wakeHandles) ) {
+        fcntl(wakeHandles[0],F_SETFL,O_NONBLOCK);
+        fcntl(wakeHandles[1],F_SETFL,O_NONBLOCK);
+#ifdef  HAVE_SYS_EPOLL_H
+        if ( pollHandle >= 0 ) {
+            struct epoll_event ev;
+            memset(&ev,0,sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.ptr = &wakeTarget;
+            epoll_ctl(pollHandle,EPOLL_CTL_ADD,wakeHandles[0],&ev);
+        }
+#endif
+    } else {
+        wakeHandles[0] = wakeHandles[1] = -1;
+    }
+#endif
+}
+
+RTPSessionPool::~RTPSessionPool()
+{
+    purgeSessions();
+    if ( uring ) {
+        // sessions left must not refer to the ring any more
+        poolLock.writeLock();
+        for ( size_t i = 0; i < sessions.size(); i++ ) {
+            if ( sessions[i]->dataUring ) {
+                setDataUring(*sessions[i]->get(),NULL,NULL);
+                sessions[i]->dataUring = false;
+            }
+        }
+        poolLock.unlock();
+        delete uring;
+    }
+#ifdef  HAVE_SYS_EPOLL_H
+    if ( pollHandle >= 0 )
+        ::close(pollHandle);
+#endif
+#ifndef _MSWINDOWS_
+    if ( wakeHandles[0] >= 0 ) {
+        ::close(wakeHandles[0]);
+        ::close(wakeHandles[1]);
+    }
+#endif
+}
+
+void
+SessionListElement::onSendQueued()
+{
+    pool->scheduleNow(*this);
+}
+
+void
+RTPSessionPool::scheduleNow(SessionListElement& element)
+{
+    timerLock.enter();
+    uint64 now = RTPTimerWheel::getTime();
+    if ( !element.isScheduled() || element.getDeadline() > now )
+        timers.schedule(element,now);
+    bool wake = waiting;
+    waiting = false;
+    timerLock.leave();
+    if ( wake )
+        wakeUp();
+}
+
+void
+RTPSessionPool::scheduleNext(SessionListElement& element)
+{
+    RTPSessionBase& session = *element.get();
+    uint64 now = RTPTimerWheel::getTime();
+    // checked again for the stack to be started, or for RTCP
+    // packets if there is no control socket to watch
+    uint64 deadline = now +
+        timeval2microtimeout(getRTCPCheckInterval(session));
+    if ( isControlServiceActive(session) ) {
+        timeval next = getNextControlTime(session);
+        uint64 rtcp = static_cast<uint64>(next.tv_sec) * 1000000 +
+            next.tv_usec;
+        if ( rtcp < deadline ||
+             element.controlSocket != element.dataSocket )
+            deadline = rtcp;
+    }
+    // packets held for delivery are given up at the hold time
+    timeval next;
+    if ( getHeldDeadline(session,next) ) {
+        uint64 held = static_cast<uint64>(next.tv_sec) * 1000000 +
+            next.tv_usec;
+        if ( held < deadline )
+            deadline = held;
+    }
+    // with nothing to send, the session is scheduled when data
+    // is put (see onSendQueued()).
+    if ( isSending(session) ) {
+        uint64 send = now + getSchedulingTimeout(session);
+        if ( send < deadline )
+            deadline = send;
+    }
+    timerLock.enter();
+    // keep an earlier deadline set meanwhile by onSendQueued()
+    if ( !element.isScheduled() || element.getDeadline() > deadline )
+        timers.schedule(element,deadline);
+    timerLock.leave();
+}
+
+void
+RTPSessionPool::wakeUp()
+{
+#ifndef _MSWINDOWS_
+    if ( wakeHandles[1] >= 0 ) {
+        char c = 0;
+        if ( ::write(wakeHandles[1],&c,1) < 0 ) {
+            // full: the thread will wake up anyway
+        }
+    }
+#endif
+}
+
+void
+RTPSessionPool::watch(SessionListElement& element, bool ring)
+{
+#ifndef _MSWINDOWS_
+    element.dataSocket = getDataRecvSocket(*element.get());
+    element.controlSocket = getControlRecvSocket(*element.get());
+    // data packets received are told by the ring, tagged with
+    // the target (see waitReady()).
+    element.dataUring = ring && uring &&
+        setDataUring(*element.get(),uring,&element.dataTarget);
+#ifdef  HAVE_SYS_EPOLL_H
+    if ( pollHandle >= 0 ) {
+        struct epoll_event ev;
+        memset(&ev,0,sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = &element.dataTarget;
+        if ( !element.dataUring )
+            epoll_ctl(pollHandle,EPOLL_CTL_ADD,element.dataSocket,&ev);
+        if ( element.controlSocket != element.dataSocket ) {
+            ev.data.ptr = &element.controlTarget;
+            epoll_ctl(pollHandle,EPOLL_CTL_ADD,element.controlSocket,&ev);
+        }
+    }
+#endif
+#endif
+}
+
+void
+RTPSessionPool::unwatch(SessionListElement& element)
+{
+#ifdef  HAVE_SYS_EPOLL_H
+    if ( pollHandle >= 0 ) {
+        // (kernels before 2.6.9 require an event for EPOLL_CTL_DEL)
+        struct epoll_event ev;
+        memset(&ev,0,sizeof(ev));
+        if ( !element.dataUring )
+            epoll_ctl(pollHandle,EPOLL_CTL_DEL,element.dataSocket,&ev);
+        if ( element.controlSocket != element.dataSocket )
+            epoll_ctl(pollHandle,EPOLL_CTL_DEL,element.controlSocket,&ev);
+    }
+#endif
+    if ( element.dataUring ) {
+        setDataUring(*element.get(),NULL,NULL);
+        element.dataUring = false;
+    }
+}
+
+bool
+RTPSessionPool::enableUring()
+{
+#ifndef _MSWINDOWS_
+    if ( isActive() )
+        return false;
+    poolLock.writeLock();
+    if ( !uring ) {
+        uring = new RTPUring();
+        if ( !uring->isAvailable() ) {
+            delete uring;
+            uring = NULL;
+        }
+#ifdef  HAVE_SYS_EPOLL_H
+        if ( uring && pollHandle >= 0 ) {
+            struct epoll_event ev;
+            memset(&ev,0,sizeof(ev));
+            ev.events = EPOLLIN;
+            ev.data.ptr = &uringTarget;
+            epoll_ctl(pollHandle,EPOLL_CTL_ADD,uring->getHandle(),&ev);
+        }
+#endif
+        // sessions already added move to the ring
+        for ( size_t i = 0; uring && i < sessions.size(); i++ ) {
+            unwatch(*sessions[i]);
+            watch(*sessions[i]);
+        }
+    }
+    poolLock.unlock();
+    return NULL != uring;
+#else
+    return false;
 #endif
 }
 
@@ -56,18 +515,16 @@ bool
 RTPSessionPool::addSession(RTPSessionBase& session)
 {
 #ifndef _MSWINDOWS_
-    bool result = false;
     poolLock.writeLock();
-    // insert in list.
-    PredEquals predEquals(&session);
-    if ( sessionList.end() == std::find_if(sessionList.begin(),sessionList.end(),predEquals) ) {
-        result = true;
-        sessionList.push_back(new SessionListElement(&session));
-    } else {
-        result = false;
+    SessionListElement* element = sessions.add(&session);
+    if ( element ) {
+        element->pool = this;
+        watch(*element);
+        session.setSendListener(element);
+        scheduleNow(*element);
     }
     poolLock.unlock();
-    return result;
+    return (NULL != element);
 #else
     return false;
 #endif
@@ -77,19 +534,20 @@ bool
 RTPSessionPool::removeSession(RTPSessionBase& session)
 {
 #ifndef _MSWINDOWS_
-    bool result = false;
     poolLock.writeLock();
-    // remove from list.
-    PredEquals predEquals(&session);
-    PoolIterator i;
-    if ( sessionList.end() != (i = find_if(sessionList.begin(),sessionList.end(),predEquals)) ) {
-        (*i)->clear();
-        result = true;
-    } else {
-        result = false;
+    SessionListElement* element = sessions.find(&session);
+    if ( element ) {
+        unwatch(*element);
+        sessions.remove(element);
+        session.setSendListener(NULL);
+        timerLock.enter();
+        timers.cancel(*element);
+        timerLock.leave();
+        element->clear();
+        removedSessions.push_back(element);
     }
     poolLock.unlock();
-    return result;
+    return (NULL != element);
 #else
     return false;
 #endif
@@ -101,7 +559,7 @@ RTPSessionPool::getPoolLength() const
 #ifndef _MSWINDOWS_
     size_t result;
     poolLock.readLock();
-    result = sessionList.size();
+    result = sessions.size();
     poolLock.unlock();
     return result;
 #else
@@ -110,107 +568,490 @@ RTPSessionPool::getPoolLength() const
 }
 
 void
-SingleRTPSessionPool::run()
+RTPSessionPool::getLoad(RTPPoolLoad& load) const
 {
+    load.sessions = getPoolLength();
+    loadLock.enter();
+    load.packetsReceived = packetsReceived;
+    load.packetsSent = packetsSent;
+    load.busy = busy;
+    loadLock.leave();
+}
+
+RTPSessionBase*
+RTPSessionPool::releaseSession()
+{
+    RTPSessionBase* session = NULL;
 #ifndef _MSWINDOWS_
-    SOCKET so;
-    microtimeout_t packetTimeout(0);
-    while ( isActive() ) {
-        poolLock.readLock();
-        // Make a copy of the list so that add and remove does
-        // not affect the list during this loop iteration
-        list<SessionListElement*> sessions(sessionList);
-        poolLock.unlock();
+    poolLock.writeLock();
+    if ( sessions.size() ) {
+        SessionListElement* element = sessions[sessions.size() - 1];
+        unwatch(*element);
+        sessions.remove(element);
+        element->get()->setSendListener(NULL);
+        timerLock.enter();
+        timers.cancel(*element);
+        timerLock.leave();
+        session = element->release();
+        removedSessions.push_back(element);
+    }
+    poolLock.unlock();
+#endif
+    return session;
+}
 
-        PoolIterator i = sessions.begin();
-        while ( i != sessions.end() ) {
-            poolLock.readLock();
-            if (!(*i)->isCleared()) {
-                RTPSessionBase* session((*i)->get());
-                controlReceptionService(*session);
-                controlTransmissionService(*session);
-            }
-            poolLock.unlock();
-            i++;
+void
+RTPSessionPool::purgeSessions()
+{
+    poolLock.writeLock();
+    for ( size_t i = 0; i < removedSessions.size(); i++ )
+        delete removedSessions[i];
+    removedSessions.clear();
+    poolLock.unlock();
+}
+
+size_t
+RTPSessionPool::waitReady(const timeval& timeout)
+{
+    readyTargets.clear();
+#ifndef _MSWINDOWS_
+    int ms = timeout.tv_sec * 1000 + (timeout.tv_usec + 999) / 1000;
+#ifdef  HAVE_SYS_EPOLL_H
+    if ( pollHandle >= 0 ) {
+        struct epoll_event events[poolMaxEvents];
+        int n = epoll_wait(pollHandle,events,poolMaxEvents,ms);
+        for ( int i = 0; i < n; i++ ) {
+            PollTarget* target =
+                static_cast<PollTarget*>(events[i].data.ptr);
+            if ( target == &wakeTarget )
+                drainWakeUps();
+            else if ( target == &uringTarget )
+                processUring();
+            else
+                readyTargets.push_back(target);
+        }
+        return readyTargets.size();
+    }
+#endif
+    // poll: the set is rebuilt from the registry, reusing its
+    // storage.
+    pollSet.clear();
+    pollSetTargets.clear();
+    if ( wakeHandles[0] >= 0 ) {
+        struct pollfd p;
+        p.events = POLLIN;
+        p.revents = 0;
+        p.fd = wakeHandles[0];
+        pollSet.push_back(p);
+        pollSetTargets.push_back(&wakeTarget);
+    }
+    if ( uring ) {
+        struct pollfd p;
+        p.events = POLLIN;
+        p.revents = 0;
+        p.fd = uring->getHandle();
+        pollSet.push_back(p);
+        pollSetTargets.push_back(&uringTarget);
+    }
+    poolLock.readLock();
+    for ( size_t i = 0; i < sessions.size(); i++ ) {
+        SessionListElement* e = sessions[i];
+        struct pollfd p;
+        p.events = POLLIN;
+        p.revents = 0;
+        p.fd = e->dataSocket;
+        if ( !e->dataUring ) {
+            pollSet.push_back(p);
+            pollSetTargets.push_back(&e->dataTarget);
+        }
+        if ( e->controlSocket != e->dataSocket ) {
+            p.fd = e->controlSocket;
+            pollSet.push_back(p);
+            pollSetTargets.push_back(&e->controlTarget);
         }
-        timeval timeout = getPoolTimeout();
+    }
+    poolLock.unlock();
+    if ( pollSet.empty() ) {
+        Thread::sleep(ms);
+        return 0;
+    }
+    int n = ::poll(&pollSet[0],pollSet.size(),ms);
+    for ( size_t i = 0; n > 0 && i < pollSet.size(); i++ ) {
+        if ( pollSet[i].revents ) {
+            if ( pollSetTargets[i] == &wakeTarget )
+                drainWakeUps();
+            else if ( pollSetTargets[i] == &uringTarget )
+                processUring();
+            else
+                readyTargets.push_back(pollSetTargets[i]);
+            n--;
+        }
+    }
+#endif
+    return readyTargets.size();
+}
 
-        // Reinitializa fd set
-        FD_ZERO(&recvSocketSet);
-        poolLock.readLock();
-        highestSocket = 0;
-        for (PoolIterator j = sessions.begin(); j != sessions.end (); j++) {
-            if (!(*j)->isCleared()) {
-                RTPSessionBase* session((*j)->get());
-                SOCKET s = getDataRecvSocket(*session);
-                FD_SET(s,&recvSocketSet);
-                if ( s > highestSocket + 1 )
-                    highestSocket = s + 1;
-            }
+void
+RTPSessionPool::processUring()
+{
+    // a target for each datagram received
+    uringReady.clear();
+    uringFailed.clear();
+    uring->process(uringReady,&uringFailed);
+    for ( size_t i = 0; i < uringReady.size(); i++ )
+        readyTargets.push_back(static_cast<PollTarget*>(uringReady[i]));
+    if ( uringFailed.empty() )
+        return;
+    // the ring can not receive for these sessions any longer:
+    // their data sockets are watched again.
+    poolLock.writeLock();
+    for ( size_t i = 0; i < uringFailed.size(); i++ ) {
+        SessionListElement* element =
+            static_cast<PollTarget*>(uringFailed[i])->element;
+        if ( element->isCleared() || !element->dataUring )
+            continue;
+        unwatch(*element);
+        watch(*element,false);
+    }
+    poolLock.unlock();
+}
+
+void
+RTPSessionPool::drainWakeUps()
+{
+#ifndef _MSWINDOWS_
+    char buffer[64];
+    while ( ::read(wakeHandles[0],buffer,sizeof(buffer)) > 0 )
+        ;
+#endif
+}
+
+void
+RTPSessionPool::serviceSessions()
+{
+#ifndef _MSWINDOWS_
+    timeval start, waitStart, waitEnd, end;
+    SysTime::gettimeofday(&start,NULL);
+
+    // sessions with their send or RTCP deadline expired
+    expiredTimers.clear();
+    timerLock.enter();
+    timers.expire(RTPTimerWheel::getTime(),expiredTimers);
+    timerLock.leave();
+
+    uint32 received = 0, sent = 0;
+    poolLock.readLock();
+    for ( size_t i = 0; i < expiredTimers.size(); i++ ) {
+        SessionListElement* element =
+            static_cast<SessionListElement*>(expiredTimers[i]);
+        if ( element->isCleared() )
+            continue;
+        RTPSessionBase* session = element->get();
+        // a control socket of its own is read when readable
+        if ( element->controlSocket == element->dataSocket )
+            controlReceptionService(*session);
+        controlTransmissionService(*session);
+        releaseHeldPackets(*session);
+        // schedule by timestamp, as in SingleThreadRTPSession
+        // (by Joergen Terner): packets due within a millisecond
+        // are sent now.
+        while ( getSchedulingTimeout(*session) < 1000 &&
+                dispatchDataPacket(*session) )
+            sent++;
+        scheduleNext(*element);
+    }
+    poolLock.unlock();
+    // the packets sent, in one system call
+    if ( uring )
+        uring->submit();
+
+    // wait till the next deadline, or till data is put in a
+    // session with nothing to send
+    timerLock.enter();
+    microtimeout_t wait =
+        timers.getTimeout(RTPTimerWheel::getTime(),
+                  timeval2microtimeout(getPoolTimeout()));
+    waiting = true;
+    timerLock.leave();
+    timeval timeout;
+    timeout.tv_sec = wait / 1000000;
+    timeout.tv_usec = wait % 1000000;
+
+    SysTime::gettimeofday(&waitStart,NULL);
+    size_t n = waitReady(timeout);
+    SysTime::gettimeofday(&waitEnd,NULL);
+
+    timerLock.enter();
+    waiting = false;
+    timerLock.leave();
+
+    poolLock.readLock();
+    // only the sessions with packets are read
+    for ( size_t i = 0; i < n; i++ ) {
+        PollTarget* target = readyTargets[i];
+        if ( target->element->isCleared() )
+            continue;
+        RTPSessionBase* session = target->element->get();
+        if ( target->control ) {
+            // RTCP packets are read as they arrive
+            controlReadyService(*session);
+        } else if ( takeInDataPacket(*session) ) {
+            received++;
+            // feedback to send may have been scheduled
+            scheduleNext(*target->element);
+        }
+    }
+    poolLock.unlock();
+
+    // elements of removed sessions, once their notifications
+    // have been gone through.
+    purgeSessions();
+
+    SysTime::gettimeofday(&end,NULL);
+    timeval total, waiting;
+    timersub(&end,&start,&total);
+    timersub(&waitEnd,&waitStart,&waiting);
+    microtimeout_t t = timeval2microtimeout(total);
+    float iterationBusy = t ?
+        static_cast<float>(t - timeval2microtimeout(waiting)) / t : 0;
+    loadLock.enter();
+    packetsReceived += received;
+    packetsSent += sent;
+    busy += poolBusyWeight * (iterationBusy - busy);
+    loadLock.leave();
+#endif
+}
+
+void
+SingleRTPSessionPool::run()
+{
+    while ( isActive() )
+        serviceSessions();
+}
+
+/**
+ * A shard of a threaded pool: a pool served by its own thread.
+ **/
+class ThreadedRTPSessionPool::Shard : public RTPSessionPool, public Thread
+{
+public:
+    Shard(ThreadedRTPSessionPool& p, int c, int pri) :
+        RTPSessionPool(), Thread(pri), pool(p), cpu(c)
+    { timerclear(&lastBalance); }
+
+    ~Shard()
+    { stopRunning(); }
+
+    void stopRunning()
+    {
+        if ( isRunning() ) {
+            setInactive();
+            wakeUp();
+            Thread::join();
         }
+    }
+
+    void startRunning()
+    { setActive(); Thread::start(); }
+
+    inline bool
+    hasSession(RTPSessionBase& session) const
+    {
+        poolLock.readLock();
+        bool result = (NULL != sessions.find(&session));
         poolLock.unlock();
+        return result;
+    }
 
+    inline RTPSessionBase*
+    takeSession()
+    { return releaseSession(); }
 
-        int n = select(highestSocket,&recvSocketSet,NULL,NULL,
-                   &timeout);
-
-        i = sessions.begin();
-        while ( (i != sessions.end()) ) {
-            poolLock.readLock();
-            if (!(*i)->isCleared()) {
-                RTPSessionBase* session((*i)->get());
-                so = getDataRecvSocket(*session);
-                if ( FD_ISSET(so,&recvSocketSet) && (n-- > 0) ) {
-                    takeInDataPacket(*session);
-                }
-
-                // schedule by timestamp, as in
-                // SingleThreadRTPSession (by Joergen
-                // Terner)
-                if (packetTimeout < 1000) {
-                    packetTimeout = getSchedulingTimeout(*session);
-                }
-                microtimeout_t maxWait =
-                    timeval2microtimeout(getRTCPCheckInterval(*session));
-                // make sure the scheduling timeout is
-                // <= the check interval for RTCP
-                // packets
-                packetTimeout = (packetTimeout > maxWait)? maxWait : packetTimeout;
-                if ( packetTimeout < 1000 ) { // !(packetTimeout/1000)
-                    dispatchDataPacket(*session);
-                    //timerTick();
-                } else {
-                    packetTimeout = 0;
-                }
-            }
-            poolLock.unlock();
-            i++;
+    float
+    getBusy() const
+    {
+        RTPPoolLoad load;
+        getLoad(load);
+        return load.busy;
+    }
+
+    // when a session was last moved to this shard
+    timeval lastBalance;
+
+protected:
+    void run()
+    {
+#ifdef  HAVE_SCHED_SETAFFINITY
+        if ( cpu >= 0 ) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu,&set);
+            sched_setaffinity(0,sizeof(set),&set);
+        }
+#endif
+        while ( isActive() ) {
+            serviceSessions();
+            pool.rebalance(*this);
         }
+    }
 
-        // Purge elements for removed sessions.
-        poolLock.writeLock();
-        i = sessionList.begin();
-        while (i != sessionList.end()) {
-            if ((*i)->isCleared()) {
-                SessionListElement* element(*i);
-                i = sessionList.erase(i);
-                delete element;
-            }
-            else {
-                ++i;
-            }
+private:
+    ThreadedRTPSessionPool& pool;
+    // processor the thread is pinned to, -1 if none
+    int cpu;
+};
+
+ThreadedRTPSessionPool::ThreadedRTPSessionPool(unsigned count, bool pin,
+int pri) :
+RTPSessionPoolBase(), shards(), migrationLock(), lowLoad(0.25f), highLoad(0.75f),
+migratedCount(0)
+{
+    unsigned processors = 1;
+#if defined(_SC_NPROCESSORS_ONLN)
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if ( online > 0 )
+        processors = static_cast<unsigned>(online);
+#endif
+    if ( !count )
+        count = processors;
+    for ( unsigned i = 0; i < count; i++ )
+        shards.push_back(new Shard(*this,pin ? int(i % processors) : -1,
+                       pri));
+}
+
+ThreadedRTPSessionPool::~ThreadedRTPSessionPool()
+{
+    // no shard may be rebalancing while others are deleted
+    for ( size_t i = 0; i < shards.size(); i++ )
+        shards[i]->stopRunning();
+    for ( size_t i = 0; i < shards.size(); i++ ) {
+        // sessions are not owned by the pool
+        while ( shards[i]->takeSession() )
+            ;
+        delete shards[i];
+    }
+}
+
+bool
+ThreadedRTPSessionPool::enableUring()
+{
+    if ( isActive() )
+        return false;
+    bool result = true;
+    for ( size_t i = 0; i < shards.size(); i++ )
+        result = shards[i]->enableUring() && result;
+    return result;
+}
+
+void
+ThreadedRTPSessionPool::startRunning()
+{
+    setActive();
+    for ( size_t i = 0; i < shards.size(); i++ )
+        shards[i]->startRunning();
+}
+
+bool
+ThreadedRTPSessionPool::addSession(RTPSessionBase& session)
+{
+    MutexLock lock(migrationLock);
+    Shard* least = NULL;
+    size_t leastSessions = 0;
+    for ( size_t i = 0; i < shards.size(); i++ ) {
+        if ( shards[i]->hasSession(session) )
+            return false;
+        size_t n = shards[i]->getPoolLength();
+        if ( !least || n < leastSessions ) {
+            least = shards[i];
+            leastSessions = n;
         }
-        poolLock.unlock();
+    }
+    return least->addSession(session);
+}
+
+bool
+ThreadedRTPSessionPool::removeSession(RTPSessionBase& session)
+{
+    MutexLock lock(migrationLock);
+    for ( size_t i = 0; i < shards.size(); i++ ) {
+        if ( shards[i]->removeSession(session) )
+            return true;
+    }
+    return false;
+}
+
+size_t
+ThreadedRTPSessionPool::getPoolLength() const
+{
+    size_t result = 0;
+    for ( size_t i = 0; i < shards.size(); i++ )
+        result += shards[i]->getPoolLength();
+    return result;
+}
+
+void
+ThreadedRTPSessionPool::getShardLoad(unsigned shard, RTPPoolLoad& load) const
+{
+    shards[shard]->getLoad(load);
+}
+
+void
+ThreadedRTPSessionPool::getLoad(RTPPoolLoad& load) const
+{
+    load.sessions = 0;
+    load.packetsReceived = load.packetsSent = 0;
+    load.busy = 0;
+    for ( size_t i = 0; i < shards.size(); i++ ) {
+        RTPPoolLoad l;
+        shards[i]->getLoad(l);
+        load.sessions += l.sessions;
+        load.packetsReceived += l.packetsReceived;
+        load.packetsSent += l.packetsSent;
+        load.busy += l.busy;
+    }
+    if ( !shards.empty() )
+        load.busy /= shards.size();
+}
+
+void
+ThreadedRTPSessionPool::setBalancing(float low, float high)
+{
+    MutexLock lock(migrationLock);
+    lowLoad = low;
+    highLoad = high;
+}
 
-        //GF we added that to allow the kernel scheduler  to
-        // give other tasks some time as if we have lots of
-                // active sessions the thread cann take all the CPU if we
-                // don't pause at all. We haven't found the best way to
-                // do that yet.
-        // usleep (10);
-        yield();
+void
+ThreadedRTPSessionPool::rebalance(Shard& idle)
+{
+    if ( shards.size() < 2 || idle.getBusy() >= lowLoad )
+        return;
+    timeval now, elapsed;
+    SysTime::gettimeofday(&now,NULL);
+    timersub(&now,&idle.lastBalance,&elapsed);
+    if ( timeval2microtimeout(elapsed) < poolBalancePeriod )
+        return;
+    idle.lastBalance = now;
+
+    MutexLock lock(migrationLock);
+    size_t idleSessions = idle.getPoolLength();
+    Shard* busiest = NULL;
+    float busiestLoad = highLoad;
+    for ( size_t i = 0; i < shards.size(); i++ ) {
+        float b = shards[i]->getBusy();
+        if ( shards[i] != &idle && b > busiestLoad &&
+             shards[i]->getPoolLength() > idleSessions + 1 ) {
+            busiest = shards[i];
+            busiestLoad = b;
+        }
     }
-#endif // ndef WIN32
+    if ( !busiest )
+        return;
+    // the element of the session stays in the busy shard till its
+    // notifications have been gone through.
+    RTPSessionBase* session = busiest->takeSession();
+    if ( session && idle.addSession(*session) )
+        migratedCount++;
 }
 
 #if defined(_MSC_VER) && _MSC_VER >= 1300
@@ -0,0 +1,238 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+#include "private.h"
+#include <ccrtp/red.h>
+
+NAMESPACE_COMMONCPP
+
+// RFC 2198: the timestamp offset and block length fields are 14 and
+// 10 bits long.
+static const uint32 redMaxOffset = 0x3fff;
+static const size_t redMaxBlockLength = 0x3ff;
+static const size_t redHeaderSize = 4;
+// RTP fixed header size.
+static const size_t rtpHeaderSize = 12;
+
+REDEncoder::REDEncoder(uint8 r) :
+redundancy(0), latest(0), kept(0), primaryStamp(0), primaryType(0),
+primaryData(NULL), primaryLength(0), included(0), nextSize(0)
+{
+    if ( !setRedundancy(r) )
+        setRedundancy(maxRedundancy);
+}
+
+bool
+REDEncoder::setRedundancy(uint8 r)
+{
+    if ( r > maxRedundancy )
+        return false;
+    redundancy = r;
+    return true;
+}
+
+void
+REDEncoder::reset()
+{
+    kept = 0;
+    included = 0;
+    nextSize = 0;
+}
+
+void
+REDEncoder::setFrame(const unsigned char* data, size_t len,
+size_t maxPayload)
+{
+    primaryData = data;
+    primaryLength = len;
+    included = 0;
+    size_t size = 1 + len;
+    // previous frames, newest first, as long as they fit
+    while ( included < kept && included < redundancy ) {
+        const Frame& f =
+            history[(latest + maxRedundancy - included) % maxRedundancy];
+        uint32 offset = primaryStamp - f.stamp;
+        if ( 0 == offset || offset > redMaxOffset ||
+             f.len > redMaxBlockLength ||
+             size + redHeaderSize + f.len > maxPayload )
+            break;
+        size += redHeaderSize + f.len;
+        included++;
+    }
+    nextSize = size;
+}
+
+void
+REDEncoder::writeNext(unsigned char* payload)
+{
+    unsigned char* p = payload;
+    // block headers, oldest first
+    for ( uint8 k = included; k > 0; k-- ) {
+        const Frame& f =
+            history[(latest + maxRedundancy - (k - 1)) % maxRedundancy];
+        uint32 offset = primaryStamp - f.stamp;
+        p[0] = 0x80 | (f.type & 0x7f);
+        p[1] = static_cast<unsigned char>(offset >> 6);
+        p[2] = static_cast<unsigned char>(((offset & 0x3f) << 2) |
+                          (f.len >> 8));
+        p[3] = static_cast<unsigned char>(f.len);
+        p += redHeaderSize;
+    }
+    *p++ = primaryType & 0x7f;
+    for ( uint8 k = included; k > 0; k-- ) {
+        const Frame& f =
+            history[(latest + maxRedundancy - (k - 1)) % maxRedundancy];
+        memcpy(p,&f.data[0],f.len);
+        p += f.len;
+    }
+    memcpy(p,primaryData,primaryLength);
+    nextSize = 0;
+
+    // keep the frame for the following payloads
+    if ( !redundancy )
+        return;
+    latest = (latest + 1) % maxRedundancy;
+    Frame& f = history[latest];
+    f.stamp = primaryStamp;
+    f.type = primaryType;
+    if ( f.data.size() < primaryLength )
+        f.data.resize(primaryLength);
+    if ( primaryLength )
+        memcpy(&f.data[0],primaryData,primaryLength);
+    f.len = primaryLength;
+    if ( kept < maxRedundancy )
+        kept++;
+}
+
+REDDecoder::REDDecoder() :
+header(NULL), count(0), recoveredCount(0), lastSSRC(0), lastSeqNum(0),
+lastStamp(0), interval(0)
+{ }
+
+uint8
+REDDecoder::decode(const unsigned char* h, const unsigned char* payload,
+size_t len)
+{
+    header = h;
+    count = 0;
+    size_t pos = 0;
+    size_t total = 0;
+    while ( pos < len && (payload[pos] & 0x80) ) {
+        // the last block is the primary one
+        if ( pos + redHeaderSize > len || count + 1 >= maxBlocks )
+            return count = 0;
+        Block& b = blocks[count++];
+        b.type = payload[pos] & 0x7f;
+        b.offset = static_cast<uint16>((payload[pos + 1] << 6) |
+                           (payload[pos + 2] >> 2));
+        b.len = ((payload[pos + 2] & 0x03) << 8) | payload[pos + 3];
+        total += b.len;
+        pos += redHeaderSize;
+    }
+    if ( pos >= len || total > len - pos - 1 )
+        return count = 0;
+    Block& primary = blocks[count++];
+    primary.type = payload[pos++] & 0x7f;
+    primary.offset = 0;
+    primary.len = len - pos - total;
+
+    const unsigned char* data = payload + pos;
+    for ( uint8 i = 0; i < count; i++ ) {
+        blocks[i].data = data;
+        data += blocks[i].len;
+    }
+
+    // learn the timestamp interval from packets in sequence
+    uint16 seqNum = static_cast<uint16>((h[2] << 8) | h[3]);
+    uint32 stamp = (static_cast<uint32>(h[4]) << 24) | (h[5] << 16) |
+        (h[6] << 8) | h[7];
+    uint32 ssrc = (static_cast<uint32>(h[8]) << 24) | (h[9] << 16) |
+        (h[10] << 8) | h[11];
+    int16 step = static_cast<int16>(seqNum - lastSeqNum);
+    if ( ssrc != lastSSRC || step > 0 ) {
+        if ( ssrc != lastSSRC )
+            interval = 0;
+        else if ( 1 == step && static_cast<int32>(stamp - lastStamp) > 0 )
+            interval = stamp - lastStamp;
+        lastSSRC = ssrc;
+        lastSeqNum = seqNum;
+        lastStamp = stamp;
+    }
+    return count;
+}
+
+unsigned char*
+REDDecoder::getPacket(uint8 i, size_t& len) const
+{
+    const Block& b = blocks[i];
+    // a redundant block is as many packets before this one as
+    // intervals in its offset.
+    if ( i + 1 < count && (!interval || !b.offset || b.offset % interval) )
+        return NULL;
+    size_t headerSize = rtpHeaderSize + 4 * (header[0] & 0x0f);
+    len = headerSize + b.len;
+    unsigned char* packet = new unsigned char[len];
+    memcpy(packet,header,headerSize);
+    // neither padding nor header extension
+    packet[0] &= ~0x30;
+    if ( i + 1 == count ) {
+        packet[1] = (header[1] & 0x80) | b.type;
+    } else {
+        packet[1] = b.type;
+        uint16 seqNum = static_cast<uint16>
+            (((header[2] << 8) | header[3]) - b.offset / interval);
+        packet[2] = static_cast<unsigned char>(seqNum >> 8);
+        packet[3] = static_cast<unsigned char>(seqNum);
+        uint32 stamp = ((static_cast<uint32>(header[4]) << 24) |
+                (header[5] << 16) | (header[6] << 8) | header[7])
+            - b.offset;
+        packet[4] = static_cast<unsigned char>(stamp >> 24);
+        packet[5] = static_cast<unsigned char>(stamp >> 16);
+        packet[6] = static_cast<unsigned char>(stamp >> 8);
+        packet[7] = static_cast<unsigned char>(stamp);
+    }
+    memcpy(packet + headerSize,b.data,b.len);
+    return packet;
+}
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */
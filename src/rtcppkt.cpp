@@ -76,14 +76,13 @@ timeval
 microtimeout2Timeval(microtimeout_t to)
 {
     timeval result;
-    result.tv_sec = to % 1000000;
-    result.tv_usec = to / 1000000;
+    result.tv_sec = to / 1000000;
+    result.tv_usec = to % 1000000;
     return result;
 }
 
 RTCPCompoundHandler::RTCPCompoundHandler(uint16 mtu) :
-rtcpSendBuffer(new unsigned char[mtu]()), rtcpRecvBuffer(new unsigned char[mtu]()),
-pathMTU(mtu)
+rtcpSendBuffer(NULL), rtcpRecvBuffer(NULL), pathMTU(mtu)
 {
 }
 
@@ -103,6 +102,15 @@ RTCPCompoundHandler::~RTCPCompoundHandler()
 #endif
 }
 
+void
+RTCPCompoundHandler::freeRTCPBuffers()
+{
+    delete [] rtcpRecvBuffer;
+    rtcpRecvBuffer = NULL;
+    delete [] rtcpSendBuffer;
+    rtcpSendBuffer = NULL;
+}
+
 bool
 RTCPCompoundHandler::checkCompoundRTCPHeader(size_t len)
 {
@@ -41,8 +41,66 @@
 #include "private.h"
 #include <ccrtp/channel.h>
 
+#ifndef _MSWINDOWS_
+#include <sys/socket.h>
+#include <sys/select.h>
+#ifdef  HAVE_PPOLL
+#include <poll.h>
+#endif
+#endif
+
 NAMESPACE_COMMONCPP
 
+bool
+RTPSocketWait::isReadable(SOCKET so, microtimeout_t timeout)
+{
+#ifdef  HAVE_PPOLL
+    struct pollfd p;
+    p.fd = so;
+    p.events = POLLIN;
+    p.revents = 0;
+    struct timespec ts;
+    ts.tv_sec = timeout / 1000000;
+    ts.tv_nsec = (timeout % 1000000) * 1000;
+    return ppoll(&p,1,&ts,NULL) > 0;
+#else
+    // select takes microseconds as well
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(so,&set);
+    timeval tv = microtimeout2Timeval(timeout);
+    return select(static_cast<int>(so) + 1,&set,NULL,NULL,&tv) > 0;
+#endif
+}
+
+bool
+RTPSocketWait::spinReadable(SOCKET so, microtimeout_t timeout)
+{
+    timeval now, end;
+    SysTime::gettimeofday(&now,NULL);
+    timeval tv = microtimeout2Timeval(timeout);
+    timeradd(&now,&tv,&end);
+    for(;;) {
+        if ( isReadable(so,0) )
+            return true;
+        SysTime::gettimeofday(&now,NULL);
+        if ( !timercmp(&now,&end,<) )
+            return false;
+    }
+}
+
+bool
+RTPSocketWait::setBusyPoll(SOCKET so, microtimeout_t usec)
+{
+#ifdef  SO_BUSY_POLL
+    int value = static_cast<int>(usec);
+    return 0 == setsockopt(so,SOL_SOCKET,SO_BUSY_POLL,
+                   reinterpret_cast<char*>(&value),sizeof(value));
+#else
+    return false;
+#endif
+}
+
 END_NAMESPACE
 
 /** EMACS **
@@ -0,0 +1,824 @@
+// Copyright (C) 2026 the GNU ccRTP authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with GNU ccRTP.  If not, see <http://www.gnu.org/licenses/>.
+//
+// As a special exception, you may use this file as part of a free software
+// library without restriction.  Specifically, if other files instantiate
+// templates or use macros or inline functions from this file, or you compile
+// this file and link it with other files to produce an executable, this
+// file does not by itself cause the resulting executable to be covered by
+// the GNU General Public License.  This exception does not however
+// invalidate any other reasons why the executable file might be covered by
+// the GNU General Public License.
+//
+// This exception applies only to the code released under the name GNU
+// ccRTP.  If you copy code from other releases into a copy of GNU
+// ccRTP, as the General Public License permits, the exception does
+// not apply to the code that you add in this way.  To avoid misleading
+// anyone as to the status of such modified files, you must delete
+// this exception notice from them.
+//
+// If you write modifications of your own for GNU ccRTP, it is your choice
+// whether to permit this exception to apply to your modifications.
+// If you do not wish that, delete this exception notice.
+//
+
+#include "private.h"
+#include <ccrtp/uring.h>
+
+#ifdef  HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cerrno>
+#include <deque>
+#include <list>
+#endif
+
+NAMESPACE_COMMONCPP
+
+#ifdef  HAVE_LINUX_IO_URING_H
+
+// buffer group of the reception buffers
+static const uint16 uringBufferGroup = 0;
+
+// reception failures in a row before an endpoint is given up
+static const unsigned uringMaxFailures = 8;
+
+/**
+ * What the completion of an entry refers to: the reception of an
+ * endpoint, or a datagram sent.
+ **/
+struct UringRequest
+{
+    bool sending;
+};
+
+struct UringDatagram
+{
+    uint16 buffer;
+    unsigned char* payload;
+    size_t len;
+    sockaddr_in from;
+};
+
+class RTPUringEndpoint : public UringRequest
+{
+public:
+    RTPUring* ring;
+    SOCKET so;
+    void* tag;
+    // template of the multishot reception
+    msghdr msg;
+    // a reception request is in flight
+    bool armed;
+    bool detached;
+    // receptions ended by an error since the last datagram
+    unsigned failures;
+    std::deque<UringDatagram> queue;
+    sockaddr_in peer;
+};
+
+struct UringSend : public UringRequest
+{
+    msghdr msg;
+    iovec iov;
+    sockaddr_in to;
+    unsigned char* data;
+    // data is a buffer of the send pool
+    bool pooled;
+};
+
+struct RTPUring::Rings
+{
+    Rings() : fd(-1), sqMap(NULL), cqMap(NULL), sqes(NULL),
+        bufRing(NULL), bufMemory(NULL), bufTail(0), sends(NULL),
+        sendMemory(NULL), sendSize(0), freeSends(), sqLocalTail(0),
+        pending(0), sendsInFlight(0), multishot(true), served(false),
+        lock()
+    { }
+
+    ~Rings();
+
+    io_uring_sqe*
+    getEntry();
+
+    void
+    enter(unsigned wait = 0);
+
+    void
+    arm(RTPUringEndpoint& e);
+
+    void
+    rearm();
+
+    bool
+    cancel(RTPUringEndpoint& e);
+
+    void
+    recancel();
+
+    void
+    recycle(uint16 buffer);
+
+    UringSend*
+    takeSend(size_t len);
+
+    void
+    releaseSend(UringSend* s);
+
+    void
+    reap(std::vector<void*>* ready, std::vector<void*>* failed,
+         size_t& received);
+
+    int fd;
+    void* sqMap;
+    size_t sqMapSize;
+    void* cqMap;
+    size_t cqMapSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned sqEntries;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe* cqes;
+    // reception buffers, and the ring they are provided in
+    io_uring_buf* bufRing;
+    unsigned bufCount;
+    size_t bufSize;
+    unsigned char* bufMemory;
+    uint16 bufTail;
+    // send buffers, one for each submission entry, and the free ones
+    UringSend* sends;
+    unsigned char* sendMemory;
+    size_t sendSize;
+    std::vector<UringSend*> freeSends;
+    unsigned sqLocalTail;
+    // entries not submitted yet
+    unsigned pending;
+    unsigned sendsInFlight;
+    std::list<RTPUringEndpoint*> endpoints;
+    // endpoints whose reception stopped
+    std::vector<RTPUringEndpoint*> stopped;
+    // endpoints detached with no entry left to cancel their reception
+    std::vector<RTPUringEndpoint*> cancels;
+    // cleared when a multishot reception is refused by the kernel
+    bool multishot;
+    // the thread processing completions
+    pthread_t server;
+    bool served;
+    Mutex lock;
+};
+
+RTPUring::Rings::~Rings()
+{
+    for ( std::list<RTPUringEndpoint*>::iterator i = endpoints.begin();
+          i != endpoints.end(); i++ )
+        delete *i;
+    if ( fd >= 0 )
+        ::close(fd);
+    if ( sqes )
+        munmap(sqes,sqesSize);
+    if ( cqMap && cqMap != sqMap )
+        munmap(cqMap,cqMapSize);
+    if ( sqMap )
+        munmap(sqMap,sqMapSize);
+    if ( bufRing )
+        munmap(bufRing,bufCount * sizeof(io_uring_buf));
+    delete [] bufMemory;
+    delete [] sends;
+    delete [] sendMemory;
+}
+
+io_uring_sqe*
+RTPUring::Rings::getEntry()
+{
+    unsigned head = __atomic_load_n(sqHead,__ATOMIC_ACQUIRE);
+    if ( sqLocalTail - head >= sqEntries ) {
+        enter();
+        head = __atomic_load_n(sqHead,__ATOMIC_ACQUIRE);
+        if ( sqLocalTail - head >= sqEntries )
+            return NULL;
+    }
+    unsigned index = sqLocalTail & *sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe,0,sizeof(*sqe));
+    sqArray[index] = index;
+    sqLocalTail++;
+    pending++;
+    return sqe;
+}
+
+void
+RTPUring::Rings::enter(unsigned wait)
+{
+    __atomic_store_n(sqTail,sqLocalTail,__ATOMIC_RELEASE);
+    if ( !pending && !wait )
+        return;
+    syscall(__NR_io_uring_enter,fd,pending,wait,
+        wait ? IORING_ENTER_GETEVENTS : 0,NULL,0);
+    pending = 0;
+}
+
+void
+RTPUring::Rings::arm(RTPUringEndpoint& e)
+{
+    io_uring_sqe* sqe = getEntry();
+    if ( !sqe ) {
+        stopped.push_back(&e);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = e.so;
+    sqe->addr = reinterpret_cast<uintptr_t>(&e.msg);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = uringBufferGroup;
+    sqe->user_data =
+        reinterpret_cast<uintptr_t>(static_cast<UringRequest*>(&e));
+    e.armed = true;
+}
+
+void
+RTPUring::Rings::rearm()
+{
+    std::vector<RTPUringEndpoint*> again;
+    again.swap(stopped);
+    for ( size_t i = 0; i < again.size(); i++ )
+        arm(*again[i]);
+}
+
+bool
+RTPUring::Rings::cancel(RTPUringEndpoint& e)
+{
+    io_uring_sqe* sqe = getEntry();
+    if ( !sqe )
+        return false;
+    // deleted with the last completion of the reception
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uintptr_t>(static_cast<UringRequest*>(&e));
+    sqe->user_data = 0;
+    return true;
+}
+
+void
+RTPUring::Rings::recancel()
+{
+    std::vector<RTPUringEndpoint*> again;
+    again.swap(cancels);
+    for ( size_t i = 0; i < again.size(); i++ )
+        if ( !cancel(*again[i]) )
+            cancels.push_back(again[i]);
+}
+
+void
+RTPUring::Rings::recycle(uint16 buffer)
+{
+    io_uring_buf* b = &bufRing[bufTail & (bufCount - 1)];
+    b->addr = reinterpret_cast<uintptr_t>(bufMemory + buffer * bufSize);
+    b->len = static_cast<uint32>(bufSize);
+    b->bid = buffer;
+    bufTail++;
+    // the tail overlays the reserved field of the first buffer
+    __atomic_store_n(&bufRing[0].resv,bufTail,__ATOMIC_RELEASE);
+}
+
+UringSend*
+RTPUring::Rings::takeSend(size_t len)
+{
+    if ( len <= sendSize && !freeSends.empty() ) {
+        UringSend* s = freeSends.back();
+        freeSends.pop_back();
+        return s;
+    }
+    // larger than the pool buffers, or too many in flight
+    UringSend* s = new UringSend;
+    s->sending = true;
+    s->data = new unsigned char[len];
+    s->pooled = false;
+    return s;
+}
+
+void
+RTPUring::Rings::releaseSend(UringSend* s)
+{
+    if ( s->pooled ) {
+        freeSends.push_back(s);
+    } else {
+        delete [] s->data;
+        delete s;
+    }
+}
+
+void
+RTPUring::Rings::reap(std::vector<void*>* ready, std::vector<void*>* failed,
+size_t& received)
+{
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail,__ATOMIC_ACQUIRE);
+    while ( head != tail ) {
+        io_uring_cqe* cqe = &cqes[head & *cqMask];
+        head++;
+        UringRequest* r =
+            reinterpret_cast<UringRequest*>(static_cast<uintptr_t>(cqe->user_data));
+        // cancellations carry no request
+        if ( !r )
+            continue;
+        if ( r->sending ) {
+            releaseSend(static_cast<UringSend*>(r));
+            sendsInFlight--;
+            continue;
+        }
+        RTPUringEndpoint* e = static_cast<RTPUringEndpoint*>(r);
+        if ( cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER) ) {
+            e->failures = 0;
+            uint16 buffer =
+                static_cast<uint16>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            unsigned char* b = bufMemory + buffer * bufSize;
+            io_uring_recvmsg_out* out =
+                reinterpret_cast<io_uring_recvmsg_out*>(b);
+            unsigned char* name = b + sizeof(io_uring_recvmsg_out);
+            if ( e->detached || !ready || (out->flags & MSG_TRUNC) ) {
+                recycle(buffer);
+            } else {
+                UringDatagram d;
+                d.buffer = buffer;
+                d.payload = name + e->msg.msg_namelen +
+                    e->msg.msg_controllen;
+                d.len = out->payloadlen;
+                memset(&d.from,0,sizeof(d.from));
+                memcpy(&d.from,name,
+                       (out->namelen < sizeof(d.from)) ?
+                       out->namelen : sizeof(d.from));
+                e->queue.push_back(d);
+                ready->push_back(e->tag);
+                received++;
+            }
+        }
+        if ( !(cqe->flags & IORING_CQE_F_MORE) ) {
+            e->armed = false;
+            // kernels without multishot reception refuse it
+            if ( -EINVAL == cqe->res )
+                multishot = false;
+            if ( e->detached ) {
+                for ( size_t i = 0; i < cancels.size(); i++ ) {
+                    if ( cancels[i] == e ) {
+                        cancels[i] = cancels.back();
+                        cancels.pop_back();
+                        break;
+                    }
+                }
+                endpoints.remove(e);
+                delete e;
+            } else if ( multishot && (-ENOBUFS == cqe->res ||
+                          ++e->failures < uringMaxFailures) ) {
+                // stopped, for lack of buffers, by the kernel or
+                // by an error: started again
+                stopped.push_back(e);
+            } else if ( failed ) {
+                // failing again and again, or not supported: the
+                // owner must read the socket itself
+                failed->push_back(e->tag);
+            }
+        }
+    }
+    __atomic_store_n(cqHead,head,__ATOMIC_RELEASE);
+}
+
+// whether the kernel knows the operations used. Whether it knows
+// multishot reception is only found out when it is first armed.
+static bool
+uringSupported(int fd)
+{
+    static const uint8 ops[] = { IORING_OP_RECVMSG, IORING_OP_SENDMSG,
+                     IORING_OP_ASYNC_CANCEL };
+    const unsigned count = 256;
+    size_t size = sizeof(io_uring_probe) + count * sizeof(io_uring_probe_op);
+    unsigned char* buffer = new unsigned char[size];
+    memset(buffer,0,size);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer);
+    bool result = syscall(__NR_io_uring_register,fd,IORING_REGISTER_PROBE,
+                  probe,count) >= 0;
+    for ( size_t i = 0; result && i < sizeof(ops); i++ )
+        result = ops[i] <= probe->last_op && ops[i] < probe->ops_len &&
+            (probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED);
+    delete [] buffer;
+    return result;
+}
+
+RTPUring::RTPUring(unsigned entries, unsigned buffers, size_t bufferSize) :
+rings(NULL)
+{
+    // buffers are provided in a ring of a power of 2 size
+    if ( !buffers || (buffers & (buffers - 1)) || buffers > 32768 ||
+         bufferSize < 64 )
+        return;
+    Rings* r = new Rings;
+    io_uring_params p;
+    memset(&p,0,sizeof(p));
+    // a completion may be waiting for each buffer
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries + buffers;
+    r->fd = static_cast<int>(syscall(__NR_io_uring_setup,entries,&p));
+    if ( r->fd < 0 || !uringSupported(r->fd) ) {
+        delete r;
+        return;
+    }
+    r->sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if ( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        if ( r->cqMapSize > r->sqMapSize )
+            r->sqMapSize = r->cqMapSize;
+        r->cqMapSize = 0;
+    }
+    r->sqMap = mmap(NULL,r->sqMapSize,PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE,r->fd,IORING_OFF_SQ_RING);
+    if ( MAP_FAILED == r->sqMap ) {
+        r->sqMap = NULL;
+    } else if ( r->cqMapSize ) {
+        r->cqMap = mmap(NULL,r->cqMapSize,PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE,r->fd,IORING_OFF_CQ_RING);
+        if ( MAP_FAILED == r->cqMap )
+            r->cqMap = NULL;
+    } else {
+        r->cqMap = r->sqMap;
+    }
+    r->sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(NULL,r->sqesSize,PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE,r->fd,IORING_OFF_SQES);
+    r->sqes = ( MAP_FAILED == sqes ) ? NULL :
+        static_cast<io_uring_sqe*>(sqes);
+    // reception buffers
+    r->bufCount = buffers;
+    r->bufSize = bufferSize;
+    void* ring = mmap(NULL,buffers * sizeof(io_uring_buf),
+              PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+    r->bufRing = ( MAP_FAILED == ring ) ? NULL :
+        static_cast<io_uring_buf*>(ring);
+    r->bufMemory = new unsigned char[buffers * bufferSize];
+    // send buffers
+    r->sendSize = bufferSize;
+    r->sends = new UringSend[entries];
+    r->sendMemory = new unsigned char[entries * bufferSize];
+    r->freeSends.reserve(entries);
+    for ( unsigned i = 0; i < entries; i++ ) {
+        UringSend* s = &r->sends[entries - 1 - i];
+        s->sending = true;
+        s->data = r->sendMemory + (entries - 1 - i) * bufferSize;
+        s->pooled = true;
+        r->freeSends.push_back(s);
+    }
+    if ( !r->sqMap || !r->cqMap || !r->sqes || !r->bufRing ) {
+        delete r;
+        return;
+    }
+
+    unsigned char* sq = static_cast<unsigned char*>(r->sqMap);
+    unsigned char* cq = static_cast<unsigned char*>(r->cqMap);
+    r->sqEntries = p.sq_entries;
+    r->sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    r->sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    r->sqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    r->sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    r->sqLocalTail = *r->sqTail;
+    r->cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    r->cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    r->cqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    r->cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    io_uring_buf_reg reg;
+    memset(&reg,0,sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uintptr_t>(r->bufRing);
+    reg.ring_entries = buffers;
+    reg.bgid = uringBufferGroup;
+    if ( syscall(__NR_io_uring_register,r->fd,IORING_REGISTER_PBUF_RING,
+             &reg,1) < 0 ) {
+        delete r;
+        return;
+    }
+    for ( unsigned i = 0; i < buffers; i++ )
+        r->recycle(static_cast<uint16>(i));
+    rings = r;
+}
+
+RTPUring::~RTPUring()
+{
+    if ( !rings )
+        return;
+    rings->lock.enter();
+    // datagrams sent are freed once completed
+    size_t received = 0;
+    rings->enter();
+    for ( int i = 0; rings->sendsInFlight && i < 100; i++ ) {
+        rings->enter(1);
+        rings->reap(NULL,NULL,received);
+    }
+    rings->lock.leave();
+    delete rings;
+}
+
+bool
+RTPUring::isAvailable() const
+{
+    return rings && rings->multishot;
+}
+
+int
+RTPUring::getHandle() const
+{
+    return rings ? rings->fd : -1;
+}
+
+RTPUringEndpoint*
+RTPUring::attach(SOCKET so, void* tag)
+{
+    if ( !rings || !rings->multishot )
+        return NULL;
+    RTPUringEndpoint* e = new RTPUringEndpoint;
+    e->sending = false;
+    e->ring = this;
+    e->so = so;
+    e->tag = tag;
+    memset(&e->msg,0,sizeof(e->msg));
+    e->msg.msg_namelen = sizeof(sockaddr_in);
+    e->armed = false;
+    e->detached = false;
+    e->failures = 0;
+    memset(&e->peer,0,sizeof(e->peer));
+    e->peer.sin_family = AF_INET;
+    rings->lock.enter();
+    rings->endpoints.push_back(e);
+    if ( tag ) {
+        rings->arm(*e);
+        rings->enter();
+    }
+    rings->lock.leave();
+    return e;
+}
+
+void
+RTPUring::detach(RTPUringEndpoint* e)
+{
+    if ( !rings || !e )
+        return;
+    rings->lock.enter();
+    e->detached = true;
+    while ( !e->queue.empty() ) {
+        rings->recycle(e->queue.front().buffer);
+        e->queue.pop_front();
+    }
+    std::vector<RTPUringEndpoint*>& stopped = rings->stopped;
+    for ( size_t i = 0; i < stopped.size(); ) {
+        if ( stopped[i] == e ) {
+            stopped[i] = stopped.back();
+            stopped.pop_back();
+        } else {
+            i++;
+        }
+    }
+    if ( !e->armed ) {
+        rings->endpoints.remove(e);
+        delete e;
+    } else if ( rings->cancel(*e) ) {
+        rings->enter();
+    } else {
+        // the reception would keep the socket open: cancelled by
+        // process() once there are free entries.
+        rings->cancels.push_back(e);
+    }
+    rings->lock.leave();
+}
+
+size_t
+RTPUring::process(std::vector<void*>& ready, std::vector<void*>* failed)
+{
+    if ( !rings )
+        return 0;
+    size_t received = 0;
+    rings->lock.enter();
+    rings->server = pthread_self();
+    rings->served = true;
+    rings->reap(&ready,failed,received);
+    rings->recancel();
+    rings->rearm();
+    rings->enter();
+    rings->lock.leave();
+    return received;
+}
+
+void
+RTPUring::submit()
+{
+    if ( !rings )
+        return;
+    rings->lock.enter();
+    // buffers may have been given back since
+    rings->recancel();
+    rings->rearm();
+    rings->enter();
+    rings->lock.leave();
+}
+
+bool
+RTPUring::isPending(RTPUringEndpoint& e)
+{
+    Rings* r = e.ring->rings;
+    r->lock.enter();
+    bool result = !e.queue.empty();
+    r->lock.leave();
+    return result;
+}
+
+size_t
+RTPUring::getNextSize(RTPUringEndpoint& e)
+{
+    Rings* r = e.ring->rings;
+    r->lock.enter();
+    size_t result = e.queue.empty() ? 0 : e.queue.front().len;
+    r->lock.leave();
+    return result;
+}
+
+InetHostAddress
+RTPUring::getSender(RTPUringEndpoint& e, tpport_t& port)
+{
+    Rings* r = e.ring->rings;
+    sockaddr_in from;
+    memset(&from,0,sizeof(from));
+    r->lock.enter();
+    if ( !e.queue.empty() )
+        from = e.queue.front().from;
+    r->lock.leave();
+    port = ntohs(from.sin_port);
+    return InetHostAddress(from.sin_addr);
+}
+
+size_t
+RTPUring::recv(RTPUringEndpoint& e, unsigned char* buffer, size_t len)
+{
+    Rings* r = e.ring->rings;
+    size_t result = 0;
+    r->lock.enter();
+    if ( !e.queue.empty() ) {
+        UringDatagram& d = e.queue.front();
+        result = (d.len < len) ? d.len : len;
+        memcpy(buffer,d.payload,result);
+        r->recycle(d.buffer);
+        e.queue.pop_front();
+    }
+    r->lock.leave();
+    return result;
+}
+
+void
+RTPUring::setPeer(RTPUringEndpoint& e, const InetAddress& ia, tpport_t port)
+{
+    e.peer.sin_addr = ia.getAddress();
+    e.peer.sin_port = htons(port);
+}
+
+size_t
+RTPUring::send(RTPUringEndpoint& e, const unsigned char* buffer, size_t len)
+{
+    Rings* r = e.ring->rings;
+    r->lock.enter();
+    // the datagram is copied: the buffer is reused once sent
+    UringSend* s = r->takeSend(len);
+    memcpy(s->data,buffer,len);
+    s->to = e.peer;
+    s->iov.iov_base = s->data;
+    s->iov.iov_len = len;
+    memset(&s->msg,0,sizeof(s->msg));
+    s->msg.msg_name = &s->to;
+    s->msg.msg_namelen = sizeof(s->to);
+    s->msg.msg_iov = &s->iov;
+    s->msg.msg_iovlen = 1;
+
+    io_uring_sqe* sqe = r->getEntry();
+    if ( !sqe ) {
+        r->releaseSend(s);
+        r->lock.leave();
+        return 0;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = e.so;
+    sqe->addr = reinterpret_cast<uintptr_t>(&s->msg);
+    sqe->len = 1;
+    sqe->user_data =
+        reinterpret_cast<uintptr_t>(static_cast<UringRequest*>(s));
+    r->sendsInFlight++;
+    // batched by the serving thread, see submit()
+    if ( !r->served || !pthread_equal(r->server,pthread_self()) )
+        r->enter();
+    r->lock.leave();
+    return len;
+}
+
+#else   // HAVE_LINUX_IO_URING_H
+
+// without io_uring, nothing is ever attached.
+
+struct RTPUring::Rings
+{ };
+
+RTPUring::RTPUring(unsigned, unsigned, size_t) :
+rings(NULL)
+{ }
+
+RTPUring::~RTPUring()
+{ }
+
+bool
+RTPUring::isAvailable() const
+{
+    return false;
+}
+
+int
+RTPUring::getHandle() const
+{
+    return -1;
+}
+
+RTPUringEndpoint*
+RTPUring::attach(SOCKET, void*)
+{
+    return NULL;
+}
+
+void
+RTPUring::detach(RTPUringEndpoint*)
+{ }
+
+size_t
+RTPUring::process(std::vector<void*>&, std::vector<void*>*)
+{
+    return 0;
+}
+
+void
+RTPUring::submit()
+{ }
+
+bool
+RTPUring::isPending(RTPUringEndpoint&)
+{
+    return false;
+}
+
+size_t
+RTPUring::getNextSize(RTPUringEndpoint&)
+{
+    return 0;
+}
+
+InetHostAddress
+RTPUring::getSender(RTPUringEndpoint&, tpport_t& port)
+{
+    port = 0;
+    return InetHostAddress();
+}
+
+size_t
+RTPUring::recv(RTPUringEndpoint&, unsigned char*, size_t)
+{
+    return 0;
+}
+
+void
+RTPUring::setPeer(RTPUringEndpoint&, const InetAddress&, tpport_t)
+{ }
+
+size_t
+RTPUring::send(RTPUringEndpoint&, const unsigned char*, size_t)
+{
+    return 0;
+}
+
+#endif  // HAVE_LINUX_IO_URING_H
+
+END_NAMESPACE
+
+/** EMACS **
+ * Local variables:
+ * mode: c++
+ * c-basic-offset: 4
+ * End:
+ */